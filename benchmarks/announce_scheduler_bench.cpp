@@ -0,0 +1,95 @@
+#include "announce_scheduler.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using bt::AnnounceScheduler;
+using namespace std::chrono_literals;
+
+/**
+ * @brief a client seeding 20k torrents spread over 50 tracker hosts, two of them down,
+ *        simulated for three hours in one second ticks; trackers answer right away
+ */
+BENCHMARK("AnnounceScheduler, 20k torrents for 3 hours") {
+    constexpr int TorrentsCount = 20000;
+    constexpr int HostsCount = 50;
+    constexpr int DeadHostsCount = 2;
+    constexpr int Seconds = 3 * 3600;
+
+    std::vector<std::string> urls;
+    for (int host = 0; host < HostsCount; host++) {
+        urls.push_back("udp://tracker" + std::to_string(host) + ".example:6969/announce");
+    }
+    auto isDead = [&](std::string_view url) {
+        for (int host = 0; host < DeadHostsCount; host++) {
+            if (url == urls[host]) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    auto start = AnnounceScheduler::Clock::time_point();
+    AnnounceScheduler scheduler(start);
+    std::vector<bt::InfoHash> infoHashes(TorrentsCount);
+
+    auto addStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < TorrentsCount; i++) {
+        infoHashes[i] = bt::torrent_parser::GetSha1Hash(std::to_string(i));
+        // a tier of two hosts and a backup tier, the dead hosts show up in every tenth torrent
+        std::vector<std::vector<std::string_view>> tiers = {
+            {urls[(i * 7) % HostsCount], urls[(i * 7 + 1) % HostsCount]},
+            {urls[(i * 13 + 5) % HostsCount]}};
+        scheduler.Add(infoHashes[i], tiers, start);
+    }
+    double addSeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - addStart).count();
+    std::printf("  add: %.1f ns per torrent\n", addSeconds * 1e9 / TorrentsCount);
+
+    bt::AnnounceResponse response;
+    response.interval = 30min;
+    response.minInterval = 5min;
+
+    size_t announces = 0;
+    size_t deadAnnounces = 0;
+    size_t batches = 0;
+    size_t maxPerTick = 0;
+    int lastStartupTick = 0;
+    double pollSeconds = 0;
+    for (int second = 0; second < Seconds; second++) {
+        auto now = start + std::chrono::seconds(second);
+        auto pollStart = std::chrono::steady_clock::now();
+        std::vector<bt::AnnounceBatch> due = scheduler.Poll(now);
+        size_t tickAnnounces = 0;
+        for (const bt::AnnounceBatch& batch : due) {
+            for (const bt::ScheduledAnnounce& announce : batch.announces) {
+                if (isDead(announce.url)) {
+                    deadAnnounces++;
+                    scheduler.OnFailure(announce.infoHash, now);
+                } else {
+                    scheduler.OnSuccess(announce.infoHash, response, now);
+                }
+                if (announce.event == bt::AnnounceEvent::Started) {
+                    lastStartupTick = second;
+                }
+            }
+            tickAnnounces += batch.announces.size();
+        }
+        pollSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - pollStart)
+                           .count();
+        announces += tickAnnounces;
+        batches += due.size();
+        maxPerTick = std::max(maxPerTick, tickAnnounces);
+    }
+
+    std::printf("  first announces spread over %d s, at most %zu announces per tick\n",
+                lastStartupTick + 1, maxPerTick);
+    std::printf("  %zu announces in %zu host batches (%.2f per batch), %zu to dead hosts\n",
+                announces, batches, double(announces) / double(batches), deadAnnounces);
+    std::printf("  poll + outcomes: %.2f us per tick, %.0f ns per announce\n",
+                pollSeconds * 1e6 / Seconds, pollSeconds * 1e9 / double(announces));
+}
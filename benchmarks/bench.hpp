@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief tiny benchmark harness used by bt_bench
+ * @brief every benchmark is a function registered with BENCHMARK(name), which reports
+ *        one or more measurements through bench::Measure
+ */
+namespace bench {
+
+/**
+ * @brief heap allocations done by the process so far, counted by bench_main.cpp
+ */
+size_t AllocationCount();
+size_t AllocatedBytes();
+
+/**
+ * @brief runs fn iterations times and prints time and allocations per iteration
+ * @param label printed in front of the measurement
+ * @param iterations how many times fn is called
+ * @param fn the measured operation
+ * @return average nanoseconds per iteration
+ */
+double Measure(std::string_view label, size_t iterations, const std::function<void()>& fn);
+
+/**
+ * @brief keeps the compiler from optimizing away a computed value
+ */
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+using BenchmarkFn = void (*)();
+
+struct Registrar {
+    Registrar(const char* name, BenchmarkFn fn);
+};
+
+} // namespace bench
+
+#define BENCH_CONCAT_IMPL(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_IMPL(a, b)
+
+// defines and registers a benchmark function
+#define BENCHMARK(name)                                                   \
+    static void BENCH_CONCAT(_BenchFn, __LINE__)();                       \
+    static bench::Registrar BENCH_CONCAT(_benchRegistrar, __LINE__)(      \
+        name, BENCH_CONCAT(_BenchFn, __LINE__));                          \
+    static void BENCH_CONCAT(_BenchFn, __LINE__)()
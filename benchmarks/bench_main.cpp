@@ -0,0 +1,94 @@
+#include "bench.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// count every heap allocation so benchmarks can report allocations per operation
+static std::atomic<size_t> allocationCount = 0;
+static std::atomic<size_t> allocatedBytes = 0;
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace bench {
+
+struct Benchmark {
+    const char* name;
+    BenchmarkFn fn;
+};
+
+static std::vector<Benchmark>& _Registry() {
+    static std::vector<Benchmark> registry;
+    return registry;
+}
+
+Registrar::Registrar(const char* name, BenchmarkFn fn) {
+    _Registry().push_back({name, fn});
+}
+
+size_t AllocationCount() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+size_t AllocatedBytes() {
+    return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+double Measure(std::string_view label, size_t iterations, const std::function<void()>& fn) {
+    // warm up caches and lazily initialized state
+    fn();
+
+    size_t allocsBefore = AllocationCount();
+    size_t bytesBefore = AllocatedBytes();
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; i++) {
+        fn();
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+    double allocs = double(AllocationCount() - allocsBefore) / iterations;
+    double bytes = double(AllocatedBytes() - bytesBefore) / iterations;
+
+    std::printf("  %-48.*s %14.1f ns/op %12.1f allocs/op %14.1f B/op\n",
+                static_cast<int>(label.size()), label.data(), ns, allocs, bytes);
+    return ns;
+}
+
+} // namespace bench
+
+// usage: bt_bench [name filter]
+int main(int argc, char** argv) {
+    std::string_view filter = argc > 1 ? argv[1] : "";
+
+    // silence bt-core logging, results are printed with printf
+    std::cout.rdbuf(nullptr);
+
+    for (const bench::Benchmark& b : bench::_Registry()) {
+        if (std::string_view(b.name).find(filter) == std::string_view::npos) {
+            continue;
+        }
+        std::printf("%s\n", b.name);
+        b.fn();
+        std::printf("\n");
+    }
+    return 0;
+}
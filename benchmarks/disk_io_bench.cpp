@@ -0,0 +1,429 @@
+#include "bench.hpp"
+#include "disk_io.hpp"
+#include "synthetic_torrent.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using bt::DiskIoService;
+using bt::ReadCache;
+using bt::peer_wire::BlockSize;
+
+// size of the written torrent, BT_BENCH_DISK_GIB overrides it
+static long long _TorrentGiB() {
+    const char* value = std::getenv("BT_BENCH_DISK_GIB");
+    return value != nullptr ? std::strtoll(value, nullptr, 10) : 10;
+}
+
+// CPU seconds of the whole process, the disk threads and the kernel's io_uring workers included
+static double _ProcessCpuSeconds() {
+#ifndef _WIN32
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+ * @brief writes every block of the torrent once in random order, like a download from many
+ *        peers, keeping inFlight writes queued, then flushes
+ * @return seconds until the flush completed
+ */
+static double _WriteTorrent(const bt::StorageLayout& layout, bt::DiskIoOptions options,
+                            size_t inFlight) {
+    const bt::TorrentMetadata& torrent = layout.torrent();
+    const uint32_t blocksPerPiece = static_cast<uint32_t>(torrent.pieceLength() / BlockSize);
+    std::vector<uint32_t> blocks(static_cast<size_t>(torrent.totalSize() / BlockSize));
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        blocks[i] = i;
+    }
+    std::shuffle(blocks.begin(), blocks.end(), std::mt19937(11));
+    const std::vector<std::byte> data(BlockSize, std::byte(0xa5));
+
+    asio::io_context ioContext;
+    auto start = std::chrono::steady_clock::now();
+    DiskIoService disk(options);
+    DiskIoService::StorageId storage = disk.AddStorage(layout);
+    size_t next = 0;
+    std::function<void(const std::error_code&)> onWritten = [&](const std::error_code& error) {
+        if (error) {
+            std::printf("  write failed: %s\n", error.message().c_str());
+            ioContext.stop();
+            return;
+        }
+        if (next < blocks.size()) {
+            uint32_t block = blocks[next++];
+            disk.AsyncWrite(storage, block / blocksPerPiece, block % blocksPerPiece * BlockSize,
+                            data, ioContext.get_executor(), onWritten);
+        }
+    };
+    for (size_t i = 0; i < inFlight; i++) {
+        onWritten({});
+    }
+    ioContext.run();
+    ioContext.restart();
+    disk.AsyncFlush(storage, ioContext.get_executor(), [](const std::error_code&) {});
+    ioContext.run();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief 16 KiB blocks of a large torrent arriving in random order, written through the disk
+ *        threads; with sorted jobs every thread takes the queued block closest after the last
+ *        one written, in FIFO order they hit the files at random
+ */
+BENCHMARK("DiskIoService, random order download") {
+    const long long gib = _TorrentGiB();
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bt_disk_io_bench";
+    bt::TorrentMetadata torrent =
+        bt::torrent_parser::Parse(bench::MakeMultiFileTorrent(gib, 1LL << 30, 1 << 20));
+    bt::StorageLayout layout(torrent, directory);
+    std::printf("  %lld GiB in %zu files, %lld blocks\n", gib, torrent.files().size(),
+                torrent.totalSize() / BlockSize);
+
+    const std::pair<const char*, bool> modes[] = {{"FIFO", false}, {"sorted by offset", true}};
+    for (size_t threadsCount : {1, 4}) {
+        for (auto [label, sort] : modes) {
+            std::filesystem::remove_all(directory);
+            double seconds =
+                _WriteTorrent(layout, {.threadsCount = threadsCount, .sortJobs = sort}, 1024);
+            std::printf("  %zu threads, %-18s %8.1f s %10.0f MiB/s\n", threadsCount, label,
+                        seconds, torrent.totalSize() / 1048576.0 / seconds);
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+/**
+ * @brief downloads the torrent the way peers serve it: the blocks of windowPieces pieces at a
+ *        time arrive in random order, and every piece is hashed once its last block is written
+ * @param validCount set to the count of pieces that verified
+ * @return seconds until every piece was verified and the data flushed
+ */
+static double _DownloadTorrent(const bt::StorageLayout& layout, bt::DiskIoOptions options,
+                               size_t windowPieces, size_t& validCount) {
+    const bt::TorrentMetadata& torrent = layout.torrent();
+    const uint32_t blocksPerPiece = static_cast<uint32_t>(torrent.pieceLength() / BlockSize);
+    std::vector<uint32_t> blocks(static_cast<size_t>(torrent.totalSize() / BlockSize));
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        blocks[i] = i;
+    }
+    std::mt19937 random(13);
+    for (size_t window = 0; window < blocks.size(); window += windowPieces * blocksPerPiece) {
+        auto end = blocks.begin() + std::min(blocks.size(), window + windowPieces * blocksPerPiece);
+        std::shuffle(blocks.begin() + window, end, random);
+    }
+    const std::vector<std::byte> data(BlockSize, std::byte(0xa5));
+
+    asio::io_context ioContext;
+    auto start = std::chrono::steady_clock::now();
+    DiskIoService disk(options);
+    DiskIoService::StorageId storage = disk.AddStorage(layout);
+    std::vector<uint32_t> writtenBlocks(static_cast<size_t>(torrent.piecesCount()));
+    validCount = 0;
+    size_t next = 0;
+    std::function<void(const std::error_code&, uint32_t)> onWritten =
+        [&](const std::error_code& error, uint32_t piece) {
+            if (error) {
+                std::printf("  write failed: %s\n", error.message().c_str());
+                ioContext.stop();
+                return;
+            }
+            if (piece != UINT32_MAX && ++writtenBlocks[piece] == blocksPerPiece) {
+                disk.AsyncHash(storage, piece, ioContext.get_executor(),
+                               [&](const std::error_code&, bool valid) { validCount += valid; });
+            }
+            if (next < blocks.size()) {
+                uint32_t block = blocks[next++];
+                uint32_t index = block / blocksPerPiece;
+                disk.AsyncWrite(storage, index, block % blocksPerPiece * BlockSize, data,
+                                ioContext.get_executor(),
+                                [&, index](const std::error_code& e) { onWritten(e, index); });
+            }
+        };
+    for (size_t i = 0; i < 1024; i++) {
+        onWritten({}, UINT32_MAX);
+    }
+    ioContext.run();
+    ioContext.restart();
+    disk.AsyncFlush(storage, ioContext.get_executor(), [](const std::error_code&) {});
+    ioContext.run();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief pieces downloaded a few dozen at a time and verified as they complete: without a
+ *        cache every block is written on its own and every piece read back to be hashed,
+ *        with one the pieces are hashed in memory and written with one vectored write each
+ */
+BENCHMARK("DiskIoService, download with and without the write cache") {
+    const long long gib = _TorrentGiB();
+    constexpr size_t WindowPieces = 32;
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bt_disk_io_bench";
+    bt::TorrentMetadata torrent = bt::torrent_parser::Parse(
+        bench::MakeFilledTorrent(gib, 1LL << 30, 1 << 20, static_cast<char>(0xa5)));
+    bt::StorageLayout layout(torrent, directory);
+    std::printf("  %lld GiB, %lld pieces, %zu pieces at a time\n", gib, torrent.piecesCount(),
+                WindowPieces);
+
+    const std::pair<const char*, size_t> caches[] = {{"no cache", 0},
+                                                     {"64 MiB write cache", 64 << 20}};
+    for (auto [label, cacheSize] : caches) {
+        std::filesystem::remove_all(directory);
+        size_t validCount = 0;
+        double cpuStart = _ProcessCpuSeconds();
+        double seconds = _DownloadTorrent(layout, {.writeCacheSize = cacheSize}, WindowPieces,
+                                          validCount);
+        double cpuSeconds = _ProcessCpuSeconds() - cpuStart;
+        std::printf("  %-20s %8.1f s %8.0f MiB/s %8.1f s CPU, %zu pieces valid\n", label,
+                    seconds, torrent.totalSize() / 1048576.0 / seconds, cpuSeconds, validCount);
+    }
+    std::filesystem::remove_all(directory);
+}
+
+struct IopsResult {
+    double iops;
+    double cpuMicrosecondsPerOperation;
+};
+
+/**
+ * @brief random block reads or writes, keeping queueDepth of them in flight
+ */
+static IopsResult _RandomBlocks(DiskIoService& disk, DiskIoService::StorageId storage,
+                                const bt::TorrentMetadata& torrent, bool write,
+                                size_t operationsCount, size_t queueDepth) {
+    const uint32_t blocksPerPiece = static_cast<uint32_t>(torrent.pieceLength() / BlockSize);
+    const uint32_t blocksCount = static_cast<uint32_t>(torrent.totalSize() / BlockSize);
+    std::mt19937 random(3);
+    const std::vector<std::byte> data(BlockSize, std::byte(0x3c));
+    asio::io_context ioContext;
+    size_t started = 0;
+    std::function<void()> next = [&] {
+        if (started == operationsCount) {
+            return;
+        }
+        started++;
+        uint32_t block = random() % blocksCount;
+        uint32_t piece = block / blocksPerPiece;
+        uint32_t begin = block % blocksPerPiece * BlockSize;
+        if (write) {
+            disk.AsyncWrite(storage, piece, begin, data, ioContext.get_executor(),
+                            [&](const std::error_code&) { next(); });
+        } else {
+            disk.AsyncRead(storage, {piece, begin, BlockSize}, ioContext.get_executor(),
+                           [&](const std::error_code&, std::vector<std::byte>) { next(); });
+        }
+    };
+
+    double cpuStart = _ProcessCpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queueDepth; i++) {
+        next();
+    }
+    ioContext.run();
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpuSeconds = _ProcessCpuSeconds() - cpuStart;
+    return {operationsCount / seconds, cpuSeconds * 1e6 / operationsCount};
+}
+
+/**
+ * @brief 16 KiB random reads and writes of a file on tmpfs, so the device does not hide the
+ *        cost of the syscalls and thread handoffs of each backend
+ */
+BENCHMARK("DiskIoService backends, random 16 KiB blocks on tmpfs") {
+    constexpr size_t OperationsCount = 200'000;
+    constexpr size_t QueueDepth = 64;
+    std::filesystem::path directory = std::filesystem::exists("/dev/shm")
+                                          ? std::filesystem::path("/dev/shm/bt_disk_io_bench")
+                                          : std::filesystem::temp_directory_path() /
+                                                "bt_disk_io_bench";
+    std::filesystem::remove_all(directory);
+    bt::TorrentMetadata torrent =
+        bt::torrent_parser::Parse(bench::MakeMultiFileTorrent(4, 64LL << 20, 1 << 20));
+    bt::StorageLayout layout(torrent, directory);
+    std::printf("  %lld MiB in %s, %zu operations at queue depth %zu\n",
+                torrent.totalSize() >> 20, directory.string().c_str(), OperationsCount,
+                QueueDepth);
+
+    const std::pair<const char*, bt::DiskIoBackend> backends[] = {
+        {"thread pool", bt::DiskIoBackend::ThreadPool},
+        {"io_uring", bt::DiskIoBackend::IoUring},
+    };
+    for (auto [label, backend] : backends) {
+        DiskIoService disk({.backend = backend});
+        if (disk.backend() != backend) {
+            std::printf("  %s is not available\n", label);
+            continue;
+        }
+        DiskIoService::StorageId storage = disk.AddStorage(layout);
+        asio::io_context ioContext;
+        disk.AsyncAllocate(storage, {.mode = bt::AllocationMode::Full}, ioContext.get_executor(),
+                           [](const std::error_code&) {});
+        ioContext.run();
+
+        for (bool write : {true, false}) {
+            size_t submitsBefore = disk.ring() != nullptr ? disk.ring()->submitCount() : 0;
+            IopsResult result =
+                _RandomBlocks(disk, storage, torrent, write, OperationsCount, QueueDepth);
+            std::printf("  %-12s %-6s %8.0f IOPS %6.2f us CPU per operation", label,
+                        write ? "write" : "read", result.iops, result.cpuMicrosecondsPerOperation);
+            if (disk.ring() != nullptr) {
+                std::printf(", %.1f operations per io_uring_enter",
+                            double(OperationsCount) /
+                                (disk.ring()->submitCount() - submitsBefore));
+            }
+            std::printf("\n");
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+/**
+ * @brief draws piece indices with probability proportional to 1 / rank^exponent, the ranks
+ *        are shuffled over the torrent
+ */
+class ZipfPieces {
+  public:
+    ZipfPieces(uint32_t piecesCount, double exponent, std::mt19937& random)
+        : _random(random), _pieces(piecesCount), _weights(piecesCount) {
+        double total = 0;
+        for (uint32_t rank = 0; rank < piecesCount; rank++) {
+            _pieces[rank] = rank;
+            total += 1 / std::pow(rank + 1, exponent);
+            _weights[rank] = total;
+        }
+        std::shuffle(_pieces.begin(), _pieces.end(), random);
+    }
+
+    uint32_t operator()() {
+        double value = std::uniform_real_distribution<double>(0, _weights.back())(_random);
+        size_t rank = std::lower_bound(_weights.begin(), _weights.end(), value) - _weights.begin();
+        return _pieces[std::min(rank, _pieces.size() - 1)];
+    }
+
+  private:
+    std::mt19937& _random;
+    std::vector<uint32_t> _pieces;
+    std::vector<double> _weights; // cumulative, by rank
+};
+
+/**
+ * @brief seeding a popular torrent: peers ask for pieces by a Zipf distribution and each reads
+ *        its piece block by block, with 64 reads in flight; in the scan runs every other piece
+ *        comes from one peer downloading the whole torrent in order
+ */
+BENCHMARK("DiskIoService read cache, Zipf-distributed piece requests") {
+    constexpr long long PieceLength = 1 << 20;
+    constexpr size_t PieceReadsCount = 3000;
+    constexpr size_t QueueDepth = 64;
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bt_disk_io_bench";
+    std::filesystem::remove_all(directory);
+    bt::TorrentMetadata torrent =
+        bt::torrent_parser::Parse(bench::MakeMultiFileTorrent(1, 1LL << 30, PieceLength));
+    bt::StorageLayout layout(torrent, directory);
+    {
+        DiskIoService disk;
+        asio::io_context ioContext;
+        disk.AsyncAllocate(disk.AddStorage(layout), {.mode = bt::AllocationMode::Full},
+                           ioContext.get_executor(), [](const std::error_code&) {});
+        ioContext.run();
+    }
+    const uint32_t piecesCount = static_cast<uint32_t>(torrent.piecesCount());
+    const uint32_t blocksPerPiece = static_cast<uint32_t>(PieceLength / BlockSize);
+    std::printf("  %u pieces of 1 MiB, %zu pieces read, Zipf exponent 1\n", piecesCount,
+                PieceReadsCount);
+
+    for (bool scan : {false, true}) {
+        std::mt19937 random(17);
+        ZipfPieces zipf(piecesCount, 1.0, random);
+        std::vector<bt::peer_wire::BlockInfo> reads;
+        uint32_t scanned = 0;
+        for (size_t i = 0; i < PieceReadsCount; i++) {
+            uint32_t piece = scan && i % 2 == 1 ? scanned++ % piecesCount : zipf();
+            for (uint32_t block = 0; block < blocksPerPiece; block++) {
+                reads.push_back({piece, block * BlockSize, BlockSize});
+            }
+        }
+
+        for (size_t cacheMiB : {0, 64, 256}) {
+            DiskIoService disk({.readCacheSize = cacheMiB << 20});
+            DiskIoService::StorageId storage = disk.AddStorage(layout);
+            asio::io_context ioContext;
+            size_t next = 0;
+            std::function<void()> read = [&] {
+                if (next < reads.size()) {
+                    disk.AsyncRead(storage, reads[next++], ioContext.get_executor(),
+                                   [&](const std::error_code&, std::vector<std::byte>) { read(); });
+                }
+            };
+            double cpuStart = _ProcessCpuSeconds();
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < QueueDepth; i++) {
+                read();
+            }
+            ioContext.run();
+            double seconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double cpuSeconds = _ProcessCpuSeconds() - cpuStart;
+            ReadCache::Stats stats = disk.readCacheStats();
+            double hitRate = stats.hits * 100.0 / std::max<size_t>(stats.hits + stats.misses, 1);
+            std::printf("  %-7s %4zu MiB cache %8.0f MiB/s %6.2f us CPU per block, %5.1f%% hits"
+                        " (%zu of them read ahead)\n",
+                        scan ? "scan," : "", cacheMiB,
+                        reads.size() * BlockSize / 1048576.0 / seconds,
+                        cpuSeconds * 1e6 / reads.size(), hitRate, stats.readAheadHits);
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+/**
+ * @brief setting up the files of a torrent of many small files before its download, sparse
+ *        and with the disk space reserved, by one thread and by the default four
+ */
+BENCHMARK("DiskIoService, allocating 100k files") {
+    constexpr size_t FilesCount = 100'000;
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bt_disk_io_bench";
+    bt::TorrentMetadata torrent = bt::torrent_parser::Parse(
+        bench::MakeMultiFileTorrent(FilesCount, 64 << 10, 1 << 20));
+    bt::StorageLayout layout(torrent, directory);
+    std::printf("  %zu files of 64 KiB in %s\n", FilesCount, directory.string().c_str());
+
+    const std::pair<const char*, bt::AllocationMode> modes[] = {
+        {"sparse", bt::AllocationMode::Sparse},
+        {"full", bt::AllocationMode::Full},
+    };
+    for (auto [label, mode] : modes) {
+        for (size_t threadsCount : {4, 1}) {
+            std::filesystem::remove_all(directory);
+            DiskIoService disk({.threadsCount = threadsCount});
+            asio::io_context ioContext;
+            std::error_code result;
+            double cpuStart = _ProcessCpuSeconds();
+            auto start = std::chrono::steady_clock::now();
+            disk.AsyncAllocate(disk.AddStorage(layout), {.mode = mode}, ioContext.get_executor(),
+                               [&](const std::error_code& error) { result = error; });
+            ioContext.run();
+            double seconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double cpuSeconds = _ProcessCpuSeconds() - cpuStart;
+            std::printf("  %-6s %zu threads %8.2f s %8.0f files/s %6.2f s CPU%s\n", label,
+                        threadsCount, seconds, FilesCount / seconds, cpuSeconds,
+                        result ? " failed" : "");
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
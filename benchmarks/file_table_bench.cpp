@@ -0,0 +1,117 @@
+#include "bench.hpp"
+#include "file_table.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+static constexpr size_t filesCount = 100'000;
+
+/**
+ * @brief the layout FileTable replaced: a vector of path nodes per file
+ */
+struct NestedFile {
+    std::vector<std::string> relativePath;
+    long long size;
+};
+
+BENCHMARK("FileTable, 100k files") {
+    // path nodes as the parser sees them, views into the metainfo
+    std::vector<std::string> names;
+    std::vector<std::string> dirs;
+    for (size_t i = 0; i < filesCount; i++) {
+        names.push_back("part-" + std::to_string(i) + ".bin");
+    }
+    for (size_t i = 0; i < filesCount / 1000; i++) {
+        dirs.push_back("shard-" + std::to_string(i));
+    }
+    auto pathOf = [&](size_t i) {
+        return std::vector<std::string_view>{"dataset", dirs[i / 1000], names[i]};
+    };
+
+    size_t nestedBytes = 0;
+    bench::Measure("build vector<vector<string>>", 5, [&] {
+        size_t before = bench::AllocatedBytes();
+        std::vector<NestedFile> files;
+        for (size_t i = 0; i < filesCount; i++) {
+            std::vector<std::string_view> path = pathOf(i);
+            files.push_back({std::vector<std::string>(path.begin(), path.end()), 4096});
+        }
+        nestedBytes = bench::AllocatedBytes() - before - filesCount * 3 * sizeof(std::string_view);
+        bench::DoNotOptimize(files);
+    });
+
+    bt::FileTable table;
+    bench::Measure("build FileTable", 5, [&] {
+        bt::FileTable::Builder builder;
+        builder.Reserve(filesCount);
+        std::string_view path[3];
+        for (size_t i = 0; i < filesCount; i++) {
+            path[0] = "dataset";
+            path[1] = dirs[i / 1000];
+            path[2] = names[i];
+            builder.AddFile(path, 4096);
+        }
+        table = builder.Build();
+    });
+
+    std::printf("  memory per file: nested %.1f B (allocated), FileTable %.1f B\n",
+                double(nestedBytes) / filesCount, double(table.memoryUsage()) / filesCount);
+
+    bench::Measure("join every path", 5, [&] {
+        size_t length = 0;
+        std::string pathBuffer;
+        for (size_t i = 0; i < table.size(); i++) {
+            pathBuffer.clear();
+            table.path(i).AppendTo(pathBuffer);
+            length += pathBuffer.size();
+        }
+        bench::DoNotOptimize(length);
+    });
+}
+
+BENCHMARK("FileTable::MapRange") {
+    constexpr long long pieceLength = 256 * 1024;
+    constexpr size_t lookups = 100'000;
+
+    struct Layout {
+        const char* label;
+        size_t files;
+        long long averageSize;
+    };
+    Layout layouts[] = {{"1 file", 1, 10LL << 30},
+                        {"10k files", 10'000, 1 << 20},
+                        {"1M files", 1'000'000, 16 * 1024}};
+
+    std::mt19937_64 rng(7);
+    for (const Layout& layout : layouts) {
+        bt::FileTable::Builder builder;
+        builder.Reserve(layout.files);
+        std::string name = "file";
+        std::string_view path = name;
+        for (size_t i = 0; i < layout.files; i++) {
+            // sizes between half and one and a half of the average
+            long long size = layout.averageSize / 2 + rng() % layout.averageSize;
+            builder.AddFile({&path, 1}, size);
+        }
+        bt::FileTable table = builder.Build();
+
+        long long piecesCount = (table.totalSize() + pieceLength - 1) / pieceLength;
+        std::vector<long long> pieces(lookups);
+        for (long long& piece : pieces) {
+            piece = rng() % piecesCount;
+        }
+
+        std::string label = std::string(layout.label) + ", " + std::to_string(lookups) +
+                            " random pieces";
+        bench::Measure(label, 10, [&] {
+            long long covered = 0;
+            for (long long piece : pieces) {
+                for (bt::FileSlice slice : table.MapRange(piece * pieceLength, pieceLength)) {
+                    covered += slice.length;
+                }
+            }
+            bench::DoNotOptimize(covered);
+        });
+    }
+}
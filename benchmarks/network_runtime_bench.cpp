@@ -0,0 +1,205 @@
+#include "bench.hpp"
+#include "network_runtime.hpp"
+#include "peer_connection.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using bt::PeerConnection;
+
+// simulated peers, BT_BENCH_PEERS overrides it
+static size_t _PeersCount() {
+    const char* value = std::getenv("BT_BENCH_PEERS");
+    return value != nullptr ? std::strtoull(value, nullptr, 10) : 5000;
+}
+
+// every peer is two sockets in this process
+static void _RaiseFileLimit() {
+#ifndef _WIN32
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+static bool _WaitFor(const std::atomic<size_t>& counter, size_t target) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    while (counter.load() < target) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            std::printf("  timed out at %zu of %zu\n", counter.load(), target);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    return true;
+}
+
+// bench::Measure runs fn once to warm up, the phases below only make sense once
+static double _Seconds(const std::function<void()>& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief a seeder and many leechers in one process, every connection lives on one shard and
+ *        only that shard's thread touches it; the seeder announces pieces to all leechers
+ *        through NetworkRuntime::Broadcast, like a client sending HAVE after a piece completes
+ */
+BENCHMARK("NetworkRuntime, loopback peers") {
+    constexpr uint32_t piecesCount = 64;
+    constexpr uint32_t blocksPerPeer = 2;
+    constexpr size_t connectWave = 1000; // stays below the listen backlog
+    const size_t peersCount = _PeersCount();
+    _RaiseFileLimit();
+
+    PeerConnection::Options options;
+    options.infoHash = bt::Sha1Digest::FromHex("a9993e364706816aba3e25717850c26c9cd0d89d").value();
+    options.piecesCount = piecesCount;
+    const std::vector<std::byte> block(bt::peer_wire::BlockSize, std::byte(0x5a));
+
+    size_t maxShards = bt::ThreadPool::ResolveThreadsCount(0);
+    std::printf("  %zu peers, %zu hardware threads\n", peersCount, maxShards);
+    for (size_t shardsCount = 1; shardsCount <= std::max<size_t>(maxShards, 2); shardsCount *= 2) {
+        std::atomic<size_t> unchoked = 0;
+        std::atomic<size_t> blocksReceived = 0;
+        std::atomic<size_t> havesReceived = 0;
+        std::atomic<size_t> closed = 0;
+        // connections of each shard, only touched by that shard
+        std::vector<std::vector<std::shared_ptr<PeerConnection>>> seeders(shardsCount);
+        std::vector<std::vector<std::shared_ptr<PeerConnection>>> leechers(shardsCount);
+
+        PeerConnection::Callbacks seederCallbacks;
+        seederCallbacks.onConnected = [](PeerConnection& peer) {
+            bt::Bitfield all(piecesCount);
+            for (uint32_t i = 0; i < piecesCount / 2; i++) {
+                all.Set(i);
+            }
+            peer.SendBitfield(all);
+        };
+        seederCallbacks.onStateChanged = [](PeerConnection& peer) {
+            if (peer.peerInterested()) {
+                peer.Unchoke();
+            }
+        };
+        seederCallbacks.onRequest = [&block](PeerConnection& peer,
+                                             const bt::peer_wire::BlockInfo& info) {
+            peer.SendPiece(info.pieceIndex, info.begin, std::span(block).first(info.length));
+        };
+        seederCallbacks.onClosed = [&](PeerConnection&, const std::error_code&) { closed++; };
+
+        PeerConnection::Callbacks leecherCallbacks;
+        leecherCallbacks.onStateChanged = [&](PeerConnection& peer) {
+            if (!peer.peerChoking()) {
+                unchoked++;
+            }
+        };
+        leecherCallbacks.onBitfield = [](PeerConnection& peer) { peer.SetInterested(true); };
+        leecherCallbacks.onHave = [&](PeerConnection&, uint32_t) { havesReceived++; };
+        leecherCallbacks.onPiece = [&](PeerConnection&, const bt::peer_wire::BlockInfo&,
+                                       std::span<const std::byte>) { blocksReceived++; };
+        leecherCallbacks.onClosed = [&](PeerConnection&, const std::error_code&) { closed++; };
+
+        bt::NetworkRuntime runtime(shardsCount);
+        asio::ip::tcp::acceptor acceptor(runtime.context(0),
+                                         {asio::ip::address_v4::loopback(), 0});
+        asio::ip::tcp::endpoint endpoint = acceptor.local_endpoint();
+
+        // accepted sockets are created on the io_context of the shard that will own them
+        std::function<void()> accept = [&, accepted = size_t(0)]() mutable {
+            if (accepted++ == peersCount) {
+                return;
+            }
+            size_t shard = runtime.NextShard();
+            acceptor.async_accept(runtime.context(shard), [&, shard](const std::error_code& error,
+                                                                     asio::ip::tcp::socket socket) {
+                if (error) {
+                    if (error != asio::error::operation_aborted) {
+                        std::printf("  accept failed: %s\n", error.message().c_str());
+                    }
+                    return;
+                }
+                auto owned = std::make_shared<asio::ip::tcp::socket>(std::move(socket));
+                runtime.Post(shard, [&, shard, owned] {
+                    seeders[shard].push_back(
+                        PeerConnection::Accept(std::move(*owned), options, seederCallbacks));
+                });
+                accept();
+            });
+        };
+        runtime.Post(0, [&] { accept(); });
+
+        std::string suffix = ", " + std::to_string(shardsCount) + " shards";
+        bool completed = true;
+        double seconds = _Seconds([&] {
+            for (size_t begin = 0; completed && begin < peersCount; begin += connectWave) {
+                size_t end = std::min(peersCount, begin + connectWave);
+                for (size_t i = begin; i < end; i++) {
+                    size_t shard = i % shardsCount;
+                    runtime.Post(shard, [&, shard] {
+                        leechers[shard].push_back(PeerConnection::Connect(
+                            runtime.context(shard), endpoint, options, leecherCallbacks));
+                    });
+                }
+                completed = _WaitFor(unchoked, end);
+            }
+        });
+        std::printf("  %-48s %10.0f ms %10.0f peers/s\n",
+                    ("connect, handshake and unchoke" + suffix).c_str(), seconds * 1e3,
+                    unchoked / seconds);
+
+        auto requestBlocks = [&](size_t shard) {
+            for (auto& peer : leechers[shard]) {
+                for (uint32_t i = 0; i < blocksPerPeer; i++) {
+                    peer->Request({i, 0, bt::peer_wire::BlockSize});
+                }
+            }
+        };
+        std::string label = "request " + std::to_string(blocksPerPeer) + " blocks per peer";
+        seconds = _Seconds([&] {
+            runtime.Broadcast(requestBlocks);
+            completed = completed && _WaitFor(blocksReceived, peersCount * blocksPerPeer);
+        });
+        std::printf("  %-48s %10.0f ms %10.0f MiB/s\n", (label + suffix).c_str(), seconds * 1e3,
+                    blocksReceived * double(bt::peer_wire::BlockSize) / 1048576.0 / seconds);
+
+        constexpr uint32_t havesCount = piecesCount / 2;
+        label = "broadcast " + std::to_string(havesCount) + " HAVE to every peer";
+        seconds = _Seconds([&] {
+            for (uint32_t piece = piecesCount / 2; piece < piecesCount; piece++) {
+                runtime.Broadcast([&, piece](size_t shard) {
+                    for (auto& peer : seeders[shard]) {
+                        peer->SendHave(piece);
+                    }
+                });
+            }
+            completed = completed && _WaitFor(havesReceived, peersCount * havesCount);
+        });
+        std::printf("  %-48s %10.0f ms %10.2f M HAVE/s\n", (label + suffix).c_str(),
+                    seconds * 1e3, havesReceived / seconds / 1e6);
+
+        runtime.Broadcast([&](size_t shard) {
+            for (auto& peer : leechers[shard]) {
+                peer->Close();
+            }
+            leechers[shard].clear();
+        });
+        if (completed) {
+            _WaitFor(closed, 2 * peersCount);
+        }
+        runtime.Broadcast([&](size_t shard) { seeders[shard].clear(); });
+        runtime.Post(0, [&] { acceptor.close(); });
+        runtime.Stop();
+    }
+}
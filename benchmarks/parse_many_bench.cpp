@@ -0,0 +1,31 @@
+#include "bench.hpp"
+#include "torrent_metadata.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+
+BENCHMARK("torrent_parser::ParseMany") {
+    // the test torrents over and over, served from the page cache
+    std::vector<std::string> paths;
+    for (int i = 0; i < 1000; i++) {
+        paths.push_back(TORRENT_FILES_PATH "linuxmint-22-xfce-64bit.iso.torrent");
+        paths.push_back(TORRENT_FILES_PATH "india-pocket-map_archive.torrent");
+    }
+
+    size_t maxThreads = bt::ThreadPool::ResolveThreadsCount(0);
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        std::string label = std::to_string(paths.size()) + " files, " + std::to_string(threads) +
+                            " threads";
+        double ns = bench::Measure(label, 3, [&] {
+            size_t loaded = bt::torrent_parser::ParseMany(
+                paths, [](bt::torrent_parser::ParseResult&&) {}, threads);
+            bench::DoNotOptimize(loaded);
+        });
+        std::printf("  %48s %14.0f files/s\n", "", paths.size() / (ns / 1e9));
+
+        // also measure the hardware thread count when it is not a power of two
+        if (threads < maxThreads && threads * 2 > maxThreads) {
+            threads = maxThreads / 2;
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#include "bench.hpp"
+#include "piece_picker.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using bt::Bitfield;
+using bt::PiecePicker;
+
+static double _Seconds(const std::function<void()>& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief 1M pieces and 500 connected peers holding random halves of the torrent, then the
+ *        swarm keeps sending HAVE, peers come and go, and blocks are picked and completed
+ */
+BENCHMARK("PiecePicker, HAVE churn with 500 peers") {
+    constexpr size_t PiecesCount = 1 << 20;
+    constexpr size_t PeersCount = 500;
+    constexpr uint32_t PieceLength = 16 * 1024; // one block each
+    PiecePicker picker(PiecesCount, PieceLength, static_cast<long long>(PiecesCount) * PieceLength);
+
+    std::mt19937_64 random(1);
+    std::vector<Bitfield> peers(PeersCount, Bitfield(PiecesCount));
+    for (Bitfield& peer : peers) {
+        for (size_t i = 0; i < PiecesCount; i++) {
+            if (random() % 2 == 0) {
+                peer.Set(i);
+            }
+        }
+    }
+
+    double seconds = _Seconds([&] {
+        for (const Bitfield& peer : peers) {
+            picker.IncrementAvailability(peer);
+        }
+    });
+    std::printf("  bitfields of %zu peers: %.1f ms, %.2f ns per piece\n", PeersCount,
+                seconds * 1e3, seconds * 1e9 / (double(PeersCount) * PiecesCount * 0.5));
+
+    // a peer completes a piece it did not have
+    std::vector<uint32_t> haves(1 << 20);
+    for (uint32_t& piece : haves) {
+        piece = static_cast<uint32_t>(random() % PiecesCount);
+    }
+    double ns = bench::Measure("HAVE, increment and decrement", 5, [&] {
+        for (uint32_t piece : haves) {
+            picker.IncrementAvailability(piece);
+        }
+        for (uint32_t piece : haves) {
+            picker.DecrementAvailability(piece);
+        }
+    });
+    std::printf("  %.2f ns per HAVE\n", ns / double(2 * haves.size()));
+
+    ns = bench::Measure("peer leaves, another one joins", 20, [&] {
+        size_t leaving = random() % PeersCount;
+        picker.DecrementAvailability(peers[leaving]);
+        picker.IncrementAvailability(peers[leaving]);
+    });
+    std::printf("  %.2f ns per piece\n", ns / (PiecesCount * 0.5 * 2));
+
+    // downloads the torrent a tenth of the way, 16 blocks per request round
+    size_t picked = 0;
+    seconds = _Seconds([&] {
+        while (picker.haveCount() < PiecesCount / 10) {
+            const Bitfield& peer = peers[random() % PeersCount];
+            for (const bt::peer_wire::BlockInfo& block : picker.Pick(peer, 16)) {
+                picked++;
+                if (picker.OnBlockReceived(block)) {
+                    picker.OnPieceVerified(block.pieceIndex);
+                }
+            }
+        }
+    });
+    std::printf("  Pick and complete: %.1f ns per block over %zu blocks\n",
+                seconds * 1e9 / double(picked), picked);
+}
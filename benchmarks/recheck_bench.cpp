@@ -0,0 +1,113 @@
+#include "bench.hpp"
+#include "recheck.hpp"
+#include "thread_pool.hpp"
+
+#include "external/bencode.hpp"
+#include "external/sha1.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+// size of the payload in MiB, BT_BENCH_RECHECK_MIB overrides it
+static size_t _PayloadMiB() {
+    const char* value = std::getenv("BT_BENCH_RECHECK_MIB");
+    return value != nullptr ? std::strtoull(value, nullptr, 10) : 256;
+}
+
+BENCHMARK("Recheck") {
+    const long long pieceLength = 256 * 1024;
+    const long long fileSize = 64 * 1024 * 1024 + 12345; // pieces span file boundaries
+    const long long totalSize = static_cast<long long>(_PayloadMiB()) * 1024 * 1024;
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bt_recheck_bench";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory / "payload");
+
+    // write the payload and hash it piece by piece as a torrent creator would
+    bencode::list files;
+    std::string pieces;
+    {
+        std::string piece;
+        std::string chunk(1024 * 1024, '\0');
+        unsigned state = 1;
+        for (long long written = 0, index = 0; written < totalSize; index++) {
+            long long size = std::min(fileSize, totalSize - written);
+            std::string name = "file-" + std::to_string(index);
+            std::ofstream file(directory / "payload" / name, std::ios::binary);
+            for (long long fileWritten = 0; fileWritten < size;) {
+                size_t count =
+                    static_cast<size_t>(std::min<long long>(chunk.size(), size - fileWritten));
+                for (size_t i = 0; i < count; i++) {
+                    state = state * 1664525u + 1013904223u;
+                    chunk[i] = static_cast<char>(state >> 24);
+                }
+                file.write(chunk.data(), count);
+                for (size_t i = 0; i < count;) {
+                    size_t take = std::min<size_t>(count - i, pieceLength - piece.size());
+                    piece.append(chunk, i, take);
+                    i += take;
+                    if (piece.size() == size_t(pieceLength)) {
+                        bt::Sha1Digest digest = bt::torrent_parser::GetSha1Hash(piece);
+                        pieces.append(reinterpret_cast<const char*>(digest.bytes.data()), 20);
+                        piece.clear();
+                    }
+                }
+                fileWritten += count;
+            }
+            files.push_back(bencode::dict{{"length", size}, {"path", bencode::list{name}}});
+            written += size;
+        }
+        if (!piece.empty()) {
+            bt::Sha1Digest digest = bt::torrent_parser::GetSha1Hash(piece);
+            pieces.append(reinterpret_cast<const char*>(digest.bytes.data()), 20);
+        }
+    }
+    bencode::dict info = {{"files", std::move(files)},
+                          {"name", "payload"},
+                          {"piece length", pieceLength},
+                          {"pieces", std::move(pieces)}};
+    bt::TorrentMetadata torrent =
+        bt::torrent_parser::Parse(bencode::encode(bencode::dict{{"info", std::move(info)}}));
+    bt::StorageLayout layout(torrent, directory);
+
+    // the payload was just written, so it is served from the page cache and this measures
+    // how fast the pipeline can go, a real disk is the limit below these numbers
+    std::printf("  payload %lld MiB in %zu files, page cache\n", totalSize >> 20,
+                torrent.files().size());
+
+    double ns = bench::Measure("baseline: read and hash piece by piece, 1 thread", 1, [&] {
+        std::string piece(pieceLength, '\0');
+        size_t valid = 0;
+        for (size_t i = 0; i < size_t(torrent.piecesCount()); i++) {
+            size_t position = 0;
+            for (bt::FileSlice slice : torrent.MapPiece(i)) {
+                std::ifstream file(layout.filePath(slice.fileIndex), std::ios::binary);
+                file.seekg(slice.offset);
+                file.read(piece.data() + position, slice.length);
+                position += slice.length;
+            }
+            SHA1 sha1;
+            sha1.add(piece.data(), position);
+            bt::Sha1Digest digest;
+            sha1.getHash(reinterpret_cast<unsigned char*>(digest.bytes.data()));
+            valid += digest == bt::Sha1Digest::FromBytes(torrent.pieceHash(i).data());
+        }
+        bench::DoNotOptimize(valid);
+    });
+    std::printf("  %48s %10.0f MiB/s\n", "", totalSize / 1048576.0 / (ns / 1e9));
+
+    size_t maxThreads = bt::ThreadPool::ResolveThreadsCount(0);
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        bt::RecheckOptions options;
+        options.threadsCount = threads;
+        size_t validPieces = 0;
+        ns = bench::Measure("Recheck, " + std::to_string(threads) + " threads", 1, [&] {
+            validPieces = bt::Recheck(layout, options).count();
+        });
+        std::printf("  %48s %10.0f MiB/s, %zu of %lld pieces valid\n", "",
+                    totalSize / 1048576.0 / (ns / 1e9), validPieces, torrent.piecesCount());
+    }
+
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,79 @@
+#include "bench.hpp"
+#include "external/sha1.h"
+#include "piece_hashing.hpp"
+#include "sha1_backend.hpp"
+#include "torrent_metadata.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using bt::sha1_backend::Backend;
+using bt::sha1_backend::MultiBackend;
+
+BENCHMARK("SHA1 throughput") {
+    // a typical piece size
+    std::string piece(1024 * 1024, '\0');
+    for (size_t i = 0; i < piece.size(); i++) {
+        piece[i] = static_cast<char>(i * 2654435761u >> 24);
+    }
+
+    Backend detected = bt::sha1_backend::Active();
+    for (Backend backend : {Backend::Scalar, Backend::Avx2, Backend::ShaNi}) {
+        if (!bt::sha1_backend::Select(backend)) {
+            std::printf("  %.*s: not supported\n", int(bt::sha1_backend::Name(backend).size()),
+                        bt::sha1_backend::Name(backend).data());
+            continue;
+        }
+        std::string label = "hash 1 MiB piece, " + std::string(bt::sha1_backend::Name(backend));
+        double ns = bench::Measure(label, 200, [&] {
+            bench::DoNotOptimize(bt::torrent_parser::GetSha1Hash(piece));
+        });
+        std::printf("  %.2f GB/s\n", double(piece.size()) / ns);
+    }
+    bt::sha1_backend::Select(detected);
+}
+
+BENCHMARK("HashPieces, 64 pieces of 256 KiB") {
+    std::vector<std::string> buffers(64, std::string(256 * 1024, '\0'));
+    std::vector<std::span<const std::byte>> pieces;
+    for (size_t i = 0; i < buffers.size(); i++) {
+        for (size_t j = 0; j < buffers[i].size(); j++) {
+            buffers[i][j] = static_cast<char>((i + j) * 2654435761u >> 24);
+        }
+        pieces.push_back(std::as_bytes(std::span(buffers[i])));
+    }
+    double totalBytes = double(buffers.size() * buffers[0].size());
+    std::vector<bt::Sha1Digest> digests(pieces.size());
+
+    Backend detected = bt::sha1_backend::Active();
+    MultiBackend detectedMulti = bt::sha1_backend::ActiveMulti();
+    for (Backend backend : {Backend::Scalar, detected}) {
+        bt::sha1_backend::Select(backend);
+        std::string single(bt::sha1_backend::Name(backend));
+
+        double ns = bench::Measure("sequential SHA1::add/getHash, " + single, 5, [&] {
+            for (size_t i = 0; i < buffers.size(); i++) {
+                SHA1 sha1;
+                sha1.add(buffers[i].data(), buffers[i].size());
+                sha1.getHash(reinterpret_cast<unsigned char*>(digests[i].bytes.data()));
+            }
+        });
+        std::printf("  %.2f GB/s\n", totalBytes / ns);
+
+        for (MultiBackend multi : {MultiBackend::Sse2, MultiBackend::Avx2, MultiBackend::Avx512}) {
+            if (!bt::sha1_backend::Select(multi)) {
+                continue;
+            }
+            std::string label = "HashPieces, " + single + " / " +
+                                std::string(bt::sha1_backend::Name(multi));
+            ns = bench::Measure(label, 5, [&] { bt::HashPieces(pieces, digests); });
+            std::printf("  %.2f GB/s\n", totalBytes / ns);
+        }
+        if (backend == detected) {
+            break;
+        }
+    }
+    bt::sha1_backend::Select(detected);
+    bt::sha1_backend::Select(detectedMulti);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include "external/bencode.hpp"
+#include "torrent_metadata.hpp"
+
+namespace bench {
+
+/**
+ * @brief builds bencoded metainfo of a multi-file torrent with fileCount files spread
+ *        over a few directory levels, piece hashes are random bytes
+ */
+inline std::string MakeMultiFileTorrent(size_t fileCount, long long fileSize,
+                                        long long pieceLength = 256 * 1024) {
+    bencode::list files;
+    files.reserve(fileCount);
+    for (size_t i = 0; i < fileCount; i++) {
+        bencode::list path = {"dataset", "shard-" + std::to_string(i / 1000),
+                              "part-" + std::to_string(i % 1000) + ".bin"};
+        files.push_back(bencode::dict{{"length", fileSize}, {"path", std::move(path)}});
+    }
+
+    long long totalSize = fileSize * static_cast<long long>(fileCount);
+    long long piecesCount = (totalSize + pieceLength - 1) / pieceLength;
+
+    std::mt19937 rng(42);
+    std::string pieces(piecesCount * 20, '\0');
+    for (char& c : pieces) {
+        c = static_cast<char>(rng());
+    }
+
+    bencode::dict info = {{"files", std::move(files)},
+                          {"name", "synthetic"},
+                          {"piece length", pieceLength},
+                          {"pieces", std::move(pieces)}};
+    bencode::dict metaInfo = {{"announce", "http://tracker.example/announce"},
+                              {"info", std::move(info)}};
+    return bencode::encode(metaInfo);
+}
+
+/**
+ * @brief like MakeMultiFileTorrent, but the piece hashes are those of data where every byte
+ *        is fill, so writing such data verifies
+ */
+inline std::string MakeFilledTorrent(size_t fileCount, long long fileSize, long long pieceLength,
+                                     char fill) {
+    bencode::dict metaInfo = std::get<bencode::dict>(
+        bencode::decode(MakeMultiFileTorrent(fileCount, fileSize, pieceLength)));
+    bencode::dict& info = std::get<bencode::dict>(metaInfo["info"]);
+    long long totalSize = fileSize * static_cast<long long>(fileCount);
+    // all pieces but a short last one are the same
+    bt::Sha1Digest full = bt::torrent_parser::GetSha1Hash(std::string(pieceLength, fill));
+    std::string pieces;
+    for (long long offset = 0; offset < totalSize; offset += pieceLength) {
+        long long length = std::min(pieceLength, totalSize - offset);
+        bt::Sha1Digest digest = length == pieceLength
+                                    ? full
+                                    : bt::torrent_parser::GetSha1Hash(std::string(length, fill));
+        pieces.append(reinterpret_cast<const char*>(digest.bytes.data()), digest.bytes.size());
+    }
+    info["pieces"] = std::move(pieces);
+    return bencode::encode(metaInfo);
+}
+
+} // namespace bench
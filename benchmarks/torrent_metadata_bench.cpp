@@ -0,0 +1,38 @@
+#include "bench.hpp"
+#include "synthetic_torrent.hpp"
+#include "torrent_metadata.hpp"
+#include "utils.hpp"
+
+// rows drawn by bt-ui's files table per frame, it scrolls after 8 lines
+static constexpr int visibleRows = 9;
+
+BENCHMARK("TorrentMetadata::files per frame, 50k files") {
+    bt::TorrentMetadata torr = bt::torrent_parser::Parse(bench::MakeMultiFileTorrent(50'000, 4096));
+
+    // what bt-ui's _DisplayFiles does for the visible rows of the files table
+    bench::Measure("visible rows of the files table", 20000, [&] {
+        size_t drawn = 0;
+        const bt::FileTable& files = torr.files();
+        std::string pathBuffer;
+        for (int row = 0; row < visibleRows; row++) {
+            pathBuffer.clear();
+            files.path(row).AppendTo(pathBuffer);
+            drawn += pathBuffer.size();
+            drawn += utils::BytesToString(files.fileSize(row)).size();
+        }
+        bench::DoNotOptimize(drawn + files.size());
+    });
+}
+
+BENCHMARK("TorrentMetadata::pieceHash") {
+    bt::TorrentMetadata torr = bt::torrent_parser::Parse(bench::MakeMultiFileTorrent(1000, 1 << 20));
+    size_t pieces = static_cast<size_t>(torr.piecesCount());
+
+    bench::Measure("pieceHash(i) for every piece", 1000, [&] {
+        unsigned sum = 0;
+        for (size_t i = 0; i < pieces; i++) {
+            sum += std::to_integer<unsigned>(torr.pieceHash(i)[0]);
+        }
+        bench::DoNotOptimize(sum);
+    });
+}
@@ -0,0 +1,102 @@
+#include "bench.hpp"
+#include "synthetic_torrent.hpp"
+#include "torrent_metadata.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include "external/bencode.hpp"
+#include "external/sha1.h"
+
+static std::string _ReadFile(const std::string& path) {
+    std::ifstream file{path, std::ios::binary};
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief the parser as it was before decoding into views: owning bencode::data tree,
+ *        by-value dict lookups and a re-encoded info dict for the infohash
+ */
+static size_t _ParseOwningTree(std::string metaInfo) {
+    bencode::data metaData = bencode::decode(metaInfo);
+    bencode::dict infoDict = std::get<bencode::dict>(std::get<bencode::dict>(metaData)["info"]);
+
+    auto lookup = [](bencode::data dict, std::string key) { return dict[key]; };
+    std::string pieces = std::get<std::string>(lookup(infoDict, "pieces"));
+    std::string name = std::get<std::string>(lookup(infoDict, "name"));
+
+    SHA1 sha1;
+    std::string infoHash = sha1(bencode::encode(std::get<bencode::dict>(metaData)["info"]));
+
+    size_t files = 0;
+    if (infoDict.find("files") != infoDict.end()) {
+        for (bencode::data file : std::get<bencode::list>(infoDict["files"])) {
+            std::vector<std::string> path;
+            bencode::data pathList = lookup(file, "path");
+            for (bencode::data p : std::get<bencode::list>(pathList)) {
+                path.push_back(std::get<std::string>(p));
+            }
+            files += path.size();
+        }
+    }
+    return pieces.size() + name.size() + infoHash.size() + files;
+}
+
+BENCHMARK("torrent_parser::Parse") {
+    const char* torrents[] = {"linuxmint-22-xfce-64bit.iso.torrent",
+                              "india-pocket-map_archive.torrent"};
+
+    for (const char* torrent : torrents) {
+        std::string metaInfo = _ReadFile(std::string(TORRENT_FILES_PATH) + torrent);
+        std::printf(" %s (%zu bytes)\n", torrent, metaInfo.size());
+
+        bench::Measure("owning bencode::data tree", 2000, [&] {
+            bench::DoNotOptimize(_ParseOwningTree(metaInfo));
+        });
+        bench::Measure("bt::torrent_parser::Parse (views)", 2000, [&] {
+            bt::TorrentMetadata torr = bt::torrent_parser::Parse(metaInfo);
+            bench::DoNotOptimize(torr);
+        });
+    }
+}
+
+/**
+ * @brief how ParseFromFile loaded files before MappedFile: one character at a time
+ *        into a string, which was then copied into Parse
+ */
+static bt::TorrentMetadata _ParseFromStream(const std::string& path) {
+    std::ifstream torrentFile{path, std::ios::binary | std::ios::ate};
+    torrentFile.seekg(0);
+    std::string metaInfo((std::istreambuf_iterator<char>(torrentFile)),
+                         (std::istreambuf_iterator<char>()));
+    std::string copy = metaInfo;
+    return bt::torrent_parser::Parse(copy);
+}
+
+BENCHMARK("torrent_parser::ParseFromFile") {
+    // a torrent with an 8 MB pieces string, big enough to be memory mapped
+    std::filesystem::path largeTorrent =
+        std::filesystem::temp_directory_path() / "bt_bench_large.torrent";
+    {
+        std::string metaInfo = bench::MakeMultiFileTorrent(1000, 1LL << 30, 2LL << 20);
+        std::ofstream file{largeTorrent, std::ios::binary | std::ios::trunc};
+        file.write(metaInfo.data(), metaInfo.size());
+    }
+
+    std::string torrents[] = {TORRENT_FILES_PATH "linuxmint-22-xfce-64bit.iso.torrent",
+                              largeTorrent.string()};
+    for (const std::string& path : torrents) {
+        std::printf(" %s (%ju bytes)\n", std::filesystem::path(path).filename().string().c_str(),
+                    static_cast<uintmax_t>(std::filesystem::file_size(path)));
+
+        bench::Measure("istreambuf_iterator + copy into Parse", 50, [&] {
+            bench::DoNotOptimize(_ParseFromStream(path));
+        });
+        bench::Measure("ParseFromFile", 50, [&] {
+            bench::DoNotOptimize(bt::torrent_parser::ParseFromFile(path));
+        });
+    }
+    std::filesystem::remove(largeTorrent);
+}
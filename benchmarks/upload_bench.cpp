@@ -0,0 +1,174 @@
+#include "bench.hpp"
+#include "file_handle.hpp"
+#include "peer_connection.hpp"
+#include "synthetic_torrent.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#else
+#include <ctime>
+#endif
+
+using bt::PeerConnection;
+using bt::peer_wire::BlockInfo;
+using bt::peer_wire::BlockSize;
+
+// CPU seconds of the calling thread, the whole process where threads are not measured
+static double _ThreadCpuSeconds() {
+#ifdef RUSAGE_THREAD
+    rusage usage{};
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+enum class UploadMode {
+    Copy,     // read into a buffer, copied again into the message queue
+    Gather,   // file ranges read at write time, one gathering write
+    ZeroCopy, // file ranges sent with sendfile
+};
+
+struct UploadResult {
+    double seconds;
+    double senderCpuSeconds;
+};
+
+/**
+ * @brief a seeder thread uploads bytes of the torrent to a leecher on the calling thread,
+ *        which keeps a deep pipeline of requests cycling through the data
+ */
+static UploadResult _Upload(const bt::StorageLayout& layout, UploadMode mode, long long bytes) {
+    const bt::TorrentMetadata& torrent = layout.torrent();
+    const uint32_t blocksPerPiece = static_cast<uint32_t>(torrent.pieceLength() / BlockSize);
+    const uint32_t blocksCount = static_cast<uint32_t>(torrent.piecesCount()) * blocksPerPiece;
+
+    PeerConnection::Options options;
+    options.infoHash = torrent.infoHash();
+    options.piecesCount = torrent.piecesCount();
+    options.zeroCopyUploads = mode == UploadMode::ZeroCopy;
+
+    asio::io_context seederContext;
+    asio::ip::tcp::acceptor acceptor(seederContext, {asio::ip::address_v4::loopback(), 0});
+    bt::UploadSource source(layout);
+    std::vector<std::byte> buffer(BlockSize);
+    PeerConnection::Callbacks seederCallbacks;
+    seederCallbacks.onConnected = [&](PeerConnection& peer) {
+        bt::Bitfield all(torrent.piecesCount());
+        for (size_t i = 0; i < all.size(); i++) {
+            all.Set(i);
+        }
+        peer.SendBitfield(all);
+    };
+    seederCallbacks.onStateChanged = [](PeerConnection& peer) {
+        if (peer.peerInterested()) {
+            peer.Unchoke();
+        }
+    };
+    seederCallbacks.onRequest = [&](PeerConnection& peer, const BlockInfo& block) {
+        std::vector<bt::FileRange> ranges = source.Block(block);
+        if (mode != UploadMode::Copy) {
+            peer.SendPiece(block.pieceIndex, block.begin, std::move(ranges));
+            return;
+        }
+        size_t position = 0;
+        for (const bt::FileRange& range : ranges) {
+            position += range.file->ReadAt(
+                range.offset, std::span(buffer).subspan(position, range.length));
+        }
+        peer.SendPiece(block.pieceIndex, block.begin, std::span(buffer).first(position));
+    };
+    std::shared_ptr<PeerConnection> seeder;
+    acceptor.async_accept([&](const std::error_code& error, asio::ip::tcp::socket socket) {
+        if (!error) {
+            seeder = PeerConnection::Accept(std::move(socket), options, seederCallbacks);
+        }
+    });
+    double senderCpuSeconds = 0;
+    std::thread seederThread([&] {
+        double start = _ThreadCpuSeconds();
+        seederContext.run();
+        senderCpuSeconds = _ThreadCpuSeconds() - start;
+    });
+
+    asio::io_context leecherContext;
+    long long received = 0;
+    uint32_t nextBlock = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto request = [&](PeerConnection& peer) {
+        uint32_t block = nextBlock++ % blocksCount;
+        peer.Request({block / blocksPerPiece, block % blocksPerPiece * BlockSize, BlockSize});
+    };
+    PeerConnection::Callbacks leecherCallbacks;
+    leecherCallbacks.onConnected = [](PeerConnection& peer) { peer.SetInterested(true); };
+    leecherCallbacks.onStateChanged = [&](PeerConnection& peer) {
+        if (peer.peerChoking()) {
+            return;
+        }
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 256; i++) {
+            request(peer);
+        }
+    };
+    leecherCallbacks.onPiece = [&](PeerConnection& peer, const BlockInfo&,
+                                   std::span<const std::byte> data) {
+        received += static_cast<long long>(data.size());
+        if (received >= bytes) {
+            leecherContext.stop();
+            return;
+        }
+        request(peer);
+    };
+    auto leecher = PeerConnection::Connect(leecherContext, acceptor.local_endpoint(), options,
+                                           leecherCallbacks);
+    leecherContext.run();
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    seederContext.stop();
+    seederThread.join();
+    return {seconds, senderCpuSeconds};
+}
+
+/**
+ * @brief upload CPU cost of a seeder on loopback, the data is in the page cache; loopback
+ *        also copies on the receiving side, which runs on its own thread and is not counted
+ */
+BENCHMARK("Upload from files") {
+    constexpr long long FileSize = 16 << 20;
+    constexpr long long Bytes = 2LL << 30;
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bt_upload_bench";
+    std::filesystem::remove_all(directory);
+
+    bt::TorrentMetadata torrent =
+        bt::torrent_parser::Parse(bench::MakeMultiFileTorrent(4, FileSize, 1 << 20));
+    bt::StorageLayout layout(torrent, directory);
+    std::vector<char> content(FileSize, 'x');
+    for (size_t i = 0; i < torrent.files().size(); i++) {
+        std::filesystem::create_directories(layout.filePath(i).parent_path());
+        std::ofstream(layout.filePath(i), std::ios::binary).write(content.data(), content.size());
+    }
+    std::printf("  payload %lld MiB in page cache, %lld MiB uploaded per mode\n",
+                torrent.totalSize() >> 20, Bytes >> 20);
+
+    const std::pair<const char*, UploadMode> modes[] = {
+        {"pread + copy into message buffer", UploadMode::Copy},
+        {"pread at write time + gather write", UploadMode::Gather},
+        {"sendfile", UploadMode::ZeroCopy},
+    };
+    for (auto [label, mode] : modes) {
+        UploadResult result = _Upload(layout, mode, Bytes);
+        double gigabits = Bytes * 8 / 1e9;
+        std::printf("  %-40s %6.2f Gbit/s, sender CPU %6.1f ms per Gbit\n", label,
+                    gigabits / result.seconds, result.senderCpuSeconds * 1e3 / gigabits);
+    }
+    std::filesystem::remove_all(directory);
+}
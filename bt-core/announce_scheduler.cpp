@@ -0,0 +1,315 @@
+#include "announce_scheduler.hpp"
+
+#include <algorithm>
+
+namespace bt {
+
+/**
+ * @return scheme://host:port part of an announce url, hosts are failed as a whole
+ */
+static std::string_view _HostOf(std::string_view url) {
+    size_t schemeEnd = url.find("://");
+    if (schemeEnd == std::string_view::npos) {
+        return url;
+    }
+    return url.substr(0, url.find('/', schemeEnd + 3));
+}
+
+AnnounceScheduler::AnnounceScheduler(Clock::time_point now, AnnounceSchedulerOptions options)
+    : _options(options),
+      _epoch(now),
+      _wheel(std::max<size_t>(options.wheelSize, 1)),
+      _random(options.seed) {
+    _options.maxAnnouncesPerTick = std::max<size_t>(_options.maxAnnouncesPerTick, 1);
+}
+
+bool AnnounceScheduler::Add(const InfoHash& infoHash,
+                            std::span<const std::vector<std::string_view>> tiers,
+                            Clock::time_point now) {
+    if (_torrentIndexes.contains(infoHash)) {
+        return false;
+    }
+    std::vector<uint32_t> trackers;
+    std::vector<uint32_t> tierEnds;
+    for (const std::vector<std::string_view>& tier : tiers) {
+        for (std::string_view url : tier) {
+            trackers.push_back(_Intern(url));
+        }
+        if (tierEnds.empty() ? !trackers.empty() : tierEnds.back() != trackers.size()) {
+            tierEnds.push_back(static_cast<uint32_t>(trackers.size()));
+        }
+    }
+    if (trackers.empty()) {
+        return false;
+    }
+
+    uint32_t index;
+    if (!_freeTorrents.empty()) {
+        index = _freeTorrents.back();
+        _freeTorrents.pop_back();
+    } else {
+        index = static_cast<uint32_t>(_torrents.size());
+        _torrents.emplace_back();
+    }
+    Torrent& torrent = _torrents[index];
+    uint32_t generation = torrent.generation;
+    torrent = Torrent{};
+    torrent.generation = generation;
+    torrent.infoHash = infoHash;
+    torrent.trackers = std::move(trackers);
+    torrent.tierEnds = std::move(tierEnds);
+    torrent.used = true;
+    _torrentIndexes.emplace(infoHash, index);
+
+    // a torrent added alone announces right away, thousands added at once fill tick after tick
+    int64_t tick = std::max(_Tick(now), _nextTick);
+    if (_lastAddTick < tick) {
+        _lastAddTick = tick;
+        _addsInLastTick = 0;
+    }
+    if (_addsInLastTick == _options.maxAnnouncesPerTick) {
+        _lastAddTick++;
+        _addsInLastTick = 0;
+    }
+    _addsInLastTick++;
+    _Schedule(index, _lastAddTick);
+    return true;
+}
+
+bool AnnounceScheduler::Add(const TorrentMetadata& torrent, Clock::time_point now) {
+    std::vector<std::vector<std::string_view>> tiers;
+    for (size_t tier = 0; tier < torrent.announceTiersCount(); tier++) {
+        std::span<const std::string_view> urls = torrent.announceTier(tier);
+        tiers.emplace_back(urls.begin(), urls.end());
+    }
+    if (tiers.empty() && torrent.mainAnnounce().has_value()) {
+        tiers.push_back({*torrent.mainAnnounce()});
+    }
+    return Add(torrent.infoHash(), tiers, now);
+}
+
+void AnnounceScheduler::Remove(const InfoHash& infoHash) {
+    auto it = _torrentIndexes.find(infoHash);
+    if (it == _torrentIndexes.end()) {
+        return;
+    }
+    Torrent& torrent = _torrents[it->second];
+    torrent.used = false;
+    torrent.generation++;
+    torrent.trackers = {};
+    torrent.tierEnds = {};
+    _freeTorrents.push_back(it->second);
+    _torrentIndexes.erase(it);
+}
+
+void AnnounceScheduler::RequestAnnounce(const InfoHash& infoHash, Clock::time_point now) {
+    auto it = _torrentIndexes.find(infoHash);
+    if (it == _torrentIndexes.end() || _torrents[it->second].inFlight) {
+        return;
+    }
+    _Schedule(it->second, std::max(_Tick(now), _DueTick(_torrents[it->second].minIntervalEnd)));
+}
+
+std::vector<AnnounceBatch> AnnounceScheduler::Poll(Clock::time_point now) {
+    int64_t nowTick = _Tick(now);
+    if (nowTick < _nextTick) {
+        return {};
+    }
+
+    // a slot holds every lap, entries of later laps stay in it
+    std::vector<uint32_t> due;
+    int64_t firstTick = std::max(_nextTick, nowTick - static_cast<int64_t>(_wheel.size()) + 1);
+    for (int64_t tick = firstTick; tick <= nowTick; tick++) {
+        std::vector<Entry>& slot = _wheel[tick % _wheel.size()];
+        size_t kept = 0;
+        for (Entry entry : slot) {
+            const Torrent& torrent = _torrents[entry.torrent];
+            if (!torrent.used || torrent.generation != entry.generation || torrent.inFlight) {
+                continue;
+            }
+            if (torrent.dueTick > nowTick) {
+                slot[kept++] = entry;
+            } else {
+                due.push_back(entry.torrent);
+            }
+        }
+        slot.resize(kept);
+    }
+    _nextTick = nowTick + 1;
+
+    std::vector<AnnounceBatch> batches;
+    std::unordered_map<uint32_t, size_t> hostBatches;
+    size_t handedOut = 0;
+    auto handOut = [&](uint32_t index, uint32_t tracker) {
+        Torrent& torrent = _torrents[index];
+        torrent.inFlight = true;
+        torrent.generation++;
+        uint32_t host = _trackers[tracker].host;
+        auto [it, inserted] = hostBatches.emplace(host, batches.size());
+        if (inserted) {
+            batches.push_back({_hosts[host].name, {}});
+        }
+        batches[it->second].announces.push_back(
+            {torrent.infoHash, _trackers[tracker].url,
+             torrent.started ? AnnounceEvent::None : AnnounceEvent::Started});
+        handedOut++;
+    };
+
+    for (uint32_t index : due) {
+        if (handedOut == _options.maxAnnouncesPerTick) {
+            _Schedule(index, nowTick + 1);
+            continue;
+        }
+        Torrent& torrent = _torrents[index];
+        uint32_t tracker = _Pick(torrent, now);
+        if (tracker != _NoTracker) {
+            handOut(index, tracker);
+            continue;
+        }
+        // every host is backing off, come back when the first one may be tried
+        Clock::time_point retryAt = Clock::time_point::max();
+        for (uint32_t candidate : torrent.trackers) {
+            retryAt = std::min(retryAt, _hosts[_trackers[candidate].host].health.retryAt);
+        }
+        _Schedule(index, _DueTick(retryAt));
+    }
+
+    // pull forward torrents of the hosts announced to anyway
+    int64_t windowEnd = std::min(_Tick(now + _options.coalesceWindow),
+                                 nowTick + static_cast<int64_t>(_wheel.size()) - 1);
+    for (int64_t tick = nowTick + 1; tick <= windowEnd && !batches.empty(); tick++) {
+        for (Entry entry : _wheel[tick % _wheel.size()]) {
+            if (handedOut == _options.maxAnnouncesPerTick) {
+                return batches;
+            }
+            Torrent& torrent = _torrents[entry.torrent];
+            if (!torrent.used || torrent.generation != entry.generation || torrent.inFlight ||
+                torrent.dueTick > windowEnd || torrent.minIntervalEnd > now) {
+                continue;
+            }
+            uint32_t tracker = torrent.trackers[torrent.cursor];
+            const Host& host = _hosts[_trackers[tracker].host];
+            if (host.health.retryAt <= now && hostBatches.contains(_trackers[tracker].host)) {
+                handOut(entry.torrent, tracker);
+            }
+        }
+    }
+    return batches;
+}
+
+void AnnounceScheduler::OnSuccess(const InfoHash& infoHash, const AnnounceResponse& response,
+                                  Clock::time_point now) {
+    auto it = _torrentIndexes.find(infoHash);
+    if (it == _torrentIndexes.end() || !_torrents[it->second].inFlight) {
+        return;
+    }
+    Torrent& torrent = _torrents[it->second];
+    _hosts[_trackers[torrent.trackers[torrent.cursor]].host].health = {};
+    _MoveToFront(torrent, torrent.cursor);
+    torrent.cursor = 0;
+    torrent.inFlight = false;
+    torrent.started = true;
+    torrent.failedRounds = 0;
+
+    std::chrono::seconds interval =
+        response.interval > std::chrono::seconds(0) ? response.interval : _options.defaultInterval;
+    std::uniform_real_distribution<double> jitter(-_options.intervalJitter,
+                                                  _options.intervalJitter);
+    auto next = now + std::chrono::duration_cast<Clock::duration>(
+                          std::chrono::duration<double>(interval) * (1 + jitter(_random)));
+    torrent.minIntervalEnd = now + response.minInterval;
+    _Schedule(it->second, _DueTick(std::max(next, torrent.minIntervalEnd)));
+}
+
+void AnnounceScheduler::OnFailure(const InfoHash& infoHash, Clock::time_point now) {
+    auto it = _torrentIndexes.find(infoHash);
+    if (it == _torrentIndexes.end() || !_torrents[it->second].inFlight) {
+        return;
+    }
+    Torrent& torrent = _torrents[it->second];
+    TrackerHealth& health = _hosts[_trackers[torrent.trackers[torrent.cursor]].host].health;
+    health.consecutiveFailures++;
+    health.retryAt = _Backoff(health.consecutiveFailures, now);
+    torrent.inFlight = false;
+
+    // the next tracker is tried on the next tick, after a whole round the torrent backs off
+    if (++torrent.cursor < torrent.trackers.size()) {
+        _Schedule(it->second, _Tick(now));
+        return;
+    }
+    torrent.cursor = 0;
+    torrent.failedRounds++;
+    _Schedule(it->second, _DueTick(_Backoff(torrent.failedRounds, now)));
+}
+
+TrackerHealth AnnounceScheduler::health(std::string_view url) const {
+    auto it = _hostIndexes.find(_HostOf(url));
+    return it != _hostIndexes.end() ? _hosts[it->second].health : TrackerHealth{};
+}
+
+size_t AnnounceScheduler::size() const {
+    return _torrentIndexes.size();
+}
+
+int64_t AnnounceScheduler::_Tick(Clock::time_point time) const {
+    return (time - _epoch) / _options.tick;
+}
+
+int64_t AnnounceScheduler::_DueTick(Clock::time_point time) const {
+    Clock::duration sinceEpoch = time - _epoch;
+    return (sinceEpoch + _options.tick - Clock::duration(1)) / _options.tick;
+}
+
+uint32_t AnnounceScheduler::_Intern(std::string_view url) {
+    auto it = _trackerIndexes.find(url);
+    if (it != _trackerIndexes.end()) {
+        return it->second;
+    }
+    std::string_view hostName = _HostOf(url);
+    auto hostIt = _hostIndexes.find(hostName);
+    if (hostIt == _hostIndexes.end()) {
+        _hosts.push_back({std::string(hostName), {}});
+        hostIt = _hostIndexes.emplace(_hosts.back().name, uint32_t(_hosts.size() - 1)).first;
+    }
+    _trackers.push_back({std::string(url), hostIt->second});
+    uint32_t index = static_cast<uint32_t>(_trackers.size() - 1);
+    _trackerIndexes.emplace(_trackers.back().url, index);
+    return index;
+}
+
+void AnnounceScheduler::_Schedule(uint32_t index, int64_t tick) {
+    Torrent& torrent = _torrents[index];
+    torrent.dueTick = std::max(tick, _nextTick);
+    torrent.generation++;
+    _wheel[torrent.dueTick % _wheel.size()].push_back({index, torrent.generation});
+}
+
+uint32_t AnnounceScheduler::_Pick(Torrent& torrent, Clock::time_point now) {
+    for (uint32_t position = torrent.cursor; position < torrent.trackers.size(); position++) {
+        uint32_t tracker = torrent.trackers[position];
+        if (_hosts[_trackers[tracker].host].health.retryAt <= now) {
+            torrent.cursor = position;
+            return tracker;
+        }
+    }
+    torrent.cursor = 0;
+    return _NoTracker;
+}
+
+AnnounceScheduler::Clock::time_point AnnounceScheduler::_Backoff(int failures,
+                                                                 Clock::time_point now) const {
+    Clock::duration backoff = _options.retryBackoff;
+    for (int i = 1; i < failures && backoff < _options.maxRetryBackoff; i++) {
+        backoff *= 2;
+    }
+    return now + std::min(backoff, _options.maxRetryBackoff);
+}
+
+void AnnounceScheduler::_MoveToFront(Torrent& torrent, uint32_t position) {
+    auto tierEnd = std::upper_bound(torrent.tierEnds.begin(), torrent.tierEnds.end(), position);
+    uint32_t tierBegin = tierEnd == torrent.tierEnds.begin() ? 0 : *(tierEnd - 1);
+    std::rotate(torrent.trackers.begin() + tierBegin, torrent.trackers.begin() + position,
+                torrent.trackers.begin() + position + 1);
+}
+
+} // namespace bt
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "torrent_metadata.hpp"
+#include "tracker.hpp"
+
+namespace bt {
+
+struct AnnounceSchedulerOptions {
+    /**
+     * @brief resolution of the timer wheel, Poll is meant to be called this often
+     */
+    std::chrono::steady_clock::duration tick = std::chrono::seconds(1);
+
+    /**
+     * @brief slots of the timer wheel, announces further away than tick * wheelSize take
+     *        several laps
+     */
+    size_t wheelSize = 4096;
+
+    /**
+     * @brief at most this many announces are handed out by one Poll; torrents added together
+     *        get their first announce spread over as many ticks as needed
+     */
+    size_t maxAnnouncesPerTick = 50;
+
+    /**
+     * @brief used when the tracker did not send an interval
+     */
+    std::chrono::seconds defaultInterval = std::chrono::minutes(30);
+
+    /**
+     * @brief the next announce is at interval * (1 +- intervalJitter), so torrents started
+     *        together drift apart
+     */
+    double intervalJitter = 0.05;
+
+    /**
+     * @brief when a host gets announces in a Poll, other torrents of that host due within
+     *        coalesceWindow are announced with them, past their min interval
+     */
+    std::chrono::steady_clock::duration coalesceWindow = std::chrono::seconds(30);
+
+    /**
+     * @brief a host that failed n times in a row is skipped for retryBackoff * 2^(n-1),
+     *        a torrent whose trackers all failed waits as long before its next round
+     */
+    std::chrono::steady_clock::duration retryBackoff = std::chrono::seconds(30);
+    std::chrono::steady_clock::duration maxRetryBackoff = std::chrono::hours(1);
+
+    uint32_t seed = 0; // of the jitter
+};
+
+/**
+ * @brief state of a tracker host shared by every torrent announcing to it
+ */
+struct TrackerHealth {
+    int consecutiveFailures = 0;
+    std::chrono::steady_clock::time_point retryAt{}; // skipped until then
+};
+
+struct ScheduledAnnounce {
+    InfoHash infoHash;
+    std::string_view url; // valid while the scheduler lives
+    AnnounceEvent event = AnnounceEvent::None;
+};
+
+/**
+ * @brief announces to a single host, a client sends them over one connection
+ */
+struct AnnounceBatch {
+    std::string_view host; // scheme://host:port of the urls
+    std::vector<ScheduledAnnounce> announces;
+};
+
+/**
+ * @brief decides when every torrent announces to which tracker, for thousands of torrents
+ * @brief trackers are tried in their BEP 12 tiers: in order, the next tier only when the
+ *        whole tier failed, and a tracker that answered moves to the front of its tier;
+ *        hosts that keep failing are skipped by every torrent until their backoff ends
+ * @brief due announces sit in a hashed timer wheel, so a Poll only looks at the slots of the
+ *        ticks that passed; the scheduler does no io, the caller sends what Poll returns and
+ *        reports the outcome with OnSuccess/OnFailure
+ * @brief time is passed in explicitly; not thread safe
+ */
+class AnnounceScheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit AnnounceScheduler(Clock::time_point now, AnnounceSchedulerOptions options = {});
+
+    /**
+     * @param tiers trackers of the torrent, urls are copied
+     * @return false if the torrent is already scheduled or has no trackers
+     */
+    bool Add(const InfoHash& infoHash, std::span<const std::vector<std::string_view>> tiers,
+             Clock::time_point now);
+
+    /**
+     * @brief schedules the announce-list tiers, or the main announce url if there are none
+     */
+    bool Add(const TorrentMetadata& torrent, Clock::time_point now);
+
+    /**
+     * @brief an outcome reported for the torrent afterwards is ignored
+     */
+    void Remove(const InfoHash& infoHash);
+
+    /**
+     * @brief announces as soon as the tracker's min interval allows, e.g. when more peers
+     *        are needed; does nothing while an announce is in flight
+     */
+    void RequestAnnounce(const InfoHash& infoHash, Clock::time_point now);
+
+    /**
+     * @return announces due by now grouped by host, every one of them is in flight until
+     *         OnSuccess or OnFailure is called for its torrent
+     */
+    std::vector<AnnounceBatch> Poll(Clock::time_point now);
+
+    /**
+     * @brief schedules the next announce after the interval of response
+     */
+    void OnSuccess(const InfoHash& infoHash, const AnnounceResponse& response,
+                   Clock::time_point now);
+
+    /**
+     * @brief counts a failure of the host and moves on to the next tracker
+     */
+    void OnFailure(const InfoHash& infoHash, Clock::time_point now);
+
+    /**
+     * @return health of the host of url, default if no torrent announces there
+     */
+    TrackerHealth health(std::string_view url) const;
+
+    /**
+     * @return count of scheduled torrents
+     */
+    size_t size() const;
+
+  private:
+    static constexpr uint32_t _NoTracker = UINT32_MAX;
+
+    struct Tracker {
+        std::string url;
+        uint32_t host;
+    };
+
+    struct Host {
+        std::string name;
+        TrackerHealth health;
+    };
+
+    struct Torrent {
+        InfoHash infoHash;
+        std::vector<uint32_t> trackers; // tiers one after another
+        std::vector<uint32_t> tierEnds;
+        uint32_t cursor = 0; // in trackers, the next one to try
+        uint32_t generation = 0;
+        bool used = false;
+        bool inFlight = false;
+        bool started = false; // a tracker answered once
+        int failedRounds = 0;
+        int64_t dueTick = 0;
+        Clock::time_point minIntervalEnd{};
+    };
+
+    // wheel entries of removed or rescheduled torrents are dropped when their slot is visited
+    struct Entry {
+        uint32_t torrent;
+        uint32_t generation;
+    };
+
+    int64_t _Tick(Clock::time_point time) const;    // tick time falls in
+    int64_t _DueTick(Clock::time_point time) const; // first tick not before time
+    uint32_t _Intern(std::string_view url);
+    void _Schedule(uint32_t index, int64_t tick);
+    uint32_t _Pick(Torrent& torrent, Clock::time_point now);
+    Clock::time_point _Backoff(int failures, Clock::time_point now) const;
+    void _MoveToFront(Torrent& torrent, uint32_t position);
+
+    AnnounceSchedulerOptions _options;
+    Clock::time_point _epoch;
+    int64_t _nextTick = 0; // first tick not polled yet
+    std::vector<std::vector<Entry>> _wheel;
+
+    int64_t _lastAddTick = 0; // first announces of added torrents are spread from here
+    size_t _addsInLastTick = 0;
+
+    std::vector<Torrent> _torrents;
+    std::vector<uint32_t> _freeTorrents;
+    std::unordered_map<InfoHash, uint32_t> _torrentIndexes;
+
+    std::deque<Tracker> _trackers; // deques keep the strings in place for the views
+    std::deque<Host> _hosts;
+    std::unordered_map<std::string_view, uint32_t> _trackerIndexes;
+    std::unordered_map<std::string_view, uint32_t> _hostIndexes;
+
+    std::mt19937 _random;
+};
+
+} // namespace bt
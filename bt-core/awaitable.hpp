@@ -0,0 +1,46 @@
+#pragma once
+
+#include <asio.hpp>
+#include <asio/experimental/awaitable_operators.hpp>
+#include <chrono>
+#include <system_error>
+#include <type_traits>
+#include <variant>
+
+/**
+ * @brief helpers for the networking code written as asio::awaitable coroutines
+ * @brief a coroutine is cancelled through the cancellation slot it was spawned with,
+ *        asio::co_spawn(executor, fn(), asio::bind_cancellation_slot(signal.slot(), token)):
+ *        emitting the signal aborts the operation it is suspended on, which throws
+ *        std::system_error with asio::error::operation_aborted
+ * @brief coroutine frames started on an io_context thread come from asio's per-thread
+ *        recycling allocator, so once warm a co_await chain does not hit malloc
+ */
+namespace bt {
+
+/**
+ * @brief awaits operation and cancels it if it does not complete within timeout
+ * @brief cancelling the calling coroutine cancels operation too
+ * @throws std::system_error asio::error::timed_out if the timeout expired first, or whatever
+ *         operation throws
+ */
+template <typename T>
+asio::awaitable<T> WithTimeout(asio::awaitable<T> operation,
+                               std::chrono::steady_clock::duration timeout) {
+    using namespace asio::experimental::awaitable_operators;
+
+    asio::steady_timer timer(co_await asio::this_coro::executor, timeout);
+    // the first to complete wins, the other one is cancelled and waited for; the timer reports
+    // its error instead of throwing, so that cancelling both does not throw twice
+    auto result = co_await (std::move(operation) ||
+                            timer.async_wait(asio::as_tuple(asio::use_awaitable)));
+    if (result.index() == 1) {
+        auto [error] = std::get<1>(result);
+        throw std::system_error(error ? error : asio::error::timed_out);
+    }
+    if constexpr (!std::is_void_v<T>) {
+        co_return std::get<0>(std::move(result));
+    }
+}
+
+} // namespace bt
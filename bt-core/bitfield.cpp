@@ -0,0 +1,60 @@
+#include "bitfield.hpp"
+
+#include <bit>
+#include <stdexcept>
+
+namespace bt {
+
+Bitfield::Bitfield(size_t size) : _bytes((size + 7) / 8), _size(size) {
+}
+
+Bitfield Bitfield::FromBytes(std::span<const std::byte> bytes, size_t size) {
+    Bitfield bitfield(size);
+    if (bytes.size() != bitfield._bytes.size()) {
+        throw std::invalid_argument("Bitfield has wrong length");
+    }
+    if (size % 8 != 0 && (bytes.back() & std::byte(0xff >> (size % 8))) != std::byte(0)) {
+        throw std::invalid_argument("Bitfield has spare bits set");
+    }
+    bitfield._bytes.assign(bytes.begin(), bytes.end());
+    return bitfield;
+}
+
+size_t Bitfield::size() const {
+    return _size;
+}
+
+size_t Bitfield::count() const {
+    size_t count = 0;
+    for (std::byte byte : _bytes) {
+        count += std::popcount(std::to_integer<unsigned char>(byte));
+    }
+    return count;
+}
+
+bool Bitfield::all() const {
+    return count() == _size;
+}
+
+bool Bitfield::none() const {
+    return count() == 0;
+}
+
+bool Bitfield::Test(size_t index) const {
+    return (_bytes[index / 8] & std::byte(0x80 >> (index % 8))) != std::byte(0);
+}
+
+void Bitfield::Set(size_t index, bool value) {
+    std::byte mask = std::byte(0x80 >> (index % 8));
+    if (value) {
+        _bytes[index / 8] |= mask;
+    } else {
+        _bytes[index / 8] &= ~mask;
+    }
+}
+
+std::span<const std::byte> Bitfield::bytes() const {
+    return _bytes;
+}
+
+} // namespace bt
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace bt {
+
+/**
+ * @brief one bit per piece in the layout of the BEP 3 bitfield message: the high bit of the
+ *        first byte is piece 0, spare bits at the end are zero
+ */
+class Bitfield {
+  public:
+    Bitfield() = default;
+
+    /**
+     * @param size count of bits, all cleared
+     */
+    explicit Bitfield(size_t size);
+
+    /**
+     * @param bytes as received in a bitfield message
+     * @param size count of pieces
+     * @throws std::invalid_argument if bytes has the wrong length or spare bits set
+     */
+    static Bitfield FromBytes(std::span<const std::byte> bytes, size_t size);
+
+    /**
+     * @return count of bits
+     */
+    size_t size() const;
+
+    /**
+     * @return count of set bits
+     */
+    size_t count() const;
+
+    bool all() const;
+    bool none() const;
+
+    bool Test(size_t index) const;
+
+    void Set(size_t index, bool value = true);
+
+    /**
+     * @return bits packed as sent in a bitfield message
+     */
+    std::span<const std::byte> bytes() const;
+
+    bool operator==(const Bitfield&) const = default;
+
+  private:
+    std::vector<std::byte> _bytes;
+    size_t _size = 0;
+};
+
+} // namespace bt
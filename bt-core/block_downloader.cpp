@@ -0,0 +1,110 @@
+#include "block_downloader.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace bt {
+
+BlockDownloader::BlockDownloader(PiecePicker& picker, RequestQueueOptions options)
+    : _picker(picker), _options(options) {
+}
+
+void BlockDownloader::AddPeer(PeerConnection& peer) {
+    _peers.try_emplace(&peer, _options);
+}
+
+void BlockDownloader::RemovePeer(PeerConnection& peer) {
+    auto it = _peers.find(&peer);
+    if (it == _peers.end()) {
+        return;
+    }
+    for (const peer_wire::BlockInfo& block : it->second.Clear()) {
+        _picker.OnRequestFailed(block);
+    }
+    _peers.erase(it);
+}
+
+void BlockDownloader::OnStateChanged(PeerConnection& peer) {
+    auto it = _peers.find(&peer);
+    if (it == _peers.end()) {
+        return;
+    }
+    if (!peer.peerChoking()) {
+        Fill(peer);
+        return;
+    }
+    // the connection already forgot them, the peer will not answer
+    for (const peer_wire::BlockInfo& block : it->second.Clear()) {
+        _picker.OnRequestFailed(block);
+    }
+}
+
+bool BlockDownloader::OnPiece(PeerConnection& peer, const peer_wire::BlockInfo& block) {
+    auto it = _peers.find(&peer);
+    if (it == _peers.end()) {
+        return false;
+    }
+    it->second.OnReceived(block, RequestQueue::Clock::now());
+
+    // only endgame requests a block from several peers
+    bool endgame = _picker.endgame();
+    bool complete = _picker.OnBlockReceived(block);
+    if (endgame) {
+        for (auto& [other, queue] : _peers) {
+            if (other != &peer && queue.Remove(block)) {
+                other->Cancel(block);
+            }
+        }
+    }
+    Fill(peer);
+    return complete;
+}
+
+void BlockDownloader::Fill(PeerConnection& peer) {
+    auto it = _peers.find(&peer);
+    if (it == _peers.end() || peer.state() != PeerConnection::State::Connected ||
+        peer.peerChoking() || it->second.deficit() == 0) {
+        return;
+    }
+    RequestQueue& queue = it->second;
+    auto now = RequestQueue::Clock::now();
+    for (const peer_wire::BlockInfo& block :
+         _picker.Pick(peer.peerPieces(), queue.deficit(), peer.outstandingRequests())) {
+        if (peer.Request(block)) {
+            queue.OnRequested(block, now);
+        } else {
+            _picker.OnRequestFailed(block);
+        }
+    }
+}
+
+void BlockDownloader::ExpireRequests() {
+    auto now = RequestQueue::Clock::now();
+    std::vector<PeerConnection*> slowPeers;
+    for (auto& [peer, queue] : _peers) {
+        std::vector<peer_wire::BlockInfo> timedOut = queue.TakeTimedOut(now);
+        for (const peer_wire::BlockInfo& block : timedOut) {
+            peer->Cancel(block);
+            _picker.OnRequestFailed(block);
+        }
+        if (!timedOut.empty()) {
+            slowPeers.push_back(peer);
+        }
+    }
+    // the other peers get the first chance at the blocks
+    for (auto& [peer, queue] : _peers) {
+        if (std::find(slowPeers.begin(), slowPeers.end(), peer) == slowPeers.end()) {
+            Fill(*peer);
+        }
+    }
+    for (PeerConnection* peer : slowPeers) {
+        Fill(*peer);
+    }
+}
+
+const RequestQueue* BlockDownloader::queue(const PeerConnection& peer) const {
+    auto it = _peers.find(const_cast<PeerConnection*>(&peer));
+    return it != _peers.end() ? &it->second : nullptr;
+}
+
+} // namespace bt
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "peer_connection.hpp"
+#include "piece_picker.hpp"
+#include "request_queue.hpp"
+
+namespace bt {
+
+/**
+ * @brief keeps the request pipeline of every peer of a torrent full
+ * @brief blocks are picked by the PiecePicker and sent through PeerConnection::Request, every
+ *        peer has a RequestQueue sizing its pipeline to its bandwidth-delay product; timed out
+ *        requests are cancelled and picked again, and in endgame the duplicate requests of a
+ *        block are cancelled once it arrives
+ * @brief not thread safe, the connections must share one executor
+ */
+class BlockDownloader {
+  public:
+    explicit BlockDownloader(PiecePicker& picker, RequestQueueOptions options = {});
+
+    /**
+     * @brief a connection completed its handshake; its bitfield and HAVEs are counted with
+     *        the picker by the caller
+     */
+    void AddPeer(PeerConnection& peer);
+
+    /**
+     * @brief the connection closed, its requests go back to the picker
+     */
+    void RemovePeer(PeerConnection& peer);
+
+    /**
+     * @brief call from onStateChanged: a choke drops the requests, an unchoke fills the pipeline
+     */
+    void OnStateChanged(PeerConnection& peer);
+
+    /**
+     * @brief call from onPiece, then refills the peer's pipeline
+     * @return true when this was the last block of the piece, hash it now
+     */
+    bool OnPiece(PeerConnection& peer, const peer_wire::BlockInfo& block);
+
+    /**
+     * @brief sends requests until the peer's pipeline is at its depth, e.g. after a HAVE or
+     *        after a piece failed its hash check
+     */
+    void Fill(PeerConnection& peer);
+
+    /**
+     * @brief call periodically, re-requests blocks that took too long
+     */
+    void ExpireRequests();
+
+    /**
+     * @return null if peer was not added
+     */
+    const RequestQueue* queue(const PeerConnection& peer) const;
+
+  private:
+    PiecePicker& _picker;
+    RequestQueueOptions _options;
+    std::unordered_map<PeerConnection*, RequestQueue> _peers;
+};
+
+} // namespace bt
@@ -0,0 +1,722 @@
+#include "disk_io.hpp"
+#include "piece_hashing.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace bt {
+
+using peer_wire::BlockSize;
+
+/**
+ * @return executor that keeps its io_context running while a job holds it, like a pending
+ *         asio operation does
+ */
+static asio::any_io_executor _Tracked(const asio::any_io_executor& executor) {
+    return asio::prefer(executor, asio::execution::outstanding_work.tracked);
+}
+
+/**
+ * @return error handed to a job's handler for e; failures that are not system errors, such as
+ *         std::bad_alloc, are reported as io_error instead of leaving the handler uncalled
+ */
+static std::error_code _ErrorCode(const std::exception& e) {
+    if (const auto* systemError = dynamic_cast<const std::system_error*>(&e)) {
+        return systemError->code();
+    }
+    return std::make_error_code(std::errc::io_error);
+}
+
+/**
+ * @brief runs work and posts handler with its error to executor
+ */
+template <typename Work, typename Handler>
+static void _Complete(asio::any_io_executor executor, Handler handler, Work work) {
+    std::error_code error;
+    try {
+        work();
+    } catch (const std::exception& e) {
+        error = _ErrorCode(e);
+    }
+    asio::post(executor, [handler = std::move(handler), error] { handler(error); });
+}
+
+/**
+ * @brief creates the wanted files from first to end of the layout's torrent, see
+ *        DiskIoService::AsyncAllocate
+ * @brief the files are opened for the allocation only, a storage of many files would
+ *        otherwise keep them all open
+ */
+static void _AllocateFiles(const StorageLayout& layout, size_t first, size_t end,
+                           const AllocationOptions& options) {
+    const FileTable& files = layout.torrent().files();
+    // files of a directory usually follow each other
+    std::filesystem::path directory;
+    for (size_t i = first; i < end; i++) {
+        if (files.isPadFile(i) || !layout.isWanted(i)) {
+            continue;
+        }
+        std::filesystem::path path = layout.filePath(i);
+        if (path.parent_path() != directory) {
+            directory = path.parent_path();
+            std::filesystem::create_directories(directory);
+        }
+        FileHandle file(path, FileMode::ReadWrite);
+        if (options.mode == AllocationMode::Full) {
+            file.Allocate(files.fileSize(i));
+        } else {
+            file.Extend(files.fileSize(i));
+        }
+    }
+}
+
+DiskIoService::Storage::Storage(const StorageLayout& layout)
+    : layout(layout), files(layout.torrent().files().size()),
+      writable(layout.torrent().files().size()) {
+}
+
+std::shared_ptr<const FileHandle> DiskIoService::Storage::File(size_t fileIndex, FileMode mode) {
+    std::lock_guard lock(mutex);
+    std::shared_ptr<const FileHandle>& file = files[fileIndex];
+    if (file && (mode == FileMode::Read || writable[fileIndex])) {
+        return file;
+    }
+    std::filesystem::path path = layout.storedPath(fileIndex);
+    if (mode == FileMode::Read) {
+        try {
+            file = std::make_shared<const FileHandle>(path);
+        } catch (const std::system_error& e) {
+            if (e.code() == std::errc::no_such_file_or_directory) {
+                throw std::system_error(asio::error::eof);
+            }
+            throw;
+        }
+        return file;
+    }
+    std::filesystem::create_directories(path.parent_path());
+    // readers still holding the read-only handle keep it open until they finish
+    file = std::make_shared<const FileHandle>(path, FileMode::ReadWrite);
+    writable[fileIndex] = true;
+    return file;
+}
+
+std::vector<IoUringQueue::FileIo> DiskIoService::Storage::Map(long long offset,
+                                                              std::span<std::byte> data,
+                                                              FileMode mode) {
+    std::vector<IoUringQueue::FileIo> ios;
+    size_t position = 0;
+    const FileTable& fileTable = layout.torrent().files();
+    for (FileSlice slice : fileTable.MapRange(offset, data.size())) {
+        if (slice.length == 0) {
+            continue;
+        }
+        if (fileTable.isPadFile(slice.fileIndex)) {
+            // never stored: reads get zeros, the zeros written are dropped
+            if (mode == FileMode::Read) {
+                std::fill_n(data.begin() + static_cast<ptrdiff_t>(position), slice.length,
+                            std::byte(0));
+            }
+            position += static_cast<size_t>(slice.length);
+            continue;
+        }
+        ios.push_back({File(slice.fileIndex, mode),
+                       layout.storedOffset(slice.fileIndex) + slice.offset,
+                       data.subspan(position, static_cast<size_t>(slice.length))});
+        position += static_cast<size_t>(slice.length);
+    }
+    return ios;
+}
+
+std::vector<IoUringQueue::FileIo> DiskIoService::Storage::Map(
+    long long offset, std::span<std::vector<std::byte>> buffers, FileMode mode) {
+    std::vector<IoUringQueue::FileIo> ios;
+    for (std::vector<std::byte>& buffer : buffers) {
+        for (IoUringQueue::FileIo& io : Map(offset, buffer, mode)) {
+            ios.push_back(std::move(io));
+        }
+        offset += static_cast<long long>(buffer.size());
+    }
+    return ios;
+}
+
+void DiskIoService::Storage::Read(long long offset, std::span<std::vector<std::byte>> buffers) {
+    std::vector<IoUringQueue::FileIo> ios = Map(offset, buffers, FileMode::Read);
+    // adjacent parts of a file are read with one call
+    std::vector<std::span<std::byte>> parts;
+    for (size_t first = 0, end = 0; first < ios.size(); first = end) {
+        parts.clear();
+        size_t length = 0;
+        for (end = first; end < ios.size() && ios[end].file == ios[first].file &&
+                          ios[end].offset == ios[first].offset + static_cast<long long>(length);
+             end++) {
+            parts.push_back(ios[end].buffer);
+            length += ios[end].buffer.size();
+        }
+        if (ios[first].file->ReadAt(ios[first].offset, parts) < length) {
+            throw std::system_error(asio::error::eof);
+        }
+    }
+}
+
+void DiskIoService::Storage::Read(long long offset, std::span<std::byte> out) {
+    for (const IoUringQueue::FileIo& io : Map(offset, out, FileMode::Read)) {
+        if (io.file->ReadAt(io.offset, io.buffer) < io.buffer.size()) {
+            throw std::system_error(asio::error::eof);
+        }
+    }
+}
+
+void DiskIoService::Storage::Write(long long offset, std::span<const std::byte> data) {
+    // Map only hands out mutable spans, they are only written from here
+    std::span<std::byte> bytes(const_cast<std::byte*>(data.data()), data.size());
+    for (const IoUringQueue::FileIo& io : Map(offset, bytes, FileMode::ReadWrite)) {
+        io.file->WriteAt(io.offset, io.buffer);
+    }
+}
+
+void DiskIoService::Storage::Write(long long offset,
+                                   std::span<const std::span<const std::byte>> buffers) {
+    long long length = 0;
+    for (std::span<const std::byte> buffer : buffers) {
+        length += static_cast<long long>(buffer.size());
+    }
+    // the buffers are cut where the files end
+    size_t buffer = 0;
+    size_t position = 0;
+    std::vector<std::span<const std::byte>> parts;
+    const FileTable& fileTable = layout.torrent().files();
+    for (FileSlice slice : fileTable.MapRange(offset, length)) {
+        parts.clear();
+        for (long long left = slice.length; left > 0;) {
+            std::span<const std::byte> part = buffers[buffer].subspan(
+                position, std::min<size_t>(static_cast<size_t>(left),
+                                           buffers[buffer].size() - position));
+            parts.push_back(part);
+            left -= static_cast<long long>(part.size());
+            position += part.size();
+            if (position == buffers[buffer].size()) {
+                buffer++;
+                position = 0;
+            }
+        }
+        if (!parts.empty() && !fileTable.isPadFile(slice.fileIndex)) {
+            File(slice.fileIndex, FileMode::ReadWrite)
+                ->WriteAt(layout.storedOffset(slice.fileIndex) + slice.offset, parts);
+        }
+    }
+}
+
+void DiskIoService::Storage::Write(const CachedPiece& piece) {
+    long long pieceOffset =
+        static_cast<long long>(piece.pieceIndex) * layout.torrent().pieceLength();
+    std::vector<std::span<const std::byte>> run;
+    uint32_t runBegin = 0;
+    uint32_t runEnd = 0;
+    for (const auto& [begin, data] : piece.blocks) {
+        if (!run.empty() && begin != runEnd) {
+            Write(pieceOffset + runBegin, run);
+            run.clear();
+        }
+        if (run.empty()) {
+            runBegin = begin;
+        }
+        run.push_back(data);
+        runEnd = begin + static_cast<uint32_t>(data.size());
+    }
+    if (!run.empty()) {
+        Write(pieceOffset + runBegin, run);
+    }
+}
+
+DiskIoService::DiskIoService(DiskIoOptions options)
+    : _options(options),
+      _ring(options.backend == DiskIoBackend::IoUring ? IoUringQueue::Create(options.ioUring)
+                                                      : nullptr),
+      _cache(options.writeCacheSize > 0 ? std::make_unique<WriteCache>(options.writeCacheSize)
+                                        : nullptr),
+      _readCache(options.readCacheSize > 0 ? std::make_unique<ReadCache>(options.readCacheSize)
+                                           : nullptr),
+      _pool(std::max<size_t>(options.threadsCount, 1)) {
+}
+
+DiskIoService::~DiskIoService() {
+    // the ring completes its queued jobs, whose reads use the caches declared after it
+    _ring.reset();
+    if (_cache == nullptr) {
+        return;
+    }
+    std::vector<CachedPiece> pieces;
+    {
+        std::lock_guard lock(_cacheMutex);
+        _closing = true;
+        pieces = _cache->TakeAll();
+    }
+    for (const CachedPiece& piece : pieces) {
+        try {
+            _WriteBack(piece);
+        } catch (const std::exception&) {
+            // nobody is left to tell, the piece is downloaded again after a recheck
+        }
+    }
+}
+
+DiskIoService::StorageId DiskIoService::AddStorage(const StorageLayout& layout) {
+    std::lock_guard lock(_mutex);
+    _storages.push_back(std::make_shared<Storage>(layout));
+    return _storages.size() - 1;
+}
+
+void DiskIoService::RemoveStorage(StorageId storage) {
+    {
+        std::lock_guard lock(_mutex);
+        if (storage < _storages.size()) {
+            _storages[storage].reset();
+        }
+    }
+    if (_cache) {
+        std::lock_guard lock(_cacheMutex);
+        _cache->TakeStorage(storage);
+    }
+    if (_readCache) {
+        std::lock_guard lock(_readCacheMutex);
+        _readCache->EraseStorage(storage);
+    }
+}
+
+void DiskIoService::AsyncRead(StorageId storage, const peer_wire::BlockInfo& block,
+                              asio::any_io_executor executor, ReadHandler handler) {
+    std::shared_ptr<Storage> target = _Storage(storage);
+    if (target == nullptr) {
+        asio::post(executor, [handler = std::move(handler)] {
+            handler(asio::error::operation_aborted, {});
+        });
+        return;
+    }
+    const TorrentMetadata& torrent = target->layout.torrent();
+    if (block.pieceIndex >= torrent.piecesCount() ||
+        block.begin + static_cast<long long>(block.length) > torrent.pieceSize(block.pieceIndex)) {
+        throw std::out_of_range("Block is outside of the torrent");
+    }
+    // with a read cache whole blocks are read, the requested one and those after it, each into
+    // a buffer of its own that the cache keeps
+    uint32_t readBegin = block.begin;
+    std::vector<std::vector<std::byte>> buffers;
+    if (_readCache) {
+        // looked up again by the job, reads queued before it may read the block ahead
+        std::optional<std::vector<std::byte>> cached = _FindCached(storage, block, false);
+        if (cached) {
+            asio::post(executor, [handler = std::move(handler), data = std::move(*cached)] {
+                handler({}, std::move(data));
+            });
+            return;
+        }
+        readBegin = block.begin - block.begin % BlockSize;
+        long long blocksEnd = (block.begin + block.length + BlockSize - 1) / BlockSize;
+        long long readEnd =
+            std::min(torrent.pieceSize(block.pieceIndex),
+                     (blocksEnd + static_cast<long long>(_options.readAheadBlocks)) * BlockSize);
+        for (long long position = readBegin; position < readEnd; position += BlockSize) {
+            buffers.emplace_back(
+                static_cast<size_t>(std::min<long long>(BlockSize, readEnd - position)));
+        }
+    } else {
+        buffers.emplace_back(block.length);
+    }
+    long long offset =
+        static_cast<long long>(block.pieceIndex) * torrent.pieceLength() + readBegin;
+    executor = _Tracked(executor);
+    if (_ring) {
+        auto reads = std::make_shared<std::vector<std::vector<std::byte>>>(std::move(buffers));
+        auto data = std::make_shared<std::vector<std::byte>>();
+        auto cached = std::make_shared<bool>(false);
+        _ring->Queue(
+            false,
+            [=, this] {
+                if (std::optional<std::vector<std::byte>> bytes = _FindCached(storage, block)) {
+                    *data = std::move(*bytes);
+                    *cached = true;
+                    return std::vector<IoUringQueue::FileIo>();
+                }
+                _Uncache(storage, block.pieceIndex);
+                return target->Map(offset, *reads, FileMode::Read);
+            },
+            [=, this, handler = std::move(handler)](std::error_code error) {
+                if (!error && !*cached) {
+                    try {
+                        *data = _CacheRead(storage, block, readBegin, std::move(*reads));
+                    } catch (const std::exception& e) {
+                        error = _ErrorCode(e);
+                    }
+                }
+                if (error) {
+                    data->clear();
+                }
+                asio::post(executor, [=] { handler(error, std::move(*data)); });
+            });
+        return;
+    }
+    _Queue(storage, offset,
+           [=, this, target = std::move(target), buffers = std::move(buffers),
+            handler = std::move(handler)]() mutable {
+               std::vector<std::byte> data;
+               std::error_code error;
+               try {
+                   if (std::optional<std::vector<std::byte>> cached = _FindCached(storage, block)) {
+                       data = std::move(*cached);
+                   } else {
+                       _Uncache(storage, block.pieceIndex);
+                       target->Read(offset, buffers);
+                       data = _CacheRead(storage, block, readBegin, std::move(buffers));
+                   }
+               } catch (const std::exception& e) {
+                   error = _ErrorCode(e);
+                   data.clear();
+               }
+               asio::post(executor, [handler, error, data = std::move(data)]() mutable {
+                   handler(error, std::move(data));
+               });
+           });
+}
+
+void DiskIoService::AsyncWrite(StorageId storage, uint32_t pieceIndex, uint32_t begin,
+                               std::vector<std::byte> data, asio::any_io_executor executor,
+                               Handler handler) {
+    std::shared_ptr<Storage> target = _Storage(storage);
+    if (target == nullptr) {
+        asio::post(executor,
+                   [handler = std::move(handler)] { handler(asio::error::operation_aborted); });
+        return;
+    }
+    const TorrentMetadata& torrent = target->layout.torrent();
+    if (pieceIndex >= torrent.piecesCount() ||
+        begin + static_cast<long long>(data.size()) > torrent.pieceSize(pieceIndex)) {
+        throw std::out_of_range("Block is outside of the torrent");
+    }
+    long long offset = static_cast<long long>(pieceIndex) * torrent.pieceLength() + begin;
+    if (_readCache) {
+        std::lock_guard lock(_readCacheMutex);
+        _readCache->Erase(storage, pieceIndex);
+    }
+    executor = _Tracked(executor);
+    if (_cache) {
+        _Queue(storage, offset,
+               [=, this, target = std::move(target), data = std::move(data),
+                handler = std::move(handler)]() mutable {
+                   _Complete(executor, handler, [&] {
+                       _CacheWrite(storage, *target, pieceIndex, begin, std::move(data));
+                   });
+               });
+        return;
+    }
+    if (_ring) {
+        auto bytes = std::make_shared<std::vector<std::byte>>(std::move(data));
+        _ring->Queue(
+            true, [=] { return target->Map(offset, *bytes, FileMode::ReadWrite); },
+            [=, handler = std::move(handler)](const std::error_code& error) {
+                asio::post(executor, [=] { handler(error); });
+            });
+        return;
+    }
+    _Queue(storage, offset,
+           [=, target = std::move(target), data = std::move(data),
+            handler = std::move(handler)] {
+               _Complete(executor, handler, [&] { target->Write(offset, data); });
+           });
+}
+
+void DiskIoService::AsyncHash(StorageId storage, uint32_t pieceIndex,
+                              asio::any_io_executor executor, HashHandler handler) {
+    std::shared_ptr<Storage> target = _Storage(storage);
+    if (target == nullptr) {
+        asio::post(executor, [handler = std::move(handler)] {
+            handler(asio::error::operation_aborted, false);
+        });
+        return;
+    }
+    const TorrentMetadata& torrent = target->layout.torrent();
+    if (pieceIndex >= torrent.piecesCount()) {
+        throw std::out_of_range("Piece is outside of the torrent");
+    }
+    long long offset = static_cast<long long>(pieceIndex) * torrent.pieceLength();
+    executor = _Tracked(executor);
+    _Queue(storage, offset, [=, this, target = std::move(target), handler = std::move(handler)] {
+        {
+            std::lock_guard lock(target->mutex);
+            auto verdict = target->verdicts.find(pieceIndex);
+            if (verdict != target->verdicts.end()) {
+                bool valid = verdict->second;
+                target->verdicts.erase(verdict);
+                asio::post(executor, [handler, valid] { handler({}, valid); });
+                return;
+            }
+        }
+        const TorrentMetadata& torrent = target->layout.torrent();
+        std::vector<std::byte> data(static_cast<size_t>(torrent.pieceSize(pieceIndex)));
+        std::error_code error;
+        bool valid = false;
+        try {
+            _Uncache(storage, pieceIndex);
+            target->Read(offset, data);
+            std::span<const std::byte> pieces[] = {data};
+            Sha1Digest digest;
+            HashPieces(pieces, std::span(&digest, 1));
+            std::span<const std::byte, Sha1Digest::Size> expected = torrent.pieceHash(pieceIndex);
+            valid = std::equal(expected.begin(), expected.end(), digest.bytes.begin());
+        } catch (const std::exception& e) {
+            error = _ErrorCode(e);
+        }
+        asio::post(executor, [handler, error, valid] { handler(error, valid); });
+    });
+}
+
+void DiskIoService::AsyncFlush(StorageId storage, asio::any_io_executor executor,
+                               Handler handler) {
+    std::shared_ptr<Storage> target = _Storage(storage);
+    if (target == nullptr) {
+        asio::post(executor,
+                   [handler = std::move(handler)] { handler(asio::error::operation_aborted); });
+        return;
+    }
+    executor = _Tracked(executor);
+    _Queue(storage, 0, [=, this, target = std::move(target), handler = std::move(handler)] {
+        _Complete(executor, handler, [&] {
+            if (_cache) {
+                std::vector<CachedPiece> pieces;
+                {
+                    std::lock_guard lock(_cacheMutex);
+                    pieces = _cache->TakeStorage(storage);
+                }
+                for (const CachedPiece& piece : pieces) {
+                    target->Write(piece);
+                }
+            }
+            std::vector<std::shared_ptr<const FileHandle>> files;
+            {
+                std::lock_guard lock(target->mutex);
+                for (size_t i = 0; i < target->files.size(); i++) {
+                    if (target->writable[i]) {
+                        files.push_back(target->files[i]);
+                    }
+                }
+            }
+            for (const std::shared_ptr<const FileHandle>& file : files) {
+                file->Sync();
+            }
+        });
+    });
+}
+
+void DiskIoService::AsyncAllocate(StorageId storage, AllocationOptions options,
+                                  asio::any_io_executor executor, Handler handler) {
+    std::shared_ptr<Storage> target = _Storage(storage);
+    if (target == nullptr) {
+        asio::post(executor,
+                   [handler = std::move(handler)] { handler(asio::error::operation_aborted); });
+        return;
+    }
+    const FileTable& files = target->layout.torrent().files();
+    executor = _Tracked(executor);
+
+    // a few runs per thread even out runs of large and small files, up to a run size that
+    // keeps the jobs of other torrents from waiting long
+    size_t runLength = std::clamp<size_t>(
+        (files.size() + 4 * _pool.size() - 1) / (4 * _pool.size()), 1, 1024);
+    size_t runsCount = std::max<size_t>((files.size() + runLength - 1) / runLength, 1);
+    struct Progress {
+        std::mutex mutex;
+        size_t runsLeft;
+        std::error_code error;
+    };
+    auto progress = std::make_shared<Progress>();
+    progress->runsLeft = runsCount;
+    for (size_t run = 0; run < runsCount; run++) {
+        size_t first = run * runLength;
+        size_t end = std::min(first + runLength, files.size());
+        _Queue(storage, first < files.size() ? files.fileOffset(first) : 0,
+               [=] {
+                   std::error_code error;
+                   try {
+                       _AllocateFiles(target->layout, first, end, options);
+                   } catch (const std::exception& e) {
+                       error = _ErrorCode(e);
+                   }
+                   std::lock_guard lock(progress->mutex);
+                   if (error && !progress->error) {
+                       progress->error = error;
+                   }
+                   if (--progress->runsLeft == 0) {
+                       asio::post(executor, [handler, error = progress->error] { handler(error); });
+                   }
+               });
+    }
+}
+
+size_t DiskIoService::pendingCount() const {
+    std::lock_guard lock(_mutex);
+    return _jobs.size();
+}
+
+size_t DiskIoService::cachedBytes() const {
+    if (_cache == nullptr) {
+        return 0;
+    }
+    std::lock_guard lock(_cacheMutex);
+    return _cache->size();
+}
+
+ReadCache::Stats DiskIoService::readCacheStats() const {
+    if (_readCache == nullptr) {
+        return {};
+    }
+    std::lock_guard lock(_readCacheMutex);
+    return _readCache->stats();
+}
+
+DiskIoBackend DiskIoService::backend() const {
+    return _ring ? DiskIoBackend::IoUring : DiskIoBackend::ThreadPool;
+}
+
+const IoUringQueue* DiskIoService::ring() const {
+    return _ring.get();
+}
+
+std::shared_ptr<DiskIoService::Storage> DiskIoService::_Storage(StorageId storage) const {
+    std::lock_guard lock(_mutex);
+    return storage < _storages.size() ? _storages[storage] : nullptr;
+}
+
+void DiskIoService::_Queue(StorageId storage, long long offset, std::function<void()> job) {
+    {
+        std::lock_guard lock(_mutex);
+        size_t sequence = _queuedCount++;
+        JobKey key = _options.sortJobs ? JobKey{storage, offset, sequence} : JobKey{0, 0, sequence};
+        _jobs.emplace(key, std::move(job));
+    }
+    // every post runs one job, whichever is next in the sweep when a thread is free
+    _pool.Post([this] { _RunNext(); });
+}
+
+void DiskIoService::_RunNext() {
+    std::function<void()> job;
+    {
+        std::lock_guard lock(_mutex);
+        auto it = _jobs.upper_bound(_position);
+        if (it == _jobs.end()) {
+            it = _jobs.begin();
+        }
+        _position = it->first;
+        job = std::move(it->second);
+        _jobs.erase(it);
+    }
+    job();
+}
+
+void DiskIoService::_CacheWrite(StorageId storage, Storage& target, uint32_t pieceIndex,
+                                uint32_t begin, std::vector<std::byte> data) {
+    const TorrentMetadata& torrent = target.layout.torrent();
+    long long pieceOffset = static_cast<long long>(pieceIndex) * torrent.pieceLength();
+    WriteCache::Insertion insertion;
+    bool closing;
+    {
+        std::lock_guard lock(_cacheMutex);
+        closing = _closing;
+        if (!closing) {
+            insertion = _cache->Insert(storage, pieceIndex, torrent.pieceSize(pieceIndex), begin,
+                                       std::move(data));
+            // the piece is downloaded again, an earlier verdict is stale; erased together with
+            // the insertion, so that it never erases the verdict of a block inserted after it
+            std::lock_guard storageLock(target.mutex);
+            target.verdicts.erase(pieceIndex);
+        }
+    }
+    if (closing) {
+        target.Write(pieceOffset + begin, data);
+        return;
+    }
+
+    // every evicted piece is written even if another one fails
+    std::optional<std::system_error> failure;
+    for (const CachedPiece& piece : insertion.evicted) {
+        try {
+            _WriteBack(piece);
+        } catch (const std::system_error& e) {
+            failure = failure.value_or(e);
+        }
+    }
+    if (insertion.completed) {
+        std::span<const std::byte, Sha1Digest::Size> expected = torrent.pieceHash(pieceIndex);
+        bool valid = std::equal(expected.begin(), expected.end(),
+                                insertion.completed->digest->bytes.begin());
+        if (valid) {
+            target.Write(*insertion.completed);
+        }
+        std::lock_guard lock(target.mutex);
+        target.verdicts[pieceIndex] = valid;
+    }
+    if (failure) {
+        throw *failure;
+    }
+}
+
+void DiskIoService::_Uncache(StorageId storage, uint32_t pieceIndex) {
+    if (_cache == nullptr) {
+        return;
+    }
+    std::optional<CachedPiece> piece;
+    {
+        std::lock_guard lock(_cacheMutex);
+        piece = _cache->Take(storage, pieceIndex);
+    }
+    if (piece) {
+        _WriteBack(*piece);
+    }
+}
+
+void DiskIoService::_WriteBack(const CachedPiece& piece) {
+    if (std::shared_ptr<Storage> target = _Storage(piece.storage)) {
+        target->Write(piece);
+    }
+}
+
+std::optional<std::vector<std::byte>> DiskIoService::_FindCached(
+    StorageId storage, const peer_wire::BlockInfo& block, bool countMiss) {
+    if (_readCache == nullptr) {
+        return std::nullopt;
+    }
+    std::lock_guard lock(_readCacheMutex);
+    return _readCache->Find(storage, block.pieceIndex, block.begin, block.length, countMiss);
+}
+
+std::vector<std::byte> DiskIoService::_CacheRead(StorageId storage,
+                                                 const peer_wire::BlockInfo& block,
+                                                 uint32_t readBegin,
+                                                 std::vector<std::vector<std::byte>> buffers) {
+    if (_readCache == nullptr) {
+        return std::move(buffers.front());
+    }
+    std::vector<std::byte> data;
+    data.reserve(block.length);
+    size_t position = readBegin;
+    for (const std::vector<std::byte>& buffer : buffers) {
+        size_t from = std::max<size_t>(block.begin, position);
+        size_t to = std::min<size_t>(block.begin + block.length, position + buffer.size());
+        if (from < to) {
+            data.insert(data.end(), buffer.begin() + static_cast<ptrdiff_t>(from - position),
+                        buffer.begin() + static_cast<ptrdiff_t>(to - position));
+        }
+        position += buffer.size();
+    }
+    std::lock_guard lock(_readCacheMutex);
+    uint32_t begin = readBegin;
+    for (std::vector<std::byte>& buffer : buffers) {
+        uint32_t length = static_cast<uint32_t>(buffer.size());
+        _readCache->Insert(storage, block.pieceIndex, begin, std::move(buffer),
+                           begin >= block.begin + block.length);
+        begin += length;
+    }
+    return data;
+}
+
+} // namespace bt
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <asio.hpp>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+#include "file_handle.hpp"
+#include "io_uring.hpp"
+#include "peer_wire.hpp"
+#include "read_cache.hpp"
+#include "storage_layout.hpp"
+#include "thread_pool.hpp"
+#include "write_cache.hpp"
+
+namespace bt {
+
+enum class DiskIoBackend {
+    ThreadPool, // blocking reads and writes on the threads
+    IoUring,    // reads and writes through IoUringQueue, Linux only
+};
+
+struct DiskIoOptions {
+    // disk jobs block, a few threads keep several requests in the device's queue
+    size_t threadsCount = 4;
+    // queued jobs run in order of torrent and offset like an elevator, instead of in FIFO order
+    bool sortJobs = true;
+    // falls back to ThreadPool where io_uring can not be used, see DiskIoService::backend()
+    DiskIoBackend backend = DiskIoBackend::ThreadPool;
+    IoUringOptions ioUring{};
+    // bytes of downloaded blocks held in memory until their piece is complete and verified, see
+    // WriteCache; 0 writes every block when it arrives. Cached writes run on the threads with
+    // either backend
+    size_t writeCacheSize = 0;
+    // bytes of read blocks kept for the next reads of them, see ReadCache; 0 reads every block
+    // from the files
+    size_t readCacheSize = 0;
+    // blocks after the requested one that a read that misses the read cache reads along with
+    // it, up to the end of the piece
+    size_t readAheadBlocks = 3;
+};
+
+enum class AllocationMode {
+    // files get their full size without disk space, see FileHandle::Extend; instant, suits SSDs
+    Sparse,
+    // disk space is reserved up front, see FileHandle::Allocate; blocks downloaded in random
+    // order then land in few extents instead of fragmenting the files on spinning disks
+    Full,
+};
+
+struct AllocationOptions {
+    AllocationMode mode = AllocationMode::Sparse;
+};
+
+/**
+ * @brief runs the blocking file work of torrents on its own threads, so that network threads
+ *        never wait for the disk
+ * @brief every job completes by posting its handler to the executor given with it, usually
+ *        the io_context of the connection that asked; jobs that are queued together run
+ *        sorted by file and offset, so jobs queued at the same time have no order: issue a
+ *        hash or flush from the completions of the writes it depends on
+ * @brief with the IoUring backend reads and writes go through the ring, which sorts what
+ *        was queued since its last submission; hashing, flushing and allocation stay on the
+ *        threads
+ * @brief with a write cache, blocks are gathered per piece and hashed as they arrive; a
+ *        complete piece is written with one vectored write per file if its hash matches and
+ *        dropped if not, and the next AsyncHash of it reports the outcome without reading
+ *        the piece back; partial pieces are written as they are when the cache is full, or
+ *        when they are read, hashed or flushed
+ * @brief with a read cache, a read it holds completes without a disk job; one it misses
+ *        reads the next blocks of the piece as well and caches them all; a write drops the
+ *        cached blocks of its piece, hashing bypasses the cache
+ * @brief pad files (BEP 47) are never stored: their bytes read as zeros and writes of them
+ *        are dropped
+ * @brief the bytes of files the layout does not want are read and written in its part file,
+ *        see StorageLayout::storedPath
+ * @brief thread safe
+ */
+class DiskIoService {
+  public:
+    using StorageId = size_t;
+    using Handler = std::function<void(const std::error_code&)>;
+    using ReadHandler = std::function<void(const std::error_code&, std::vector<std::byte> data)>;
+    using HashHandler = std::function<void(const std::error_code&, bool valid)>;
+
+    explicit DiskIoService(DiskIoOptions options = {});
+
+    /**
+     * @brief writes the cached blocks, runs the queued jobs, then joins the threads
+     */
+    ~DiskIoService();
+
+    DiskIoService(const DiskIoService&) = delete;
+    DiskIoService& operator=(const DiskIoService&) = delete;
+
+    /**
+     * @param layout must outlive the storage, files are opened on first use
+     */
+    StorageId AddStorage(const StorageLayout& layout);
+
+    /**
+     * @brief jobs queued later fail with asio::error::operation_aborted, the files are closed
+     *        once the jobs already running finish; cached blocks are dropped, flush first to
+     *        keep them
+     */
+    void RemoveStorage(StorageId storage);
+
+    /**
+     * @brief reads a block, e.g. to upload it; a missing or short file fails with
+     *        asio::error::eof
+     * @throws std::out_of_range if the block is not inside the torrent
+     */
+    void AsyncRead(StorageId storage, const peer_wire::BlockInfo& block,
+                   asio::any_io_executor executor, ReadHandler handler);
+
+    /**
+     * @brief writes a downloaded block, files and their directories are created as needed
+     * @brief with a write cache the handler runs once the block is cached, with the error of
+     *        any write it caused: of its piece if it completed it, or of the pieces it evicted
+     * @throws std::out_of_range if the data is not inside the piece
+     */
+    void AsyncWrite(StorageId storage, uint32_t pieceIndex, uint32_t begin,
+                    std::vector<std::byte> data, asio::any_io_executor executor,
+                    Handler handler);
+
+    /**
+     * @brief reads a piece and compares its SHA1 with the torrent's, or reports how the piece
+     *        was verified when its last block left the write cache
+     * @throws std::out_of_range if there is no such piece
+     */
+    void AsyncHash(StorageId storage, uint32_t pieceIndex, asio::any_io_executor executor,
+                   HashHandler handler);
+
+    /**
+     * @brief writes the storage's cached blocks, then waits until the data written to its open
+     *        files is on the disk
+     */
+    void AsyncFlush(StorageId storage, asio::any_io_executor executor, Handler handler);
+
+    /**
+     * @brief creates the files the layout wants at their full size, with their directories;
+     *        runs of files are set up by the threads together, so that torrents of many files
+     *        start quickly
+     * @brief the handler gets the first error, the other runs complete regardless
+     */
+    void AsyncAllocate(StorageId storage, AllocationOptions options,
+                       asio::any_io_executor executor, Handler handler);
+
+    /**
+     * @return jobs queued and not started yet, reads and writes queued on the ring excluded
+     */
+    size_t pendingCount() const;
+
+    /**
+     * @return bytes of blocks in the write cache
+     */
+    size_t cachedBytes() const;
+
+    /**
+     * @return hits and misses of the read cache, all 0 without one
+     */
+    ReadCache::Stats readCacheStats() const;
+
+    /**
+     * @return backend reads and writes actually use
+     */
+    DiskIoBackend backend() const;
+
+    /**
+     * @return null unless the IoUring backend is used
+     */
+    const IoUringQueue* ring() const;
+
+  private:
+    struct Storage {
+        explicit Storage(const StorageLayout& layout);
+
+        // a read-only file is opened again for writing by the first write
+        std::shared_ptr<const FileHandle> File(size_t fileIndex, FileMode mode);
+
+        /**
+         * @return parts of the files holding data at offset in the torrent, in order
+         * @throws std::system_error if a file can not be opened, with asio::error::eof if it is
+         *         missing and only read
+         */
+        std::vector<IoUringQueue::FileIo> Map(long long offset, std::span<std::byte> data,
+                                              FileMode mode);
+        // of buffers that follow each other from offset
+        std::vector<IoUringQueue::FileIo> Map(long long offset,
+                                              std::span<std::vector<std::byte>> buffers,
+                                              FileMode mode);
+
+        /**
+         * @throws std::system_error, with asio::error::eof if a file is missing or short
+         */
+        void Read(long long offset, std::span<std::byte> out);
+        void Read(long long offset, std::span<std::vector<std::byte>> buffers);
+        void Write(long long offset, std::span<const std::byte> data);
+        void Write(long long offset, std::span<const std::span<const std::byte>> buffers);
+
+        /**
+         * @brief writes the blocks, every run of adjacent ones with one call per file
+         */
+        void Write(const CachedPiece& piece);
+
+        const StorageLayout& layout;
+        std::mutex mutex;
+        std::vector<std::shared_ptr<const FileHandle>> files; // null until used
+        std::vector<bool> writable;
+        // whether pieces that completed in the write cache were valid, until hashed
+        std::map<uint32_t, bool> verdicts;
+    };
+
+    // storage, offset in the torrent, then the order jobs were queued in
+    using JobKey = std::tuple<StorageId, long long, size_t>;
+
+    std::shared_ptr<Storage> _Storage(StorageId storage) const;
+    void _Queue(StorageId storage, long long offset, std::function<void()> job);
+    void _RunNext();
+
+    /**
+     * @brief adds the block to the write cache, writes and verifies what that completes or
+     *        evicts; writes the block directly once the service is being destroyed
+     * @throws std::system_error with the first failed write
+     */
+    void _CacheWrite(StorageId storage, Storage& target, uint32_t pieceIndex, uint32_t begin,
+                     std::vector<std::byte> data);
+
+    /**
+     * @brief writes the cached blocks of the piece, if there are any
+     */
+    void _Uncache(StorageId storage, uint32_t pieceIndex);
+
+    /**
+     * @brief writes blocks that left the cache, unless their storage was removed
+     */
+    void _WriteBack(const CachedPiece& piece);
+
+    /**
+     * @return the block's bytes from the read cache, if it holds them
+     */
+    std::optional<std::vector<std::byte>> _FindCached(StorageId storage,
+                                                      const peer_wire::BlockInfo& block,
+                                                      bool countMiss = true);
+
+    /**
+     * @brief adds the buffers, whole blocks read from readBegin in the block's piece, to the
+     *        read cache; without one there is a single buffer with the block
+     * @return the block's bytes
+     */
+    std::vector<std::byte> _CacheRead(StorageId storage, const peer_wire::BlockInfo& block,
+                                      uint32_t readBegin,
+                                      std::vector<std::vector<std::byte>> buffers);
+
+    DiskIoOptions _options;
+    mutable std::mutex _mutex;
+    std::vector<std::shared_ptr<Storage>> _storages; // null once removed
+    std::map<JobKey, std::function<void()>> _jobs;
+    JobKey _position{}; // of the last job started, the sweep continues from there
+    size_t _queuedCount = 0;
+    std::unique_ptr<IoUringQueue> _ring; // reads and writes of the IoUring backend
+    mutable std::mutex _cacheMutex;
+    std::unique_ptr<WriteCache> _cache; // null without a write cache
+    bool _closing = false;              // blocks are no longer cached
+    mutable std::mutex _readCacheMutex;
+    std::unique_ptr<ReadCache> _readCache; // null without a read cache
+    ThreadPool _pool; // last, so its destructor runs the queued jobs while the rest is alive
+};
+
+} // namespace bt
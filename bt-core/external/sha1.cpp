@@ -6,6 +6,8 @@
 
 #include "sha1.h"
 
+#include "../sha1_backend.hpp"
+
 // big endian architectures need #define __BYTE_ORDER __BIG_ENDIAN
 #ifndef _MSC_VER
 #include <endian.h>
@@ -56,14 +58,27 @@ inline uint32_t swap(uint32_t x) {
 }
 }  // namespace
 
+/// process blocks of 64 bytes with the backend selected for this CPU
+void SHA1::processBlocks(const void* data, size_t numBlocks) {
+  bt::sha1_backend::Compress(m_hash, (const uint8_t*)data, numBlocks);
+}
+
+/// portable implementation, process numBlocks blocks of 64 bytes
+void SHA1::processBlocksScalar(uint32_t hash[HashValues], const void* data,
+                               size_t numBlocks) {
+  for (size_t block = 0; block < numBlocks; block++) {
+    processBlockScalar(hash, (const uint8_t*)data + block * BlockSize);
+  }
+}
+
 /// process 64 bytes
-void SHA1::processBlock(const void* data) {
+void SHA1::processBlockScalar(uint32_t hash[HashValues], const void* data) {
   // get last hash
-  uint32_t a = m_hash[0];
-  uint32_t b = m_hash[1];
-  uint32_t c = m_hash[2];
-  uint32_t d = m_hash[3];
-  uint32_t e = m_hash[4];
+  uint32_t a = hash[0];
+  uint32_t b = hash[1];
+  uint32_t c = hash[2];
+  uint32_t d = hash[3];
+  uint32_t e = hash[4];
 
   // data represented as 16x 32-bit words
   const uint32_t* input = (uint32_t*)data;
@@ -143,11 +158,11 @@ void SHA1::processBlock(const void* data) {
   }
 
   // update hash
-  m_hash[0] += a;
-  m_hash[1] += b;
-  m_hash[2] += c;
-  m_hash[3] += d;
-  m_hash[4] += e;
+  hash[0] += a;
+  hash[1] += b;
+  hash[2] += c;
+  hash[3] += d;
+  hash[4] += e;
 }
 
 /// add arbitrary number of bytes
@@ -163,7 +178,7 @@ void SHA1::add(const void* data, size_t numBytes) {
 
   // full buffer
   if (m_bufferSize == BlockSize) {
-    processBlock((void*)m_buffer);
+    processBlocks((void*)m_buffer, 1);
     m_numBytes += BlockSize;
     m_bufferSize = 0;
   }
@@ -171,12 +186,13 @@ void SHA1::add(const void* data, size_t numBytes) {
   // no more data ?
   if (numBytes == 0) return;
 
-  // process full blocks
-  while (numBytes >= BlockSize) {
-    processBlock(current);
-    current += BlockSize;
-    m_numBytes += BlockSize;
-    numBytes -= BlockSize;
+  // process full blocks in one go
+  size_t numBlocks = numBytes / BlockSize;
+  if (numBlocks > 0) {
+    processBlocks(current, numBlocks);
+    current += numBlocks * BlockSize;
+    m_numBytes += numBlocks * BlockSize;
+    numBytes -= numBlocks * BlockSize;
   }
 
   // keep remaining bytes in buffer
@@ -243,9 +259,9 @@ void SHA1::processBuffer() {
   *addLength = (unsigned char)(msgBits & 0xFF);
 
   // process blocks
-  processBlock(m_buffer);
+  processBlocks(m_buffer, 1);
   // flowed over into a second block ?
-  if (paddedLength > BlockSize) processBlock(extra);
+  if (paddedLength > BlockSize) processBlocks(extra, 1);
 }
 
 /// return latest hash as 40 hex characters
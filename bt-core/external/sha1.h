@@ -58,9 +58,15 @@ class SHA1  //: public Hash
   /// restart
   void reset();
 
+  /// portable compression of numBlocks blocks of 64 bytes into hash[5]
+  static void processBlocksScalar(uint32_t hash[], const void* data,
+                                  size_t numBlocks);
+
  private:
+  /// process blocks of 64 bytes
+  void processBlocks(const void* data, size_t numBlocks);
   /// process 64 bytes
-  void processBlock(const void* data);
+  static void processBlockScalar(uint32_t hash[], const void* data);
   /// process everything left in the internal buffer
   void processBuffer();
 
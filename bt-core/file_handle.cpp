@@ -0,0 +1,313 @@
+#include "file_handle.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace bt {
+
+static std::system_error _LastError(const char* what) {
+#ifdef _WIN32
+    return std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+#else
+    return std::system_error(errno, std::generic_category(), what);
+#endif
+}
+
+FileHandle::FileHandle(const std::filesystem::path& path, FileMode mode) {
+    bool write = mode == FileMode::ReadWrite;
+#ifdef _WIN32
+    _native = CreateFileW(path.c_str(), write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                          write ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_native == INVALID_HANDLE_VALUE) {
+        throw _LastError("Could not open file");
+    }
+#else
+    _native = write ? open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)
+                    : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_native < 0) {
+        throw _LastError("Could not open file");
+    }
+#endif
+}
+
+FileHandle::~FileHandle() {
+#ifdef _WIN32
+    CloseHandle(_native);
+#else
+    close(_native);
+#endif
+}
+
+FileHandle::Native FileHandle::native() const {
+    return _native;
+}
+
+size_t FileHandle::ReadAt(long long offset, std::span<std::byte> out) const {
+    size_t total = 0;
+    while (total < out.size()) {
+        size_t length = out.size() - total;
+#ifdef _WIN32
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD read = 0;
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(length, 1 << 30));
+        if (!ReadFile(_native, out.data() + total, chunk, &read, &overlapped)) {
+            if (GetLastError() == ERROR_HANDLE_EOF) {
+                break;
+            }
+            throw _LastError("Could not read file");
+        }
+#else
+        ssize_t read = pread(_native, out.data() + total, length, offset);
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read < 0) {
+            throw _LastError("Could not read file");
+        }
+#endif
+        if (read == 0) {
+            break;
+        }
+        total += static_cast<size_t>(read);
+        offset += read;
+    }
+    return total;
+}
+
+size_t FileHandle::ReadAt(long long offset, std::span<const std::span<std::byte>> buffers) const {
+    size_t total = 0;
+#ifdef _WIN32
+    for (std::span<std::byte> buffer : buffers) {
+        size_t read = ReadAt(offset + static_cast<long long>(total), buffer);
+        total += read;
+        if (read < buffer.size()) {
+            break;
+        }
+    }
+#else
+    std::vector<iovec> iovecs;
+    iovecs.reserve(buffers.size());
+    for (std::span<std::byte> buffer : buffers) {
+        if (!buffer.empty()) {
+            iovecs.push_back({buffer.data(), buffer.size()});
+        }
+    }
+    std::span<iovec> pending = iovecs;
+    while (!pending.empty()) {
+        int count = static_cast<int>(std::min<size_t>(pending.size(), IOV_MAX));
+        ssize_t read = preadv(_native, pending.data(), count, offset);
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read < 0) {
+            throw _LastError("Could not read file");
+        }
+        if (read == 0) {
+            break;
+        }
+        total += static_cast<size_t>(read);
+        offset += read;
+        // skips what was read, a short read may end inside a buffer
+        while (read > 0 && static_cast<size_t>(read) >= pending.front().iov_len) {
+            read -= static_cast<ssize_t>(pending.front().iov_len);
+            pending = pending.subspan(1);
+        }
+        if (read > 0) {
+            pending.front().iov_base = static_cast<std::byte*>(pending.front().iov_base) + read;
+            pending.front().iov_len -= static_cast<size_t>(read);
+        }
+    }
+#endif
+    return total;
+}
+
+void FileHandle::WriteAt(long long offset, std::span<const std::byte> data) const {
+    while (!data.empty()) {
+#ifdef _WIN32
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD written = 0;
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(data.size(), 1 << 30));
+        if (!WriteFile(_native, data.data(), chunk, &written, &overlapped)) {
+            throw _LastError("Could not write file");
+        }
+#else
+        ssize_t written = pwrite(_native, data.data(), data.size(), offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0) {
+            throw _LastError("Could not write file");
+        }
+#endif
+        data = data.subspan(static_cast<size_t>(written));
+        offset += written;
+    }
+}
+
+void FileHandle::WriteAt(long long offset,
+                         std::span<const std::span<const std::byte>> buffers) const {
+#ifdef _WIN32
+    for (std::span<const std::byte> buffer : buffers) {
+        WriteAt(offset, buffer);
+        offset += static_cast<long long>(buffer.size());
+    }
+#else
+    std::vector<iovec> iovecs;
+    iovecs.reserve(buffers.size());
+    for (std::span<const std::byte> buffer : buffers) {
+        if (!buffer.empty()) {
+            iovecs.push_back({const_cast<std::byte*>(buffer.data()), buffer.size()});
+        }
+    }
+    std::span<iovec> pending = iovecs;
+    while (!pending.empty()) {
+        int count = static_cast<int>(std::min<size_t>(pending.size(), IOV_MAX));
+        ssize_t written = pwritev(_native, pending.data(), count, offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0) {
+            throw _LastError("Could not write file");
+        }
+        offset += written;
+        // skips what was written, a short write may end inside a buffer
+        while (written > 0 && static_cast<size_t>(written) >= pending.front().iov_len) {
+            written -= static_cast<ssize_t>(pending.front().iov_len);
+            pending = pending.subspan(1);
+        }
+        if (written > 0) {
+            pending.front().iov_base = static_cast<std::byte*>(pending.front().iov_base) + written;
+            pending.front().iov_len -= static_cast<size_t>(written);
+        }
+    }
+#endif
+}
+
+void FileHandle::Allocate(long long length) const {
+    if (size() >= length) {
+        return;
+    }
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO allocation{};
+    allocation.AllocationSize.QuadPart = length;
+    FILE_END_OF_FILE_INFO endOfFile{};
+    endOfFile.EndOfFile.QuadPart = length;
+    if (!SetFileInformationByHandle(_native, FileAllocationInfo, &allocation,
+                                    sizeof(allocation)) ||
+        !SetFileInformationByHandle(_native, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile))) {
+        throw _LastError("Could not allocate file");
+    }
+#elif defined(__linux__)
+    int error = posix_fallocate(_native, 0, length);
+    if (error != 0) {
+        throw std::system_error(error, std::generic_category(), "Could not allocate file");
+    }
+#else
+    if (ftruncate(_native, length) != 0) {
+        throw _LastError("Could not allocate file");
+    }
+#endif
+}
+
+void FileHandle::Extend(long long length) const {
+    if (size() >= length) {
+        return;
+    }
+#ifdef _WIN32
+    FILE_END_OF_FILE_INFO endOfFile{};
+    endOfFile.EndOfFile.QuadPart = length;
+    if (!SetFileInformationByHandle(_native, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile))) {
+        throw _LastError("Could not extend file");
+    }
+#else
+    if (ftruncate(_native, length) != 0) {
+        throw _LastError("Could not extend file");
+    }
+#endif
+}
+
+void FileHandle::Sync() const {
+#ifdef _WIN32
+    if (!FlushFileBuffers(_native)) {
+        throw _LastError("Could not sync file");
+    }
+#elif defined(__APPLE__)
+    if (fsync(_native) != 0) {
+        throw _LastError("Could not sync file");
+    }
+#else
+    if (fdatasync(_native) != 0) {
+        throw _LastError("Could not sync file");
+    }
+#endif
+}
+
+long long FileHandle::size() const {
+#ifdef _WIN32
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(_native, &size)) {
+        throw _LastError("Could not get file size");
+    }
+    return size.QuadPart;
+#else
+    struct stat status {};
+    if (fstat(_native, &status) != 0) {
+        throw _LastError("Could not get file size");
+    }
+    return status.st_size;
+#endif
+}
+
+UploadSource::UploadSource(const StorageLayout& layout)
+    : _layout(layout), _files(layout.torrent().files().size()) {
+}
+
+std::vector<FileRange> UploadSource::Block(const peer_wire::BlockInfo& block) {
+    const TorrentMetadata& torrent = _layout.torrent();
+    if (block.pieceIndex >= torrent.piecesCount() ||
+        block.begin + static_cast<long long>(block.length) > torrent.pieceSize(block.pieceIndex)) {
+        throw std::out_of_range("Block is outside of the torrent");
+    }
+
+    std::vector<FileRange> ranges;
+    long long offset =
+        static_cast<long long>(block.pieceIndex) * torrent.pieceLength() + block.begin;
+    for (FileSlice slice : torrent.files().MapRange(offset, block.length)) {
+        if (slice.length == 0) {
+            continue;
+        }
+        if (torrent.files().isPadFile(slice.fileIndex)) {
+            ranges.push_back({nullptr, slice.offset, static_cast<size_t>(slice.length)});
+            continue;
+        }
+        std::shared_ptr<const FileHandle>& file = _files[slice.fileIndex];
+        if (!file) {
+            file = std::make_shared<const FileHandle>(_layout.storedPath(slice.fileIndex));
+        }
+        ranges.push_back({file, _layout.storedOffset(slice.fileIndex) + slice.offset,
+                          static_cast<size_t>(slice.length)});
+    }
+    return ranges;
+}
+
+} // namespace bt
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "peer_wire.hpp"
+#include "storage_layout.hpp"
+
+namespace bt {
+
+enum class FileMode {
+    Read,
+    ReadWrite, // the file is created if missing
+};
+
+/**
+ * @brief an open file, accessed at explicit offsets so it can be shared by any number of threads
+ */
+class FileHandle {
+  public:
+#ifdef _WIN32
+    using Native = void*;
+#else
+    using Native = int;
+#endif
+
+    /**
+     * @throws std::system_error if the file can not be opened
+     */
+    explicit FileHandle(const std::filesystem::path& path, FileMode mode = FileMode::Read);
+    ~FileHandle();
+
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+
+    Native native() const;
+
+    /**
+     * @return bytes read, less than out.size() only at the end of the file
+     * @throws std::system_error if the read fails
+     */
+    size_t ReadAt(long long offset, std::span<std::byte> out) const;
+
+    /**
+     * @brief reads into the buffers one after another starting at offset, with as few system
+     *        calls as the platform allows (preadv)
+     * @return bytes read, less than the buffers hold only at the end of the file
+     * @throws std::system_error if the read fails
+     */
+    size_t ReadAt(long long offset, std::span<const std::span<std::byte>> buffers) const;
+
+    /**
+     * @brief writes all of data, the file grows as needed
+     * @throws std::system_error if the write fails
+     */
+    void WriteAt(long long offset, std::span<const std::byte> data) const;
+
+    /**
+     * @brief writes the buffers one after another starting at offset, with as few system calls
+     *        as the platform allows (pwritev)
+     * @throws std::system_error if the write fails
+     */
+    void WriteAt(long long offset, std::span<const std::span<const std::byte>> buffers) const;
+
+    /**
+     * @brief reserves disk space for the first length bytes so later writes do not fragment the
+     *        file, where the platform can not reserve it only extends the file; never shrinks
+     * @throws std::system_error on failure, e.g. the disk is full
+     */
+    void Allocate(long long length) const;
+
+    /**
+     * @brief sets the size to length without reserving disk space, the unwritten bytes read as
+     *        zeros and take no space where the file system supports sparse files; never shrinks
+     * @throws std::system_error on failure
+     */
+    void Extend(long long length) const;
+
+    /**
+     * @brief waits until the written data is on the disk
+     * @throws std::system_error on failure
+     */
+    void Sync() const;
+
+    /**
+     * @throws std::system_error on failure
+     */
+    long long size() const;
+
+  private:
+    Native _native;
+};
+
+/**
+ * @brief bytes of a file, the file stays open as long as a range refers to it
+ */
+struct FileRange {
+    std::shared_ptr<const FileHandle> file; // null for bytes of a pad file, which are zeros
+    long long offset;
+    size_t length;
+};
+
+/**
+ * @brief finds the file ranges holding the blocks peers request from us
+ * @brief files are opened on first use and kept open; not thread safe
+ */
+class UploadSource {
+  public:
+    /**
+     * @param layout must outlive the source
+     */
+    explicit UploadSource(const StorageLayout& layout);
+
+    /**
+     * @return ranges of the files the block is stored in, in order; pad files are never
+     *         opened, their ranges have no file; files not wanted are read from the part file
+     * @throws std::system_error if a file can not be opened,
+     *         std::out_of_range if the block is not inside the torrent
+     */
+    std::vector<FileRange> Block(const peer_wire::BlockInfo& block);
+
+  private:
+    const StorageLayout& _layout;
+    std::vector<std::shared_ptr<const FileHandle>> _files; // by file index, null until used
+};
+
+} // namespace bt
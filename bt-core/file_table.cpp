@@ -0,0 +1,233 @@
+#include "file_table.hpp"
+
+#include <algorithm>
+#include <functional>
+
+namespace bt {
+
+FilePath::FilePath(const FileTable* table, std::span<const uint32_t> components)
+    : _table(table), _components(components) {
+}
+
+size_t FilePath::size() const {
+    return _components.size();
+}
+
+std::string_view FilePath::operator[](size_t index) const {
+    return _table->_Component(_components[index]);
+}
+
+std::string_view FilePath::back() const {
+    return _table->_Component(_components.back());
+}
+
+size_t FilePath::JoinedLength() const {
+    if (_components.empty()) {
+        return 0;
+    }
+    size_t length = _components.size() - 1; // delimeters
+    for (uint32_t id : _components) {
+        length += _table->_Component(id).size();
+    }
+    return length;
+}
+
+void FilePath::AppendTo(std::string& out, char delimeter) const {
+    out.reserve(out.size() + JoinedLength());
+    for (size_t i = 0; i < _components.size(); i++) {
+        if (i != 0) {
+            out.push_back(delimeter);
+        }
+        out.append(_table->_Component(_components[i]));
+    }
+}
+
+std::string FilePath::ToString(char delimeter) const {
+    std::string pathNameBuider;
+    AppendTo(pathNameBuider, delimeter);
+    return pathNameBuider;
+}
+
+FileSliceRange::Iterator::Iterator(const FileTable* table, size_t fileIndex, long long position,
+                                   long long remaining)
+    : _table(table), _fileIndex(fileIndex), _position(position), _remaining(remaining) {
+}
+
+FileSlice FileSliceRange::Iterator::operator*() const {
+    long long fileEnd = _table->fileOffset(_fileIndex + 1);
+    return FileSlice{_fileIndex, _position - _table->fileOffset(_fileIndex),
+                     std::min(_remaining, fileEnd - _position)};
+}
+
+FileSliceRange::Iterator& FileSliceRange::Iterator::operator++() {
+    long long covered = (**this).length;
+    _position += covered;
+    _remaining -= covered;
+    _fileIndex++;
+
+    // skip empty files, which start and end at _position
+    while (_remaining > 0 && _table->fileSize(_fileIndex) == 0) {
+        _fileIndex++;
+    }
+    return *this;
+}
+
+FileSliceRange::Iterator FileSliceRange::Iterator::operator++(int) {
+    Iterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+bool FileSliceRange::Iterator::operator==(const Iterator& other) const {
+    // all exhausted iterators are equal
+    if (_remaining == 0 || other._remaining == 0) {
+        return _remaining == other._remaining;
+    }
+    return _fileIndex == other._fileIndex && _position == other._position;
+}
+
+FileSliceRange::FileSliceRange(const FileTable* table, size_t firstFile, long long offset,
+                               long long length)
+    : _table(table), _firstFile(firstFile), _offset(offset), _length(length) {
+}
+
+FileSliceRange::Iterator FileSliceRange::begin() const {
+    return Iterator(_table, _firstFile, _offset, _length);
+}
+
+FileSliceRange::Iterator FileSliceRange::end() const {
+    return Iterator(_table, 0, 0, 0);
+}
+
+bool FileSliceRange::empty() const {
+    return _length == 0;
+}
+
+FileTable::FileTable() : _componentBegin{0}, _pathBegin{0}, _offsets{0} {
+}
+
+size_t FileTable::size() const {
+    return _pathBegin.size() - 1;
+}
+
+bool FileTable::empty() const {
+    return size() == 0;
+}
+
+long long FileTable::fileSize(size_t index) const {
+    return _offsets[index + 1] - _offsets[index];
+}
+
+long long FileTable::fileOffset(size_t index) const {
+    return _offsets[index];
+}
+
+long long FileTable::totalSize() const {
+    return _offsets.back();
+}
+
+std::span<const long long> FileTable::fileOffsets() const {
+    return _offsets;
+}
+
+FilePath FileTable::path(size_t index) const {
+    std::span<const uint32_t> nodes(_pathNodes);
+    return FilePath(this, nodes.subspan(_pathBegin[index], _pathBegin[index + 1] - _pathBegin[index]));
+}
+
+bool FileTable::isPadFile(size_t index) const {
+    return _padFiles[index];
+}
+
+FileSliceRange FileTable::MapRange(long long offset, long long length) const {
+    offset = std::clamp(offset, 0LL, totalSize());
+    length = std::clamp(length, 0LL, totalSize() - offset);
+
+    // last file starting at or before offset, empty files before it share its offset
+    auto it = std::upper_bound(_offsets.begin(), _offsets.end(), offset);
+    size_t firstFile = static_cast<size_t>(it - _offsets.begin()) - 1;
+    return FileSliceRange(this, firstFile, offset, length);
+}
+
+size_t FileTable::internedCount() const {
+    return _componentBegin.size() - 1;
+}
+
+size_t FileTable::memoryUsage() const {
+    return _arena.capacity() + _componentBegin.capacity() * sizeof(uint32_t) +
+           _pathNodes.capacity() * sizeof(uint32_t) + _pathBegin.capacity() * sizeof(uint32_t) +
+           _offsets.capacity() * sizeof(long long) + _padFiles.capacity() / 8;
+}
+
+std::string_view FileTable::_Component(uint32_t id) const {
+    return std::string_view(_arena).substr(_componentBegin[id],
+                                           _componentBegin[id + 1] - _componentBegin[id]);
+}
+
+void FileTable::Builder::Reserve(size_t filesCount) {
+    _table._pathBegin.reserve(filesCount + 1);
+    _table._offsets.reserve(filesCount + 1);
+    _table._padFiles.reserve(filesCount);
+}
+
+void FileTable::Builder::AddFile(std::span<const std::string_view> path, long long size,
+                                 bool padFile) {
+    for (std::string_view component : path) {
+        _table._pathNodes.push_back(_Intern(component));
+    }
+    _table._pathBegin.push_back(static_cast<uint32_t>(_table._pathNodes.size()));
+    _table._offsets.push_back(_table._offsets.back() + size);
+    _table._padFiles.push_back(padFile);
+}
+
+FileTable FileTable::Builder::Build() {
+    _internSlots = {};
+
+    FileTable table = std::move(_table);
+    table._arena.shrink_to_fit();
+    table._componentBegin.shrink_to_fit();
+    table._pathNodes.shrink_to_fit();
+
+    // leave the builder usable
+    _table = FileTable();
+    return table;
+}
+
+uint32_t FileTable::Builder::_Intern(std::string_view component) {
+    // keep load factor below 1/2
+    if ((_table.internedCount() + 1) * 2 > _internSlots.size()) {
+        _Grow();
+    }
+
+    size_t mask = _internSlots.size() - 1;
+    size_t slot = std::hash<std::string_view>{}(component) & mask;
+    while (_internSlots[slot] != 0) {
+        uint32_t id = _internSlots[slot] - 1;
+        if (_table._Component(id) == component) {
+            return id;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    uint32_t id = static_cast<uint32_t>(_table.internedCount());
+    _table._arena.append(component);
+    _table._componentBegin.push_back(static_cast<uint32_t>(_table._arena.size()));
+    _internSlots[slot] = id + 1;
+    return id;
+}
+
+void FileTable::Builder::_Grow() {
+    std::vector<uint32_t> slots(std::max<size_t>(64, _internSlots.size() * 2), 0);
+    size_t mask = slots.size() - 1;
+
+    for (uint32_t id = 0; id < _table.internedCount(); id++) {
+        size_t slot = std::hash<std::string_view>{}(_table._Component(id)) & mask;
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id + 1;
+    }
+    _internSlots = std::move(slots);
+}
+
+} // namespace bt
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bt {
+
+class FileTable;
+
+/**
+ * @brief part of a single file, covered by a byte range of the torrent
+ */
+struct FileSlice {
+    size_t fileIndex;
+    long long offset; // from the start of the file
+    long long length;
+
+    bool operator==(const FileSlice&) const = default;
+};
+
+/**
+ * @brief slices of the files covered by a byte range of the torrent, in file order
+ * @brief computed while iterating, so it does not allocate; empty files are skipped
+ */
+class FileSliceRange {
+  public:
+    class Iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = FileSlice;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = FileSlice;
+
+        Iterator() = default;
+        Iterator(const FileTable* table, size_t fileIndex, long long position, long long remaining);
+
+        FileSlice operator*() const;
+        Iterator& operator++();
+        Iterator operator++(int);
+
+        bool operator==(const Iterator& other) const;
+
+      private:
+        const FileTable* _table = nullptr;
+        size_t _fileIndex = 0;
+        long long _position = 0;  // in the torrent
+        long long _remaining = 0; // bytes not yet covered, 0 marks the end
+    };
+
+    FileSliceRange(const FileTable* table, size_t firstFile, long long offset, long long length);
+
+    Iterator begin() const;
+    Iterator end() const;
+
+    bool empty() const;
+
+  private:
+    const FileTable* _table;
+    size_t _firstFile;
+    long long _offset;
+    long long _length;
+};
+
+/**
+ * @brief relative path of a single file from a FileTable
+ * @brief cheap to copy view, components are interned strings of the table
+ */
+class FilePath {
+  public:
+    FilePath(const FileTable* table, std::span<const uint32_t> components);
+
+    /**
+     * @return count of path nodes, last one is the file name
+     */
+    size_t size() const;
+
+    std::string_view operator[](size_t index) const;
+
+    /**
+     * @return file name (last path node)
+     */
+    std::string_view back() const;
+
+    /**
+     * @return length of the path joined with single character delimeter
+     */
+    size_t JoinedLength() const;
+
+    /**
+     * @brief appends nodes joined with delimeter to out, without reallocating more than once
+     */
+    void AppendTo(std::string& out, char delimeter = '/') const;
+
+    /**
+     * @return concatinated string for relative path with delimeter
+     */
+    std::string ToString(char delimeter = '/') const;
+
+  private:
+    const FileTable* _table;
+    std::span<const uint32_t> _components;
+};
+
+/**
+ * @brief struct of arrays list of files of a torrent
+ * @brief path nodes are interned once into a single string arena and every file keeps
+ *        only indices into it, together with its cumulative byte offset in the torrent
+ */
+class FileTable {
+  public:
+    class Builder;
+
+    /**
+     * @brief empty table, use Builder to add files
+     */
+    FileTable();
+
+    /**
+     * @return count of files
+     */
+    size_t size() const;
+
+    bool empty() const;
+
+    /**
+     * @return size of file in bytes
+     */
+    long long fileSize(size_t index) const;
+
+    /**
+     * @return byte offset of file's first byte in the concatenated torrent data
+     */
+    long long fileOffset(size_t index) const;
+
+    /**
+     * @return sum of all file sizes
+     */
+    long long totalSize() const;
+
+    /**
+     * @return cumulative file offsets, size() + 1 entries ending with totalSize()
+     */
+    std::span<const long long> fileOffsets() const;
+
+    FilePath path(size_t index) const;
+
+    /**
+     * @return whether the file is padding (BEP 47 attribute "p"), whose bytes are all zero and
+     *         need not be stored
+     */
+    bool isPadFile(size_t index) const;
+
+    /**
+     * @brief finds the first file with binary search over the cumulative offsets
+     * @param offset in the concatenated torrent data
+     * @param length of the range, clamped to the end of the last file
+     * @return slices of all files the range spans
+     */
+    FileSliceRange MapRange(long long offset, long long length) const;
+
+    /**
+     * @return count of distinct path nodes stored in the arena
+     */
+    size_t internedCount() const;
+
+    /**
+     * @return bytes of heap memory held by the table
+     */
+    size_t memoryUsage() const;
+
+  private:
+    friend class FilePath;
+
+    std::string_view _Component(uint32_t id) const;
+
+    std::string _arena;                    // distinct path nodes back to back
+    std::vector<uint32_t> _componentBegin; // arena offset per node id, + end sentinel
+    std::vector<uint32_t> _pathNodes;      // node ids of every path back to back
+    std::vector<uint32_t> _pathBegin;      // first entry in _pathNodes per file, + end sentinel
+    std::vector<long long> _offsets;       // cumulative byte offsets, + total size
+    std::vector<bool> _padFiles;           // per file
+};
+
+/**
+ * @brief builds a FileTable one file at a time
+ */
+class FileTable::Builder {
+  public:
+    void Reserve(size_t filesCount);
+
+    void AddFile(std::span<const std::string_view> path, long long size, bool padFile = false);
+
+    FileTable Build();
+
+  private:
+    uint32_t _Intern(std::string_view component);
+
+    void _Grow();
+
+    FileTable _table;
+    // open addressing set of node ids + 1 (0 marks an empty slot), keyed by arena content
+    std::vector<uint32_t> _internSlots;
+};
+
+} // namespace bt
@@ -0,0 +1,411 @@
+#include "http_tracker.hpp"
+#include "awaitable.hpp"
+
+#include "external/bencode.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace bt {
+
+namespace http_tracker {
+
+static void _AppendPercentEncoded(std::string& out, std::span<const std::byte> bytes) {
+    static constexpr const char* hexDigits = "0123456789ABCDEF";
+    for (std::byte byte : bytes) {
+        out += '%';
+        out += hexDigits[std::to_integer<int>(byte) >> 4];
+        out += hexDigits[std::to_integer<int>(byte) & 0xf];
+    }
+}
+
+static std::string_view _EventName(AnnounceEvent event) {
+    switch (event) {
+    case AnnounceEvent::Completed:
+        return "completed";
+    case AnnounceEvent::Started:
+        return "started";
+    case AnnounceEvent::Stopped:
+        return "stopped";
+    default:
+        return "";
+    }
+}
+
+std::string BuildAnnounceUrl(std::string_view announceUrl, const AnnounceRequest& request) {
+    if (!announceUrl.starts_with("http://")) {
+        throw std::invalid_argument("not an http tracker: " + std::string(announceUrl));
+    }
+    std::string url(announceUrl);
+    url += announceUrl.find('?') == std::string_view::npos ? '?' : '&';
+
+    std::array<char, 60> infoHash = request.infoHash.ToPercentEncoded();
+    url += "info_hash=";
+    url.append(infoHash.data(), infoHash.size());
+    url += "&peer_id=";
+    _AppendPercentEncoded(url, request.peerId);
+    url += "&port=" + std::to_string(request.port);
+    url += "&uploaded=" + std::to_string(request.uploaded);
+    url += "&downloaded=" + std::to_string(request.downloaded);
+    url += "&left=" + std::to_string(request.left);
+    url += "&compact=1&no_peer_id=1";
+    if (request.peersWanted >= 0) {
+        url += "&numwant=" + std::to_string(request.peersWanted);
+    }
+    url += "&key=" + std::to_string(request.key);
+    if (request.event != AnnounceEvent::None) {
+        url += "&event=";
+        url += _EventName(request.event);
+    }
+    return url;
+}
+
+/**
+ * @param stride 6 for IPv4 addresses, 18 for IPv6, each followed by a 2 byte port
+ */
+static void _AppendCompactPeers(std::vector<asio::ip::tcp::endpoint>& peers,
+                                std::string_view compact, size_t stride) {
+    if (compact.size() % stride != 0) {
+        throw TrackerError("tracker sent a truncated compact peer list");
+    }
+    const auto* data = reinterpret_cast<const unsigned char*>(compact.data());
+    peers.reserve(peers.size() + compact.size() / stride);
+    for (size_t offset = 0; offset < compact.size(); offset += stride) {
+        const unsigned char* peer = data + offset;
+        asio::ip::address address;
+        if (stride == 6) {
+            asio::ip::address_v4::bytes_type bytes;
+            std::memcpy(bytes.data(), peer, bytes.size());
+            address = asio::ip::address_v4(bytes);
+        } else {
+            asio::ip::address_v6::bytes_type bytes;
+            std::memcpy(bytes.data(), peer, bytes.size());
+            address = asio::ip::address_v6(bytes);
+        }
+        uint16_t port = uint16_t(peer[stride - 2] << 8 | peer[stride - 1]);
+        peers.emplace_back(address, port);
+    }
+}
+
+AnnounceResponse ParseAnnounceResponse(std::string_view body) {
+    bencode::data_view data;
+    try {
+        data = bencode::decode_view(body);
+    } catch (const bencode::decode_error& e) {
+        throw TrackerError(std::string("tracker response is not bencoded: ") + e.what());
+    }
+    const auto* dict = std::get_if<bencode::dict_view>(&data);
+    if (dict == nullptr) {
+        throw TrackerError("tracker response is not a dictionary");
+    }
+    auto get = [&dict]<typename T>(std::string_view key, T) -> const T* {
+        auto it = (*dict)->find(key);
+        return it != (*dict)->end() ? std::get_if<T>(&it->second) : nullptr;
+    };
+
+    if (const auto* failure = get("failure reason", bencode::string_view{})) {
+        throw TrackerError("tracker refused the announce: " + std::string(*failure));
+    }
+
+    AnnounceResponse response;
+    const auto* interval = get("interval", bencode::integer_view{});
+    if (interval == nullptr || *interval < 0) {
+        throw TrackerError("tracker response has no interval");
+    }
+    response.interval = std::chrono::seconds(*interval);
+    if (const auto* minInterval = get("min interval", bencode::integer_view{})) {
+        response.minInterval = std::chrono::seconds(std::max(*minInterval, 0LL));
+    }
+    if (const auto* seeders = get("complete", bencode::integer_view{})) {
+        response.seeders = *seeders;
+    }
+    if (const auto* leechers = get("incomplete", bencode::integer_view{})) {
+        response.leechers = *leechers;
+    }
+    if (const auto* warning = get("warning message", bencode::string_view{})) {
+        response.warning = *warning;
+    }
+
+    if (const auto* compact = get("peers", bencode::string_view{})) {
+        _AppendCompactPeers(response.peers, *compact, 6);
+    } else if (const auto* list = get("peers", bencode::list_view{})) {
+        for (const bencode::data_view& item : *list) {
+            const auto* peer = std::get_if<bencode::dict_view>(&item);
+            if (peer == nullptr) {
+                continue;
+            }
+            auto ip = (*peer)->find("ip");
+            auto port = (*peer)->find("port");
+            if (ip == (*peer)->end() || port == (*peer)->end()) {
+                continue;
+            }
+            const auto* ipString = std::get_if<bencode::string_view>(&ip->second);
+            const auto* portValue = std::get_if<bencode::integer_view>(&port->second);
+            std::error_code error;
+            // host names are allowed by BEP 3 but no tracker sends them, they are skipped
+            asio::ip::address address =
+                ipString ? asio::ip::make_address(*ipString, error) : asio::ip::address();
+            if (ipString == nullptr || error || portValue == nullptr || *portValue < 0 ||
+                *portValue > 0xffff) {
+                continue;
+            }
+            response.peers.emplace_back(address, uint16_t(*portValue));
+        }
+    }
+    if (const auto* compact6 = get("peers6", bencode::string_view{})) {
+        _AppendCompactPeers(response.peers, *compact6, 18);
+    }
+    return response;
+}
+
+} // namespace http_tracker
+
+static bool _EqualsIgnoreCase(std::string_view a, std::string_view b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) ==
+               std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+/**
+ * @return value of an unsigned decimal or hexadecimal number, null if text is not one
+ */
+static std::optional<size_t> _ParseSize(std::string_view text, int base = 10) {
+    size_t value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    if (error != std::errc() || end == text.data()) {
+        return {};
+    }
+    return value;
+}
+
+HttpTrackerClient::HttpTrackerClient(asio::any_io_executor executor, HttpTrackerOptions options)
+    : _executor(std::move(executor)),
+      _options(options) {
+}
+
+asio::awaitable<AnnounceResponse> HttpTrackerClient::Announce(std::string announceUrl,
+                                                              AnnounceRequest request) {
+    Url url = _ParseUrl(http_tracker::BuildAnnounceUrl(announceUrl, request));
+    std::string body = co_await WithTimeout(_Get(std::move(url)), _options.timeout);
+    co_return http_tracker::ParseAnnounceResponse(body);
+}
+
+size_t HttpTrackerClient::idleConnectionsCount() const {
+    size_t count = 0;
+    for (const auto& [host, connections] : _idleConnections) {
+        count += connections.size();
+    }
+    return count;
+}
+
+HttpTrackerClient::Url HttpTrackerClient::_ParseUrl(std::string_view url) {
+    constexpr std::string_view scheme = "http://";
+    if (!url.starts_with(scheme)) {
+        throw std::invalid_argument("not an http tracker: " + std::string(url));
+    }
+    url.remove_prefix(scheme.size());
+    size_t targetBegin = std::min(url.find('/'), url.find('?'));
+    std::string_view authority = url.substr(0, targetBegin);
+    std::string_view target = targetBegin < url.size() ? url.substr(targetBegin) : "/";
+
+    Url result;
+    result.port = "80";
+    size_t portBegin = authority.rfind(':');
+    bool hasPort = portBegin != std::string_view::npos &&
+                   authority.find(']', portBegin) == std::string_view::npos;
+    if (hasPort) {
+        result.port = authority.substr(portBegin + 1);
+        authority = authority.substr(0, portBegin);
+    }
+    if (authority.starts_with('[') && authority.ends_with(']')) {
+        authority = authority.substr(1, authority.size() - 2); // IPv6 literal
+    }
+    if (authority.empty() || !_ParseSize(result.port)) {
+        throw std::invalid_argument("malformed tracker url: " + std::string(url));
+    }
+    result.host = authority;
+    result.target = target.starts_with('/') ? std::string(target) : "/" + std::string(target);
+    return result;
+}
+
+asio::awaitable<std::string> HttpTrackerClient::_Get(Url url) {
+    std::string hostKey = url.host + ":" + url.port;
+    for (;;) {
+        std::vector<asio::ip::tcp::socket>& idle = _idleConnections[hostKey];
+        bool reused = !idle.empty();
+        asio::ip::tcp::socket socket(_executor);
+        if (reused) {
+            socket = std::move(idle.back());
+            idle.pop_back();
+        } else {
+            asio::ip::tcp::resolver resolver(_executor);
+            auto endpoints =
+                co_await resolver.async_resolve(url.host, url.port, asio::use_awaitable);
+            co_await asio::async_connect(socket, endpoints, asio::use_awaitable);
+        }
+
+        Response response;
+        std::error_code error;
+        try {
+            response = co_await _Exchange(socket, url);
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+        if (error) {
+            // the tracker may have closed the idle connection in the meantime, that is
+            // only known once it is used, a new connection gets the request through
+            if (reused && error != asio::error::operation_aborted) {
+                continue;
+            }
+            throw std::system_error(error);
+        }
+
+        if (response.keepAlive) {
+            std::vector<asio::ip::tcp::socket>& idleNow = _idleConnections[hostKey];
+            if (idleNow.size() < _options.idleConnectionsPerHost) {
+                idleNow.push_back(std::move(socket));
+            }
+        }
+        if (response.status != 200) {
+            throw TrackerError("tracker answered with HTTP status " +
+                               std::to_string(response.status));
+        }
+        co_return std::move(response.body);
+    }
+}
+
+asio::awaitable<HttpTrackerClient::Response> HttpTrackerClient::_Exchange(
+    asio::ip::tcp::socket& socket, const Url& url) {
+    std::string request = "GET " + url.target + " HTTP/1.1\r\nHost: " + url.host;
+    if (url.port != "80") {
+        request += ":" + url.port;
+    }
+    request += "\r\nUser-Agent: BTorrent\r\nAccept-Encoding: identity\r\n"
+               "Connection: keep-alive\r\n\r\n";
+    co_await asio::async_write(socket, asio::buffer(request), asio::use_awaitable);
+
+    std::string buffer;
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        co_await _ReadSome(socket, buffer);
+    }
+    std::string_view header = std::string_view(buffer).substr(0, headerEnd + 2);
+
+    // HTTP/1.1 200 OK
+    Response response;
+    if (!header.starts_with("HTTP/1.") || header.size() < 12) {
+        throw TrackerError("tracker did not answer with HTTP");
+    }
+    bool http11 = header[7] != '0';
+    response.status = int(_ParseSize(header.substr(9, 3)).value_or(0));
+    response.keepAlive = http11;
+
+    std::optional<size_t> contentLength;
+    bool chunked = false;
+    for (size_t lineBegin = header.find("\r\n") + 2; lineBegin < header.size();) {
+        size_t lineEnd = header.find("\r\n", lineBegin);
+        std::string_view line = header.substr(lineBegin, lineEnd - lineBegin);
+        lineBegin = lineEnd + 2;
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+            value.remove_suffix(1);
+        }
+        if (_EqualsIgnoreCase(name, "content-length")) {
+            contentLength = _ParseSize(value);
+        } else if (_EqualsIgnoreCase(name, "transfer-encoding")) {
+            chunked = _EqualsIgnoreCase(value, "chunked");
+        } else if (_EqualsIgnoreCase(name, "connection")) {
+            if (_EqualsIgnoreCase(value, "close")) {
+                response.keepAlive = false;
+            } else if (_EqualsIgnoreCase(value, "keep-alive")) {
+                response.keepAlive = true;
+            }
+        }
+    }
+
+    size_t position = headerEnd + 4;
+    if (chunked) {
+        // chunk size in hex, chunk data, until a chunk of size 0
+        for (;;) {
+            size_t lineEnd;
+            while ((lineEnd = buffer.find("\r\n", position)) == std::string::npos) {
+                co_await _ReadSome(socket, buffer);
+            }
+            std::string_view sizeLine(buffer.data() + position, lineEnd - position);
+            std::optional<size_t> chunkSize =
+                _ParseSize(sizeLine.substr(0, sizeLine.find(';')), 16); // drops extensions
+            if (!chunkSize || *chunkSize > _options.maxResponseSize) {
+                throw TrackerError("tracker sent a malformed chunked response");
+            }
+            size_t chunkBegin = lineEnd + 2;
+            while (buffer.size() < chunkBegin + *chunkSize + 2) {
+                co_await _ReadSome(socket, buffer);
+            }
+            response.body.append(buffer, chunkBegin, *chunkSize);
+            position = chunkBegin + *chunkSize + 2;
+            if (*chunkSize == 0) {
+                // trailers are not used by trackers, the last line is empty
+                break;
+            }
+        }
+    } else if (contentLength) {
+        if (*contentLength > _options.maxResponseSize) {
+            throw TrackerError("tracker response is too large");
+        }
+        while (buffer.size() < position + *contentLength) {
+            co_await _ReadSome(socket, buffer);
+        }
+        response.body = buffer.substr(position, *contentLength);
+    } else {
+        // the body ends with the connection
+        response.keepAlive = false;
+        for (;;) {
+            try {
+                co_await _ReadSome(socket, buffer);
+            } catch (const std::system_error& e) {
+                if (e.code() != asio::error::eof) {
+                    throw;
+                }
+                break;
+            }
+        }
+        response.body = buffer.substr(position);
+    }
+    co_return response;
+}
+
+/**
+ * @brief appends what the socket has to buffer
+ * @throws TrackerError when the response gets larger than allowed
+ */
+asio::awaitable<void> HttpTrackerClient::_ReadSome(asio::ip::tcp::socket& socket,
+                                                   std::string& buffer) {
+    // room for the header on top of the body
+    if (buffer.size() > _options.maxResponseSize + 16 * 1024) {
+        throw TrackerError("tracker response is too large");
+    }
+    size_t size = buffer.size();
+    buffer.resize(size + 16 * 1024);
+    size_t bytesRead = 0;
+    try {
+        bytesRead = co_await socket.async_read_some(asio::buffer(buffer.data() + size, 16 * 1024),
+                                                    asio::use_awaitable);
+    } catch (...) {
+        buffer.resize(size);
+        throw;
+    }
+    buffer.resize(size + bytesRead);
+}
+
+} // namespace bt
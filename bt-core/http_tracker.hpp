@@ -0,0 +1,97 @@
+#pragma once
+
+#include <asio.hpp>
+#include <chrono>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tracker.hpp"
+
+namespace bt {
+
+namespace http_tracker {
+
+/**
+ * @brief appends the BEP 3 announce parameters to the tracker's url, asking for a compact
+ *        peer list (BEP 23)
+ * @throws std::invalid_argument if announceUrl is not an http:// url
+ */
+std::string BuildAnnounceUrl(std::string_view announceUrl, const AnnounceRequest& request);
+
+/**
+ * @brief decodes a bencoded announce response, peers may be compact (BEP 23), a list of
+ *        dicts (BEP 3) or compact IPv6 (peers6, BEP 7)
+ * @throws TrackerError with the tracker's failure reason, or if body is malformed
+ */
+AnnounceResponse ParseAnnounceResponse(std::string_view body);
+
+} // namespace http_tracker
+
+struct HttpTrackerOptions {
+    /**
+     * @brief limit for a whole announce, from resolving the host to the last byte of the answer
+     */
+    std::chrono::steady_clock::duration timeout = std::chrono::seconds(30);
+
+    /**
+     * @brief idle keep-alive connections kept per tracker host for the next announce
+     */
+    size_t idleConnectionsPerHost = 2;
+
+    /**
+     * @brief larger responses fail the announce
+     */
+    size_t maxResponseSize = 1024 * 1024;
+};
+
+/**
+ * @brief announces to HTTP trackers over HTTP/1.1
+ * @brief connections are kept alive and reused for the next announce to the same host, which
+ *        saves the TCP handshake when many torrents share a tracker
+ * @brief not thread safe, use it from coroutines of a single thread or strand
+ */
+class HttpTrackerClient {
+  public:
+    explicit HttpTrackerClient(asio::any_io_executor executor, HttpTrackerOptions options = {});
+
+    HttpTrackerClient(const HttpTrackerClient&) = delete;
+    HttpTrackerClient& operator=(const HttpTrackerClient&) = delete;
+
+    /**
+     * @throws TrackerError if the tracker refuses the announce or answers garbage,
+     *         std::system_error on network errors and asio::error::timed_out on timeout,
+     *         std::invalid_argument if announceUrl is not an http:// url
+     */
+    asio::awaitable<AnnounceResponse> Announce(std::string announceUrl, AnnounceRequest request);
+
+    /**
+     * @return idle connections kept for reuse, over all hosts
+     */
+    size_t idleConnectionsCount() const;
+
+  private:
+    struct Url {
+        std::string host;
+        std::string port;
+        std::string target; // path and query
+    };
+
+    struct Response {
+        int status = 0;
+        bool keepAlive = false;
+        std::string body;
+    };
+
+    static Url _ParseUrl(std::string_view url);
+    asio::awaitable<std::string> _Get(Url url);
+    asio::awaitable<Response> _Exchange(asio::ip::tcp::socket& socket, const Url& url);
+    asio::awaitable<void> _ReadSome(asio::ip::tcp::socket& socket, std::string& buffer);
+
+    asio::any_io_executor _executor;
+    HttpTrackerOptions _options;
+    std::map<std::string, std::vector<asio::ip::tcp::socket>> _idleConnections; // by host:port
+};
+
+} // namespace bt
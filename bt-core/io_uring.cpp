@@ -0,0 +1,511 @@
+#include "io_uring.hpp"
+
+#ifdef BT_IO_URING
+#include <algorithm>
+#include <asio/error.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace bt {
+
+#ifdef BT_IO_URING
+
+namespace {
+
+struct Job {
+    bool write;
+    std::function<std::vector<IoUringQueue::FileIo>()> prepare;
+    std::function<void(const std::error_code&)> done;
+    std::error_code error{};
+    size_t remaining = 0; // operations not completed yet
+};
+
+// one read or write of a job, after a short transfer the rest is submitted again
+struct Operation {
+    Job* job;
+    IoUringQueue::FileIo io;
+    int buffer = -1; // registered buffer
+    int slot = -1;   // in the registered file table
+};
+
+// user_data of the read of the wakeup eventfd, operations use their address
+constexpr uint64_t WakeupData = 0;
+
+int _Setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int _Enter(int ring, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(
+        syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int _Register(int ring, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ring, opcode, arg, count));
+}
+
+} // namespace
+
+struct IoUringQueue::Impl {
+    ~Impl();
+
+    /**
+     * @return false if the ring can not be set up
+     */
+    bool Setup();
+    void Run();
+
+    io_uring_sqe* _NextSqe();
+    void _ArmWakeup();
+    void _Submit(Operation* operation);
+    void _Complete(Operation* operation, int result);
+    int _Slot(const std::shared_ptr<const FileHandle>& file);
+    std::byte* _Buffer(int index);
+
+    IoUringOptions options;
+    int ring = -1;
+    int wakeup = -1; // eventfd, written when jobs are queued while the thread waits
+
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned sqLocalTail = 0;
+    unsigned toSubmit = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    void* buffers = MAP_FAILED;
+    size_t buffersSize = 0;
+    bool buffersRegistered = false;
+    std::vector<int> freeBuffers;
+
+    struct Slot {
+        std::shared_ptr<const FileHandle> file;
+        size_t users = 0; // operations in flight
+        uint64_t lastUse = 0;
+    };
+    bool filesRegistered = false;
+    std::vector<Slot> slots;
+    std::unordered_map<const FileHandle*, int> slotIndexes;
+    uint64_t useClock = 0;
+
+    std::mutex mutex;
+    std::vector<Job*> queued;
+    bool stopping = false;
+    std::atomic<bool> wakeupPending = false;
+    uint64_t wakeupValue = 0;
+
+    // only touched by the thread
+    std::deque<Operation*> waiting; // for room in the submission queue
+    size_t inFlight = 0;
+    std::atomic<size_t> submitCount = 0;
+    std::thread thread;
+};
+
+IoUringQueue::Impl::~Impl() {
+    if (ring >= 0) {
+        close(ring);
+    }
+    if (wakeup >= 0) {
+        close(wakeup);
+    }
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != MAP_FAILED && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != MAP_FAILED) {
+        munmap(sqRing, sqRingSize);
+    }
+    if (buffers != MAP_FAILED) {
+        munmap(buffers, buffersSize);
+    }
+}
+
+bool IoUringQueue::Impl::Setup() {
+    io_uring_params params{};
+    ring = _Setup(static_cast<unsigned>(std::max<size_t>(options.entries, 2)), &params);
+    // IORING_OP_READ and IORING_OP_WRITE came with the same kernel (5.6)
+    if (ring < 0 || !(params.features & IORING_FEAT_RW_CUR_POS)) {
+        return false;
+    }
+
+    sqEntries = params.sq_entries;
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                  IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        return false;
+    }
+    cqRing = singleMap ? sqRing
+                       : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES));
+    if (cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        return false;
+    }
+    auto sq = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqLocalTail = *sqTail;
+    auto cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    wakeup = eventfd(0, EFD_CLOEXEC);
+    if (wakeup < 0) {
+        return false;
+    }
+
+    // both registrations are optimizations, the kernel or RLIMIT_MEMLOCK may refuse them
+    if (options.registeredBuffers > 0 && options.bufferSize > 0) {
+        buffersSize = options.registeredBuffers * options.bufferSize;
+        buffers = mmap(nullptr, buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0);
+        if (buffers != MAP_FAILED) {
+            std::vector<iovec> iovecs(options.registeredBuffers);
+            for (size_t i = 0; i < iovecs.size(); i++) {
+                iovecs[i] = {_Buffer(static_cast<int>(i)), options.bufferSize};
+            }
+            buffersRegistered = _Register(ring, IORING_REGISTER_BUFFERS, iovecs.data(),
+                                          static_cast<unsigned>(iovecs.size())) == 0;
+        }
+        if (buffersRegistered) {
+            for (size_t i = options.registeredBuffers; i > 0; i--) {
+                freeBuffers.push_back(static_cast<int>(i - 1));
+            }
+        }
+    }
+    if (options.fixedFiles > 0) {
+        // a sparse table, slots are filled as files are used
+        std::vector<int> fds(options.fixedFiles, -1);
+        filesRegistered = _Register(ring, IORING_REGISTER_FILES, fds.data(),
+                                    static_cast<unsigned>(fds.size())) == 0;
+        if (filesRegistered) {
+            slots.resize(options.fixedFiles);
+        }
+    }
+    return true;
+}
+
+std::byte* IoUringQueue::Impl::_Buffer(int index) {
+    return static_cast<std::byte*>(buffers) + static_cast<size_t>(index) * options.bufferSize;
+}
+
+io_uring_sqe* IoUringQueue::Impl::_NextSqe() {
+    unsigned head = std::atomic_ref(*sqHead).load(std::memory_order_acquire);
+    if (sqLocalTail - head >= sqEntries) {
+        return nullptr;
+    }
+    unsigned index = sqLocalTail & sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    sqLocalTail++;
+    toSubmit++;
+    return sqe;
+}
+
+void IoUringQueue::Impl::_ArmWakeup() {
+    io_uring_sqe* sqe = _NextSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeup;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeupValue);
+    sqe->len = sizeof(wakeupValue);
+    sqe->user_data = WakeupData;
+}
+
+int IoUringQueue::Impl::_Slot(const std::shared_ptr<const FileHandle>& file) {
+    if (!filesRegistered) {
+        return -1;
+    }
+    auto it = slotIndexes.find(file.get());
+    int index = -1;
+    if (it != slotIndexes.end()) {
+        index = it->second;
+    } else {
+        // a free slot, or the one used least recently by no operation in flight
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (slots[i].users == 0 &&
+                (index < 0 || slots[i].lastUse < slots[static_cast<size_t>(index)].lastUse)) {
+                index = static_cast<int>(i);
+            }
+        }
+        if (index < 0) {
+            return -1;
+        }
+        int fd = file->native();
+        io_uring_files_update update{};
+        update.offset = static_cast<unsigned>(index);
+        update.fds = reinterpret_cast<uint64_t>(&fd);
+        if (_Register(ring, IORING_REGISTER_FILES_UPDATE, &update, 1) != 1) {
+            return -1;
+        }
+        Slot& slot = slots[static_cast<size_t>(index)];
+        if (slot.file) {
+            slotIndexes.erase(slot.file.get());
+        }
+        slot.file = file;
+        slotIndexes.emplace(file.get(), index);
+    }
+    Slot& slot = slots[static_cast<size_t>(index)];
+    slot.users++;
+    slot.lastUse = ++useClock;
+    return index;
+}
+
+void IoUringQueue::Impl::_Submit(Operation* operation) {
+    io_uring_sqe* sqe = _NextSqe();
+    bool write = operation->job->write;
+    std::span<std::byte> data = operation->io.buffer;
+    if (buffersRegistered && data.size() <= options.bufferSize && !freeBuffers.empty()) {
+        operation->buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+        if (write) {
+            std::memcpy(_Buffer(operation->buffer), data.data(), data.size());
+        }
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->addr = reinterpret_cast<uint64_t>(_Buffer(operation->buffer));
+        sqe->buf_index = static_cast<uint16_t>(operation->buffer);
+    } else {
+        sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->addr = reinterpret_cast<uint64_t>(data.data());
+    }
+    sqe->len = static_cast<uint32_t>(data.size());
+    sqe->off = static_cast<uint64_t>(operation->io.offset);
+    operation->slot = _Slot(operation->io.file);
+    if (operation->slot >= 0) {
+        sqe->fd = operation->slot;
+        sqe->flags = IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = operation->io.file->native();
+    }
+    sqe->user_data = reinterpret_cast<uint64_t>(operation);
+    inFlight++;
+}
+
+void IoUringQueue::Impl::_Complete(Operation* operation, int result) {
+    inFlight--;
+    Job* job = operation->job;
+    std::span<std::byte>& data = operation->io.buffer;
+    if (operation->slot >= 0) {
+        slots[static_cast<size_t>(operation->slot)].users--;
+        operation->slot = -1;
+    }
+    if (result >= 0 && operation->buffer >= 0 && !job->write) {
+        std::memcpy(data.data(), _Buffer(operation->buffer), static_cast<size_t>(result));
+    }
+    if (operation->buffer >= 0) {
+        freeBuffers.push_back(operation->buffer);
+        operation->buffer = -1;
+    }
+
+    if (result < 0) {
+        job->error = std::error_code(-result, std::generic_category());
+    } else if (result == 0 && !data.empty()) {
+        job->error = job->write ? std::make_error_code(std::errc::io_error)
+                                : std::error_code(asio::error::eof);
+    } else if (static_cast<size_t>(result) < data.size()) {
+        operation->io.offset += result;
+        data = data.subspan(static_cast<size_t>(result));
+        waiting.push_front(operation);
+        return;
+    }
+    delete operation;
+    if (--job->remaining == 0) {
+        job->done(job->error);
+        delete job;
+    }
+}
+
+void IoUringQueue::Impl::Run() {
+    _ArmWakeup();
+    for (;;) {
+        std::vector<Job*> batch;
+        bool stop;
+        {
+            std::lock_guard lock(mutex);
+            batch.swap(queued);
+            stop = stopping;
+        }
+
+        std::vector<Operation*> operations;
+        for (Job* job : batch) {
+            std::vector<FileIo> ios;
+            try {
+                ios = job->prepare();
+            } catch (const std::system_error& e) {
+                job->done(e.code());
+                delete job;
+                continue;
+            } catch (const std::exception&) {
+                // the job is done either way, its caller must not wait forever
+                job->done(std::make_error_code(std::errc::io_error));
+                delete job;
+                continue;
+            }
+            if (ios.empty()) {
+                job->done({});
+                delete job;
+                continue;
+            }
+            job->remaining = ios.size();
+            for (FileIo& io : ios) {
+                operations.push_back(new Operation{job, std::move(io)});
+            }
+        }
+        std::sort(operations.begin(), operations.end(), [](Operation* a, Operation* b) {
+            return std::make_pair(a->io.file.get(), a->io.offset) <
+                   std::make_pair(b->io.file.get(), b->io.offset);
+        });
+        waiting.insert(waiting.end(), operations.begin(), operations.end());
+
+        // the wakeup read keeps one entry, so completions never overflow the queue
+        while (!waiting.empty() && inFlight + 1 < sqEntries) {
+            _Submit(waiting.front());
+            waiting.pop_front();
+        }
+        if (stop && waiting.empty() && inFlight == 0) {
+            break;
+        }
+
+        // while operations wait for room, refill half the queue at once instead of one entry
+        // per completion
+        unsigned minComplete = waiting.empty() ? 1 : static_cast<unsigned>((inFlight + 1) / 2);
+        std::atomic_ref(*sqTail).store(sqLocalTail, std::memory_order_release);
+        int submitted = _Enter(ring, toSubmit, minComplete, IORING_ENTER_GETEVENTS);
+        if (submitted >= 0) {
+            toSubmit -= static_cast<unsigned>(submitted);
+        }
+        submitCount.fetch_add(1, std::memory_order_relaxed);
+
+        unsigned head = *cqHead;
+        unsigned tail = std::atomic_ref(*cqTail).load(std::memory_order_acquire);
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            if (cqe.user_data == WakeupData) {
+                wakeupPending = false;
+                _ArmWakeup();
+                continue;
+            }
+            _Complete(reinterpret_cast<Operation*>(cqe.user_data), cqe.res);
+        }
+        std::atomic_ref(*cqHead).store(head, std::memory_order_release);
+    }
+}
+
+std::unique_ptr<IoUringQueue> IoUringQueue::Create(IoUringOptions options) {
+    auto impl = std::make_unique<Impl>();
+    impl->options = options;
+    if (!impl->Setup()) {
+        return nullptr;
+    }
+    std::unique_ptr<IoUringQueue> queue(new IoUringQueue(std::move(impl)));
+    queue->_impl->thread = std::thread([impl = queue->_impl.get()] { impl->Run(); });
+    return queue;
+}
+
+IoUringQueue::~IoUringQueue() {
+    {
+        std::lock_guard lock(_impl->mutex);
+        _impl->stopping = true;
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = write(_impl->wakeup, &one, sizeof(one));
+    _impl->thread.join();
+}
+
+void IoUringQueue::Queue(bool write, std::function<std::vector<FileIo>()> prepare,
+                         std::function<void(const std::error_code&)> done) {
+    {
+        std::lock_guard lock(_impl->mutex);
+        _impl->queued.push_back(
+            new Job{.write = write, .prepare = std::move(prepare), .done = std::move(done)});
+    }
+    // one wakeup per turn of the thread is enough, it takes every job queued until then
+    if (!_impl->wakeupPending.exchange(true)) {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = ::write(_impl->wakeup, &one, sizeof(one));
+    }
+}
+
+size_t IoUringQueue::submitCount() const {
+    return _impl->submitCount.load(std::memory_order_relaxed);
+}
+
+bool IoUringQueue::registeredBuffers() const {
+    return _impl->buffersRegistered;
+}
+
+bool IoUringQueue::fixedFiles() const {
+    return _impl->filesRegistered;
+}
+
+#else
+
+struct IoUringQueue::Impl {};
+
+std::unique_ptr<IoUringQueue> IoUringQueue::Create(IoUringOptions) {
+    return nullptr;
+}
+
+IoUringQueue::~IoUringQueue() = default;
+
+void IoUringQueue::Queue(bool, std::function<std::vector<FileIo>()>,
+                         std::function<void(const std::error_code&)>) {
+}
+
+size_t IoUringQueue::submitCount() const {
+    return 0;
+}
+
+bool IoUringQueue::registeredBuffers() const {
+    return false;
+}
+
+bool IoUringQueue::fixedFiles() const {
+    return false;
+}
+
+#endif
+
+IoUringQueue::IoUringQueue(std::unique_ptr<Impl> impl) : _impl(std::move(impl)) {
+}
+
+} // namespace bt
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include "file_handle.hpp"
+
+namespace bt {
+
+struct IoUringOptions {
+    // submission queue entries, also the most operations in flight
+    size_t entries = 256;
+    // pinned buffers registered with the kernel, operations on up to bufferSize bytes go
+    // through them while one is free
+    size_t registeredBuffers = 64;
+    size_t bufferSize = 16 * 1024;
+    // slots of the registered file table, the least recently used file gives up its slot
+    size_t fixedFiles = 256;
+};
+
+/**
+ * @brief reads and writes files through a Linux io_uring driven by one thread
+ * @brief every turn of the thread's loop takes all newly queued jobs, sorts their operations
+ *        by file and offset and submits them together with a single io_uring_enter, which
+ *        also waits for completions; files are used through the registered file table and
+ *        data through registered buffers, so the kernel neither looks up the descriptor nor
+ *        pins the pages of every operation
+ * @brief thread safe
+ */
+class IoUringQueue {
+  public:
+    /**
+     * @brief part of a file a job reads into or writes from buffer, which has to live until
+     *        the job's completion
+     */
+    struct FileIo {
+        std::shared_ptr<const FileHandle> file;
+        long long offset;
+        std::span<std::byte> buffer;
+    };
+
+    /**
+     * @return null if io_uring can not be used, the platform or kernel lacks it or it is
+     *         disabled (e.g. by seccomp or the io_uring_disabled sysctl)
+     */
+    static std::unique_ptr<IoUringQueue> Create(IoUringOptions options = {});
+
+    /**
+     * @brief completes the queued jobs, then stops the thread
+     */
+    ~IoUringQueue();
+
+    IoUringQueue(const IoUringQueue&) = delete;
+    IoUringQueue& operator=(const IoUringQueue&) = delete;
+
+    /**
+     * @brief runs prepare on the ring's thread, it may block e.g. to open files; then reads
+     *        or writes every range it returns
+     * @param prepare throws std::system_error to fail the job
+     * @param done called on the ring's thread, with asio::error::eof for a read past the end
+     *        of a file
+     */
+    void Queue(bool write, std::function<std::vector<FileIo>()> prepare,
+               std::function<void(const std::error_code&)> done);
+
+    /**
+     * @return count of io_uring_enter calls so far, every one submitted a batch
+     */
+    size_t submitCount() const;
+
+    /**
+     * @return whether registered buffers and files are in use, the kernel may refuse them
+     */
+    bool registeredBuffers() const;
+    bool fixedFiles() const;
+
+  private:
+    struct Impl;
+
+    explicit IoUringQueue(std::unique_ptr<Impl> impl);
+
+    std::unique_ptr<Impl> _impl;
+};
+
+} // namespace bt
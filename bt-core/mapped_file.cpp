@@ -0,0 +1,125 @@
+#include "mapped_file.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace bt {
+
+MappedFile::MappedFile(const std::string& path) {
+    if (!_Map(path)) {
+        _Read(path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (!_mapped) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(_mappingHandle);
+#else
+    munmap(const_cast<char*>(_data), _size);
+#endif
+}
+
+std::string_view MappedFile::data() const {
+    return std::string_view(_data, _size);
+}
+
+bool MappedFile::isMapped() const {
+    return _mapped;
+}
+
+/**
+ * @return false if file is too small to be worth mapping or could not be mapped
+ * @throws std::runtime_error if file could not be opened
+ */
+bool MappedFile::_Map(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Could not open file");
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < LONGLONG(MapThreshold)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    // the mapping keeps its own reference to the file
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    _mappingHandle = mapping;
+    _data = static_cast<const char*>(view);
+    _size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file");
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) ||
+        fileStat.st_size < off_t(MapThreshold)) {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    // the parser reads the metainfo front to back exactly once
+    madvise(view, fileStat.st_size, MADV_SEQUENTIAL);
+
+    _data = static_cast<const char*>(view);
+    _size = static_cast<size_t>(fileStat.st_size);
+#endif
+    _mapped = true;
+    return true;
+}
+
+void MappedFile::_Read(const std::string& path) {
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file");
+    }
+    std::streamoff fileSize = file.tellg();
+    if (fileSize < 0) {
+        throw std::runtime_error("Could not read file");
+    }
+    file.seekg(0);
+
+    _size = static_cast<size_t>(fileSize);
+    _buffer = std::make_unique_for_overwrite<char[]>(_size);
+    if (!file.read(_buffer.get(), fileSize)) {
+        throw std::runtime_error("Could not read file");
+    }
+    _data = _buffer.get();
+}
+
+} // namespace bt
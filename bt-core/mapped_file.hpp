@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace bt {
+
+/**
+ * @brief read only contents of a whole file
+ * @brief files of at least MapThreshold bytes are memory mapped, smaller ones (and files
+ *        that can not be mapped) are read into a single heap buffer with one read
+ */
+class MappedFile {
+  public:
+    /**
+     * @brief below this size a read is cheaper than setting up a mapping, and keeping
+     *        thousands of small torrents loaded does not use up the process' mapping limit
+     */
+    static constexpr size_t MapThreshold = 1024 * 1024;
+
+    /**
+     * @param path of file to load
+     * @throws std::runtime_error if file could not be opened or read
+     */
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @return whole content of the file, valid as long as this object lives; when mapped, only
+     *         while the file is not truncated or written to, see torrent_parser::ParseFromFile
+     */
+    std::string_view data() const;
+
+    /**
+     * @return true if data() points into a memory mapping instead of a heap buffer
+     */
+    bool isMapped() const;
+
+  private:
+    bool _Map(const std::string& path);
+    void _Read(const std::string& path);
+
+    const char* _data = nullptr;
+    size_t _size = 0;
+    bool _mapped = false;
+    std::unique_ptr<char[]> _buffer; // used when not mapped
+#ifdef _WIN32
+    void* _mappingHandle = nullptr;
+#endif
+};
+
+} // namespace bt
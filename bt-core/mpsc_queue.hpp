@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace bt {
+
+/**
+ * @brief unbounded lock-free queue, any thread may push, a single thread pops
+ * @brief linked list of nodes with an atomic exchange on the head (Vyukov's MPSC queue):
+ *        Push is wait-free, TryPop may briefly see an empty queue while a Push is half done
+ */
+template <typename T>
+class MpscQueue {
+  public:
+    MpscQueue() : _head(&_stub), _tail(&_stub) {
+    }
+
+    ~MpscQueue() {
+        while (TryPop()) {
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * @brief safe to call from any thread
+     */
+    void Push(T value) {
+        _Push(new Node(std::move(value)));
+    }
+
+    /**
+     * @brief only called by the consumer thread
+     * @return oldest value or null if the queue is empty
+     */
+    std::optional<T> TryPop() {
+        Node* tail = _tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &_stub) {
+            if (next == nullptr) {
+                return {};
+            }
+            // skip the stub, it is pushed back once the queue runs empty
+            _tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            _tail = next;
+            return _Take(tail);
+        }
+        if (tail != _head.load(std::memory_order_acquire)) {
+            // a producer swapped the head but did not link its node yet
+            return {};
+        }
+        _Push(&_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            _tail = next;
+            return _Take(tail);
+        }
+        return {};
+    }
+
+  private:
+    struct Node {
+        Node() = default;
+        explicit Node(T&& value) : value(std::move(value)) {
+        }
+
+        std::atomic<Node*> next = nullptr;
+        std::optional<T> value; // empty in the stub
+    };
+
+    void _Push(Node* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* previous = _head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    std::optional<T> _Take(Node* node) {
+        std::optional<T> value = std::move(node->value);
+        delete node;
+        return value;
+    }
+
+    Node _stub;
+    alignas(64) std::atomic<Node*> _head; // producers
+    alignas(64) Node* _tail;              // consumer
+};
+
+} // namespace bt
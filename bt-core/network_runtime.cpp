@@ -0,0 +1,128 @@
+#include "network_runtime.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace bt {
+
+static thread_local std::optional<size_t> currentShard;
+
+/**
+ * @return false if the platform does not support pinning or the core does not exist
+ */
+static bool _PinToCore(std::thread& thread, size_t core) {
+#ifdef _WIN32
+    if (core >= sizeof(DWORD_PTR) * 8) {
+        return false;
+    }
+    return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << core) != 0;
+#elif defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus) == 0;
+#else
+    (void)thread;
+    (void)core;
+    return false;
+#endif
+}
+
+NetworkRuntime::NetworkRuntime(size_t shardsCount, bool pinThreads) {
+    shardsCount = ThreadPool::ResolveThreadsCount(shardsCount);
+    size_t coresCount = ThreadPool::ResolveThreadsCount(0);
+
+    _shards.reserve(shardsCount);
+    for (size_t i = 0; i < shardsCount; i++) {
+        _shards.push_back(std::make_unique<Shard>());
+    }
+    for (size_t i = 0; i < shardsCount; i++) {
+        Shard& shard = *_shards[i];
+        shard.thread = std::thread([&shard, i] {
+            currentShard = i;
+            // keeps run() from returning while the shard has no connections
+            auto work = asio::make_work_guard(shard.ioContext);
+            shard.ioContext.run();
+        });
+        if (pinThreads && shardsCount <= coresCount && !_PinToCore(shard.thread, i)) {
+            LogDebug("could not pin network shard {} to its core", i);
+        }
+    }
+}
+
+NetworkRuntime::~NetworkRuntime() {
+    Stop();
+}
+
+size_t NetworkRuntime::size() const {
+    return _shards.size();
+}
+
+asio::io_context& NetworkRuntime::context(size_t shard) {
+    return _shards[shard]->ioContext;
+}
+
+size_t NetworkRuntime::NextShard() {
+    return _nextShard.fetch_add(1, std::memory_order_relaxed) % _shards.size();
+}
+
+std::optional<size_t> NetworkRuntime::CurrentShard() {
+    return currentShard;
+}
+
+void NetworkRuntime::Post(size_t shard, std::function<void()> task) {
+    Shard& target = *_shards[shard];
+    target.inbox.Push(std::move(task));
+    // only the first task of a burst wakes the shard up through the io_context; seq_cst pairs
+    // with the fence in _Drain, so either this sees the flag cleared or the drain sees the task
+    if (!target.drainScheduled.exchange(true, std::memory_order_seq_cst)) {
+        asio::post(target.ioContext, [this, &target] { _Drain(target); });
+    }
+}
+
+void NetworkRuntime::Broadcast(const std::function<void(size_t shard)>& task) {
+    for (size_t shard = 0; shard < _shards.size(); shard++) {
+        Post(shard, [task, shard] { task(shard); });
+    }
+}
+
+void NetworkRuntime::Stop() {
+    if (_stopped) {
+        return;
+    }
+    _stopped = true;
+    for (auto& shard : _shards) {
+        // runs after everything already queued on the shard
+        asio::post(shard->ioContext, [&ioContext = shard->ioContext] { ioContext.stop(); });
+    }
+    for (auto& shard : _shards) {
+        shard->thread.join();
+    }
+}
+
+void NetworkRuntime::_Drain(Shard& shard) {
+    // cleared first, a task pushed while draining schedules another drain instead of being lost
+    shard.drainScheduled.store(false, std::memory_order_relaxed);
+    // keeps the loads of TryPop from moving before the clear: otherwise a Post could still
+    // see the flag set while the loop below already found the queue empty, and its task would
+    // wait for an unrelated later Post
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (std::optional<std::function<void()>> task = shard.inbox.TryPop()) {
+        try {
+            (*task)();
+        } catch (std::exception& e) {
+            LogError("network task failed: {}", e.what());
+        }
+    }
+}
+
+} // namespace bt
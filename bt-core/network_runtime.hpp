@@ -0,0 +1,91 @@
+#pragma once
+
+#include <asio.hpp>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "mpsc_queue.hpp"
+
+namespace bt {
+
+/**
+ * @brief runs one io_context per core, each on its own thread, optionally pinned to a core
+ * @brief every peer connection lives on a single shard and its state is only touched by that
+ *        shard's thread, so the hot path takes no locks; shards talk to each other through
+ *        lock-free queues (Post, Broadcast)
+ */
+class NetworkRuntime {
+  public:
+    /**
+     * @param shardsCount 0 for one shard per hardware thread
+     * @param pinThreads pins shard i to core i where the platform supports it
+     */
+    explicit NetworkRuntime(size_t shardsCount = 0, bool pinThreads = true);
+
+    /**
+     * @brief stops the shards, see Stop
+     */
+    ~NetworkRuntime();
+
+    NetworkRuntime(const NetworkRuntime&) = delete;
+    NetworkRuntime& operator=(const NetworkRuntime&) = delete;
+
+    /**
+     * @return count of shards
+     */
+    size_t size() const;
+
+    /**
+     * @return io_context of shard, run only by that shard's thread
+     */
+    asio::io_context& context(size_t shard);
+
+    /**
+     * @return shards in turn, for spreading new connections evenly
+     */
+    size_t NextShard();
+
+    /**
+     * @return shard the calling thread runs, or null when called from outside the runtime
+     */
+    static std::optional<size_t> CurrentShard();
+
+    /**
+     * @brief runs task on shard, safe to call from any thread
+     * @brief tasks posted to a shard run in order, a burst of them is handed over with a
+     *        single wakeup of the shard
+     */
+    void Post(size_t shard, std::function<void()> task);
+
+    /**
+     * @brief runs task(shard) once on every shard, e.g. to send a HAVE to all peers
+     */
+    void Broadcast(const std::function<void(size_t shard)>& task);
+
+    /**
+     * @brief lets the shards finish the handlers already queued, then joins the threads;
+     *        connections still open are abandoned, close them first for a clean shutdown
+     */
+    void Stop();
+
+  private:
+    struct Shard {
+        asio::io_context ioContext{1}; // run by a single thread, no internal locking needed
+        MpscQueue<std::function<void()>> inbox;
+        std::atomic<bool> drainScheduled = false;
+        std::thread thread;
+    };
+
+    void _Drain(Shard& shard);
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+    std::atomic<size_t> _nextShard = 0;
+    bool _stopped = false;
+};
+
+} // namespace bt
@@ -0,0 +1,112 @@
+#include "peer_channel.hpp"
+
+namespace bt {
+
+PeerChannel::PeerChannel(asio::io_context& ioContext, const asio::ip::tcp::endpoint& endpoint,
+                         PeerConnection::Options options)
+    : _connection(PeerConnection::Connect(ioContext, endpoint, std::move(options), _Callbacks())),
+      _eventSignal(_connection->executor()),
+      _writeSignal(_connection->executor()) {
+}
+
+PeerChannel::PeerChannel(asio::ip::tcp::socket socket, PeerConnection::Options options)
+    : _connection(PeerConnection::Accept(std::move(socket), std::move(options), _Callbacks())),
+      _eventSignal(_connection->executor()),
+      _writeSignal(_connection->executor()) {
+}
+
+PeerChannel::~PeerChannel() {
+    // the connection outlives the channel until its handlers ran, the callbacks must not fire
+    Close();
+}
+
+asio::any_io_executor PeerChannel::executor() {
+    return _connection->executor();
+}
+
+PeerConnection& PeerChannel::connection() {
+    return *_connection;
+}
+
+asio::awaitable<PeerChannel::Event> PeerChannel::ReadEvent() {
+    while (_events.empty()) {
+        _ThrowIfClosed();
+        co_await _Wait(_eventSignal);
+    }
+    Event event = std::move(_events.front());
+    _events.pop_front();
+    co_return event;
+}
+
+asio::awaitable<void> PeerChannel::Flush() {
+    for (;;) {
+        // messages queued on a closed connection are dropped
+        _ThrowIfClosed();
+        if (!_connection->writePending()) {
+            co_return;
+        }
+        co_await _Wait(_writeSignal);
+    }
+}
+
+void PeerChannel::Close() {
+    _connection->Close();
+}
+
+/**
+ * @brief the callbacks only run on the connection's executor, after the constructor returned
+ */
+PeerConnection::Callbacks PeerChannel::_Callbacks() {
+    using Type = Event::Type;
+    PeerConnection::Callbacks callbacks;
+    callbacks.onConnected = [this](PeerConnection&) { _Push({.type = Type::Connected}); };
+    callbacks.onStateChanged = [this](PeerConnection&) { _Push({.type = Type::StateChanged}); };
+    callbacks.onBitfield = [this](PeerConnection&) { _Push({.type = Type::Bitfield}); };
+    callbacks.onHave = [this](PeerConnection&, uint32_t pieceIndex) {
+        _Push({.type = Type::Have, .pieceIndex = pieceIndex});
+    };
+    callbacks.onRequest = [this](PeerConnection&, const peer_wire::BlockInfo& block) {
+        _Push({.type = Type::Request, .block = block});
+    };
+    callbacks.onCancel = [this](PeerConnection&, const peer_wire::BlockInfo& block) {
+        _Push({.type = Type::Cancel, .block = block});
+    };
+    callbacks.onPiece = [this](PeerConnection&, const peer_wire::BlockInfo& block,
+                               std::span<const std::byte> data) {
+        // the payload only lives until the callback returns
+        _Push({.type = Type::Piece, .block = block, .data = {data.begin(), data.end()}});
+    };
+    callbacks.onWritten = [this](PeerConnection&) { _writeSignal.cancel(); };
+    callbacks.onClosed = [this](PeerConnection&, const std::error_code& error) {
+        _closeError = error;
+        _eventSignal.cancel();
+        _writeSignal.cancel();
+    };
+    return callbacks;
+}
+
+void PeerChannel::_Push(Event event) {
+    _events.push_back(std::move(event));
+    _eventSignal.cancel();
+}
+
+void PeerChannel::_ThrowIfClosed() const {
+    if (_connection->state() == PeerConnection::State::Closed) {
+        throw std::system_error(_closeError);
+    }
+}
+
+/**
+ * @brief waits until signal is cancelled
+ * @throws std::system_error operation_aborted if the calling coroutine was cancelled
+ */
+asio::awaitable<void> PeerChannel::_Wait(asio::steady_timer& signal) {
+    signal.expires_at(asio::steady_timer::time_point::max());
+    co_await signal.async_wait(asio::as_tuple(asio::use_awaitable));
+    asio::cancellation_state state = co_await asio::this_coro::cancellation_state;
+    if (state.cancelled() != asio::cancellation_type::none) {
+        throw std::system_error(asio::error::operation_aborted);
+    }
+}
+
+} // namespace bt
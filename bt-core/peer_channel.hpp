@@ -0,0 +1,102 @@
+#pragma once
+
+#include <asio.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include "peer_connection.hpp"
+#include "peer_wire.hpp"
+
+namespace bt {
+
+/**
+ * @brief PeerConnection as coroutines: the events its callbacks report are queued and read with
+ *        co_await ReadEvent(), so a peer session reads top to bottom on the same asynchronous
+ *        connection, zero-copy uploads included
+ * @brief the waits fail with operation_aborted when the calling coroutine is cancelled through
+ *        its cancellation slot, wrap them in WithTimeout to bound them (see awaitable.hpp)
+ * @brief not thread safe, like PeerConnection: use it from coroutines spawned on executor(); at
+ *        most one ReadEvent() and one Flush() may be waiting at a time
+ */
+class PeerChannel {
+  public:
+    struct Event {
+        enum class Type {
+            Connected,
+            StateChanged, // see PeerConnection::peerChoking() and peerInterested()
+            Bitfield,     // see PeerConnection::peerPieces()
+            Have,
+            Request,
+            Cancel,
+            Piece,
+        };
+
+        Type type;
+        uint32_t pieceIndex = 0;          // Have
+        peer_wire::BlockInfo block = {};  // Request, Cancel, Piece
+        std::vector<std::byte> data = {}; // Piece
+    };
+
+    /**
+     * @brief opens a connection to endpoint and sends the handshake, spawn the coroutines
+     *        using the channel on executor()
+     */
+    PeerChannel(asio::io_context& ioContext, const asio::ip::tcp::endpoint& endpoint,
+                PeerConnection::Options options);
+
+    /**
+     * @brief takes over an accepted socket, see PeerConnection::Accept
+     */
+    PeerChannel(asio::ip::tcp::socket socket, PeerConnection::Options options);
+
+    /**
+     * @brief closes the connection
+     */
+    ~PeerChannel();
+
+    PeerChannel(const PeerChannel&) = delete;
+    PeerChannel& operator=(const PeerChannel&) = delete;
+
+    asio::any_io_executor executor();
+
+    /**
+     * @return the connection, for its state and to queue messages
+     */
+    PeerConnection& connection();
+
+    /**
+     * @brief waits for the next event; the events received before the connection closed are
+     *        all read before the close is reported
+     * @throws std::system_error with the error the connection closed with (operation_aborted
+     *         after Close()), or operation_aborted if the calling coroutine is cancelled
+     */
+    asio::awaitable<Event> ReadEvent();
+
+    /**
+     * @brief waits until the messages queued on connection() are written
+     * @throws std::system_error with the error the connection closed with, or
+     *         operation_aborted if the calling coroutine is cancelled
+     */
+    asio::awaitable<void> Flush();
+
+    void Close();
+
+  private:
+    PeerConnection::Callbacks _Callbacks();
+    void _Push(Event event);
+    void _ThrowIfClosed() const;
+    static asio::awaitable<void> _Wait(asio::steady_timer& signal);
+
+    std::shared_ptr<PeerConnection> _connection;
+    std::deque<Event> _events;
+    std::error_code _closeError;
+    // never expire, cancelled by the callbacks to wake ReadEvent() and Flush()
+    asio::steady_timer _eventSignal;
+    asio::steady_timer _writeSignal;
+};
+
+} // namespace bt
@@ -0,0 +1,595 @@
+#include "peer_connection.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#endif
+
+namespace bt {
+
+using peer_wire::BlockInfo;
+using peer_wire::Message;
+using peer_wire::MessageType;
+
+// enough for a couple of 16 KiB blocks, grows up to the largest message
+static constexpr size_t InitialReadBufferSize = 64 * 1024;
+
+std::shared_ptr<PeerConnection> PeerConnection::Connect(asio::io_context& ioContext,
+                                                        const asio::ip::tcp::endpoint& endpoint,
+                                                        Options options, Callbacks callbacks) {
+    // a strand keeps the handlers of one connection serialized when ioContext has several threads
+    std::shared_ptr<PeerConnection> connection(
+        new PeerConnection(asio::ip::tcp::socket(asio::make_strand(ioContext)), std::move(options),
+                           std::move(callbacks)));
+    connection->_outbound = true;
+    connection->_socket.async_connect(
+        endpoint, [self = connection](const std::error_code& error) {
+            if (self->_state == State::Closed) {
+                return;
+            }
+            if (error) {
+                self->_Fail(error);
+                return;
+            }
+            self->_state = State::Handshaking;
+            self->_SendHandshake();
+            self->_Read();
+        });
+    return connection;
+}
+
+std::shared_ptr<PeerConnection> PeerConnection::Accept(asio::ip::tcp::socket socket,
+                                                       Options options, Callbacks callbacks) {
+    std::shared_ptr<PeerConnection> connection(
+        new PeerConnection(std::move(socket), std::move(options), std::move(callbacks)));
+    connection->_state = State::Handshaking;
+    // the handshake is answered once the peer told which torrent it wants
+    asio::dispatch(connection->executor(), [self = connection] { self->_Read(); });
+    return connection;
+}
+
+PeerConnection::PeerConnection(asio::ip::tcp::socket socket, Options options,
+                               Callbacks callbacks)
+    : _socket(std::move(socket)),
+      _options(std::move(options)),
+      _callbacks(std::move(callbacks)),
+      _readBuffer(InitialReadBufferSize) {
+}
+
+PeerConnection::State PeerConnection::state() const {
+    return _state;
+}
+
+asio::any_io_executor PeerConnection::executor() {
+    return _socket.get_executor();
+}
+
+const peer_wire::PeerId& PeerConnection::peerId() const {
+    return _peerId;
+}
+
+const Bitfield& PeerConnection::peerPieces() const {
+    return _peerPieces;
+}
+
+bool PeerConnection::amChoking() const {
+    return _amChoking;
+}
+
+bool PeerConnection::amInterested() const {
+    return _amInterested;
+}
+
+bool PeerConnection::peerChoking() const {
+    return _peerChoking;
+}
+
+bool PeerConnection::peerInterested() const {
+    return _peerInterested;
+}
+
+std::span<const BlockInfo> PeerConnection::outstandingRequests() const {
+    return _outstandingRequests;
+}
+
+bool PeerConnection::writePending() const {
+    return _writeInProgress || !_pendingWrite.empty() || !_pendingFiles.empty();
+}
+
+void PeerConnection::Choke() {
+    if (_state != State::Connected || _amChoking) {
+        return;
+    }
+    _amChoking = true;
+    peer_wire::AppendMessage(_pendingWrite, MessageType::Choke);
+    _anyMessageSent = true;
+    _Write();
+}
+
+void PeerConnection::Unchoke() {
+    if (_state != State::Connected || !_amChoking) {
+        return;
+    }
+    _amChoking = false;
+    peer_wire::AppendMessage(_pendingWrite, MessageType::Unchoke);
+    _anyMessageSent = true;
+    _Write();
+}
+
+void PeerConnection::SetInterested(bool interested) {
+    if (_state != State::Connected || _amInterested == interested) {
+        return;
+    }
+    _amInterested = interested;
+    peer_wire::AppendMessage(_pendingWrite,
+                             interested ? MessageType::Interested : MessageType::NotInterested);
+    _anyMessageSent = true;
+    _Write();
+}
+
+void PeerConnection::SendHave(uint32_t pieceIndex) {
+    if (_state != State::Connected) {
+        return;
+    }
+    peer_wire::AppendHave(_pendingWrite, pieceIndex);
+    _anyMessageSent = true;
+    _Write();
+}
+
+void PeerConnection::SendBitfield(const Bitfield& pieces) {
+    if (_state != State::Connected || _anyMessageSent) {
+        return;
+    }
+    peer_wire::AppendBitfield(_pendingWrite, pieces.bytes());
+    _anyMessageSent = true;
+    _Write();
+}
+
+bool PeerConnection::Request(const BlockInfo& block) {
+    if (_state != State::Connected || _peerChoking) {
+        return false;
+    }
+    _outstandingRequests.push_back(block);
+    peer_wire::AppendRequest(_pendingWrite, block);
+    _anyMessageSent = true;
+    _Write();
+    return true;
+}
+
+void PeerConnection::Cancel(const BlockInfo& block) {
+    auto it = std::find(_outstandingRequests.begin(), _outstandingRequests.end(), block);
+    if (_state != State::Connected || it == _outstandingRequests.end()) {
+        return;
+    }
+    _outstandingRequests.erase(it);
+    peer_wire::AppendCancel(_pendingWrite, block);
+    _anyMessageSent = true;
+    _Write();
+}
+
+void PeerConnection::SendPiece(uint32_t pieceIndex, uint32_t begin,
+                               std::span<const std::byte> data) {
+    if (_state != State::Connected) {
+        return;
+    }
+    peer_wire::AppendPiece(_pendingWrite, pieceIndex, begin, data);
+    _anyMessageSent = true;
+    _Write();
+}
+
+void PeerConnection::SendPiece(uint32_t pieceIndex, uint32_t begin, std::vector<FileRange> data) {
+    if (_state != State::Connected) {
+        return;
+    }
+    size_t length = 0;
+    for (const FileRange& range : data) {
+        length += range.length;
+    }
+    peer_wire::AppendPieceHeader(_pendingWrite, pieceIndex, begin, static_cast<uint32_t>(length));
+    for (FileRange& range : data) {
+        if (range.file == nullptr) {
+            // a pad file is not stored, its zeros go with the messages
+            _pendingWrite.resize(_pendingWrite.size() + range.length);
+            continue;
+        }
+        _pendingFiles.push_back({_pendingWrite.size(), std::move(range)});
+    }
+    _anyMessageSent = true;
+    _Write();
+}
+
+void PeerConnection::SendKeepAlive() {
+    if (_state != State::Connected) {
+        return;
+    }
+    peer_wire::AppendKeepAlive(_pendingWrite);
+    _Write();
+}
+
+void PeerConnection::Close() {
+    _Fail(asio::error::operation_aborted);
+}
+
+void PeerConnection::_SendHandshake() {
+    peer_wire::Handshake handshake;
+    handshake.infoHash = _options.infoHash;
+    handshake.peerId = _options.localPeerId;
+
+    // nothing else can be queued before the handshake, sends are dropped until connected
+    _pendingWrite.resize(peer_wire::HandshakeSize);
+    peer_wire::EncodeHandshake(handshake,
+                               std::span<std::byte, peer_wire::HandshakeSize>(_pendingWrite));
+    _Write();
+}
+
+void PeerConnection::_Read() {
+    if (_readEnd == _readBuffer.size()) {
+        if (_readBegin > 0) {
+            // move the partial message to the front
+            std::memmove(_readBuffer.data(), _readBuffer.data() + _readBegin,
+                         _readEnd - _readBegin);
+            _readEnd -= _readBegin;
+            _readBegin = 0;
+        } else {
+            // a single message fills the buffer, DecodeMessage limits how big it gets
+            _readBuffer.resize(std::min(_readBuffer.size() * 2,
+                                        size_t(peer_wire::MaxMessageLength) + 4));
+        }
+    }
+
+    _socket.async_read_some(
+        asio::buffer(_readBuffer.data() + _readEnd, _readBuffer.size() - _readEnd),
+        [self = shared_from_this()](const std::error_code& error, size_t bytesRead) {
+            self->_OnRead(error, bytesRead);
+        });
+}
+
+void PeerConnection::_OnRead(const std::error_code& error, size_t bytesRead) {
+    if (_state == State::Closed) {
+        return;
+    }
+    if (error) {
+        _Fail(error);
+        return;
+    }
+    _readEnd += bytesRead;
+
+    for (;;) {
+        std::span<const std::byte> received(_readBuffer.data() + _readBegin, _readEnd - _readBegin);
+        if (_state == State::Handshaking) {
+            if (received.size() < peer_wire::HandshakeSize || !_HandleHandshake()) {
+                break;
+            }
+            continue;
+        }
+
+        Message message;
+        std::error_code decodeError;
+        size_t messageSize = peer_wire::DecodeMessage(received, message, decodeError);
+        if (decodeError) {
+            _Fail(decodeError);
+            return;
+        }
+        if (messageSize == 0) {
+            break;
+        }
+        _readBegin += messageSize;
+        if (!_HandleMessage(message)) {
+            return;
+        }
+    }
+
+    if (_state == State::Closed) {
+        return;
+    }
+    if (_readBegin == _readEnd) {
+        _readBegin = _readEnd = 0;
+    }
+    _Read();
+}
+
+/**
+ * @return false if the connection was closed
+ */
+bool PeerConnection::_HandleHandshake() {
+    auto handshake = peer_wire::DecodeHandshake(
+        std::span<const std::byte, peer_wire::HandshakeSize>(_readBuffer.data() + _readBegin,
+                                                             peer_wire::HandshakeSize));
+    if (!handshake) {
+        _Fail(peer_wire::Error::InvalidHandshake);
+        return false;
+    }
+    if (handshake->infoHash != _options.infoHash) {
+        _Fail(peer_wire::Error::InfoHashMismatch);
+        return false;
+    }
+    _readBegin += peer_wire::HandshakeSize;
+    _peerId = handshake->peerId;
+    _peerPieces = Bitfield(_options.piecesCount);
+
+    if (!_outbound) {
+        _SendHandshake();
+    }
+    _state = State::Connected;
+    if (_callbacks.onConnected) {
+        _callbacks.onConnected(*this);
+    }
+    return _state != State::Closed;
+}
+
+/**
+ * @return false if the connection was closed
+ */
+bool PeerConnection::_HandleMessage(const Message& message) {
+    bool first = !_anyMessageReceived;
+    if (message.type != MessageType::KeepAlive) {
+        _anyMessageReceived = true;
+    }
+
+    switch (message.type) {
+    case MessageType::Choke:
+        _peerChoking = true;
+        // the peer drops all requests it has not answered yet
+        _outstandingRequests.clear();
+        if (_callbacks.onStateChanged) {
+            _callbacks.onStateChanged(*this);
+        }
+        break;
+    case MessageType::Unchoke:
+        _peerChoking = false;
+        if (_callbacks.onStateChanged) {
+            _callbacks.onStateChanged(*this);
+        }
+        break;
+    case MessageType::Interested:
+    case MessageType::NotInterested:
+        _peerInterested = message.type == MessageType::Interested;
+        if (_callbacks.onStateChanged) {
+            _callbacks.onStateChanged(*this);
+        }
+        break;
+    case MessageType::Have:
+        if (message.pieceIndex >= _peerPieces.size()) {
+            _Fail(peer_wire::Error::ProtocolViolation);
+            return false;
+        }
+        _peerPieces.Set(message.pieceIndex);
+        if (_callbacks.onHave) {
+            _callbacks.onHave(*this, message.pieceIndex);
+        }
+        break;
+    case MessageType::Bitfield:
+        if (!first) {
+            _Fail(peer_wire::Error::ProtocolViolation);
+            return false;
+        }
+        try {
+            _peerPieces = Bitfield::FromBytes(message.payload, _options.piecesCount);
+        } catch (std::invalid_argument&) {
+            _Fail(peer_wire::Error::MalformedMessage);
+            return false;
+        }
+        if (_callbacks.onBitfield) {
+            _callbacks.onBitfield(*this);
+        }
+        break;
+    case MessageType::Request:
+        if (message.length == 0 || message.length > peer_wire::MaxRequestLength ||
+            message.pieceIndex >= _peerPieces.size()) {
+            _Fail(peer_wire::Error::ProtocolViolation);
+            return false;
+        }
+        // requests that cross a choke are dropped
+        if (!_amChoking && _callbacks.onRequest) {
+            _callbacks.onRequest(*this, message.block());
+        }
+        break;
+    case MessageType::Piece: {
+        // blocks that were cancelled or never requested are dropped
+        auto it = std::find(_outstandingRequests.begin(), _outstandingRequests.end(),
+                            message.block());
+        if (it == _outstandingRequests.end()) {
+            break;
+        }
+        _outstandingRequests.erase(it);
+        if (_callbacks.onPiece) {
+            _callbacks.onPiece(*this, message.block(), message.payload);
+        }
+        break;
+    }
+    case MessageType::Cancel:
+        if (_callbacks.onCancel) {
+            _callbacks.onCancel(*this, message.block());
+        }
+        break;
+    default: // keep-alive, DHT port and extensions
+        break;
+    }
+    return _state != State::Closed;
+}
+
+void PeerConnection::_Write() {
+    if (_writeInProgress || (_pendingWrite.empty() && _pendingFiles.empty()) ||
+        _state == State::Closed) {
+        return;
+    }
+    // everything queued so far goes out with one write, later messages wait for the next
+    std::swap(_writing, _pendingWrite);
+    _pendingWrite.clear();
+    std::swap(_writingFiles, _pendingFiles);
+    _pendingFiles.clear();
+    _writeInProgress = true;
+
+    if (_writingFiles.empty()) {
+        asio::async_write(_socket, asio::buffer(_writing),
+                          [self = shared_from_this()](const std::error_code& error, size_t) {
+                              self->_OnWritten(error);
+                          });
+        return;
+    }
+#ifdef __linux__
+    if (_options.zeroCopyUploads) {
+        _writtenBytes = 0;
+        _writtenFiles = 0;
+        _WriteNext();
+        return;
+    }
+#endif
+    _WriteGathered();
+}
+
+void PeerConnection::_WriteNext() {
+#ifdef __linux__
+    if (_state == State::Closed) {
+        return;
+    }
+    std::error_code error;
+    _socket.native_non_blocking(true, error);
+    if (error) {
+        _OnWritten(error);
+        return;
+    }
+    int socket = _socket.native_handle();
+    auto wait = [this] {
+        _socket.async_wait(asio::ip::tcp::socket::wait_write,
+                           [self = shared_from_this()](const std::error_code& error) {
+                               if (error) {
+                                   self->_OnWritten(error);
+                                   return;
+                               }
+                               self->_WriteNext();
+                           });
+    };
+
+    while (_writtenFiles < _writingFiles.size()) {
+        FileWrite& write = _writingFiles[_writtenFiles];
+        // MSG_MORE holds the header back so it shares a segment with the block data
+        while (_writtenBytes < write.bytesBefore) {
+            ssize_t sent = ::send(socket, _writing.data() + _writtenBytes,
+                                  write.bytesBefore - _writtenBytes, MSG_MORE | MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                wait();
+                return;
+            }
+            if (sent < 0) {
+                _OnWritten(std::error_code(errno, asio::error::get_system_category()));
+                return;
+            }
+            _writtenBytes += static_cast<size_t>(sent);
+        }
+
+        while (write.range.length > 0) {
+            off_t offset = static_cast<off_t>(write.range.offset);
+            ssize_t sent = ::sendfile(socket, write.range.file->native(), &offset,
+                                      write.range.length);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                wait();
+                return;
+            }
+            if (sent < 0) {
+                _OnWritten(std::error_code(errno, asio::error::get_system_category()));
+                return;
+            }
+            if (sent == 0) {
+                // the file was truncated under us, the peer would get a short block
+                _OnWritten(asio::error::eof);
+                return;
+            }
+            write.range.offset += sent;
+            write.range.length -= static_cast<size_t>(sent);
+        }
+        write.range.file.reset();
+        _writtenFiles++;
+    }
+
+    asio::async_write(_socket, asio::buffer(_writing.data() + _writtenBytes,
+                                            _writing.size() - _writtenBytes),
+                      [self = shared_from_this()](const std::error_code& error, size_t) {
+                          self->_OnWritten(error);
+                      });
+#endif
+}
+
+void PeerConnection::_WriteGathered() {
+    size_t length = 0;
+    for (const FileWrite& write : _writingFiles) {
+        length += write.range.length;
+    }
+    _fileBuffer.resize(length);
+
+    // one gathering write of the messages and the blocks read between them
+    std::vector<asio::const_buffer> buffers;
+    size_t bytesOffset = 0;
+    size_t fileOffset = 0;
+    for (const FileWrite& write : _writingFiles) {
+        if (write.bytesBefore > bytesOffset) {
+            buffers.push_back(
+                asio::buffer(_writing.data() + bytesOffset, write.bytesBefore - bytesOffset));
+            bytesOffset = write.bytesBefore;
+        }
+        std::span<std::byte> out = std::span(_fileBuffer).subspan(fileOffset, write.range.length);
+        try {
+            if (write.range.file->ReadAt(write.range.offset, out) < out.size()) {
+                _OnWritten(asio::error::eof);
+                return;
+            }
+        } catch (const std::system_error& error) {
+            _OnWritten(error.code());
+            return;
+        }
+        buffers.push_back(asio::buffer(out.data(), out.size()));
+        fileOffset += out.size();
+    }
+    if (bytesOffset < _writing.size()) {
+        buffers.push_back(
+            asio::buffer(_writing.data() + bytesOffset, _writing.size() - bytesOffset));
+    }
+
+    asio::async_write(_socket, buffers,
+                      [self = shared_from_this()](const std::error_code& error, size_t) {
+                          self->_OnWritten(error);
+                      });
+}
+
+void PeerConnection::_OnWritten(const std::error_code& error) {
+    _writeInProgress = false;
+    if (error) {
+        _Fail(error);
+        return;
+    }
+    _writing.clear();
+    _writingFiles.clear();
+    _Write();
+    if (!_writeInProgress && _callbacks.onWritten) {
+        _callbacks.onWritten(*this);
+    }
+}
+
+void PeerConnection::_Fail(const std::error_code& error) {
+    if (_state == State::Closed) {
+        return;
+    }
+    _state = State::Closed;
+    std::error_code ignored;
+    _socket.close(ignored);
+
+    if (_callbacks.onClosed) {
+        _callbacks.onClosed(*this, error);
+    }
+    // callbacks may hold the last reference to other objects, release them with the connection;
+    // the one that called Close() is still running, so they go once the current handler returned
+    asio::post(executor(), [self = shared_from_this()] { self->_callbacks = {}; });
+}
+
+} // namespace bt
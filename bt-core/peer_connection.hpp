@@ -0,0 +1,199 @@
+#pragma once
+
+#include <asio.hpp>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include "bitfield.hpp"
+#include "file_handle.hpp"
+#include "peer_wire.hpp"
+
+namespace bt {
+
+/**
+ * @brief one BitTorrent peer connection on asio
+ * @brief does the handshake, frames messages, and keeps the choke/interest state of both
+ *        sides and the pieces the peer has; everything is asynchronous on the io_context
+ *        given at creation, so any number of connections can share one thread
+ * @brief not thread safe, public members must be called from the connection's executor
+ *        (callbacks already run there)
+ */
+class PeerConnection : public std::enable_shared_from_this<PeerConnection> {
+  public:
+    enum class State {
+        Connecting,
+        Handshaking,
+        Connected,
+        Closed,
+    };
+
+    struct Options {
+        InfoHash infoHash;
+        peer_wire::PeerId localPeerId{};
+        size_t piecesCount = 0;
+        // blocks given as file ranges go from the page cache to the socket with sendfile where
+        // supported, turn off when the stream is transformed (e.g. encrypted) after the socket
+        bool zeroCopyUploads = true;
+    };
+
+    /**
+     * @brief events of the connection, every callback is optional
+     * @brief payload spans only live until the callback returns
+     */
+    struct Callbacks {
+        // handshake with the expected infohash completed
+        std::function<void(PeerConnection&)> onConnected;
+        // peer choked/unchoked us or changed its interest
+        std::function<void(PeerConnection&)> onStateChanged;
+        // peer's pieces changed through a bitfield message, see peerPieces()
+        std::function<void(PeerConnection&)> onBitfield;
+        std::function<void(PeerConnection&, uint32_t pieceIndex)> onHave;
+        // peer requests a block while unchoked, answer with SendPiece
+        std::function<void(PeerConnection&, const peer_wire::BlockInfo&)> onRequest;
+        std::function<void(PeerConnection&, const peer_wire::BlockInfo&)> onCancel;
+        // block we requested arrived
+        std::function<void(PeerConnection&, const peer_wire::BlockInfo&,
+                           std::span<const std::byte> data)>
+            onPiece;
+        // every queued message was written, see writePending()
+        std::function<void(PeerConnection&)> onWritten;
+        // called once, when the connection is closed by either side or fails
+        std::function<void(PeerConnection&, const std::error_code&)> onClosed;
+    };
+
+    /**
+     * @brief opens a connection to endpoint and sends the handshake
+     */
+    static std::shared_ptr<PeerConnection> Connect(asio::io_context& ioContext,
+                                                   const asio::ip::tcp::endpoint& endpoint,
+                                                   Options options, Callbacks callbacks);
+
+    /**
+     * @brief takes over an accepted socket, waits for the peer's handshake and answers it
+     * @param socket accept it on a strand, acceptor.async_accept(asio::make_strand(ioContext)),
+     *        if the io_context is run by several threads
+     */
+    static std::shared_ptr<PeerConnection> Accept(asio::ip::tcp::socket socket, Options options,
+                                                  Callbacks callbacks);
+
+    PeerConnection(const PeerConnection&) = delete;
+    PeerConnection& operator=(const PeerConnection&) = delete;
+
+    State state() const;
+
+    asio::any_io_executor executor();
+
+    /**
+     * @return id the peer sent in its handshake, valid once connected
+     */
+    const peer_wire::PeerId& peerId() const;
+
+    const Bitfield& peerPieces() const;
+
+    bool amChoking() const;
+    bool amInterested() const;
+    bool peerChoking() const;
+    bool peerInterested() const;
+
+    /**
+     * @return blocks requested from the peer that have not arrived yet
+     */
+    std::span<const peer_wire::BlockInfo> outstandingRequests() const;
+
+    /**
+     * @return true while queued messages are not written yet
+     */
+    bool writePending() const;
+
+    // messages are queued and written in batches, they are dropped when not connected
+
+    void Choke();
+    void Unchoke();
+    void SetInterested(bool interested);
+    void SendHave(uint32_t pieceIndex);
+
+    /**
+     * @brief only allowed as the first message after the handshake
+     */
+    void SendBitfield(const Bitfield& pieces);
+
+    /**
+     * @return false if the request was not sent because the peer is choking us
+     */
+    bool Request(const peer_wire::BlockInfo& block);
+
+    void Cancel(const peer_wire::BlockInfo& block);
+
+    void SendPiece(uint32_t pieceIndex, uint32_t begin, std::span<const std::byte> data);
+
+    /**
+     * @brief sends a block straight from the files, see UploadSource; the header is queued
+     *        with the other messages and the data is sent without copying it into user space
+     *        if Options::zeroCopyUploads, otherwise it is read into one buffer at write time
+     * @param data ranges of the block in order, the files are kept open until written; ranges
+     *        without a file are sent as zeros
+     */
+    void SendPiece(uint32_t pieceIndex, uint32_t begin, std::vector<FileRange> data);
+
+    void SendKeepAlive();
+
+    /**
+     * @brief closes the socket, onClosed gets asio::error::operation_aborted
+     */
+    void Close();
+
+  private:
+    PeerConnection(asio::ip::tcp::socket socket, Options options, Callbacks callbacks);
+
+    void _SendHandshake();
+    void _Read();
+    void _OnRead(const std::error_code& error, size_t bytesRead);
+    bool _HandleHandshake();
+    bool _HandleMessage(const peer_wire::Message& message);
+    void _Write();
+    void _WriteNext();
+    void _WriteGathered();
+    void _OnWritten(const std::error_code& error);
+    void _Fail(const std::error_code& error);
+
+    asio::ip::tcp::socket _socket;
+    Options _options;
+    Callbacks _callbacks;
+    State _state = State::Connecting;
+    bool _outbound = false;
+
+    peer_wire::PeerId _peerId{};
+    Bitfield _peerPieces;
+    bool _amChoking = true;
+    bool _amInterested = false;
+    bool _peerChoking = true;
+    bool _peerInterested = false;
+    bool _anyMessageSent = false;     // bitfield is only valid as the first message
+    bool _anyMessageReceived = false; // ditto
+    std::vector<peer_wire::BlockInfo> _outstandingRequests;
+
+    std::vector<std::byte> _readBuffer; // received data in [_readBegin, _readEnd)
+    size_t _readBegin = 0;
+    size_t _readEnd = 0;
+
+    // block data that is sent from files, in order, between the bytes of the message buffer
+    struct FileWrite {
+        size_t bytesBefore; // in the message buffer
+        FileRange range;
+    };
+
+    std::vector<std::byte> _pendingWrite; // queued while _writing is on the wire
+    std::vector<FileWrite> _pendingFiles;
+    std::vector<std::byte> _writing;
+    std::vector<FileWrite> _writingFiles;
+    size_t _writtenBytes = 0; // of _writing, while sending _writingFiles one by one
+    size_t _writtenFiles = 0;
+    std::vector<std::byte> _fileBuffer; // block data read when not sending from the files
+    bool _writeInProgress = false;
+};
+
+} // namespace bt
@@ -0,0 +1,214 @@
+#include "peer_wire.hpp"
+
+#include <cstring>
+#include <string>
+
+namespace bt::peer_wire {
+
+namespace {
+
+class ErrorCategoryImpl : public std::error_category {
+  public:
+    const char* name() const noexcept override {
+        return "peer wire";
+    }
+
+    std::string message(int error) const override {
+        switch (static_cast<Error>(error)) {
+        case Error::InvalidHandshake:
+            return "invalid handshake";
+        case Error::InfoHashMismatch:
+            return "peer is not on this torrent";
+        case Error::MessageTooLarge:
+            return "message too large";
+        case Error::MalformedMessage:
+            return "malformed message";
+        case Error::ProtocolViolation:
+            return "protocol violation";
+        }
+        return "unknown error";
+    }
+};
+
+uint32_t ReadUint32(const std::byte* data) {
+    return (std::to_integer<uint32_t>(data[0]) << 24) | (std::to_integer<uint32_t>(data[1]) << 16) |
+           (std::to_integer<uint32_t>(data[2]) << 8) | std::to_integer<uint32_t>(data[3]);
+}
+
+void AppendUint32(std::vector<std::byte>& out, uint32_t value) {
+    out.push_back(std::byte(value >> 24));
+    out.push_back(std::byte(value >> 16));
+    out.push_back(std::byte(value >> 8));
+    out.push_back(std::byte(value));
+}
+
+void AppendHeader(std::vector<std::byte>& out, uint32_t length, MessageType type) {
+    AppendUint32(out, length);
+    out.push_back(std::byte(type));
+}
+
+} // namespace
+
+const std::error_category& ErrorCategory() {
+    static const ErrorCategoryImpl category;
+    return category;
+}
+
+std::error_code make_error_code(Error error) {
+    return std::error_code(static_cast<int>(error), ErrorCategory());
+}
+
+void EncodeHandshake(const Handshake& handshake, std::span<std::byte, HandshakeSize> out) {
+    std::byte* cursor = out.data();
+    *cursor++ = std::byte(ProtocolName.size());
+    std::memcpy(cursor, ProtocolName.data(), ProtocolName.size());
+    cursor += ProtocolName.size();
+    std::memcpy(cursor, handshake.reserved.data(), handshake.reserved.size());
+    cursor += handshake.reserved.size();
+    std::memcpy(cursor, handshake.infoHash.bytes.data(), Sha1Digest::Size);
+    cursor += Sha1Digest::Size;
+    std::memcpy(cursor, handshake.peerId.data(), handshake.peerId.size());
+}
+
+std::optional<Handshake> DecodeHandshake(std::span<const std::byte, HandshakeSize> data) {
+    const std::byte* cursor = data.data();
+    if (std::to_integer<size_t>(*cursor++) != ProtocolName.size() ||
+        std::memcmp(cursor, ProtocolName.data(), ProtocolName.size()) != 0) {
+        return {};
+    }
+    cursor += ProtocolName.size();
+
+    Handshake handshake;
+    std::memcpy(handshake.reserved.data(), cursor, handshake.reserved.size());
+    cursor += handshake.reserved.size();
+    handshake.infoHash = Sha1Digest::FromBytes(cursor);
+    cursor += Sha1Digest::Size;
+    std::memcpy(handshake.peerId.data(), cursor, handshake.peerId.size());
+    return handshake;
+}
+
+size_t DecodeMessage(std::span<const std::byte> data, Message& message, std::error_code& error) {
+    if (data.size() < 4) {
+        return 0;
+    }
+    uint32_t length = ReadUint32(data.data());
+    if (length > MaxMessageLength) {
+        error = Error::MessageTooLarge;
+        return 0;
+    }
+    if (data.size() - 4 < length) {
+        return 0;
+    }
+
+    message = Message{};
+    if (length == 0) {
+        message.type = MessageType::KeepAlive;
+        return 4;
+    }
+
+    const std::byte* payload = data.data() + 5;
+    size_t payloadSize = length - 1;
+    message.type = static_cast<MessageType>(data[4]);
+
+    // fixed size messages must match exactly
+    auto expect = [&](size_t size) {
+        if (payloadSize != size) {
+            error = Error::MalformedMessage;
+            return false;
+        }
+        return true;
+    };
+    switch (message.type) {
+    case MessageType::Choke:
+    case MessageType::Unchoke:
+    case MessageType::Interested:
+    case MessageType::NotInterested:
+        if (!expect(0)) {
+            return 0;
+        }
+        break;
+    case MessageType::Have:
+        if (!expect(4)) {
+            return 0;
+        }
+        message.pieceIndex = ReadUint32(payload);
+        break;
+    case MessageType::Request:
+    case MessageType::Cancel:
+        if (!expect(12)) {
+            return 0;
+        }
+        message.pieceIndex = ReadUint32(payload);
+        message.begin = ReadUint32(payload + 4);
+        message.length = ReadUint32(payload + 8);
+        break;
+    case MessageType::Piece:
+        if (payloadSize < 8) {
+            error = Error::MalformedMessage;
+            return 0;
+        }
+        message.pieceIndex = ReadUint32(payload);
+        message.begin = ReadUint32(payload + 4);
+        message.payload = std::span(payload + 8, payloadSize - 8);
+        message.length = static_cast<uint32_t>(message.payload.size());
+        break;
+    case MessageType::Port:
+        if (!expect(2)) {
+            return 0;
+        }
+        message.port = static_cast<uint16_t>((std::to_integer<uint16_t>(payload[0]) << 8) |
+                                             std::to_integer<uint16_t>(payload[1]));
+        break;
+    default: // Bitfield and extensions
+        message.payload = std::span(payload, payloadSize);
+        break;
+    }
+    return 4 + length;
+}
+
+void AppendKeepAlive(std::vector<std::byte>& out) {
+    AppendUint32(out, 0);
+}
+
+void AppendMessage(std::vector<std::byte>& out, MessageType type) {
+    AppendHeader(out, 1, type);
+}
+
+void AppendHave(std::vector<std::byte>& out, uint32_t pieceIndex) {
+    AppendHeader(out, 5, MessageType::Have);
+    AppendUint32(out, pieceIndex);
+}
+
+void AppendBitfield(std::vector<std::byte>& out, std::span<const std::byte> bitfield) {
+    AppendHeader(out, static_cast<uint32_t>(1 + bitfield.size()), MessageType::Bitfield);
+    out.insert(out.end(), bitfield.begin(), bitfield.end());
+}
+
+void AppendRequest(std::vector<std::byte>& out, const BlockInfo& block) {
+    AppendHeader(out, 13, MessageType::Request);
+    AppendUint32(out, block.pieceIndex);
+    AppendUint32(out, block.begin);
+    AppendUint32(out, block.length);
+}
+
+void AppendCancel(std::vector<std::byte>& out, const BlockInfo& block) {
+    AppendHeader(out, 13, MessageType::Cancel);
+    AppendUint32(out, block.pieceIndex);
+    AppendUint32(out, block.begin);
+    AppendUint32(out, block.length);
+}
+
+void AppendPiece(std::vector<std::byte>& out, uint32_t pieceIndex, uint32_t begin,
+                 std::span<const std::byte> data) {
+    AppendPieceHeader(out, pieceIndex, begin, static_cast<uint32_t>(data.size()));
+    out.insert(out.end(), data.begin(), data.end());
+}
+
+void AppendPieceHeader(std::vector<std::byte>& out, uint32_t pieceIndex, uint32_t begin,
+                       uint32_t length) {
+    AppendHeader(out, 9 + length, MessageType::Piece);
+    AppendUint32(out, pieceIndex);
+    AppendUint32(out, begin);
+}
+
+} // namespace bt::peer_wire
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "sha1_digest.hpp"
+
+/**
+ * @brief encoding and decoding of the BEP 3 peer wire protocol, without any I/O
+ * @brief refer to http://www.bittorrent.org/beps/bep_0003.html#peer-protocol
+ */
+namespace bt::peer_wire {
+
+inline constexpr std::string_view ProtocolName = "BitTorrent protocol";
+
+inline constexpr size_t HandshakeSize = 1 + ProtocolName.size() + 8 + 20 + 20;
+
+/**
+ * @brief size of the blocks pieces are requested in
+ */
+inline constexpr uint32_t BlockSize = 16 * 1024;
+
+/**
+ * @brief largest block a peer may request, bigger requests close the connection
+ */
+inline constexpr uint32_t MaxRequestLength = 128 * 1024;
+
+/**
+ * @brief largest message accepted, room for the bitfield of 8 million pieces
+ */
+inline constexpr uint32_t MaxMessageLength = 1024 * 1024 + 9;
+
+using PeerId = std::array<std::byte, 20>;
+
+struct Handshake {
+    std::array<std::byte, 8> reserved{}; // extension bits
+    InfoHash infoHash;
+    PeerId peerId{};
+};
+
+enum class MessageType : uint8_t {
+    Choke = 0,
+    Unchoke = 1,
+    Interested = 2,
+    NotInterested = 3,
+    Have = 4,
+    Bitfield = 5,
+    Request = 6,
+    Piece = 7,
+    Cancel = 8,
+    Port = 9,
+    // not on the wire, a message of length 0
+    KeepAlive = 0xff,
+};
+
+/**
+ * @brief block of a piece, as requested and cancelled
+ */
+struct BlockInfo {
+    uint32_t pieceIndex;
+    uint32_t begin;
+    uint32_t length;
+
+    bool operator==(const BlockInfo&) const = default;
+};
+
+/**
+ * @brief decoded message, fields not used by type are 0
+ * @brief ids of extensions are passed through as their MessageType value with the raw payload
+ */
+struct Message {
+    MessageType type;
+    uint32_t pieceIndex = 0; // Have, Request, Piece, Cancel
+    uint32_t begin = 0;      // Request, Piece, Cancel
+    uint32_t length = 0;     // Request, Cancel
+    uint16_t port = 0;       // Port
+    // Bitfield bytes, Piece block or unknown payload, view into the decoded buffer
+    std::span<const std::byte> payload;
+
+    BlockInfo block() const {
+        return BlockInfo{pieceIndex, begin, length};
+    }
+};
+
+/**
+ * @brief reasons the peer wire layer closes a connection
+ */
+enum class Error {
+    InvalidHandshake = 1,
+    InfoHashMismatch,
+    MessageTooLarge,
+    MalformedMessage,
+    ProtocolViolation,
+};
+
+const std::error_category& ErrorCategory();
+
+std::error_code make_error_code(Error error);
+
+void EncodeHandshake(const Handshake& handshake, std::span<std::byte, HandshakeSize> out);
+
+/**
+ * @return null if data is not a BitTorrent handshake
+ */
+std::optional<Handshake> DecodeHandshake(std::span<const std::byte, HandshakeSize> data);
+
+/**
+ * @brief decodes the message at the front of data
+ * @param message receives the message, its payload views into data
+ * @param error set to MessageTooLarge or MalformedMessage if the stream is broken
+ * @return bytes taken by the message, 0 if data does not hold a whole message yet or on error
+ */
+size_t DecodeMessage(std::span<const std::byte> data, Message& message, std::error_code& error);
+
+/**
+ * @brief messages are appended to out, so several can be sent with a single write
+ */
+void AppendKeepAlive(std::vector<std::byte>& out);
+
+/**
+ * @param type one of Choke, Unchoke, Interested, NotInterested
+ */
+void AppendMessage(std::vector<std::byte>& out, MessageType type);
+
+void AppendHave(std::vector<std::byte>& out, uint32_t pieceIndex);
+
+void AppendBitfield(std::vector<std::byte>& out, std::span<const std::byte> bitfield);
+
+void AppendRequest(std::vector<std::byte>& out, const BlockInfo& block);
+
+void AppendCancel(std::vector<std::byte>& out, const BlockInfo& block);
+
+void AppendPiece(std::vector<std::byte>& out, uint32_t pieceIndex, uint32_t begin,
+                 std::span<const std::byte> data);
+
+/**
+ * @brief the 13 bytes in front of a block, for senders that write its length bytes separately
+ */
+void AppendPieceHeader(std::vector<std::byte>& out, uint32_t pieceIndex, uint32_t begin,
+                       uint32_t length);
+
+} // namespace bt::peer_wire
+
+template <>
+struct std::is_error_code_enum<bt::peer_wire::Error> : std::true_type {};
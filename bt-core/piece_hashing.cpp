@@ -0,0 +1,90 @@
+#include "piece_hashing.hpp"
+
+#include "sha1_backend.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace bt {
+
+static constexpr size_t BlockSize = 64;
+static constexpr uint32_t InitialState[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476,
+                                             0xc3d2e1f0};
+
+/**
+ * @brief compresses what is left of piece after the first done bytes, pads it and
+ *        writes the resulting digest
+ */
+static void _Finish(uint32_t state[5], std::span<const std::byte> piece, size_t done,
+                    Sha1Digest& digest) {
+    const uint8_t* rest = reinterpret_cast<const uint8_t*>(piece.data()) + done;
+    size_t restSize = piece.size() - done;
+    size_t fullBlocks = restSize / BlockSize;
+    if (fullBlocks > 0) {
+        sha1_backend::Compress(state, rest, fullBlocks);
+    }
+
+    // 0x80 terminator and the big endian bit length, spilling into a second block if needed
+    uint8_t tail[2 * BlockSize] = {};
+    size_t tailSize = restSize % BlockSize;
+    std::memcpy(tail, rest + fullBlocks * BlockSize, tailSize);
+    tail[tailSize] = 0x80;
+    size_t paddedSize = tailSize + 9 <= BlockSize ? BlockSize : 2 * BlockSize;
+    uint64_t bits = uint64_t(piece.size()) * 8;
+    for (int i = 0; i < 8; i++) {
+        tail[paddedSize - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+    sha1_backend::Compress(state, tail, paddedSize / BlockSize);
+
+    for (size_t i = 0; i < 5; i++) {
+        for (size_t j = 0; j < 4; j++) {
+            digest.bytes[i * 4 + j] = std::byte(state[i] >> (24 - 8 * j));
+        }
+    }
+}
+
+void HashPieces(std::span<const std::span<const std::byte>> pieces, std::span<Sha1Digest> digests) {
+    if (digests.size() < pieces.size()) {
+        throw std::invalid_argument("Not enough room for piece digests");
+    }
+
+    // a single SHA-NI stream outruns 4 lanes of SSE2, but not 8 or 16 lanes
+    size_t lanes = sha1_backend::MultiLanes();
+    bool multiBuffer =
+        lanes >= 8 || (lanes > 1 && sha1_backend::Active() != sha1_backend::Backend::ShaNi);
+
+    uint32_t states[16 * 5];
+    const uint8_t* blocks[16];
+    size_t next = 0;
+    // a partly filled group is still worth it when at least half of the lanes do work,
+    // idle lanes hash the first piece of the group again
+    while (multiBuffer && next < pieces.size() && (pieces.size() - next) * 2 >= lanes) {
+        size_t groupSize = std::min(lanes, pieces.size() - next);
+        size_t commonBlocks = SIZE_MAX;
+        for (size_t lane = 0; lane < lanes; lane++) {
+            std::span<const std::byte> piece = pieces[next + (lane < groupSize ? lane : 0)];
+            blocks[lane] = reinterpret_cast<const uint8_t*>(piece.data());
+            commonBlocks = std::min(commonBlocks, piece.size() / BlockSize);
+            std::copy(std::begin(InitialState), std::end(InitialState), states + lane * 5);
+        }
+
+        if (commonBlocks > 0) {
+            sha1_backend::CompressMulti(states, blocks, commonBlocks);
+        }
+        for (size_t lane = 0; lane < groupSize; lane++) {
+            _Finish(states + lane * 5, pieces[next + lane], commonBlocks * BlockSize,
+                    digests[next + lane]);
+        }
+        next += groupSize;
+    }
+
+    for (; next < pieces.size(); next++) {
+        uint32_t state[5];
+        std::copy(std::begin(InitialState), std::end(InitialState), state);
+        _Finish(state, pieces[next], 0, digests[next]);
+    }
+}
+
+} // namespace bt
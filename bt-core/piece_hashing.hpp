@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "sha1_digest.hpp"
+
+namespace bt {
+
+/**
+ * @brief SHA1 of many independent buffers, e.g. all pieces of a torrent on recheck or creation
+ * @brief pieces are hashed several at a time, one per SIMD lane, unless a single stream of
+ *        SHA extensions is faster; this pays off most when the buffers have equal length
+ * @param pieces buffers to hash
+ * @param digests receives the digest of every piece, at the same index
+ * @throws std::invalid_argument if digests is smaller than pieces
+ */
+void HashPieces(std::span<const std::span<const std::byte>> pieces, std::span<Sha1Digest> digests);
+
+} // namespace bt
@@ -0,0 +1,415 @@
+#include "piece_picker.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+namespace bt {
+
+PiecePicker::PiecePicker(size_t piecesCount, long long pieceLength, long long totalSize,
+                         PiecePickerOptions options)
+    : _options(options),
+      _pieceLength(pieceLength),
+      _totalSize(totalSize),
+      _pieces(piecesCount),
+      _freshCount(piecesCount) {
+    // equally rare pieces are picked in this order
+    Level& level = _levels[DefaultPriority];
+    level.pieces.resize(piecesCount);
+    std::iota(level.pieces.begin(), level.pieces.end(), 0);
+    std::shuffle(level.pieces.begin(), level.pieces.end(), std::mt19937(options.seed));
+    for (uint32_t position = 0; position < level.pieces.size(); position++) {
+        _pieces[level.pieces[position]].position = position;
+    }
+    level.bucketBegins = {0, static_cast<uint32_t>(piecesCount)};
+}
+
+PiecePicker::PiecePicker(const TorrentMetadata& torrent, PiecePickerOptions options)
+    : PiecePicker(torrent.piecesCount(), torrent.pieceLength(), torrent.totalSize(), options) {
+}
+
+size_t PiecePicker::piecesCount() const {
+    return _pieces.size();
+}
+
+size_t PiecePicker::availability(uint32_t pieceIndex) const {
+    return _pieces[pieceIndex].availability + _seedsCount;
+}
+
+uint8_t PiecePicker::priority(uint32_t pieceIndex) const {
+    return _pieces[pieceIndex].priority;
+}
+
+void PiecePicker::SetPriority(uint32_t pieceIndex, uint8_t priority) {
+    priority = std::min(priority, MaxPriority);
+    PieceState& piece = _pieces[pieceIndex];
+    if (piece.priority == priority) {
+        return;
+    }
+    bool fresh = !(piece.flags & _PartialFlag);
+    if (_IsWanted(piece)) {
+        _Remove(pieceIndex);
+        _freshCount -= fresh;
+    }
+    piece.priority = priority;
+    if (_IsWanted(piece)) {
+        _Insert(pieceIndex);
+        _freshCount += fresh;
+        _sequentialCursor = std::min(_sequentialCursor, pieceIndex);
+    }
+}
+
+void PiecePicker::IncrementAvailability(uint32_t pieceIndex) {
+    if (_IsWanted(_pieces[pieceIndex])) {
+        _Increment(pieceIndex);
+    } else {
+        _pieces[pieceIndex].availability++;
+    }
+}
+
+void PiecePicker::DecrementAvailability(uint32_t pieceIndex) {
+    if (_pieces[pieceIndex].availability == 0) {
+        return;
+    }
+    if (_IsWanted(_pieces[pieceIndex])) {
+        _Decrement(pieceIndex);
+    } else {
+        _pieces[pieceIndex].availability--;
+    }
+}
+
+// calls fn with the index of every set bit
+template <typename Fn>
+static void _ForEachSet(const Bitfield& pieces, size_t piecesCount, Fn fn) {
+    if (pieces.size() != piecesCount) {
+        throw std::invalid_argument("Bitfield has wrong size");
+    }
+    std::span<const std::byte> bytes = pieces.bytes();
+    for (size_t i = 0; i < bytes.size(); i++) {
+        auto bits = std::to_integer<uint8_t>(bytes[i]);
+        while (bits != 0) {
+            int bit = std::countl_zero(bits);
+            fn(static_cast<uint32_t>(i * 8 + bit));
+            bits &= static_cast<uint8_t>(~(0x80u >> bit));
+        }
+    }
+}
+
+void PiecePicker::IncrementAvailability(const Bitfield& pieces) {
+    _ForEachSet(pieces, _pieces.size(), [this](uint32_t index) { IncrementAvailability(index); });
+}
+
+void PiecePicker::DecrementAvailability(const Bitfield& pieces) {
+    _ForEachSet(pieces, _pieces.size(), [this](uint32_t index) { DecrementAvailability(index); });
+}
+
+void PiecePicker::AddSeed() {
+    _seedsCount++;
+}
+
+void PiecePicker::RemoveSeed() {
+    if (_seedsCount > 0) {
+        _seedsCount--;
+    }
+}
+
+std::vector<peer_wire::BlockInfo> PiecePicker::Pick(
+    const Bitfield& peerPieces, size_t count,
+    std::span<const peer_wire::BlockInfo> peerRequests) {
+    std::vector<peer_wire::BlockInfo> blocks;
+
+    // finish what is started, fewer pieces are left half done
+    for (size_t i = 0; i < _partials.size() && blocks.size() < count; i++) {
+        Partial& partial = _partials[i];
+        if (partial.freeCount > 0 && peerPieces.Test(partial.pieceIndex) &&
+            _pieces[partial.pieceIndex].priority != SkipPriority) {
+            _PickFrom(partial, count - blocks.size(), blocks);
+        }
+    }
+
+    if (_options.sequential) {
+        while (_sequentialCursor < _pieces.size() &&
+               (!_IsWanted(_pieces[_sequentialCursor]) ||
+                (_pieces[_sequentialCursor].flags & _PartialFlag))) {
+            _sequentialCursor++;
+        }
+        for (uint32_t index = _sequentialCursor;
+             index < _pieces.size() && blocks.size() < count && _freshCount > 0; index++) {
+            const PieceState& piece = _pieces[index];
+            if (_IsWanted(piece) && !(piece.flags & _PartialFlag) && peerPieces.Test(index)) {
+                _PickFrom(_StartPartial(index), count - blocks.size(), blocks);
+            }
+        }
+    } else {
+        for (int priority = MaxPriority; priority > SkipPriority; priority--) {
+            const Level& level = _levels[priority];
+            // without seeds nobody has the pieces of bucket 0
+            uint32_t position =
+                _seedsCount == 0 && level.bucketBegins.size() > 1 ? level.bucketBegins[1] : 0;
+            for (; position < level.pieces.size() && blocks.size() < count && _freshCount > 0;
+                 position++) {
+                uint32_t index = level.pieces[position];
+                if (!(_pieces[index].flags & _PartialFlag) && peerPieces.Test(index)) {
+                    _PickFrom(_StartPartial(index), count - blocks.size(), blocks);
+                }
+            }
+        }
+    }
+
+    if (blocks.size() < count && endgame()) {
+        _PickEndgame(peerPieces, count - blocks.size(), peerRequests, blocks);
+    }
+    return blocks;
+}
+
+void PiecePicker::OnRequestFailed(const peer_wire::BlockInfo& block) {
+    Partial* partial;
+    Block* entry = _FindBlock(block, partial);
+    if (entry == nullptr || entry->state != BlockState::Requested) {
+        return;
+    }
+    if (--entry->requests == 0) {
+        entry->state = BlockState::Free;
+        partial->freeCount++;
+        _freeBlocksCount++;
+    }
+}
+
+bool PiecePicker::OnBlockReceived(const peer_wire::BlockInfo& block) {
+    Partial* partial;
+    Block* entry = _FindBlock(block, partial);
+    if (entry == nullptr || entry->state == BlockState::Received) {
+        return false;
+    }
+    if (entry->state == BlockState::Free) {
+        partial->freeCount--;
+        _freeBlocksCount--;
+    }
+    entry->state = BlockState::Received;
+    entry->requests = 0;
+    partial->receivedCount++;
+    return partial->receivedCount == partial->blocks.size();
+}
+
+void PiecePicker::OnPieceVerified(uint32_t pieceIndex) {
+    PieceState& piece = _pieces[pieceIndex];
+    if (piece.flags & _HaveFlag) {
+        return;
+    }
+    if (piece.flags & _PartialFlag) {
+        _ErasePartial(pieceIndex);
+    } else if (_IsWanted(piece)) {
+        _freshCount--;
+    }
+    if (_IsWanted(piece)) {
+        _Remove(pieceIndex);
+    }
+    piece.flags |= _HaveFlag;
+    _haveCount++;
+}
+
+void PiecePicker::OnPieceFailed(uint32_t pieceIndex) {
+    if (!(_pieces[pieceIndex].flags & _PartialFlag)) {
+        return;
+    }
+    _ErasePartial(pieceIndex);
+    if (_IsWanted(_pieces[pieceIndex])) {
+        _freshCount++;
+        _sequentialCursor = std::min(_sequentialCursor, pieceIndex);
+    }
+}
+
+bool PiecePicker::Have(uint32_t pieceIndex) const {
+    return _pieces[pieceIndex].flags & _HaveFlag;
+}
+
+size_t PiecePicker::haveCount() const {
+    return _haveCount;
+}
+
+bool PiecePicker::endgame() const {
+    return _freshCount == 0 && _freeBlocksCount == 0 && !_partials.empty();
+}
+
+bool PiecePicker::_IsWanted(const PieceState& piece) const {
+    return !(piece.flags & _HaveFlag) && piece.priority != SkipPriority;
+}
+
+void PiecePicker::_Swap(Level& level, uint32_t first, uint32_t second) {
+    std::swap(level.pieces[first], level.pieces[second]);
+    _pieces[level.pieces[first]].position = first;
+    _pieces[level.pieces[second]].position = second;
+}
+
+void PiecePicker::_TrimBuckets(Level& level) {
+    std::vector<uint32_t>& begins = level.bucketBegins;
+    while (begins.size() > 1 && begins[begins.size() - 2] == begins.back()) {
+        begins.pop_back();
+    }
+}
+
+void PiecePicker::_Insert(uint32_t pieceIndex) {
+    PieceState& piece = _pieces[pieceIndex];
+    Level& level = _levels[piece.priority];
+    std::vector<uint32_t>& begins = level.bucketBegins;
+    while (begins.size() < piece.availability + 2) {
+        begins.insert(begins.end() - 1, begins.back());
+    }
+
+    // appended to the last bucket, then moved down by taking the first place of every bucket
+    // above its own
+    uint32_t position = static_cast<uint32_t>(level.pieces.size());
+    level.pieces.push_back(pieceIndex);
+    piece.position = position;
+    begins.back()++;
+    for (size_t bucket = begins.size() - 2; bucket > piece.availability; bucket--) {
+        _Swap(level, position, begins[bucket]);
+        position = begins[bucket]++;
+    }
+}
+
+void PiecePicker::_Remove(uint32_t pieceIndex) {
+    const PieceState& piece = _pieces[pieceIndex];
+    Level& level = _levels[piece.priority];
+    std::vector<uint32_t>& begins = level.bucketBegins;
+
+    // moved up to the end by taking the last place of every bucket above its own
+    uint32_t position = piece.position;
+    for (size_t bucket = piece.availability + 1; bucket < begins.size(); bucket++) {
+        uint32_t last = --begins[bucket];
+        _Swap(level, position, last);
+        position = last;
+    }
+    level.pieces.pop_back();
+    _TrimBuckets(level);
+}
+
+void PiecePicker::_Increment(uint32_t pieceIndex) {
+    PieceState& piece = _pieces[pieceIndex];
+    Level& level = _levels[piece.priority];
+    std::vector<uint32_t>& begins = level.bucketBegins;
+    if (begins.size() < piece.availability + 3) {
+        begins.insert(begins.end() - 1, begins.back());
+    }
+    // the last place of its bucket becomes the first of the next one
+    uint32_t last = --begins[piece.availability + 1];
+    _Swap(level, piece.position, last);
+    piece.availability++;
+}
+
+void PiecePicker::_Decrement(uint32_t pieceIndex) {
+    PieceState& piece = _pieces[pieceIndex];
+    Level& level = _levels[piece.priority];
+    // the first place of its bucket becomes the last of the previous one
+    uint32_t first = level.bucketBegins[piece.availability]++;
+    _Swap(level, piece.position, first);
+    piece.availability--;
+    _TrimBuckets(level);
+}
+
+long long PiecePicker::_PieceSize(uint32_t pieceIndex) const {
+    if (pieceIndex + 1 == _pieces.size()) {
+        return _totalSize - static_cast<long long>(pieceIndex) * _pieceLength;
+    }
+    return _pieceLength;
+}
+
+PiecePicker::Partial& PiecePicker::_StartPartial(uint32_t pieceIndex) {
+    auto blocksCount = static_cast<uint32_t>((_PieceSize(pieceIndex) + _options.blockSize - 1) /
+                                             _options.blockSize);
+    _pieces[pieceIndex].flags |= _PartialFlag;
+    _freshCount--;
+    _freeBlocksCount += blocksCount;
+    _partialIndexes.emplace(pieceIndex, static_cast<uint32_t>(_partials.size()));
+    return _partials.emplace_back(
+        Partial{pieceIndex, blocksCount, 0, std::vector<Block>(blocksCount)});
+}
+
+void PiecePicker::_ErasePartial(uint32_t pieceIndex) {
+    auto it = _partialIndexes.find(pieceIndex);
+    uint32_t index = it->second;
+    _partialIndexes.erase(it);
+    _freeBlocksCount -= _partials[index].freeCount;
+    if (index + 1 != _partials.size()) {
+        _partials[index] = std::move(_partials.back());
+        _partialIndexes[_partials[index].pieceIndex] = index;
+    }
+    _partials.pop_back();
+    _pieces[pieceIndex].flags &= ~_PartialFlag;
+}
+
+PiecePicker::Block* PiecePicker::_FindBlock(const peer_wire::BlockInfo& block,
+                                            Partial*& partial) {
+    auto it = _partialIndexes.find(block.pieceIndex);
+    if (it == _partialIndexes.end() || block.begin % _options.blockSize != 0) {
+        return nullptr;
+    }
+    partial = &_partials[it->second];
+    size_t index = block.begin / _options.blockSize;
+    return index < partial->blocks.size() ? &partial->blocks[index] : nullptr;
+}
+
+void PiecePicker::_PickFrom(Partial& partial, size_t count,
+                            std::vector<peer_wire::BlockInfo>& blocks) {
+    long long pieceSize = _PieceSize(partial.pieceIndex);
+    for (uint32_t i = 0; i < partial.blocks.size() && count > 0 && partial.freeCount > 0; i++) {
+        Block& block = partial.blocks[i];
+        if (block.state != BlockState::Free) {
+            continue;
+        }
+        block.state = BlockState::Requested;
+        block.requests = 1;
+        partial.freeCount--;
+        _freeBlocksCount--;
+        count--;
+        uint32_t begin = i * _options.blockSize;
+        auto length = static_cast<uint32_t>(std::min<long long>(_options.blockSize,
+                                                                pieceSize - begin));
+        blocks.push_back({partial.pieceIndex, begin, length});
+    }
+}
+
+void PiecePicker::_PickEndgame(const Bitfield& peerPieces, size_t count,
+                               std::span<const peer_wire::BlockInfo> peerRequests,
+                               std::vector<peer_wire::BlockInfo>& blocks) {
+    struct Candidate {
+        Block* block;
+        peer_wire::BlockInfo info;
+    };
+    std::vector<Candidate> candidates;
+    for (Partial& partial : _partials) {
+        if (!peerPieces.Test(partial.pieceIndex) ||
+            _pieces[partial.pieceIndex].priority == SkipPriority) {
+            continue;
+        }
+        long long pieceSize = _PieceSize(partial.pieceIndex);
+        for (uint32_t i = 0; i < partial.blocks.size(); i++) {
+            Block& block = partial.blocks[i];
+            uint32_t begin = i * _options.blockSize;
+            auto length = static_cast<uint32_t>(
+                std::min<long long>(_options.blockSize, pieceSize - begin));
+            peer_wire::BlockInfo info{partial.pieceIndex, begin, length};
+            if (block.state == BlockState::Requested && block.requests < UINT8_MAX &&
+                std::find(peerRequests.begin(), peerRequests.end(), info) ==
+                    peerRequests.end() &&
+                std::find(blocks.begin(), blocks.end(), info) == blocks.end()) {
+                candidates.push_back({&block, info});
+            }
+        }
+    }
+
+    // blocks requested the fewest times first, so every slow one gets raced
+    count = std::min(count, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                      [](const Candidate& left, const Candidate& right) {
+                          return left.block->requests < right.block->requests;
+                      });
+    for (size_t i = 0; i < count; i++) {
+        candidates[i].block->requests++;
+        blocks.push_back(candidates[i].info);
+    }
+}
+
+} // namespace bt
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "bitfield.hpp"
+#include "peer_wire.hpp"
+#include "torrent_metadata.hpp"
+
+namespace bt {
+
+struct PiecePickerOptions {
+    uint32_t blockSize = 16 * 1024;
+
+    /**
+     * @brief pieces are picked in index order instead of rarest first, e.g. for streaming
+     */
+    bool sequential = false;
+
+    /**
+     * @brief order of pieces that are equally rare, clients should not all pick the same
+     */
+    uint32_t seed = 0;
+};
+
+/**
+ * @brief decides which blocks to request from a peer
+ * @brief wanted pieces are kept in an array per priority, sorted by availability in buckets:
+ *        a HAVE moves the piece to the border of its bucket and shifts the border, so count
+ *        changes are O(1) and the rarest pieces a peer has are found from the front
+ * @brief pieces other peers are downloading are finished first; once every missing block is
+ *        requested (endgame) blocks are handed out again to other peers
+ * @brief not thread safe
+ */
+class PiecePicker {
+  public:
+    static constexpr uint8_t SkipPriority = 0; // never downloaded
+    static constexpr uint8_t DefaultPriority = 4;
+    static constexpr uint8_t MaxPriority = 7;
+
+    /**
+     * @param pieceLength size of the pieces but the last
+     * @param totalSize size of the torrent's data
+     */
+    PiecePicker(size_t piecesCount, long long pieceLength, long long totalSize,
+                PiecePickerOptions options = {});
+
+    explicit PiecePicker(const TorrentMetadata& torrent, PiecePickerOptions options = {});
+
+    size_t piecesCount() const;
+
+    /**
+     * @return count of peers having the piece, seeds included
+     */
+    size_t availability(uint32_t pieceIndex) const;
+
+    uint8_t priority(uint32_t pieceIndex) const;
+
+    /**
+     * @brief the priority of pieces we have can be changed too, it is kept
+     * @param priority SkipPriority to MaxPriority, higher ones are picked first
+     */
+    void SetPriority(uint32_t pieceIndex, uint8_t priority);
+
+    // a peer's pieces are counted as it announces them and uncounted when it disconnects
+
+    /**
+     * @brief a peer sent HAVE
+     */
+    void IncrementAvailability(uint32_t pieceIndex);
+    void DecrementAvailability(uint32_t pieceIndex);
+
+    /**
+     * @brief a peer sent its bitfield, or left; peers having every piece should be counted with
+     *        AddSeed instead, which is O(1)
+     */
+    void IncrementAvailability(const Bitfield& pieces);
+    void DecrementAvailability(const Bitfield& pieces);
+
+    void AddSeed();
+    void RemoveSeed();
+
+    /**
+     * @brief blocks of pieces being downloaded come first, then new pieces by priority and
+     *        rarity (or index in sequential mode), in endgame blocks requested from others
+     * @param peerPieces what the peer has
+     * @param count most blocks to return
+     * @param peerRequests blocks already requested from the peer, never returned again
+     * @return blocks to request, they count as requested until received or failed
+     */
+    std::vector<peer_wire::BlockInfo> Pick(
+        const Bitfield& peerPieces, size_t count,
+        std::span<const peer_wire::BlockInfo> peerRequests = {});
+
+    /**
+     * @brief the peer choked us, rejected the request or disconnected
+     */
+    void OnRequestFailed(const peer_wire::BlockInfo& block);
+
+    /**
+     * @return true when this was the last missing block of the piece, hash it now
+     */
+    bool OnBlockReceived(const peer_wire::BlockInfo& block);
+
+    /**
+     * @brief the piece passed its hash check, or was found on disk
+     */
+    void OnPieceVerified(uint32_t pieceIndex);
+
+    /**
+     * @brief the piece failed its hash check, it is downloaded again
+     */
+    void OnPieceFailed(uint32_t pieceIndex);
+
+    bool Have(uint32_t pieceIndex) const;
+
+    size_t haveCount() const;
+
+    /**
+     * @return true when every block of the wanted pieces is requested or received
+     */
+    bool endgame() const;
+
+  private:
+    enum : uint8_t {
+        _HaveFlag = 1,
+        _PartialFlag = 2, // has an entry in _partials
+    };
+
+    struct PieceState {
+        uint32_t position = 0;     // in the array of its priority
+        uint32_t availability = 0; // seeds are not counted
+        uint8_t priority = DefaultPriority;
+        uint8_t flags = 0;
+    };
+
+    // pieces of one priority, bucket a is [bucketBegins[a], bucketBegins[a + 1]), the last
+    // entry is the end of the array
+    struct Level {
+        std::vector<uint32_t> pieces;
+        std::vector<uint32_t> bucketBegins{0};
+    };
+
+    enum class BlockState : uint8_t {
+        Free,
+        Requested,
+        Received,
+    };
+
+    struct Block {
+        BlockState state = BlockState::Free;
+        uint8_t requests = 0; // more than one in endgame
+    };
+
+    struct Partial {
+        uint32_t pieceIndex;
+        uint32_t freeCount = 0;
+        uint32_t receivedCount = 0;
+        std::vector<Block> blocks;
+    };
+
+    bool _IsWanted(const PieceState& piece) const; // in a level
+    void _Swap(Level& level, uint32_t first, uint32_t second);
+    void _TrimBuckets(Level& level);
+    void _Insert(uint32_t pieceIndex);
+    void _Remove(uint32_t pieceIndex);
+    void _Increment(uint32_t pieceIndex);
+    void _Decrement(uint32_t pieceIndex);
+    long long _PieceSize(uint32_t pieceIndex) const;
+    Partial& _StartPartial(uint32_t pieceIndex);
+    void _ErasePartial(uint32_t pieceIndex);
+    Block* _FindBlock(const peer_wire::BlockInfo& block, Partial*& partial);
+    void _PickFrom(Partial& partial, size_t count, std::vector<peer_wire::BlockInfo>& blocks);
+    void _PickEndgame(const Bitfield& peerPieces, size_t count,
+                      std::span<const peer_wire::BlockInfo> peerRequests,
+                      std::vector<peer_wire::BlockInfo>& blocks);
+
+    PiecePickerOptions _options;
+    long long _pieceLength;
+    long long _totalSize;
+    std::vector<PieceState> _pieces;
+    std::array<Level, MaxPriority + 1> _levels; // by priority, SkipPriority stays empty
+    uint32_t _seedsCount = 0;
+    size_t _haveCount = 0;
+
+    std::vector<Partial> _partials;
+    std::unordered_map<uint32_t, uint32_t> _partialIndexes; // piece to index in _partials
+    size_t _freshCount = 0;         // wanted pieces without a partial
+    size_t _freeBlocksCount = 0;    // in _partials
+    uint32_t _sequentialCursor = 0; // no fresh wanted piece before it
+};
+
+} // namespace bt
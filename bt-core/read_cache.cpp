@@ -0,0 +1,163 @@
+#include "read_cache.hpp"
+#include "peer_wire.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace bt {
+
+using peer_wire::BlockSize;
+
+ReadCache::ReadCache(size_t maxBytes) : _capacity(std::max<size_t>(maxBytes / BlockSize, 1)) {
+}
+
+std::optional<std::vector<std::byte>> ReadCache::Find(size_t storage, uint32_t pieceIndex,
+                                                      uint32_t begin, size_t length,
+                                                      bool countMiss) {
+    uint32_t index = begin / BlockSize;
+    size_t offset = begin - index * BlockSize;
+    auto it = _entries.find({storage, pieceIndex, index});
+    if (it == _entries.end() || it->second.list == RecentGhosts ||
+        it->second.list == FrequentGhosts || offset + length > it->second.data.size()) {
+        _stats.misses += countMiss;
+        return std::nullopt;
+    }
+    _stats.hits++;
+    Entry& entry = it->second;
+    if (entry.readAhead) {
+        // the first time it is asked for
+        _stats.readAheadHits++;
+        entry.readAhead = false;
+        _Move(it, Recent);
+    } else {
+        _Move(it, Frequent);
+    }
+    auto bytes = entry.data.begin() + static_cast<ptrdiff_t>(offset);
+    return std::vector<std::byte>(bytes, bytes + static_cast<ptrdiff_t>(length));
+}
+
+void ReadCache::Insert(size_t storage, uint32_t pieceIndex, uint32_t begin,
+                       std::vector<std::byte> data, bool readAhead) {
+    Key key{storage, pieceIndex, begin / BlockSize};
+    auto it = _entries.find(key);
+    if (it != _entries.end() && (it->second.list == Recent || it->second.list == Frequent)) {
+        _size += data.size();
+        _size -= it->second.data.size();
+        it->second.data = std::move(data);
+        return;
+    }
+
+    if (it != _entries.end() && !readAhead) {
+        // asked for again soon after its eviction: the list it was evicted from was too short
+        size_t recentGhosts = _lists[RecentGhosts].size();
+        size_t frequentGhosts = _lists[FrequentGhosts].size();
+        if (it->second.list == RecentGhosts) {
+            _recentTarget = std::min(
+                _capacity, _recentTarget + std::max<size_t>(frequentGhosts / recentGhosts, 1));
+            _Replace(false);
+        } else {
+            _recentTarget -= std::min(_recentTarget,
+                                      std::max<size_t>(recentGhosts / frequentGhosts, 1));
+            _Replace(true);
+        }
+        _size += data.size();
+        it->second.data = std::move(data);
+        _Move(it, Frequent);
+        return;
+    }
+    if (it != _entries.end()) {
+        // reading ahead is no sign that the block is wanted
+        _Remove(it);
+    }
+
+    size_t recentKeys = _lists[Recent].size() + _lists[RecentGhosts].size();
+    size_t keys = recentKeys + _lists[Frequent].size() + _lists[FrequentGhosts].size();
+    if (recentKeys >= _capacity) {
+        if (_lists[Recent].size() < _capacity) {
+            _RemoveLeastRecent(RecentGhosts);
+            _Replace(false);
+        } else {
+            _RemoveLeastRecent(Recent);
+        }
+    } else if (keys >= _capacity) {
+        if (keys >= 2 * _capacity) {
+            _RemoveLeastRecent(FrequentGhosts);
+        }
+        _Replace(false);
+    }
+    _size += data.size();
+    _lists[Recent].push_back(key);
+    _entries.emplace(key, Entry{Recent, std::prev(_lists[Recent].end()), std::move(data),
+                                readAhead});
+}
+
+void ReadCache::Erase(size_t storage, uint32_t pieceIndex) {
+    auto it = _entries.lower_bound({storage, pieceIndex, 0});
+    while (it != _entries.end() && std::get<0>(it->first) == storage &&
+           std::get<1>(it->first) == pieceIndex) {
+        _Remove(it++);
+    }
+}
+
+void ReadCache::EraseStorage(size_t storage) {
+    auto it = _entries.lower_bound({storage, 0, 0});
+    while (it != _entries.end() && std::get<0>(it->first) == storage) {
+        _Remove(it++);
+    }
+}
+
+size_t ReadCache::size() const {
+    return _size;
+}
+
+size_t ReadCache::blocksCount() const {
+    return _lists[Recent].size() + _lists[Frequent].size();
+}
+
+ReadCache::Stats ReadCache::stats() const {
+    return _stats;
+}
+
+void ReadCache::_Move(Entries::iterator it, ListId list) {
+    Entry& entry = it->second;
+    _lists[list].splice(_lists[list].end(), _lists[entry.list], entry.position);
+    entry.list = list;
+}
+
+void ReadCache::_Remove(Entries::iterator it) {
+    _lists[it->second.list].erase(it->second.position);
+    _size -= it->second.data.size();
+    _entries.erase(it);
+}
+
+void ReadCache::_RemoveLeastRecent(ListId list) {
+    if (!_lists[list].empty()) {
+        _Remove(_entries.find(_lists[list].front()));
+    }
+}
+
+void ReadCache::_Replace(bool frequentGhostHit) {
+    size_t recent = _lists[Recent].size();
+    if (recent + _lists[Frequent].size() < _capacity) {
+        return;
+    }
+    bool fromRecent = recent > 0 && (recent > _recentTarget ||
+                                     (frequentGhostHit && recent == _recentTarget) ||
+                                     _lists[Frequent].empty());
+    ListId list = fromRecent ? Recent : Frequent;
+    ListId ghosts = fromRecent ? RecentGhosts : FrequentGhosts;
+    auto it = _entries.find(_lists[list].front());
+    if (it->second.readAhead) {
+        // never asked for, its key says nothing about what is
+        _Remove(it);
+        return;
+    }
+    _size -= it->second.data.size();
+    it->second.data = {};
+    _Move(it, ghosts);
+    if (_lists[ghosts].size() > _capacity) {
+        _RemoveLeastRecent(ghosts);
+    }
+}
+
+} // namespace bt
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+namespace bt {
+
+/**
+ * @brief blocks read from the files, kept for the next peers asking for them
+ * @brief replacement is ARC (Megiddo and Modha, adaptive replacement cache): blocks read
+ *        once are kept in a recency list, blocks read again move to a frequency list, and
+ *        the split between the two follows the keys of recently evicted blocks; a scan that
+ *        reads every block once, e.g. a peer downloading the whole torrent, only churns the
+ *        recency list and leaves the blocks many peers ask for alone
+ * @brief blocks are keyed by storage, piece and offset in the piece, which is a multiple of
+ *        peer_wire::BlockSize; a block brought in by read-ahead counts as read once only when
+ *        it is first asked for
+ * @brief does no io; not thread safe
+ */
+class ReadCache {
+  public:
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t readAheadHits = 0; // hits on blocks read ahead, counted in hits as well
+    };
+
+    /**
+     * @param maxBytes holds maxBytes / peer_wire::BlockSize blocks, at least one
+     */
+    explicit ReadCache(size_t maxBytes);
+
+    /**
+     * @param countMiss false for a lookup that is tried again before the bytes are read, so
+     *        that only the last one counts as a miss
+     * @return copy of the cached bytes, if one block holds all of them
+     */
+    std::optional<std::vector<std::byte>> Find(size_t storage, uint32_t pieceIndex,
+                                               uint32_t begin, size_t length,
+                                               bool countMiss = true);
+
+    /**
+     * @brief adds a block, replaces it if it is cached already
+     * @param begin multiple of peer_wire::BlockSize
+     * @param readAhead whether the block was read ahead of being asked for
+     */
+    void Insert(size_t storage, uint32_t pieceIndex, uint32_t begin, std::vector<std::byte> data,
+                bool readAhead);
+
+    /**
+     * @brief drops the cached blocks of the piece, e.g. because it is written
+     */
+    void Erase(size_t storage, uint32_t pieceIndex);
+
+    /**
+     * @brief drops the cached blocks and keys of the storage
+     */
+    void EraseStorage(size_t storage);
+
+    /**
+     * @return bytes of the cached blocks
+     */
+    size_t size() const;
+
+    /**
+     * @return count of cached blocks
+     */
+    size_t blocksCount() const;
+
+    Stats stats() const;
+
+  private:
+    using Key = std::tuple<size_t, uint32_t, uint32_t>; // storage, piece, block index
+
+    enum ListId { Recent, Frequent, RecentGhosts, FrequentGhosts };
+
+    struct Entry {
+        ListId list;
+        std::list<Key>::iterator position;
+        std::vector<std::byte> data; // empty for ghosts
+        bool readAhead = false;
+    };
+
+    using Entries = std::map<Key, Entry>;
+
+    void _Move(Entries::iterator it, ListId list);
+    void _Remove(Entries::iterator it);
+    void _RemoveLeastRecent(ListId list);
+    /**
+     * @brief evicts a block of the recency or frequency list to make room, keeping its key
+     */
+    void _Replace(bool frequentGhostHit);
+
+    size_t _capacity; // blocks, every list and both ghost lists hold up to that many keys
+    size_t _recentTarget = 0; // ARC's p, blocks the recency list should hold
+    size_t _size = 0;
+    Entries _entries;
+    std::list<Key> _lists[4]; // least recent first, by ListId
+    Stats _stats;
+};
+
+} // namespace bt
@@ -0,0 +1,299 @@
+#include "recheck.hpp"
+#include "piece_hashing.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace bt {
+
+namespace {
+
+/**
+ * @brief keeps the file that is currently read open, files are visited in order
+ */
+class SequentialReader {
+  public:
+    SequentialReader(const StorageLayout& layout) : _layout(layout) {
+    }
+
+    ~SequentialReader() {
+        _Close();
+    }
+
+    SequentialReader(const SequentialReader&) = delete;
+    SequentialReader& operator=(const SequentialReader&) = delete;
+
+    /**
+     * @return false if the file is missing or shorter than offset + length; pad files are not
+     *         stored and read as zeros, files not wanted are read from the part file
+     */
+    bool ReadAt(size_t fileIndex, long long offset, char* out, long long length) {
+        if (_layout.torrent().files().isPadFile(fileIndex)) {
+            std::fill_n(out, length, '\0');
+            return true;
+        }
+        if (fileIndex != _fileIndex) {
+            _Close();
+            _Open(fileIndex);
+        }
+        if (!_IsOpen()) {
+            return false;
+        }
+        offset += _layout.storedOffset(fileIndex);
+
+        while (length > 0) {
+#ifdef _WIN32
+            OVERLAPPED overlapped{};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD chunk = static_cast<DWORD>(std::min<long long>(length, 1 << 30));
+            DWORD read = 0;
+            if (!ReadFile(_handle, out, chunk, &read, &overlapped) || read == 0) {
+                return false;
+            }
+#else
+            ssize_t read = pread(_fd, out, static_cast<size_t>(length), offset);
+            if (read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (read <= 0) {
+                return false;
+            }
+#endif
+            out += read;
+            offset += read;
+            length -= read;
+        }
+        return true;
+    }
+
+  private:
+    void _Open(size_t fileIndex) {
+        _fileIndex = fileIndex;
+        std::filesystem::path path = _layout.storedPath(fileIndex);
+#ifdef _WIN32
+        _handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+#else
+        _fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (_fd >= 0) {
+            posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+#endif
+    }
+
+    bool _IsOpen() const {
+#ifdef _WIN32
+        return _handle != INVALID_HANDLE_VALUE;
+#else
+        return _fd >= 0;
+#endif
+    }
+
+    void _Close() {
+#ifdef _WIN32
+        if (_handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(_handle);
+            _handle = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (_fd >= 0) {
+            close(_fd);
+            _fd = -1;
+        }
+#endif
+    }
+
+    const StorageLayout& _layout;
+    size_t _fileIndex = SIZE_MAX;
+#ifdef _WIN32
+    HANDLE _handle = INVALID_HANDLE_VALUE;
+#else
+    int _fd = -1;
+#endif
+};
+
+/**
+ * @brief consecutive pieces read at once, handed from the reading thread to a hasher and back
+ */
+struct ReadBatch {
+    std::unique_ptr<char[]> buffer;
+    size_t firstPiece = 0;
+    size_t piecesCount = 0;
+    long long length = 0;
+    std::vector<char> readable; // per piece, false if some of its data could not be read
+    std::vector<char> valid;    // per piece, set by the hasher
+};
+
+} // namespace
+
+Bitfield Recheck(const StorageLayout& layout, const RecheckOptions& options) {
+    const TorrentMetadata& torrent = layout.torrent();
+    const size_t piecesCount = static_cast<size_t>(torrent.piecesCount());
+    Bitfield bitfield(piecesCount);
+    const long long pieceLength = torrent.pieceLength();
+    if (piecesCount == 0 || pieceLength <= 0) {
+        return bitfield;
+    }
+    const size_t piecesPerRead =
+        std::max<size_t>(1, options.readSize / static_cast<size_t>(pieceLength));
+
+    // shared with the hashing tasks, declared before the pool so that they outlive the tasks
+    // when the reading loop throws
+    std::vector<ReadBatch> batches;
+    std::mutex mutex;
+    std::condition_variable batchHashed;
+    std::vector<ReadBatch*> idle;
+    std::vector<ReadBatch*> hashed;
+
+    ThreadPool pool(options.threadsCount);
+    size_t readsInFlight = options.readsInFlight != 0 ? options.readsInFlight : pool.size() + 2;
+    readsInFlight = std::min(readsInFlight, (piecesCount + piecesPerRead - 1) / piecesPerRead);
+
+    batches.resize(readsInFlight);
+    // reserved so that returning a hashed batch never allocates
+    hashed.reserve(readsInFlight);
+    for (ReadBatch& batch : batches) {
+        batch.buffer = std::make_unique_for_overwrite<char[]>(piecesPerRead * pieceLength);
+        idle.push_back(&batch);
+    }
+
+    RecheckProgress progress{0, 0, piecesCount, 0, torrent.totalSize()};
+    // applies hashed batches to the bitfield and returns them to idle, called with mutex held
+    auto collect = [&] {
+        for (ReadBatch* batch : hashed) {
+            for (size_t i = 0; i < batch->piecesCount; i++) {
+                if (batch->valid[i]) {
+                    bitfield.Set(batch->firstPiece + i);
+                    progress.piecesValid++;
+                }
+            }
+            progress.piecesChecked += batch->piecesCount;
+            progress.bytesChecked += batch->length;
+            idle.push_back(batch);
+        }
+        bool reported = !hashed.empty();
+        hashed.clear();
+        return reported;
+    };
+    auto report = [&](bool reported) {
+        if (reported && options.onProgress) {
+            options.onProgress(progress);
+        }
+    };
+
+    SequentialReader reader(layout);
+    for (size_t piece = 0; piece < piecesCount && !options.stopToken.stop_requested();) {
+        ReadBatch* batch;
+        bool reported;
+        {
+            std::unique_lock lock(mutex);
+            batchHashed.wait(lock, [&] { return !idle.empty() || !hashed.empty(); });
+            reported = collect();
+            batch = idle.back();
+            idle.pop_back();
+        }
+        report(reported);
+
+        batch->firstPiece = piece;
+        batch->piecesCount = std::min(piecesPerRead, piecesCount - piece);
+        batch->readable.assign(batch->piecesCount, true);
+        batch->valid.assign(batch->piecesCount, false);
+
+        // pieces past the end of the data (more hashes than data) can never be valid
+        long long offset = static_cast<long long>(piece) * pieceLength;
+        long long end = std::min(offset + static_cast<long long>(batch->piecesCount) * pieceLength,
+                                 torrent.totalSize());
+        batch->length = std::max(0LL, end - offset);
+        for (size_t i = 0; i < batch->piecesCount; i++) {
+            if (offset + static_cast<long long>(i) * pieceLength >= end) {
+                batch->readable[i] = false;
+            }
+        }
+
+        long long position = 0; // in the batch
+        for (FileSlice slice : torrent.files().MapRange(offset, batch->length)) {
+            if (!reader.ReadAt(slice.fileIndex, slice.offset, batch->buffer.get() + position,
+                               slice.length)) {
+                size_t first = static_cast<size_t>(position / pieceLength);
+                size_t last = static_cast<size_t>((position + slice.length - 1) / pieceLength);
+                std::fill(batch->readable.begin() + first, batch->readable.begin() + last + 1,
+                          false);
+            }
+            position += slice.length;
+        }
+        piece += batch->piecesCount;
+
+        pool.Post([&, batch] {
+            try {
+                std::vector<std::span<const std::byte>> pieces;
+                std::vector<size_t> indices;
+                for (size_t i = 0; i < batch->piecesCount; i++) {
+                    if (!batch->readable[i]) {
+                        continue;
+                    }
+                    long long pieceBegin = static_cast<long long>(i) * pieceLength;
+                    long long pieceEnd = std::min(pieceBegin + pieceLength, batch->length);
+                    pieces.push_back(std::as_bytes(std::span(batch->buffer.get() + pieceBegin,
+                                                             batch->buffer.get() + pieceEnd)));
+                    indices.push_back(i);
+                }
+
+                std::vector<Sha1Digest> digests(pieces.size());
+                HashPieces(pieces, digests);
+                for (size_t i = 0; i < digests.size(); i++) {
+                    size_t index = batch->firstPiece + indices[i];
+                    batch->valid[indices[i]] =
+                        digests[i] == Sha1Digest::FromBytes(torrent.pieceHash(index).data());
+                }
+            } catch (const std::exception& error) {
+                // the batch must still come back or the recheck waits for it forever
+                LogError("recheck failed to hash pieces: {}", error.what());
+                std::fill(batch->valid.begin(), batch->valid.end(), false);
+            }
+
+            // notify under the lock, the recheck may return as soon as it sees the batch
+            std::lock_guard lock(mutex);
+            hashed.push_back(batch);
+            batchHashed.notify_one();
+        });
+    }
+
+    // wait for the reads still being hashed
+    for (;;) {
+        bool reported;
+        bool done;
+        {
+            std::unique_lock lock(mutex);
+            batchHashed.wait(lock,
+                             [&] { return idle.size() == batches.size() || !hashed.empty(); });
+            reported = collect();
+            done = idle.size() == batches.size();
+        }
+        report(reported);
+        if (done) {
+            break;
+        }
+    }
+    return bitfield;
+}
+
+} // namespace bt
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <stop_token>
+
+#include "bitfield.hpp"
+#include "storage_layout.hpp"
+
+namespace bt {
+
+/**
+ * @brief state of a running Recheck, reported after every hashed read
+ */
+struct RecheckProgress {
+    size_t piecesChecked;
+    size_t piecesValid;
+    size_t piecesCount;
+    long long bytesChecked;
+    long long totalBytes;
+};
+
+struct RecheckOptions {
+    /**
+     * @brief hashing threads, 0 for one per hardware thread
+     */
+    size_t threadsCount = 0;
+
+    /**
+     * @brief bytes read from disk at once, rounded down to whole pieces but at least one piece
+     */
+    size_t readSize = 4 * 1024 * 1024;
+
+    /**
+     * @brief reads that may be in flight or waiting to be hashed, 0 for threads count + 2
+     * @brief memory used is about readsInFlight * readSize
+     */
+    size_t readsInFlight = 0;
+
+    /**
+     * @brief called on the calling thread every time a read has been hashed
+     */
+    std::function<void(const RecheckProgress&)> onProgress;
+
+    /**
+     * @brief stops the recheck early, pieces not checked yet are left unset
+     */
+    std::stop_token stopToken;
+};
+
+/**
+ * @brief verifies data on disk against the piece hashes of the torrent
+ * @brief the calling thread reads the files front to back in large sequential reads while
+ *        earlier reads are hashed on a thread pool, so a recheck is bound by disk bandwidth
+ * @brief missing files and short files only fail the pieces they overlap
+ * @param layout where the torrent's files are stored
+ * @return bitfield with the pieces whose data matches their hash
+ */
+Bitfield Recheck(const StorageLayout& layout, const RecheckOptions& options = {});
+
+} // namespace bt
@@ -0,0 +1,122 @@
+#include "request_queue.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bt {
+
+RequestQueue::RequestQueue(RequestQueueOptions options)
+    : _options(options),
+      _depth(std::clamp(options.initialDepth, options.minDepth, options.maxDepth)) {
+    if (!_options.adaptive) {
+        _depth = _options.initialDepth;
+    }
+}
+
+size_t RequestQueue::depth() const {
+    return _depth;
+}
+
+size_t RequestQueue::size() const {
+    return _requests.size();
+}
+
+size_t RequestQueue::deficit() const {
+    return _depth > _requests.size() ? _depth - _requests.size() : 0;
+}
+
+bool RequestQueue::Contains(const peer_wire::BlockInfo& block) const {
+    return std::any_of(_requests.begin(), _requests.end(),
+                       [&](const Request& request) { return request.block == block; });
+}
+
+double RequestQueue::rate() const {
+    return _maxRate;
+}
+
+RequestQueue::Clock::duration RequestQueue::minRtt() const {
+    return _minRtt;
+}
+
+RequestQueue::Clock::duration RequestQueue::timeout() const {
+    return std::max(_options.minTimeout, 4 * _smoothedRtt);
+}
+
+void RequestQueue::OnRequested(const peer_wire::BlockInfo& block, Clock::time_point now) {
+    _requests.push_back({block, now, _delivered});
+}
+
+bool RequestQueue::OnReceived(const peer_wire::BlockInfo& block, Clock::time_point now) {
+    auto it = std::find_if(_requests.begin(), _requests.end(),
+                           [&](const Request& request) { return request.block == block; });
+    if (it == _requests.end()) {
+        return false;
+    }
+    Request request = *it;
+    _requests.erase(it);
+    _delivered += block.length;
+
+    Clock::duration rtt = std::max(now - request.sentAt, Clock::duration(1));
+    if (_minRtt == Clock::duration(0) || rtt <= _minRtt || now - _minRttAt > _options.window) {
+        _minRtt = rtt;
+        _minRttAt = now;
+    }
+    _smoothedRtt = _smoothedRtt == Clock::duration(0) ? rtt : (7 * _smoothedRtt + rtt) / 8;
+
+    double rate = double(_delivered - request.deliveredAtSend) /
+                  std::chrono::duration<double>(rtt).count();
+    if (rate >= _maxRate || now - _maxRateAt > _options.window) {
+        _maxRate = rate;
+        _maxRateAt = now;
+    }
+    _UpdateDepth();
+    return true;
+}
+
+bool RequestQueue::Remove(const peer_wire::BlockInfo& block) {
+    auto it = std::find_if(_requests.begin(), _requests.end(),
+                           [&](const Request& request) { return request.block == block; });
+    if (it == _requests.end()) {
+        return false;
+    }
+    _requests.erase(it);
+    return true;
+}
+
+std::vector<peer_wire::BlockInfo> RequestQueue::Clear() {
+    std::vector<peer_wire::BlockInfo> blocks;
+    for (const Request& request : _requests) {
+        blocks.push_back(request.block);
+    }
+    _requests.clear();
+    return blocks;
+}
+
+std::vector<peer_wire::BlockInfo> RequestQueue::TakeTimedOut(Clock::time_point now) {
+    std::vector<peer_wire::BlockInfo> blocks;
+    Clock::duration limit = timeout();
+    std::erase_if(_requests, [&](const Request& request) {
+        if (now - request.sentAt <= limit) {
+            return false;
+        }
+        blocks.push_back(request.block);
+        return true;
+    });
+    if (!blocks.empty()) {
+        _maxRate /= 2;
+        _UpdateDepth();
+    }
+    return blocks;
+}
+
+void RequestQueue::_UpdateDepth() {
+    if (!_options.adaptive) {
+        return;
+    }
+    double bdp = _maxRate * std::chrono::duration<double>(_minRtt).count();
+    double depth = std::ceil(_options.gain * bdp / peer_wire::BlockSize);
+    _depth = std::clamp(static_cast<size_t>(std::min(depth, double(_options.maxDepth))),
+                        _options.minDepth, _options.maxDepth);
+}
+
+} // namespace bt
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "peer_wire.hpp"
+
+namespace bt {
+
+struct RequestQueueOptions {
+    size_t initialDepth = 4;
+    size_t minDepth = 2;
+    size_t maxDepth = 500;
+
+    /**
+     * @brief false keeps initialDepth requests outstanding whatever the link does
+     */
+    bool adaptive = true;
+
+    /**
+     * @brief depth is gain times the bandwidth-delay product; above 1 a depth limited peer
+     *        shows more throughput on the next round trip, so the depth doubles per round
+     *        trip until the link is full
+     */
+    double gain = 2;
+
+    /**
+     * @brief a request is timed out after 4 round trips, but not before minTimeout
+     */
+    std::chrono::steady_clock::duration minTimeout = std::chrono::seconds(10);
+
+    /**
+     * @brief the lowest round trip and highest throughput are taken over this long, so the
+     *        estimates follow a link that got slower
+     */
+    std::chrono::steady_clock::duration window = std::chrono::seconds(10);
+};
+
+/**
+ * @brief block requests outstanding on one peer, and how many there should be
+ * @brief every received block gives a round trip time and a delivery rate (bytes received
+ *        while it was outstanding, over that time); the depth follows the highest rate times
+ *        the lowest round trip, which queueing at the peer does not inflate
+ * @brief does no io, time is passed in explicitly; not thread safe
+ */
+class RequestQueue {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RequestQueue(RequestQueueOptions options = {});
+
+    /**
+     * @return requests that should be outstanding
+     */
+    size_t depth() const;
+
+    /**
+     * @return requests outstanding
+     */
+    size_t size() const;
+
+    /**
+     * @return requests to send to reach depth
+     */
+    size_t deficit() const;
+
+    bool Contains(const peer_wire::BlockInfo& block) const;
+
+    /**
+     * @return bytes per second, 0 before the first block
+     */
+    double rate() const;
+
+    Clock::duration minRtt() const;
+
+    /**
+     * @return time after which a request is timed out
+     */
+    Clock::duration timeout() const;
+
+    void OnRequested(const peer_wire::BlockInfo& block, Clock::time_point now);
+
+    /**
+     * @return false if the block was not outstanding
+     */
+    bool OnReceived(const peer_wire::BlockInfo& block, Clock::time_point now);
+
+    /**
+     * @brief the request was cancelled
+     * @return false if the block was not outstanding
+     */
+    bool Remove(const peer_wire::BlockInfo& block);
+
+    /**
+     * @brief the peer choked us and dropped every request
+     * @return the dropped requests
+     */
+    std::vector<peer_wire::BlockInfo> Clear();
+
+    /**
+     * @brief removes requests outstanding for longer than timeout(), and halves the depth
+     *        if there are any: the peer or the link is congested
+     * @return the removed requests
+     */
+    std::vector<peer_wire::BlockInfo> TakeTimedOut(Clock::time_point now);
+
+  private:
+    struct Request {
+        peer_wire::BlockInfo block;
+        Clock::time_point sentAt;
+        uint64_t deliveredAtSend; // _delivered when it was sent
+    };
+
+    void _UpdateDepth();
+
+    RequestQueueOptions _options;
+    std::vector<Request> _requests; // oldest first
+    size_t _depth;
+    uint64_t _delivered = 0; // bytes received so far
+
+    double _maxRate = 0;
+    Clock::time_point _maxRateAt{};
+    Clock::duration _minRtt{};
+    Clock::time_point _minRttAt{};
+    Clock::duration _smoothedRtt{};
+};
+
+} // namespace bt
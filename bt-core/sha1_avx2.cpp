@@ -0,0 +1,182 @@
+// compiled with AVX2 enabled, only called after sha1_backend checked the CPU
+// do not use standard library inline functions here, they could be emitted with
+// instructions older CPUs do not have and then be picked by the linker for other units
+#include "sha1_backend.hpp"
+#include "sha1_multibuffer.hpp"
+
+#include <immintrin.h>
+
+namespace bt::sha1_backend {
+
+namespace {
+
+// the rounds of SHA1 form a single dependency chain, only the message schedule is
+// independent work, so it is computed for two blocks at once, one per 128 bit lane
+
+inline __m256i Rol(__m256i x, int bits) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, bits), _mm256_srli_epi32(x, 32 - bits));
+}
+
+/**
+ * @brief expands two blocks into their 80 words of message schedule with round constants added
+ * @param second may equal first for a trailing single block
+ */
+inline void Schedule(const uint8_t* first, const uint8_t* second, uint32_t wkFirst[80],
+                     uint32_t wkSecond[80]) {
+    const __m256i byteSwap = _mm256_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL,
+                                               0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+    const int k[4] = {0x5a827999, 0x6ed9eba1, static_cast<int>(0x8f1bbcdc),
+                      static_cast<int>(0xca62c1d6)};
+
+    __m256i w[20];
+    for (int i = 0; i < 4; i++) {
+        __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i * 16));
+        __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + i * 16));
+        w[i] = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1),
+                                   byteSwap);
+    }
+
+    // w[t] = rol1(w[t-3] ^ w[t-8] ^ w[t-14] ^ w[t-16]), four words at a time; the last word
+    // needs the first one of the same group, so it is left out and fixed up afterwards
+    for (int i = 4; i < 20; i++) {
+        __m256i wm3 = _mm256_srli_si256(w[i - 1], 4);
+        __m256i wm14 = _mm256_alignr_epi8(w[i - 3], w[i - 4], 8);
+        __m256i t = _mm256_xor_si256(_mm256_xor_si256(wm3, w[i - 2]),
+                                     _mm256_xor_si256(wm14, w[i - 4]));
+        __m256i r = Rol(t, 1);
+        w[i] = _mm256_xor_si256(r, Rol(_mm256_slli_si256(r, 12), 1));
+    }
+
+    for (int i = 0; i < 20; i++) {
+        __m256i wk = _mm256_add_epi32(w[i], _mm256_set1_epi32(k[i / 5]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(wkFirst + i * 4), _mm256_castsi256_si128(wk));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(wkSecond + i * 4),
+                         _mm256_extracti128_si256(wk, 1));
+    }
+}
+
+inline uint32_t Rol32(uint32_t x, int bits) {
+    return (x << bits) | (x >> (32 - bits));
+}
+
+// one round, the caller rotates the roles of the five variables instead of moving them
+inline void Round0(uint32_t a, uint32_t& b, uint32_t c, uint32_t d, uint32_t& e, uint32_t wk) {
+    e += Rol32(a, 5) + (d ^ (b & (c ^ d))) + wk;
+    b = Rol32(b, 30);
+}
+
+inline void Round1(uint32_t a, uint32_t& b, uint32_t c, uint32_t d, uint32_t& e, uint32_t wk) {
+    e += Rol32(a, 5) + (b ^ c ^ d) + wk;
+    b = Rol32(b, 30);
+}
+
+inline void Round2(uint32_t a, uint32_t& b, uint32_t c, uint32_t d, uint32_t& e, uint32_t wk) {
+    e += Rol32(a, 5) + ((b & c) | (d & (b | c))) + wk;
+    b = Rol32(b, 30);
+}
+
+inline void Rounds(uint32_t state[5], const uint32_t wk[80]) {
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+
+    for (int i = 0; i < 20; i += 5) {
+        Round0(a, b, c, d, e, wk[i]);
+        Round0(e, a, b, c, d, wk[i + 1]);
+        Round0(d, e, a, b, c, wk[i + 2]);
+        Round0(c, d, e, a, b, wk[i + 3]);
+        Round0(b, c, d, e, a, wk[i + 4]);
+    }
+    for (int i = 20; i < 40; i += 5) {
+        Round1(a, b, c, d, e, wk[i]);
+        Round1(e, a, b, c, d, wk[i + 1]);
+        Round1(d, e, a, b, c, wk[i + 2]);
+        Round1(c, d, e, a, b, wk[i + 3]);
+        Round1(b, c, d, e, a, wk[i + 4]);
+    }
+    for (int i = 40; i < 60; i += 5) {
+        Round2(a, b, c, d, e, wk[i]);
+        Round2(e, a, b, c, d, wk[i + 1]);
+        Round2(d, e, a, b, c, wk[i + 2]);
+        Round2(c, d, e, a, b, wk[i + 3]);
+        Round2(b, c, d, e, a, wk[i + 4]);
+    }
+    for (int i = 60; i < 80; i += 5) {
+        Round1(a, b, c, d, e, wk[i]);
+        Round1(e, a, b, c, d, wk[i + 1]);
+        Round1(d, e, a, b, c, wk[i + 2]);
+        Round1(c, d, e, a, b, wk[i + 3]);
+        Round1(b, c, d, e, a, wk[i + 4]);
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+struct Avx2Ops {
+    using V = __m256i;
+    static constexpr int Lanes = 8;
+
+    static V Load(const uint32_t* data) {
+        return _mm256_load_si256(reinterpret_cast<const __m256i*>(data));
+    }
+    static void Store(uint32_t* data, V x) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(data), x);
+    }
+    static V Set1(uint32_t x) {
+        return _mm256_set1_epi32(static_cast<int>(x));
+    }
+    static V Add(V x, V y) {
+        return _mm256_add_epi32(x, y);
+    }
+    static V Xor(V x, V y) {
+        return _mm256_xor_si256(x, y);
+    }
+    static V Ch(V b, V c, V d) {
+        return _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+    }
+    static V Parity(V b, V c, V d) {
+        return _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+    }
+    static V Maj(V b, V c, V d) {
+        return _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+    }
+    static V Rol1(V x) {
+        return Rol(x, 1);
+    }
+    static V Rol5(V x) {
+        return Rol(x, 5);
+    }
+    static V Rol30(V x) {
+        return Rol(x, 30);
+    }
+};
+
+} // namespace
+
+void CompressMultiAvx2(uint32_t* states, const uint8_t* const* blocks, size_t blocksCount) {
+    CompressMultiImpl<Avx2Ops>(states, blocks, blocksCount);
+}
+
+void CompressAvx2(uint32_t state[5], const uint8_t* blocks, size_t blocksCount) {
+    alignas(32) uint32_t wkFirst[80];
+    alignas(32) uint32_t wkSecond[80];
+
+    size_t block = 0;
+    for (; block + 2 <= blocksCount; block += 2) {
+        Schedule(blocks + block * 64, blocks + (block + 1) * 64, wkFirst, wkSecond);
+        Rounds(state, wkFirst);
+        Rounds(state, wkSecond);
+    }
+    if (block < blocksCount) {
+        Schedule(blocks + block * 64, blocks + block * 64, wkFirst, wkSecond);
+        Rounds(state, wkFirst);
+    }
+}
+
+} // namespace bt::sha1_backend
@@ -0,0 +1,59 @@
+// compiled with AVX-512 enabled, only called after sha1_backend checked the CPU
+// do not use standard library inline functions here, they could be emitted with
+// instructions older CPUs do not have and then be picked by the linker for other units
+#include "sha1_backend.hpp"
+#include "sha1_multibuffer.hpp"
+
+#include <immintrin.h>
+
+namespace bt::sha1_backend {
+
+namespace {
+
+struct Avx512Ops {
+    using V = __m512i;
+    static constexpr int Lanes = 16;
+
+    static V Load(const uint32_t* data) {
+        return _mm512_load_si512(data);
+    }
+    static void Store(uint32_t* data, V x) {
+        _mm512_store_si512(data, x);
+    }
+    static V Set1(uint32_t x) {
+        return _mm512_set1_epi32(static_cast<int>(x));
+    }
+    static V Add(V x, V y) {
+        return _mm512_add_epi32(x, y);
+    }
+    static V Xor(V x, V y) {
+        return _mm512_xor_si512(x, y);
+    }
+    // the boolean functions of the rounds are single ternary logic instructions
+    static V Ch(V b, V c, V d) {
+        return _mm512_ternarylogic_epi32(b, c, d, 0xca);
+    }
+    static V Parity(V b, V c, V d) {
+        return _mm512_ternarylogic_epi32(b, c, d, 0x96);
+    }
+    static V Maj(V b, V c, V d) {
+        return _mm512_ternarylogic_epi32(b, c, d, 0xe8);
+    }
+    static V Rol1(V x) {
+        return _mm512_rol_epi32(x, 1);
+    }
+    static V Rol5(V x) {
+        return _mm512_rol_epi32(x, 5);
+    }
+    static V Rol30(V x) {
+        return _mm512_rol_epi32(x, 30);
+    }
+};
+
+} // namespace
+
+void CompressMultiAvx512(uint32_t* states, const uint8_t* const* blocks, size_t blocksCount) {
+    CompressMultiImpl<Avx512Ops>(states, blocks, blocksCount);
+}
+
+} // namespace bt::sha1_backend
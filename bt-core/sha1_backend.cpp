@@ -0,0 +1,272 @@
+#include "sha1_backend.hpp"
+
+#include "external/sha1.h"
+
+#include <atomic>
+
+#ifdef BT_SHA1_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace bt::sha1_backend {
+
+namespace {
+
+using CompressFn = void (*)(uint32_t state[5], const uint8_t* blocks, size_t blocksCount);
+using CompressMultiFn = void (*)(uint32_t* states, const uint8_t* const* blocks,
+                                 size_t blocksCount);
+
+void CompressScalar(uint32_t state[5], const uint8_t* blocks, size_t blocksCount) {
+    SHA1::processBlocksScalar(state, blocks, blocksCount);
+}
+
+// a single lane, for MultiBackend::None
+void CompressSingle(uint32_t* states, const uint8_t* const* blocks, size_t blocksCount) {
+    Compress(states, blocks[0], blocksCount);
+}
+
+#ifdef BT_SHA1_X86
+struct CpuFeatures {
+    bool shaNi = false;
+    bool sse2 = false;
+    bool avx2 = false;
+    bool avx512 = false;
+};
+
+void Cpuid(int leaf, int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+    int out[4];
+    __cpuidex(out, leaf, subleaf);
+    for (int i = 0; i < 4; i++) {
+        regs[i] = static_cast<unsigned int>(out[i]);
+    }
+#else
+    if (!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3])) {
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    }
+#endif
+}
+
+uint64_t Xgetbv() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t(edx) << 32) | eax;
+#endif
+}
+
+CpuFeatures DetectCpu() {
+    CpuFeatures features;
+    unsigned int regs[4];
+    Cpuid(0, 0, regs);
+    unsigned int maxLeaf = regs[0];
+    if (maxLeaf < 1) {
+        return features;
+    }
+
+    Cpuid(1, 0, regs);
+    features.sse2 = regs[3] & (1u << 26);
+    if (maxLeaf < 7) {
+        return features;
+    }
+    bool ssse3 = regs[2] & (1u << 9);
+    bool sse41 = regs[2] & (1u << 19);
+    bool osxsave = regs[2] & (1u << 27);
+    bool avx = regs[2] & (1u << 28);
+    // the OS has to save the ymm registers on context switches
+    uint64_t enabledState = osxsave && avx ? Xgetbv() : 0;
+    bool ymmEnabled = (enabledState & 0x6) == 0x6;
+    bool zmmEnabled = (enabledState & 0xe6) == 0xe6;
+
+    Cpuid(7, 0, regs);
+    features.shaNi = ssse3 && sse41 && (regs[1] & (1u << 29));
+    features.avx2 = ymmEnabled && (regs[1] & (1u << 5));
+    features.avx512 = zmmEnabled && (regs[1] & (1u << 16));
+    return features;
+}
+
+const CpuFeatures& Cpu() {
+    static const CpuFeatures features = DetectCpu();
+    return features;
+}
+#endif
+
+CompressFn Function(Backend backend) {
+    switch (backend) {
+#ifdef BT_SHA1_X86
+    case Backend::ShaNi:
+        return CompressShaNi;
+    case Backend::Avx2:
+        return CompressAvx2;
+#endif
+    default:
+        return CompressScalar;
+    }
+}
+
+Backend Detect() {
+    if (IsSupported(Backend::ShaNi)) {
+        return Backend::ShaNi;
+    }
+    if (IsSupported(Backend::Avx2)) {
+        return Backend::Avx2;
+    }
+    return Backend::Scalar;
+}
+
+CompressMultiFn Function(MultiBackend backend) {
+    switch (backend) {
+#ifdef BT_SHA1_X86
+    case MultiBackend::Sse2:
+        return CompressMultiSse2;
+    case MultiBackend::Avx2:
+        return CompressMultiAvx2;
+    case MultiBackend::Avx512:
+        return CompressMultiAvx512;
+#endif
+    default:
+        return CompressSingle;
+    }
+}
+
+MultiBackend DetectMulti() {
+    for (MultiBackend backend : {MultiBackend::Avx512, MultiBackend::Avx2, MultiBackend::Sse2}) {
+        if (IsSupported(backend)) {
+            return backend;
+        }
+    }
+    return MultiBackend::None;
+}
+
+size_t Lanes(MultiBackend backend) {
+    switch (backend) {
+    case MultiBackend::Sse2:
+        return 4;
+    case MultiBackend::Avx2:
+        return 8;
+    case MultiBackend::Avx512:
+        return 16;
+    default:
+        return 1;
+    }
+}
+
+struct State {
+    std::atomic<Backend> backend;
+    std::atomic<CompressFn> compress;
+    std::atomic<MultiBackend> multi;
+
+    State() : backend(Detect()), compress(Function(backend.load())), multi(DetectMulti()) {
+    }
+};
+
+State& GetState() {
+    static State state;
+    return state;
+}
+
+} // namespace
+
+bool IsSupported(Backend backend) {
+    switch (backend) {
+    case Backend::Scalar:
+        return true;
+#ifdef BT_SHA1_X86
+    case Backend::ShaNi:
+        return Cpu().shaNi;
+    case Backend::Avx2:
+        return Cpu().avx2;
+#endif
+    default:
+        return false;
+    }
+}
+
+Backend Active() {
+    return GetState().backend.load(std::memory_order_relaxed);
+}
+
+bool Select(Backend backend) {
+    if (!IsSupported(backend)) {
+        return false;
+    }
+    State& state = GetState();
+    state.compress.store(Function(backend), std::memory_order_relaxed);
+    state.backend.store(backend, std::memory_order_relaxed);
+    return true;
+}
+
+std::string_view Name(Backend backend) {
+    switch (backend) {
+    case Backend::Scalar:
+        return "scalar";
+    case Backend::Avx2:
+        return "avx2";
+    case Backend::ShaNi:
+        return "sha-ni";
+    }
+    return "unknown";
+}
+
+void Compress(uint32_t state[5], const uint8_t* blocks, size_t blocksCount) {
+    GetState().compress.load(std::memory_order_relaxed)(state, blocks, blocksCount);
+}
+
+bool IsSupported(MultiBackend backend) {
+    switch (backend) {
+    case MultiBackend::None:
+        return true;
+#ifdef BT_SHA1_X86
+    case MultiBackend::Sse2:
+        return Cpu().sse2;
+    case MultiBackend::Avx2:
+        return Cpu().avx2;
+    case MultiBackend::Avx512:
+        return Cpu().avx512;
+#endif
+    default:
+        return false;
+    }
+}
+
+MultiBackend ActiveMulti() {
+    return GetState().multi.load(std::memory_order_relaxed);
+}
+
+bool Select(MultiBackend backend) {
+    if (!IsSupported(backend)) {
+        return false;
+    }
+    GetState().multi.store(backend, std::memory_order_relaxed);
+    return true;
+}
+
+std::string_view Name(MultiBackend backend) {
+    switch (backend) {
+    case MultiBackend::None:
+        return "none";
+    case MultiBackend::Sse2:
+        return "sse2 x4";
+    case MultiBackend::Avx2:
+        return "avx2 x8";
+    case MultiBackend::Avx512:
+        return "avx512 x16";
+    }
+    return "unknown";
+}
+
+size_t MultiLanes() {
+    return Lanes(ActiveMulti());
+}
+
+void CompressMulti(uint32_t* states, const uint8_t* const* blocks, size_t blocksCount) {
+    Function(ActiveMulti())(states, blocks, blocksCount);
+}
+
+} // namespace bt::sha1_backend
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief SHA1 block compression, picked once at startup from what the CPU supports
+ * @brief every backend produces the same state, they only differ in speed
+ */
+namespace bt::sha1_backend {
+
+enum class Backend {
+    Scalar, // portable, used on every platform without a faster option
+    Avx2,   // vectorized message schedule, rounds stay scalar
+    ShaNi,  // x86 SHA extensions, hashes a whole block in hardware
+};
+
+/**
+ * @return true if backend was compiled in and the CPU and OS support it
+ */
+bool IsSupported(Backend backend);
+
+/**
+ * @return backend currently used by Compress
+ */
+Backend Active();
+
+/**
+ * @brief overrides the detected backend, meant for tests and benchmarks
+ * @return false and keeps the active backend if backend is not supported
+ */
+bool Select(Backend backend);
+
+std::string_view Name(Backend backend);
+
+/**
+ * @brief compresses blocksCount consecutive 64 byte blocks into state
+ * @param state five SHA1 chaining values
+ */
+void Compress(uint32_t state[5], const uint8_t* blocks, size_t blocksCount);
+
+/**
+ * @brief multi-buffer compression, hashes several independent messages at once
+ */
+enum class MultiBackend {
+    None,   // no SIMD, messages are hashed one after another
+    Sse2,   // 4 messages
+    Avx2,   // 8 messages
+    Avx512, // 16 messages
+};
+
+bool IsSupported(MultiBackend backend);
+
+MultiBackend ActiveMulti();
+
+/**
+ * @brief overrides the detected multi-buffer backend, meant for tests and benchmarks
+ * @return false and keeps the active backend if backend is not supported
+ */
+bool Select(MultiBackend backend);
+
+std::string_view Name(MultiBackend backend);
+
+/**
+ * @return count of messages compressed together by CompressMulti, 1 for MultiBackend::None
+ */
+size_t MultiLanes();
+
+/**
+ * @brief compresses blocksCount blocks of each of MultiLanes() messages
+ * @param states MultiLanes() * 5 chaining values, five consecutive ones per message
+ * @param blocks first block to compress of every message
+ */
+void CompressMulti(uint32_t* states, const uint8_t* const* blocks, size_t blocksCount);
+
+/**
+ * @brief individual backends, only defined when compiled for x86
+ */
+void CompressShaNi(uint32_t state[5], const uint8_t* blocks, size_t blocksCount);
+void CompressAvx2(uint32_t state[5], const uint8_t* blocks, size_t blocksCount);
+void CompressMultiSse2(uint32_t* states, const uint8_t* const* blocks, size_t blocksCount);
+void CompressMultiAvx2(uint32_t* states, const uint8_t* const* blocks, size_t blocksCount);
+void CompressMultiAvx512(uint32_t* states, const uint8_t* const* blocks, size_t blocksCount);
+
+} // namespace bt::sha1_backend
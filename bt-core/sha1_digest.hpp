@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <compare>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace bt {
+
+/**
+ * @brief raw 20 byte SHA1 digest as used on the wire by trackers and peers
+ * @brief hex is only produced on demand, e.g. for display
+ */
+struct Sha1Digest {
+    static constexpr size_t Size = 20;
+
+    std::array<std::byte, Size> bytes{};
+
+    /**
+     * @param data points to at least 20 bytes of a binary digest
+     */
+    static Sha1Digest FromBytes(const void* data) {
+        Sha1Digest digest;
+        std::memcpy(digest.bytes.data(), data, Size);
+        return digest;
+    }
+
+    /**
+     * @param hex is 40 hex characters, either case
+     * @return parsed digest or null if hex is malformed
+     */
+    static constexpr std::optional<Sha1Digest> FromHex(std::string_view hex) {
+        if (hex.size() != Size * 2) {
+            return {};
+        }
+        Sha1Digest digest;
+        for (size_t i = 0; i < Size; i++) {
+            int high = _HexValue(hex[2 * i]);
+            int low = _HexValue(hex[2 * i + 1]);
+            if (high < 0 || low < 0) {
+                return {};
+            }
+            digest.bytes[i] = std::byte((high << 4) | low);
+        }
+        return digest;
+    }
+
+    /**
+     * @return 40 lowercase hex characters, not null terminated
+     */
+    constexpr std::array<char, Size * 2> ToHex() const {
+        std::array<char, Size * 2> hex{};
+        for (size_t i = 0; i < Size; i++) {
+            hex[2 * i] = _hexDigits[std::to_integer<int>(bytes[i]) >> 4];
+            hex[2 * i + 1] = _hexDigits[std::to_integer<int>(bytes[i]) & 0xf];
+        }
+        return hex;
+    }
+
+    std::string ToHexString() const {
+        std::array<char, Size * 2> hex = ToHex();
+        return std::string(hex.data(), hex.size());
+    }
+
+    /**
+     * @brief every byte is escaped as %XX, which is valid for the info_hash and
+     *        peer_id parameters of a tracker request
+     * @return 60 characters, not null terminated
+     */
+    constexpr std::array<char, Size * 3> ToPercentEncoded() const {
+        std::array<char, Size * 3> encoded{};
+        for (size_t i = 0; i < Size; i++) {
+            encoded[3 * i] = '%';
+            encoded[3 * i + 1] = _upperHexDigits[std::to_integer<int>(bytes[i]) >> 4];
+            encoded[3 * i + 2] = _upperHexDigits[std::to_integer<int>(bytes[i]) & 0xf];
+        }
+        return encoded;
+    }
+
+    std::string ToPercentEncodedString() const {
+        std::array<char, Size * 3> encoded = ToPercentEncoded();
+        return std::string(encoded.data(), encoded.size());
+    }
+
+    // memcmp of a constant 20 bytes is lowered to a couple of vector compares
+    friend constexpr bool operator==(const Sha1Digest& l, const Sha1Digest& r) {
+        if (std::is_constant_evaluated()) {
+            return l.bytes == r.bytes;
+        }
+        return std::memcmp(l.bytes.data(), r.bytes.data(), Size) == 0;
+    }
+
+    friend constexpr std::strong_ordering operator<=>(const Sha1Digest& l, const Sha1Digest& r) {
+        if (std::is_constant_evaluated()) {
+            return l.bytes <=> r.bytes;
+        }
+        return std::memcmp(l.bytes.data(), r.bytes.data(), Size) <=> 0;
+    }
+
+  private:
+    static constexpr const char* _hexDigits = "0123456789abcdef";
+    static constexpr const char* _upperHexDigits = "0123456789ABCDEF";
+
+    static constexpr int _HexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+};
+
+static_assert(sizeof(Sha1Digest) == Sha1Digest::Size);
+static_assert(std::is_trivially_copyable_v<Sha1Digest>);
+
+/**
+ * @brief SHA1 of the bencoded info dict, identifies a torrent
+ */
+using InfoHash = Sha1Digest;
+
+} // namespace bt
+
+/**
+ * @brief digests are uniformly distributed, so the first machine word already is a good hash
+ */
+template <>
+struct std::hash<bt::Sha1Digest> {
+    size_t operator()(const bt::Sha1Digest& digest) const noexcept {
+        size_t hash;
+        std::memcpy(&hash, digest.bytes.data(), sizeof(hash));
+        return hash;
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+// multi-buffer SHA1: every SIMD lane compresses a different message, so the round
+// dependency chain of one message no longer limits throughput
+// included by the backend units compiled for each instruction set, everything here has
+// internal linkage so the differently compiled copies never get merged by the linker
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bt::sha1_backend {
+
+namespace {
+
+inline uint32_t LoadBigEndian(const uint8_t* data) {
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) |
+           uint32_t(data[3]);
+}
+
+/**
+ * @tparam Ops vector type V with Lanes 32 bit lanes and Add, Xor, Ch, Parity, Maj, Rol<N>,
+ *         Set1, Load, Store on it
+ * @param states Lanes * 5 chaining values, five consecutive ones per message
+ * @param blocks first block of every message
+ */
+template <typename Ops>
+inline void CompressMultiImpl(uint32_t* states, const uint8_t* const* blocks, size_t blocksCount) {
+    using V = typename Ops::V;
+    constexpr int Lanes = Ops::Lanes;
+
+    alignas(64) uint32_t words[16][Lanes];
+    alignas(64) uint32_t values[5][Lanes];
+    for (int lane = 0; lane < Lanes; lane++) {
+        for (int i = 0; i < 5; i++) {
+            values[i][lane] = states[lane * 5 + i];
+        }
+    }
+    V h[5];
+    for (int i = 0; i < 5; i++) {
+        h[i] = Ops::Load(values[i]);
+    }
+
+    for (size_t block = 0; block < blocksCount; block++) {
+        // transpose, so that w[i] holds word i of every message
+        for (int lane = 0; lane < Lanes; lane++) {
+            const uint8_t* data = blocks[lane] + block * 64;
+            for (int i = 0; i < 16; i++) {
+                words[i][lane] = LoadBigEndian(data + i * 4);
+            }
+        }
+        V w[16];
+        for (int i = 0; i < 16; i++) {
+            w[i] = Ops::Load(words[i]);
+        }
+
+        V a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        auto round = [&](int t, V f, V k) {
+            V wt;
+            if (t < 16) {
+                wt = w[t];
+            } else {
+                wt = Ops::Rol1(Ops::Xor(Ops::Xor(w[(t - 3) & 15], w[(t - 8) & 15]),
+                                        Ops::Xor(w[(t - 14) & 15], w[t & 15])));
+                w[t & 15] = wt;
+            }
+            V temp = Ops::Add(Ops::Add(Ops::Rol5(a), f), Ops::Add(Ops::Add(e, k), wt));
+            e = d;
+            d = c;
+            c = Ops::Rol30(b);
+            b = a;
+            a = temp;
+        };
+
+        const V k0 = Ops::Set1(0x5a827999);
+        const V k1 = Ops::Set1(0x6ed9eba1);
+        const V k2 = Ops::Set1(0x8f1bbcdc);
+        const V k3 = Ops::Set1(0xca62c1d6);
+        for (int t = 0; t < 20; t++) {
+            round(t, Ops::Ch(b, c, d), k0);
+        }
+        for (int t = 20; t < 40; t++) {
+            round(t, Ops::Parity(b, c, d), k1);
+        }
+        for (int t = 40; t < 60; t++) {
+            round(t, Ops::Maj(b, c, d), k2);
+        }
+        for (int t = 60; t < 80; t++) {
+            round(t, Ops::Parity(b, c, d), k3);
+        }
+
+        h[0] = Ops::Add(h[0], a);
+        h[1] = Ops::Add(h[1], b);
+        h[2] = Ops::Add(h[2], c);
+        h[3] = Ops::Add(h[3], d);
+        h[4] = Ops::Add(h[4], e);
+    }
+
+    for (int i = 0; i < 5; i++) {
+        Ops::Store(values[i], h[i]);
+    }
+    for (int lane = 0; lane < Lanes; lane++) {
+        for (int i = 0; i < 5; i++) {
+            states[lane * 5 + i] = values[i][lane];
+        }
+    }
+}
+
+} // namespace
+
+} // namespace bt::sha1_backend
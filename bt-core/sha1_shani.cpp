@@ -0,0 +1,79 @@
+// compiled with SHA extensions enabled, only called after sha1_backend checked the CPU
+// do not use standard library inline functions here, they could be emitted with
+// instructions older CPUs do not have and then be picked by the linker for other units
+#include "sha1_backend.hpp"
+
+#include <immintrin.h>
+
+namespace bt::sha1_backend {
+
+namespace {
+
+struct Lanes {
+    __m128i abcd;
+    __m128i e0;
+    __m128i e1;
+    __m128i msg[4];
+};
+
+// big endian words of the block in SHA1 order
+inline __m128i LoadMessage(const uint8_t* data) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+    return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), byteSwap);
+}
+
+/**
+ * @brief four rounds, interleaved with the message schedule of later rounds
+ */
+template <int G>
+inline void FourRounds(Lanes& l, const uint8_t* block) {
+    __m128i& eCur = G % 2 == 0 ? l.e0 : l.e1;
+    __m128i& eNext = G % 2 == 0 ? l.e1 : l.e0;
+
+    if constexpr (G < 4) {
+        l.msg[G] = LoadMessage(block + G * 16);
+    }
+    if constexpr (G == 0) {
+        eCur = _mm_add_epi32(eCur, l.msg[0]);
+    } else {
+        eCur = _mm_sha1nexte_epu32(eCur, l.msg[G % 4]);
+    }
+    eNext = l.abcd;
+    if constexpr (G >= 3 && G <= 18) {
+        l.msg[(G + 1) % 4] = _mm_sha1msg2_epu32(l.msg[(G + 1) % 4], l.msg[G % 4]);
+    }
+    l.abcd = _mm_sha1rnds4_epu32(l.abcd, eCur, G / 5);
+    if constexpr (G >= 1 && G <= 16) {
+        l.msg[(G + 3) % 4] = _mm_sha1msg1_epu32(l.msg[(G + 3) % 4], l.msg[G % 4]);
+    }
+    if constexpr (G >= 2 && G <= 17) {
+        l.msg[(G + 2) % 4] = _mm_xor_si128(l.msg[(G + 2) % 4], l.msg[G % 4]);
+    }
+
+    if constexpr (G < 19) {
+        FourRounds<G + 1>(l, block);
+    }
+}
+
+} // namespace
+
+void CompressShaNi(uint32_t state[5], const uint8_t* blocks, size_t blocksCount) {
+    Lanes l;
+    l.abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+    l.e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (size_t block = 0; block < blocksCount; block++) {
+        __m128i abcdSave = l.abcd;
+        __m128i e0Save = l.e0;
+
+        FourRounds<0>(l, blocks + block * 64);
+
+        l.e0 = _mm_sha1nexte_epu32(l.e0, e0Save);
+        l.abcd = _mm_add_epi32(l.abcd, abcdSave);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(l.abcd, 0x1B));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(l.e0, 3));
+}
+
+} // namespace bt::sha1_backend
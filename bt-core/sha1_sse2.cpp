@@ -0,0 +1,58 @@
+// compiled with SSE2 enabled, only called after sha1_backend checked the CPU
+// do not use standard library inline functions here, they could be emitted with
+// instructions older CPUs do not have and then be picked by the linker for other units
+#include "sha1_backend.hpp"
+#include "sha1_multibuffer.hpp"
+
+#include <emmintrin.h>
+
+namespace bt::sha1_backend {
+
+namespace {
+
+struct Sse2Ops {
+    using V = __m128i;
+    static constexpr int Lanes = 4;
+
+    static V Load(const uint32_t* data) {
+        return _mm_load_si128(reinterpret_cast<const __m128i*>(data));
+    }
+    static void Store(uint32_t* data, V x) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(data), x);
+    }
+    static V Set1(uint32_t x) {
+        return _mm_set1_epi32(static_cast<int>(x));
+    }
+    static V Add(V x, V y) {
+        return _mm_add_epi32(x, y);
+    }
+    static V Xor(V x, V y) {
+        return _mm_xor_si128(x, y);
+    }
+    static V Ch(V b, V c, V d) {
+        return _mm_xor_si128(d, _mm_and_si128(b, _mm_xor_si128(c, d)));
+    }
+    static V Parity(V b, V c, V d) {
+        return _mm_xor_si128(_mm_xor_si128(b, c), d);
+    }
+    static V Maj(V b, V c, V d) {
+        return _mm_or_si128(_mm_and_si128(b, c), _mm_and_si128(d, _mm_or_si128(b, c)));
+    }
+    static V Rol1(V x) {
+        return _mm_or_si128(_mm_slli_epi32(x, 1), _mm_srli_epi32(x, 31));
+    }
+    static V Rol5(V x) {
+        return _mm_or_si128(_mm_slli_epi32(x, 5), _mm_srli_epi32(x, 27));
+    }
+    static V Rol30(V x) {
+        return _mm_or_si128(_mm_slli_epi32(x, 30), _mm_srli_epi32(x, 2));
+    }
+};
+
+} // namespace
+
+void CompressMultiSse2(uint32_t* states, const uint8_t* const* blocks, size_t blocksCount) {
+    CompressMultiImpl<Sse2Ops>(states, blocks, blocksCount);
+}
+
+} // namespace bt::sha1_backend
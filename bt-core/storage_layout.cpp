@@ -0,0 +1,88 @@
+#include "storage_layout.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace bt {
+
+/**
+ * @param node UTF-8 name from the metainfo
+ * @return node usable as a single directory or file name
+ */
+static std::filesystem::path _SanitizeNode(std::string_view node) {
+    if (node.empty() || node == "." || node == "..") {
+        return "_";
+    }
+    std::string sanitized(node);
+    std::replace(sanitized.begin(), sanitized.end(), '/', '_');
+    std::replace(sanitized.begin(), sanitized.end(), '\\', '_');
+    std::replace(sanitized.begin(), sanitized.end(), '\0', '_');
+#ifdef _WIN32
+    // "C:" would make the path absolute
+    std::replace(sanitized.begin(), sanitized.end(), ':', '_');
+#endif
+    // char8_t makes the path decode UTF-8 instead of the local code page
+    return std::filesystem::path(std::u8string(sanitized.begin(), sanitized.end()));
+}
+
+StorageLayout::StorageLayout(const TorrentMetadata& torrent, std::filesystem::path savePath,
+                             std::vector<bool> wantedFiles)
+    : _torrent(&torrent),
+      _root(savePath),
+      _partFilePath(savePath / ("." + torrent.infoHash().ToHexString() + ".parts")) {
+    if (torrent.isMultiFile()) {
+        _root /= _SanitizeNode(torrent.name());
+    }
+    const FileTable& files = torrent.files();
+    if (!wantedFiles.empty() && wantedFiles.size() != files.size()) {
+        throw std::invalid_argument("wantedFiles has wrong size");
+    }
+    if (std::find(wantedFiles.begin(), wantedFiles.end(), false) == wantedFiles.end()) {
+        return;
+    }
+    _wanted = std::move(wantedFiles);
+    _partOffsets.resize(files.size());
+    long long partSize = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!_wanted[i] && !files.isPadFile(i)) {
+            _partOffsets[i] = partSize;
+            partSize += files.fileSize(i);
+        }
+    }
+}
+
+const std::filesystem::path& StorageLayout::root() const {
+    return _root;
+}
+
+std::filesystem::path StorageLayout::filePath(size_t index) const {
+    std::filesystem::path path = _root;
+    FilePath relativePath = _torrent->files().path(index);
+    for (size_t i = 0; i < relativePath.size(); i++) {
+        path /= _SanitizeNode(relativePath[i]);
+    }
+    return path;
+}
+
+bool StorageLayout::isWanted(size_t index) const {
+    return _wanted.empty() || _wanted[index];
+}
+
+const std::filesystem::path& StorageLayout::partFilePath() const {
+    return _partFilePath;
+}
+
+std::filesystem::path StorageLayout::storedPath(size_t index) const {
+    return isWanted(index) ? filePath(index) : _partFilePath;
+}
+
+long long StorageLayout::storedOffset(size_t index) const {
+    return isWanted(index) ? 0 : _partOffsets[index];
+}
+
+const TorrentMetadata& StorageLayout::torrent() const {
+    return *_torrent;
+}
+
+} // namespace bt
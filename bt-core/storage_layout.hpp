@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+#include "torrent_metadata.hpp"
+
+namespace bt {
+
+/**
+ * @brief where the files of a torrent are stored on disk
+ * @brief files of a multi-file torrent live in savePath/name/<relative path>, the file of a
+ *        single file torrent is savePath/name
+ * @brief path nodes that would leave the torrent's directory ("", ".", "..", or nodes with
+ *        path separators) are replaced, so a malicious torrent can not write elsewhere
+ */
+class StorageLayout {
+  public:
+    /**
+     * @param torrent must outlive the layout
+     * @param savePath directory the torrent is saved into
+     * @param wantedFiles per file of the torrent, empty wants every file. Files not wanted are
+     *        kept out of the tree: what is written of them anyway, the bytes they share pieces
+     *        with wanted files, goes to the part file
+     * @throws std::invalid_argument if wantedFiles is neither empty nor has an entry per file
+     */
+    StorageLayout(const TorrentMetadata& torrent, std::filesystem::path savePath,
+                  std::vector<bool> wantedFiles = {});
+
+    /**
+     * @return directory holding all files of the torrent
+     */
+    const std::filesystem::path& root() const;
+
+    /**
+     * @return full path of the file at index of torrent's file table, built on every call
+     */
+    std::filesystem::path filePath(size_t index) const;
+
+    bool isWanted(size_t index) const;
+
+    /**
+     * @return savePath/.<info hash>.parts, the files not wanted back to back; sparse, only the
+     *         bytes written take space
+     */
+    const std::filesystem::path& partFilePath() const;
+
+    /**
+     * @return path of the file the bytes of the file at index are stored in: filePath if it is
+     *         wanted, partFilePath otherwise
+     */
+    std::filesystem::path storedPath(size_t index) const;
+
+    /**
+     * @return offset of the file's first byte in storedPath
+     */
+    long long storedOffset(size_t index) const;
+
+    const TorrentMetadata& torrent() const;
+
+  private:
+    const TorrentMetadata* _torrent;
+    std::filesystem::path _root;
+    std::filesystem::path _partFilePath;
+    std::vector<bool> _wanted;           // empty if every file is wanted
+    std::vector<long long> _partOffsets; // per file, where those not wanted are in the part file
+};
+
+} // namespace bt
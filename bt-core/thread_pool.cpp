@@ -0,0 +1,67 @@
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+
+namespace bt {
+
+ThreadPool::ThreadPool(size_t threadsCount) {
+    threadsCount = ResolveThreadsCount(threadsCount);
+    _workers.reserve(threadsCount);
+    for (size_t i = 0; i < threadsCount; i++) {
+        _workers.emplace_back(&ThreadPool::_Run, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _taskPosted.notify_all();
+    for (std::thread& worker : _workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::Post(std::function<void()> task) {
+    {
+        std::lock_guard lock(_mutex);
+        _tasks.push_back(std::move(task));
+    }
+    _taskPosted.notify_one();
+}
+
+size_t ThreadPool::size() const {
+    return _workers.size();
+}
+
+size_t ThreadPool::ResolveThreadsCount(size_t threadsCount) {
+    if (threadsCount != 0) {
+        return threadsCount;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void ThreadPool::_Run() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(_mutex);
+            _taskPosted.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+            if (_tasks.empty()) {
+                return; // stopping and drained
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+
+        try {
+            task();
+        } catch (std::exception& e) {
+            LogError("thread pool task failed: {}", e.what());
+        }
+    }
+}
+
+} // namespace bt
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bt {
+
+/**
+ * @brief fixed count of worker threads running posted tasks in FIFO order
+ */
+class ThreadPool {
+  public:
+    /**
+     * @param threadsCount 0 for one thread per hardware thread
+     */
+    explicit ThreadPool(size_t threadsCount = 0);
+
+    /**
+     * @brief runs every task posted so far, then joins the workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief queues task to run on one of the workers
+     * @brief exceptions thrown by task are ignored, tasks report their own errors
+     */
+    void Post(std::function<void()> task);
+
+    /**
+     * @return count of worker threads
+     */
+    size_t size() const;
+
+    /**
+     * @return threadsCount, or one per hardware thread for 0
+     */
+    static size_t ResolveThreadsCount(size_t threadsCount);
+
+  private:
+    void _Run();
+
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _taskPosted;
+    bool _stopping = false;
+};
+
+} // namespace bt
@@ -1,7 +1,14 @@
 #include "torrent_metadata.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
 #include "utils.hpp"
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <limits>
+#include <mutex>
 #include <sstream>
 #include <format>
 
@@ -10,43 +17,30 @@
 
 namespace bt {
 
-TorrentFile::TorrentFile(std::vector<std::string> relativePath, long long size)
-    : relativePath(relativePath), size(size) {
-}
-
-std::string TorrentFile::GetRelativePathAsString() {
-    std::string pathNameBuider = "";
-    char delem = '/';
-
-    size_t foldersCount = relativePath.size() - 1;
-
-    for (size_t i = 0; i < foldersCount; i++) {
-        pathNameBuider.append(relativePath[i] + delem);
-    }
-    // append last element without delimeter
-    pathNameBuider.append(relativePath.back());
-
-    return pathNameBuider;
-}
-
-TorrentMetadata::TorrentMetadata(long long creationDate, long long pieceLength,
-                                 long long piecesCount, std::string name, std::string infoHash,
-                                 std::string piecesHashes, std::optional<std::string> comment,
-                                 std::optional<std::string> createdBy,
-                                 std::optional<std::string> mainAnnounce,
-                                 std::vector<std::string> announceList,
-                                 std::vector<TorrentFile> files)
-    : _creationDate(creationDate),
+TorrentMetadata::TorrentMetadata(std::shared_ptr<const void> metaInfoStorage,
+                                 long long creationDate, long long pieceLength,
+                                 long long piecesCount, std::string_view name, InfoHash infoHash,
+                                 std::string_view piecesHashes,
+                                 std::optional<std::string_view> comment,
+                                 std::optional<std::string_view> createdBy,
+                                 std::optional<std::string_view> mainAnnounce,
+                                 std::vector<std::string_view> announceList,
+                                 std::vector<size_t> announceTierEnds, FileTable files,
+                                 bool multiFile)
+    : _metaInfoStorage(std::move(metaInfoStorage)),
+      _creationDate(creationDate),
       _pieceLength(pieceLength),
       _piecesCount(piecesCount),
       _name(name),
-      _comment(comment),
-      _createdBy(createdBy),
       _infoHash(infoHash),
       _piecesHashes(piecesHashes),
+      _comment(comment),
+      _createdBy(createdBy),
       _mainAnnounce(mainAnnounce),
-      _announceList(announceList),
-      _files(files) {
+      _announceList(std::move(announceList)),
+      _announceTierEnds(std::move(announceTierEnds)),
+      _files(std::move(files)),
+      _multiFile(multiFile) {
 }
 
 std::optional<long long> TorrentMetadata::creationDate() const {
@@ -61,38 +55,68 @@ long long TorrentMetadata::piecesCount() const {
     return _piecesCount;
 }
 
-std::string TorrentMetadata::name() {
+long long TorrentMetadata::pieceSize(size_t index) const {
+    long long pieceBegin = static_cast<long long>(index) * _pieceLength;
+    return std::min(_pieceLength, totalSize() - pieceBegin);
+}
+
+long long TorrentMetadata::totalSize() const {
+    return _files.totalSize();
+}
+
+FileSliceRange TorrentMetadata::MapPiece(size_t index) const {
+    return _files.MapRange(static_cast<long long>(index) * _pieceLength, pieceSize(index));
+}
+
+std::string_view TorrentMetadata::name() const {
     return _name;
 }
 
-std::optional<std::string> TorrentMetadata::comment() {
+std::optional<std::string_view> TorrentMetadata::comment() const {
     return _comment;
 }
 
-std::optional<std::string> TorrentMetadata::createdBy() {
+std::optional<std::string_view> TorrentMetadata::createdBy() const {
     return _createdBy;
 }
 
-std::string TorrentMetadata::infoHash() {
+InfoHash TorrentMetadata::infoHash() const {
     return _infoHash;
 }
 
-std::string TorrentMetadata::piecesHashes() {
-    return _piecesHashes;
+std::span<const std::byte> TorrentMetadata::piecesHashes() const {
+    return std::as_bytes(std::span(_piecesHashes));
 }
 
-std::optional<std::string> TorrentMetadata::mainAnnounce() {
+std::span<const std::byte, Sha1Digest::Size> TorrentMetadata::pieceHash(size_t index) const {
+    return piecesHashes().subspan(index * Sha1Digest::Size).first<Sha1Digest::Size>();
+}
+
+std::optional<std::string_view> TorrentMetadata::mainAnnounce() const {
     return _mainAnnounce;
 }
 
-std::vector<std::string> TorrentMetadata::announceList() {
+const std::vector<std::string_view> &TorrentMetadata::announceList() const {
     return _announceList;
 }
 
-std::vector<TorrentFile> TorrentMetadata::files() {
+size_t TorrentMetadata::announceTiersCount() const {
+    return _announceTierEnds.size();
+}
+
+std::span<const std::string_view> TorrentMetadata::announceTier(size_t tier) const {
+    size_t begin = tier == 0 ? 0 : _announceTierEnds[tier - 1];
+    return std::span(_announceList).subspan(begin, _announceTierEnds[tier] - begin);
+}
+
+const FileTable &TorrentMetadata::files() const {
     return _files;
 }
 
+bool TorrentMetadata::isMultiFile() const {
+    return _multiFile;
+}
+
 /*
 ##################################################################
   bt::torrent_parser  implementation
@@ -100,114 +124,283 @@ std::vector<TorrentFile> TorrentMetadata::files() {
 */
 namespace torrent_parser {
 
+static TorrentMetadata _ParseInPlace(std::shared_ptr<const void> storage,
+                                     std::string_view metaInfo);
+
+static bencode::data_view _DecodeMetaInfo(std::string_view metaInfo, std::string_view &infoSpan);
+
 template <typename T>
-std::optional<T> _GetDictValue(bencode::data dict, std::string key);
+static std::optional<T> _GetDictValue(const bencode::data_view &dict, std::string_view key);
 
-static std::vector<std::string> _GetAnnounceList(bencode::data metaData);
+static std::vector<std::string_view> _GetAnnounceList(const bencode::data_view &metaData,
+                                                      std::vector<size_t> &tierEnds);
 
-static std::vector<TorrentFile> _ParseFiles(bencode::dict infoDict);
+static FileTable _ParseFiles(const bencode::data_view &infoDict);
 
 TorrentMetadata ParseFromFile(std::string path) {
-    // load file to string and call Parse function
-
-    std::ifstream torrentFile{path, std::ios::binary | std::ios::ate};
-    if (!torrentFile.is_open()) {
-        throw std::runtime_error("Could not open file");
-    }
-    torrentFile.seekg(0);
-    std::string metaInfo((std::istreambuf_iterator<char>(torrentFile)),
-                         (std::istreambuf_iterator<char>()));
-    return Parse(metaInfo);
+    // map the file and parse it without copying it to a string first
+    auto file = std::make_shared<const MappedFile>(path);
+    std::string_view metaInfo = file->data();
+    return _ParseInPlace(std::move(file), metaInfo);
 }
 
 TorrentMetadata Parse(std::string metaInfo) {
+    auto buffer = std::make_shared<const std::string>(std::move(metaInfo));
+    std::string_view metaInfoView = *buffer;
+    return _ParseInPlace(std::move(buffer), metaInfoView);
+}
+
+/**
+ * @param storage owns the memory metaInfo points into, shared with the returned metadata
+ * @param metaInfo is bencoded string loaded from .torrent file
+ */
+static TorrentMetadata _ParseInPlace(std::shared_ptr<const void> storage,
+                                     std::string_view metaInfo) {
     // prepare 'variables' needed for constructing a TorrentMetadata object
     // also throw InvalidTorrentFile exception if necessary data are not present
+    // every view handed out below points into metaInfo
 
-    bencode::data metaData;
-    try {
-        metaData = bencode::decode(metaInfo);
-    } catch (const bencode::decode_error &e) {
-        std::string msg = "decode error: ";
-        throw InvalidTorrentFile(msg + e.what());
-    }
+    // raw bytes of the info value, exactly as they appear in the file
+    std::string_view infoSpan;
+    bencode::data_view metaData = _DecodeMetaInfo(metaInfo, infoSpan);
 
-    bencode::dict infoDict;
-    try {
-        infoDict = std::get<bencode::dict>(std::get<bencode::dict>(metaData)["info"]);
-    } catch (std::bad_variant_access) {
+    const auto &metaDict = std::get<bencode::dict_view>(metaData);
+    auto infoIt = metaDict->find("info");
+    if (infoIt == metaDict->end() || !std::holds_alternative<bencode::dict_view>(infoIt->second)) {
         throw InvalidTorrentFile("info key not present");
     }
+    const bencode::data_view &infoDict = infoIt->second;
 
-    std::string piecesHashes;
+    std::string_view piecesHashes;
     long long pieceLength;
-    std::string name;
+    std::string_view name;
     try {
-        piecesHashes = _GetDictValue<std::string>(infoDict, "pieces").value();
-        pieceLength = _GetDictValue<bencode::integer>(infoDict, "piece length").value();
-        name = _GetDictValue<std::string>(infoDict, "name").value();
-    } catch (std::bad_optional_access) {
+        piecesHashes = _GetDictValue<bencode::string_view>(infoDict, "pieces").value();
+        pieceLength = _GetDictValue<bencode::integer_view>(infoDict, "piece length").value();
+        name = _GetDictValue<bencode::string_view>(infoDict, "name").value();
+    } catch (const std::bad_optional_access &) {
         throw InvalidTorrentFile("required keys not present");
     }
 
     long long creationDate =
-        _GetDictValue<bencode::integer>(metaData, "creation date").value_or(-1);
+        _GetDictValue<bencode::integer_view>(metaData, "creation date").value_or(-1);
 
+    if (pieceLength <= 0) {
+        throw InvalidTorrentFile("piece length is not positive");
+    }
+    if (piecesHashes.length() % 20 != 0) {
+        throw InvalidTorrentFile("pieces is not a list of SHA1 hashes");
+    }
     long long piecesCount = piecesHashes.length() / 20;
 
-    std::string infoString = bencode::encode(std::get<bencode::dict>(metaData)["info"]);
-    std::string infoHash = GetSha1Hash(infoString);
+    // hash the original bytes, re-encoding would sort keys of non-canonical dicts
+    InfoHash infoHash = GetSha1Hash(infoSpan);
 
-    std::optional<std::string> comment = _GetDictValue<std::string>(metaData, "comment");
+    std::optional<std::string_view> comment =
+        _GetDictValue<bencode::string_view>(metaData, "comment");
 
-    std::optional<std::string> createdBy = _GetDictValue<std::string>(metaData, "created by");
+    std::optional<std::string_view> createdBy =
+        _GetDictValue<bencode::string_view>(metaData, "created by");
 
-    std::optional<std::string> mainAnnounce = _GetDictValue<std::string>(metaData, "announce");
+    std::optional<std::string_view> mainAnnounce =
+        _GetDictValue<bencode::string_view>(metaData, "announce");
 
-    std::vector<std::string> announceList = _GetAnnounceList(metaData);
+    std::vector<size_t> announceTierEnds;
+    std::vector<std::string_view> announceList = _GetAnnounceList(metaData, announceTierEnds);
+
+    FileTable files = _ParseFiles(infoDict);
+    // one hash per piece, the last one may be short
+    long long totalSize = files.totalSize();
+    if (piecesCount != totalSize / pieceLength + (totalSize % pieceLength != 0)) {
+        throw InvalidTorrentFile("pieces count does not match the total size");
+    }
+    const auto &info = std::get<bencode::dict_view>(infoDict);
+    auto filesIt = info->find("files");
+    bool multiFile =
+        filesIt != info->end() && std::holds_alternative<bencode::list_view>(filesIt->second);
+
+    return TorrentMetadata(std::move(storage), creationDate, pieceLength, piecesCount, name,
+                           infoHash, piecesHashes, comment, createdBy, mainAnnounce,
+                           std::move(announceList), std::move(announceTierEnds), std::move(files),
+                           multiFile);
+}
+
+size_t ParseMany(std::span<const std::string> paths,
+                 const std::function<void(ParseResult &&)> &onResult, size_t threadsCount) {
+    if (paths.empty()) {
+        return 0;
+    }
+    threadsCount = std::min(ThreadPool::ResolveThreadsCount(threadsCount), paths.size());
+
+    std::mutex mutex;
+    std::condition_variable resultsReady;
+    std::vector<ParseResult> completed;
+    std::atomic<size_t> nextPath = 0;
+
+    {
+        ThreadPool pool(threadsCount);
+
+        // every worker keeps taking the next path, so slow files don't hold up a queue
+        for (size_t worker = 0; worker < threadsCount; worker++) {
+            pool.Post([&] {
+                for (size_t i = nextPath++; i < paths.size(); i = nextPath++) {
+                    ParseResult result{paths[i], {}, {}};
+                    try {
+                        result.metadata = ParseFromFile(paths[i]);
+                    } catch (const std::exception &e) {
+                        result.error = e.what();
+                    }
+
+                    std::lock_guard lock(mutex);
+                    completed.push_back(std::move(result));
+                    resultsReady.notify_one();
+                }
+            });
+        }
 
-    std::vector<TorrentFile> files = _ParseFiles(infoDict);
+        // hand results to the caller as batches complete
+        size_t reported = 0;
+        size_t succeeded = 0;
+        std::vector<ParseResult> batch;
+        while (reported < paths.size()) {
+            {
+                std::unique_lock lock(mutex);
+                resultsReady.wait(lock, [&] { return !completed.empty(); });
+                batch.swap(completed);
+            }
+            for (ParseResult &result : batch) {
+                succeeded += result.metadata.has_value();
+                onResult(std::move(result));
+            }
+            reported += batch.size();
+            batch.clear();
+        }
+        return succeeded;
+    }
+}
 
-    return TorrentMetadata(creationDate, pieceLength, piecesCount, name, infoHash, piecesHashes,
-                           comment, createdBy, mainAnnounce, announceList, files);
+size_t ParseDirectory(const std::string &directory,
+                      const std::function<void(ParseResult &&)> &onResult, size_t threadsCount) {
+    std::vector<std::string> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.path().extension() == ".torrent") {
+            paths.push_back(entry.path().string());
+        }
+    }
+    return ParseMany(paths, onResult, threadsCount);
 }
 
-std::string GetSha1Hash(std::string text) {
+Sha1Digest GetSha1Hash(std::string_view text) {
     SHA1 sha1;
-    return sha1(text);
+    sha1.add(text.data(), text.size());
+
+    Sha1Digest digest;
+    sha1.getHash(reinterpret_cast<unsigned char *>(digest.bytes.data()));
+    return digest;
 }
 
 /**
- * @brief It wraps std::get and catches std::bad_variant_access error
+ * @brief decodes the top level dict of metaInfo one value at a time,
+ *        so that the byte range of the info value can be recorded
+ * @param infoSpan is set to the bencoded info value, viewing into metaInfo
+ * @return decoded metaInfo as dict_view
+ * @throws InvalidTorrentFile
+ */
+static bencode::data_view _DecodeMetaInfo(std::string_view metaInfo, std::string_view &infoSpan) {
+    const char *pos = metaInfo.data();
+    const char *end = metaInfo.data() + metaInfo.size();
+
+    if (pos == end || *pos != 'd') {
+        throw InvalidTorrentFile("metainfo is not a dictionary");
+    }
+    pos++;
+
+    bencode::data_view metaData = bencode::dict_view{};
+    auto &metaDict = std::get<bencode::dict_view>(metaData);
+
+    try {
+        while (pos != end && *pos != 'e') {
+            bencode::data_view key = bencode::decode_view_some(pos, end);
+            const auto *keyString = std::get_if<bencode::string_view>(&key);
+            if (keyString == nullptr) {
+                throw InvalidTorrentFile("metainfo key is not a string");
+            }
+
+            const char *valueBegin = pos;
+            bencode::data_view value = bencode::decode_view_some(pos, end);
+            if (*keyString == "info") {
+                infoSpan = std::string_view(valueBegin, pos - valueBegin);
+            }
+
+            if (!metaDict->emplace(*keyString, std::move(value)).second) {
+                throw InvalidTorrentFile("duplicated key in metainfo");
+            }
+        }
+    } catch (const bencode::decode_error &e) {
+        std::string msg = "decode error: ";
+        throw InvalidTorrentFile(msg + e.what());
+    }
+
+    if (pos == end) {
+        throw InvalidTorrentFile("decode error: unexpected end of input");
+    }
+    if (++pos != end) {
+        throw InvalidTorrentFile("decode error: extraneous character");
+    }
+    return metaData;
+}
+
+/**
+ * @brief looks up key in a bencoded dict without copying it
  * @brief Useful for skipping 'bad_variant_access' exception
- * @tparam T any bencode::basic_data type
+ * @tparam T any bencode::data_view alternative
+ * @return copy of the value (cheap for views) or null if key or type is missing
  */
 template <typename T>
-std::optional<T> _GetDictValue(bencode::data dict, std::string key) {
-    try {
-        return std::get<T>(dict[key]);
-    } catch (std::bad_variant_access) {
-        LogInfo("torrent file does not contain attribute: {}", key);
+static std::optional<T> _GetDictValue(const bencode::data_view &dict, std::string_view key) {
+    const auto *dictPtr = std::get_if<bencode::dict_view>(&dict);
+    if (dictPtr != nullptr) {
+        auto it = (*dictPtr)->find(key);
+        if (it != (*dictPtr)->end()) {
+            if (const T *value = std::get_if<T>(&it->second)) {
+                return *value;
+            }
+        }
     }
+    LogInfo("torrent file does not contain attribute: {}", key);
     return {};
 }
 
 /**
  * @param metaData is top level bencoded data of .torrent file
+ * @param tierEnds receives the end of each tier in the returned list
  * @return  announce-list from the top of torrent metaData dict
  */
-static std::vector<std::string> _GetAnnounceList(bencode::data metaData) {
-    std::optional<bencode::list> announceListOptional =
-        _GetDictValue<bencode::list>(metaData, "announce-list");
-
-    if (!announceListOptional.has_value()) {
+static std::vector<std::string_view> _GetAnnounceList(const bencode::data_view &metaData,
+                                                      std::vector<size_t> &tierEnds) {
+    const auto &metaDict = std::get<bencode::dict_view>(metaData);
+    auto announceListIt = metaDict->find("announce-list");
+    if (announceListIt == metaDict->end()) {
+        return {};
+    }
+    const auto *tiers = std::get_if<bencode::list_view>(&announceListIt->second);
+    if (tiers == nullptr) {
         return {};
     }
 
-    std::vector<std::string> announceList;
-    for (bencode::data items : announceListOptional.value()) {
-        for (bencode::data item : std::get<bencode::list>(items)) {
-            announceList.emplace_back(std::get<bencode::string>(item));
+    std::vector<std::string_view> announceList;
+    for (const bencode::data_view &items : *tiers) {
+        const auto *tier = std::get_if<bencode::list_view>(&items);
+        if (tier == nullptr) {
+            continue;
+        }
+        for (const bencode::data_view &item : *tier) {
+            if (const auto *url = std::get_if<bencode::string_view>(&item)) {
+                announceList.emplace_back(*url);
+            }
+        }
+        if (tierEnds.empty() ? !announceList.empty() : tierEnds.back() != announceList.size()) {
+            tierEnds.push_back(announceList.size());
         }
     }
     return announceList;
@@ -219,40 +412,71 @@ static std::vector<std::string> _GetAnnounceList(bencode::data metaData) {
  * @return list of single file if there is no 'files' key in info-dict
  * @throws InvalidTorrentFile
  */
-static std::vector<TorrentFile> _ParseFiles(bencode::dict infoDict) {
-    bencode::list filesList;
+static FileTable _ParseFiles(const bencode::data_view &infoDict) {
+    const auto &info = std::get<bencode::dict_view>(infoDict);
 
     try { // catches std::bad_optional_access
 
+        FileTable::Builder torrentFilesBuilder;
+
         // check for single file torrent
-        try {
-            filesList = std::get<bencode::list>(infoDict["files"]);
-        } catch (std::bad_variant_access) {
-            long long length = _GetDictValue<bencode::integer>(infoDict, "length").value();
-            std::string fileName = _GetDictValue<std::string>(infoDict, "name").value();
+        auto filesIt = info->find("files");
+        const bencode::list_view *filesList =
+            filesIt == info->end() ? nullptr : std::get_if<bencode::list_view>(&filesIt->second);
+        if (filesList == nullptr) {
+            long long length = _GetDictValue<bencode::integer_view>(infoDict, "length").value();
+            if (length < 0) {
+                throw InvalidTorrentFile("file length is negative");
+            }
+            std::string_view fileName =
+                _GetDictValue<bencode::string_view>(infoDict, "name").value();
 
             // return single file list from top of infoHash
-            return {TorrentFile({fileName}, length)};
+            torrentFilesBuilder.AddFile({&fileName, 1}, length);
+            return torrentFilesBuilder.Build();
         }
 
-        // build TorrentFile list
-        std::vector<TorrentFile> torrentFilesBuilder;
+        // build file table, path nodes view into the metainfo until they are interned
+        torrentFilesBuilder.Reserve(filesList->size());
+        std::vector<std::string_view> pathListBuilder;
+        long long runningTotal = 0;
 
-        for (bencode::data file : filesList) {
-            long long len = _GetDictValue<bencode::integer>(file, "length").value();
-            std::vector<bencode::data> pathListData =
-                _GetDictValue<bencode::list>(file, "path").value();
+        for (const bencode::data_view &file : *filesList) {
+            long long len = _GetDictValue<bencode::integer_view>(file, "length").value();
+            if (len < 0) {
+                throw InvalidTorrentFile("file length is negative");
+            }
+            // the file offsets are running sums of the lengths
+            if (len > std::numeric_limits<long long>::max() - runningTotal) {
+                throw InvalidTorrentFile("total size is too large");
+            }
+            runningTotal += len;
+            const auto &fileDict = std::get<bencode::dict_view>(file);
+            const auto *pathListData = std::get_if<bencode::list_view>(&fileDict->at("path"));
+            if (pathListData == nullptr || pathListData->empty()) {
+                throw InvalidTorrentFile("file path is not a list");
+            }
 
-            std::vector<std::string> pathListBuilder;
-            for (bencode::data p : pathListData) {
-                pathListBuilder.emplace_back(std::get<bencode::string>(p));
+            pathListBuilder.clear();
+            for (const bencode::data_view &p : *pathListData) {
+                pathListBuilder.emplace_back(std::get<bencode::string_view>(p));
             }
-            torrentFilesBuilder.emplace_back(TorrentFile({pathListBuilder}, len));
+            // BEP 47, "p" marks a pad file; looked up directly, most files have no attributes
+            auto attrIt = fileDict->find("attr");
+            const auto *attr = attrIt == fileDict->end()
+                                   ? nullptr
+                                   : std::get_if<bencode::string_view>(&attrIt->second);
+            bool padFile = attr != nullptr && attr->find('p') != std::string_view::npos;
+            torrentFilesBuilder.AddFile(pathListBuilder, len, padFile);
         }
 
-        return torrentFilesBuilder;
+        return torrentFilesBuilder.Build();
 
-    } catch (std::bad_optional_access) {
+    } catch (const std::bad_optional_access &) {
+        throw InvalidTorrentFile("required keys not present in files list");
+    } catch (const std::bad_variant_access &) {
+        throw InvalidTorrentFile("malformed files list");
+    } catch (const std::out_of_range &) {
         throw InvalidTorrentFile("required keys not present in files list");
     }
 }
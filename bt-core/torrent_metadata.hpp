@@ -1,9 +1,17 @@
 #pragma once
 
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "file_table.hpp"
+#include "sha1_digest.hpp"
+
 namespace bt {
 
 class InvalidTorrentFile : public std::exception {
@@ -22,48 +30,29 @@ class InvalidTorrentFile : public std::exception {
     std::string _err = "Invalid Torrent File";
 };
 
-/**
- * @brief represents a single file from files list
- */
-class TorrentFile {
-  public:
-    /**
-     * @brief list of path as nodes
-     */
-    std::vector<std::string> relativePath;
-
-    /**
-     * @brief size of file in bytes
-     */
-    long long size;
-
-  public:
-    TorrentFile(std::vector<std::string> relativePath, long long size);
-
-    /**
-     * @return concatinated string for relative path with delimeter '/'
-     */
-    std::string GetRelativePathAsString();
-};
-
 /**
  * @brief It represent all stored data in a .torrent file
  * @brief refer to metainfo spec http://www.bittorrent.org/beps/bep_0003.html
+ * @brief strings are views into the bencoded metainfo, which is kept alive by
+ *        (and shared between copies of) the metadata object
  */
 class TorrentMetadata {
     // clang-format off
   public:
-    TorrentMetadata(long long creationDate,
+    TorrentMetadata(std::shared_ptr<const void> metaInfoStorage,
+                    long long creationDate,
                     long long pieceLength,
                     long long piecesCount,
-                    std::string name,
-                    std::string infoHash, 
-                    std::string piecesHashes, 
-                    std::optional<std::string> comment,
-                    std::optional<std::string> createdBy,
-                    std::optional<std::string> mainAnnounce,
-                    std::vector<std::string> announceList,
-                    std::vector<TorrentFile> files
+                    std::string_view name,
+                    InfoHash infoHash, 
+                    std::string_view piecesHashes, 
+                    std::optional<std::string_view> comment,
+                    std::optional<std::string_view> createdBy,
+                    std::optional<std::string_view> mainAnnounce,
+                    std::vector<std::string_view> announceList,
+                    std::vector<size_t> announceTierEnds,
+                    FileTable files,
+                    bool multiFile
     );
     // clang-format on
 
@@ -82,60 +71,105 @@ class TorrentMetadata {
      */
     long long piecesCount() const;
 
+    /**
+     * @param index of piece, must be less than piecesCount()
+     * @return bytes in the piece, the last piece may be shorter than pieceLength()
+     */
+    long long pieceSize(size_t index) const;
+
+    /**
+     * @return sum of sizes of all files in torrent
+     */
+    long long totalSize() const;
+
+    /**
+     * @param index of piece, must be less than piecesCount()
+     * @return slices of files the piece is stored in, computed without allocating
+     */
+    FileSliceRange MapPiece(size_t index) const;
+
     /**
      * @return name of torrent
      */
-    std::string name();
+    std::string_view name() const;
 
     /**
      * @return text comment of the author
      */
-    std::optional<std::string> comment();
+    std::optional<std::string_view> comment() const;
 
     /**
      * @return name and version of the program used to create .torrent
      */
-    std::optional<std::string> createdBy();
+    std::optional<std::string_view> createdBy() const;
 
     /**
      * @return the hash of the B-encoded meta-info dictionary of a torrent.
      */
-    std::string infoHash();
+    InfoHash infoHash() const;
 
     /**
      * @brief stores pieces hashes where every piece has 20 char length
      * @return concatenation of all 20 - byte SHA1 hash values, one per piece.
      */
-    std::string piecesHashes();
+    std::span<const std::byte> piecesHashes() const;
+
+    /**
+     * @param index of piece, must be less than piecesCount()
+     * @return 20 - byte SHA1 hash of the piece, viewing into piecesHashes()
+     */
+    std::span<const std::byte, Sha1Digest::Size> pieceHash(size_t index) const;
 
     /**
      * @return main announce url for tracker or null for absense
      */
-    std::optional<std::string> mainAnnounce();
+    std::optional<std::string_view> mainAnnounce() const;
 
     /**
      * @brief refer to http://bittorrent.org/beps/bep_0012.html
-     * @return all tracker for announce
+     * @return all tracker for announce, the tiers one after another
+     */
+    const std::vector<std::string_view>& announceList() const;
+
+    /**
+     * @return count of BEP 12 tiers in announceList(), empty tiers are left out
+     */
+    size_t announceTiersCount() const;
+
+    /**
+     * @brief trackers of a tier are tried in order, the next tier only when all of them fail
+     * @param tier must be less than announceTiersCount()
+     * @return trackers of the tier, a slice of announceList()
      */
-    std::vector<std::string> announceList();
+    std::span<const std::string_view> announceTier(size_t tier) const;
 
     /**
      * @return list of files, stored in this torrent
+     * @brief single file torrents have one file whose path is the torrent name
      */
-    std::vector<TorrentFile> files();
+    const FileTable& files() const;
+
+    /**
+     * @return true if the info dict has a files list, whose paths are then relative to a
+     *         directory named after the torrent, even if there is only one file
+     */
+    bool isMultiFile() const;
 
   private:
+    std::shared_ptr<const void> _metaInfoStorage; // owns the buffer all views point into
     long long _creationDate; // nullable null ? -1
     long long _pieceLength;  // required
     long long _piecesCount;
-    std::string _name; // required
-    std::string _infoHash;
-    std::string _piecesHashes;                // required
-    std::optional<std::string> _comment;      // nullable
-    std::optional<std::string> _createdBy;    // nullable
-    std::optional<std::string> _mainAnnounce; // nullable
-    std::vector<std::string> _announceList;
-    std::vector<TorrentFile> _files;
+    std::string_view _name; // required
+    InfoHash _infoHash;
+    std::string_view _piecesHashes;                // required
+    std::optional<std::string_view> _comment;      // nullable
+    std::optional<std::string_view> _createdBy;    // nullable
+    std::optional<std::string_view> _mainAnnounce; // nullable
+    std::vector<std::string_view> _announceList;
+    std::vector<size_t> _announceTierEnds; // end of each tier in _announceList
+    FileTable _files;
+    bool _multiFile;
 };
 
 /**
@@ -145,6 +179,11 @@ namespace torrent_parser {
 
 /**
  * @brief loads torrent metadata from .torrent file
+ * @brief the file is memory mapped (or read once for small files) and parsed in place
+ * @brief a file of at least MappedFile::MapThreshold bytes stays mapped as long as the
+ *        metadata lives: it must not be truncated or rewritten in place meanwhile, the views
+ *        of the metadata would change or reading them would raise SIGBUS. Replacing the file
+ *        with a rename is safe, the mapping keeps the old one
  * @param path for .torrent file
  * @return parsed torrent metadata
  * @throws std::runtime_error if file could not be opened
@@ -153,16 +192,45 @@ TorrentMetadata ParseFromFile(std::string path);
 
 /**
  * @brief loads torrent metadata from bencoded metaInfo
+ * @brief metaInfo is decoded in place and kept as the backing buffer of the
+ *        returned metadata, no string in it is copied
  * @param metaInfo is bencoded string loaded from .torrent file
  * @return parsed torrent metadata
  * @throws bt::InvalidTorrentFile if metaInfo has missing required fields
  */
 TorrentMetadata Parse(std::string metaInfo);
 
+/**
+ * @brief outcome of loading one file with ParseMany
+ */
+struct ParseResult {
+    std::string path;
+    std::optional<TorrentMetadata> metadata; // null if loading failed
+    std::string error;                       // what() of the failure
+};
+
+/**
+ * @brief loads many .torrent files in parallel, parsing and infohashing on a thread pool
+ * @brief a file that fails to load is reported and does not stop the others
+ * @param paths of .torrent files
+ * @param onResult called on the calling thread for every file, in order of completion
+ * @param threadsCount 0 for one thread per hardware thread
+ * @return count of files that were loaded successfully
+ */
+size_t ParseMany(std::span<const std::string> paths,
+                 const std::function<void(ParseResult&&)>& onResult, size_t threadsCount = 0);
+
+/**
+ * @brief ParseMany for every *.torrent file directly inside directory
+ * @throws std::filesystem::filesystem_error if directory could not be listed
+ */
+size_t ParseDirectory(const std::string& directory,
+                      const std::function<void(ParseResult&&)>& onResult, size_t threadsCount = 0);
+
 /**
  * @return SHA1 hash of text
  */
-std::string GetSha1Hash(std::string text);
+Sha1Digest GetSha1Hash(std::string_view text);
 } // namespace torrent_parser
 
 } // namespace bt
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "peer_wire.hpp"
+
+/**
+ * @brief types shared by the tracker protocols
+ */
+namespace bt {
+
+/**
+ * @brief values match the BEP 15 announce event field
+ */
+enum class AnnounceEvent {
+    None = 0, // regular announce while the torrent runs
+    Completed = 1,
+    Started = 2,
+    Stopped = 3,
+};
+
+struct AnnounceRequest {
+    InfoHash infoHash;
+    peer_wire::PeerId peerId{};
+    uint16_t port = 0; // where we accept peer connections
+    long long uploaded = 0;
+    long long downloaded = 0;
+    long long left = 0;
+    AnnounceEvent event = AnnounceEvent::None;
+    int peersWanted = 50; // -1 lets the tracker decide
+    uint32_t key = 0;     // lets the tracker recognize us when our address changes
+};
+
+struct AnnounceResponse {
+    std::chrono::seconds interval{0};
+    std::chrono::seconds minInterval{0}; // 0 if the tracker did not send one
+    long long seeders = -1;              // -1 if the tracker did not send the count
+    long long leechers = -1;             // ditto
+    std::vector<asio::ip::tcp::endpoint> peers;
+    std::string warning;
+};
+
+/**
+ * @brief counts a tracker reports for one torrent
+ */
+struct ScrapeInfo {
+    long long seeders = 0;
+    long long completed = 0; // downloads finished so far
+    long long leechers = 0;
+
+    bool operator==(const ScrapeInfo&) const = default;
+};
+
+/**
+ * @brief the tracker refused the request or answered something that could not be understood
+ */
+class TrackerError : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+} // namespace bt
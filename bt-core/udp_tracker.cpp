@@ -0,0 +1,309 @@
+#include "udp_tracker.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace bt {
+
+namespace {
+
+enum class Action : uint32_t {
+    Connect = 0,
+    Announce = 1,
+    Scrape = 2,
+    Error = 3,
+};
+
+// magic constant of the connect request
+constexpr uint64_t ProtocolId = 0x41727101980;
+
+constexpr size_t ReceiveBufferSize = 64 * 1024;
+
+uint32_t ReadUint32(const std::byte* data) {
+    return (std::to_integer<uint32_t>(data[0]) << 24) | (std::to_integer<uint32_t>(data[1]) << 16) |
+           (std::to_integer<uint32_t>(data[2]) << 8) | std::to_integer<uint32_t>(data[3]);
+}
+
+uint64_t ReadUint64(const std::byte* data) {
+    return (uint64_t(ReadUint32(data)) << 32) | ReadUint32(data + 4);
+}
+
+void AppendUint16(std::vector<std::byte>& out, uint16_t value) {
+    out.push_back(std::byte(value >> 8));
+    out.push_back(std::byte(value));
+}
+
+void AppendUint32(std::vector<std::byte>& out, uint32_t value) {
+    out.push_back(std::byte(value >> 24));
+    out.push_back(std::byte(value >> 16));
+    out.push_back(std::byte(value >> 8));
+    out.push_back(std::byte(value));
+}
+
+void AppendUint64(std::vector<std::byte>& out, uint64_t value) {
+    AppendUint32(out, uint32_t(value >> 32));
+    AppendUint32(out, uint32_t(value));
+}
+
+void AppendHeader(std::vector<std::byte>& out, uint64_t connectionId, Action action,
+                  uint32_t transactionId) {
+    AppendUint64(out, connectionId);
+    AppendUint32(out, uint32_t(action));
+    AppendUint32(out, transactionId);
+}
+
+/**
+ * @throws TrackerError if response is not a complete answer to action
+ */
+void CheckResponse(const std::vector<std::byte>& response, Action action, size_t minSize) {
+    if (response.size() < minSize || ReadUint32(response.data()) != uint32_t(action)) {
+        throw TrackerError("tracker sent a malformed response");
+    }
+}
+
+} // namespace
+
+UdpTrackerClient::UdpTrackerClient(asio::any_io_executor executor, UdpTrackerOptions options)
+    : _executor(std::move(executor)),
+      _options(options),
+      _socket(_executor, asio::ip::udp::endpoint(asio::ip::udp::v4(), 0)),
+      _receiveBuffer(ReceiveBufferSize),
+      _random(std::random_device{}()) {
+    asio::co_spawn(_executor, _Receive(), asio::detached);
+}
+
+UdpTrackerClient::~UdpTrackerClient() {
+    std::error_code ignored;
+    _socket.close(ignored);
+}
+
+asio::awaitable<AnnounceResponse> UdpTrackerClient::Announce(std::string announceUrl,
+                                                             AnnounceRequest request) {
+    Tracker& tracker = *co_await _Tracker(announceUrl);
+    uint64_t connectionId = co_await _ConnectionId(tracker);
+
+    uint32_t transactionId = _NewTransactionId();
+    std::vector<std::byte> packet;
+    packet.reserve(98);
+    AppendHeader(packet, connectionId, Action::Announce, transactionId);
+    packet.insert(packet.end(), request.infoHash.bytes.begin(), request.infoHash.bytes.end());
+    packet.insert(packet.end(), request.peerId.begin(), request.peerId.end());
+    AppendUint64(packet, uint64_t(request.downloaded));
+    AppendUint64(packet, uint64_t(request.left));
+    AppendUint64(packet, uint64_t(request.uploaded));
+    AppendUint32(packet, uint32_t(request.event));
+    AppendUint32(packet, 0); // our address, as seen by the tracker
+    AppendUint32(packet, request.key);
+    AppendUint32(packet, uint32_t(request.peersWanted));
+    AppendUint16(packet, request.port);
+
+    std::vector<std::byte> answer = co_await _Exchange(tracker, std::move(packet), transactionId);
+    CheckResponse(answer, Action::Announce, 20);
+
+    // action, transaction id, interval, leechers, seeders, then 6 bytes per peer
+    AnnounceResponse response;
+    response.interval = std::chrono::seconds(ReadUint32(answer.data() + 8));
+    response.leechers = ReadUint32(answer.data() + 12);
+    response.seeders = ReadUint32(answer.data() + 16);
+    if ((answer.size() - 20) % 6 != 0) {
+        throw TrackerError("tracker sent a truncated compact peer list");
+    }
+    response.peers.reserve((answer.size() - 20) / 6);
+    for (size_t offset = 20; offset < answer.size(); offset += 6) {
+        asio::ip::address_v4 address(ReadUint32(answer.data() + offset));
+        uint16_t port = uint16_t(std::to_integer<uint16_t>(answer[offset + 4]) << 8 |
+                                 std::to_integer<uint16_t>(answer[offset + 5]));
+        response.peers.emplace_back(address, port);
+    }
+    co_return response;
+}
+
+asio::awaitable<std::vector<ScrapeInfo>> UdpTrackerClient::Scrape(
+    std::string announceUrl, std::vector<InfoHash> infoHashes) {
+    Tracker& tracker = *co_await _Tracker(announceUrl);
+
+    std::vector<ScrapeInfo> result;
+    result.reserve(infoHashes.size());
+    for (size_t begin = 0; begin < infoHashes.size(); begin += MaxScrapeInfoHashes) {
+        size_t count = std::min(MaxScrapeInfoHashes, infoHashes.size() - begin);
+        uint64_t connectionId = co_await _ConnectionId(tracker);
+
+        uint32_t transactionId = _NewTransactionId();
+        std::vector<std::byte> packet;
+        packet.reserve(16 + 20 * count);
+        AppendHeader(packet, connectionId, Action::Scrape, transactionId);
+        for (size_t i = begin; i < begin + count; i++) {
+            packet.insert(packet.end(), infoHashes[i].bytes.begin(), infoHashes[i].bytes.end());
+        }
+
+        std::vector<std::byte> answer =
+            co_await _Exchange(tracker, std::move(packet), transactionId);
+        // action, transaction id, then seeders, completed, leechers per torrent
+        CheckResponse(answer, Action::Scrape, 8 + 12 * count);
+        for (size_t i = 0; i < count; i++) {
+            const std::byte* counts = answer.data() + 8 + 12 * i;
+            result.push_back(
+                {ReadUint32(counts), ReadUint32(counts + 4), ReadUint32(counts + 8)});
+        }
+    }
+    co_return result;
+}
+
+asio::ip::udp::endpoint UdpTrackerClient::localEndpoint() const {
+    return _socket.local_endpoint();
+}
+
+/**
+ * @return state of the tracker at announceUrl, resolved on first use
+ */
+asio::awaitable<UdpTrackerClient::Tracker*> UdpTrackerClient::_Tracker(
+    std::string_view announceUrl) {
+    constexpr std::string_view scheme = "udp://";
+    if (!announceUrl.starts_with(scheme)) {
+        throw std::invalid_argument("not a udp tracker: " + std::string(announceUrl));
+    }
+    std::string_view authority = announceUrl.substr(scheme.size());
+    authority = authority.substr(0, authority.find('/'));
+    size_t portBegin = authority.rfind(':');
+    if (portBegin == std::string_view::npos || portBegin == 0) {
+        throw std::invalid_argument("udp tracker url has no port: " + std::string(announceUrl));
+    }
+
+    auto it = _trackers.find(authority);
+    if (it == _trackers.end()) {
+        asio::ip::udp::resolver resolver(_executor);
+        auto endpoints = co_await resolver.async_resolve(
+            asio::ip::udp::v4(), authority.substr(0, portBegin), authority.substr(portBegin + 1),
+            asio::use_awaitable);
+        // another request may have resolved it meanwhile
+        it = _trackers.try_emplace(std::string(authority)).first;
+        it->second.endpoint = endpoints.begin()->endpoint();
+    }
+    co_return &it->second;
+}
+
+/**
+ * @return cached connection id of tracker, or a new one if it expired
+ */
+asio::awaitable<uint64_t> UdpTrackerClient::_ConnectionId(Tracker& tracker) {
+    for (;;) {
+        if (std::chrono::steady_clock::now() < tracker.connectionIdExpiry) {
+            co_return tracker.connectionId;
+        }
+        if (tracker.connecting) {
+            // another request is connecting, it cancels the timer when done
+            co_await tracker.connecting->async_wait(asio::as_tuple(asio::use_awaitable));
+            if ((co_await asio::this_coro::cancellation_state).cancelled() !=
+                asio::cancellation_type::none) {
+                throw std::system_error(asio::error::operation_aborted);
+            }
+            // if that connect failed, this request tries again
+            continue;
+        }
+
+        tracker.connecting = std::make_unique<asio::steady_timer>(
+            _executor, asio::steady_timer::time_point::max());
+        uint32_t transactionId = _NewTransactionId();
+        std::vector<std::byte> packet;
+        AppendHeader(packet, ProtocolId, Action::Connect, transactionId);
+
+        std::exception_ptr failure;
+        std::vector<std::byte> answer;
+        try {
+            answer = co_await _Exchange(tracker, std::move(packet), transactionId);
+            CheckResponse(answer, Action::Connect, 16);
+        } catch (...) {
+            failure = std::current_exception();
+        }
+        tracker.connecting->cancel();
+        tracker.connecting.reset();
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+        tracker.connectionId = ReadUint64(answer.data() + 8);
+        tracker.connectionIdExpiry =
+            std::chrono::steady_clock::now() + _options.connectionIdLifetime;
+    }
+}
+
+/**
+ * @brief sends request until its answer arrives, waiting twice as long after every retransmit
+ * @throws TrackerError if the tracker answers with an error
+ */
+asio::awaitable<std::vector<std::byte>> UdpTrackerClient::_Exchange(Tracker& tracker,
+                                                                     std::vector<std::byte> request,
+                                                                     uint32_t transactionId) {
+    std::vector<std::byte> response;
+    asio::steady_timer timer(_executor);
+    Pending& pending = _pending[transactionId];
+    pending = Pending{tracker.endpoint, &timer, &response};
+    // the request is forgotten however this coroutine ends, cancellation included
+    struct Forget {
+        std::unordered_map<uint32_t, Pending>& pending;
+        uint32_t transactionId;
+        ~Forget() {
+            pending.erase(transactionId);
+        }
+    } forget{_pending, transactionId};
+
+    for (int retransmits = 0; retransmits <= _options.maxRetransmits; retransmits++) {
+        co_await _socket.async_send_to(asio::buffer(request), tracker.endpoint,
+                                       asio::use_awaitable);
+        // the answer may have arrived while sending, with no wait pending for it to cancel
+        if (!pending.answered) {
+            timer.expires_after(_options.initialTimeout * (1 << retransmits));
+            co_await timer.async_wait(asio::as_tuple(asio::use_awaitable));
+        }
+
+        if (pending.answered) {
+            if (ReadUint32(response.data()) == uint32_t(Action::Error)) {
+                // the connection id may be what the tracker did not like
+                tracker.connectionIdExpiry = {};
+                std::string_view message(reinterpret_cast<const char*>(response.data()) + 8,
+                                         response.size() - 8);
+                throw TrackerError("tracker refused the request: " + std::string(message));
+            }
+            co_return std::move(response);
+        }
+        if ((co_await asio::this_coro::cancellation_state).cancelled() !=
+            asio::cancellation_type::none) {
+            throw std::system_error(asio::error::operation_aborted);
+        }
+    }
+    throw std::system_error(asio::error::timed_out);
+}
+
+/**
+ * @brief hands every datagram to the request waiting for it
+ */
+asio::awaitable<void> UdpTrackerClient::_Receive() {
+    for (;;) {
+        auto [error, size] = co_await _socket.async_receive_from(
+            asio::buffer(_receiveBuffer), _sender, asio::as_tuple(asio::use_awaitable));
+        if (error == asio::error::operation_aborted) {
+            // the client is being destroyed, do not touch it
+            co_return;
+        }
+        // errors are ICMP messages about earlier sends, the request will time out
+        if (error || size < 8) {
+            continue;
+        }
+        auto it = _pending.find(ReadUint32(_receiveBuffer.data() + 4));
+        if (it == _pending.end() || it->second.answered || it->second.tracker != _sender) {
+            continue;
+        }
+        it->second.response->assign(_receiveBuffer.begin(), _receiveBuffer.begin() + size);
+        it->second.answered = true;
+        it->second.timer->cancel();
+    }
+}
+
+uint32_t UdpTrackerClient::_NewTransactionId() {
+    uint32_t transactionId;
+    do {
+        transactionId = uint32_t(_random());
+    } while (_pending.contains(transactionId));
+    return transactionId;
+}
+
+} // namespace bt
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tracker.hpp"
+
+namespace bt {
+
+struct UdpTrackerOptions {
+    /**
+     * @brief a request is sent again if no answer arrives within initialTimeout * 2^n,
+     *        n counting the retransmits (BEP 15 uses 15 s)
+     */
+    std::chrono::steady_clock::duration initialTimeout = std::chrono::seconds(15);
+
+    /**
+     * @brief retransmits before the request fails with asio::error::timed_out
+     */
+    int maxRetransmits = 8;
+
+    /**
+     * @brief how long a connection id is used before connecting again, BEP 15 allows a minute
+     */
+    std::chrono::steady_clock::duration connectionIdLifetime = std::chrono::minutes(1);
+};
+
+/**
+ * @brief UDP tracker protocol, refer to http://www.bittorrent.org/beps/bep_0015.html
+ * @brief every tracker and torrent share one socket: answers are matched to requests by
+ *        their transaction id, connection ids are cached per tracker and concurrent requests
+ *        to a tracker wait for a single connect
+ * @brief IPv4 only; not thread safe, use it from coroutines of a single thread or strand and
+ *        destroy it once they have completed
+ */
+class UdpTrackerClient {
+  public:
+    /**
+     * @brief scrape requests carry at most this many infohashes, the most that fit a
+     *        packet without fragmentation
+     */
+    static constexpr size_t MaxScrapeInfoHashes = 74;
+
+    explicit UdpTrackerClient(asio::any_io_executor executor, UdpTrackerOptions options = {});
+
+    ~UdpTrackerClient();
+
+    UdpTrackerClient(const UdpTrackerClient&) = delete;
+    UdpTrackerClient& operator=(const UdpTrackerClient&) = delete;
+
+    /**
+     * @throws TrackerError if the tracker answers with an error or garbage,
+     *         std::system_error asio::error::timed_out when the retransmits are exhausted,
+     *         std::invalid_argument if announceUrl is not a udp:// url
+     */
+    asio::awaitable<AnnounceResponse> Announce(std::string announceUrl, AnnounceRequest request);
+
+    /**
+     * @brief scrapes many torrents at once, sending MaxScrapeInfoHashes per request
+     * @return counts in the order of infoHashes
+     * @throws see Announce
+     */
+    asio::awaitable<std::vector<ScrapeInfo>> Scrape(std::string announceUrl,
+                                                    std::vector<InfoHash> infoHashes);
+
+    /**
+     * @return port of the shared socket
+     */
+    asio::ip::udp::endpoint localEndpoint() const;
+
+  private:
+    struct Tracker {
+        asio::ip::udp::endpoint endpoint;
+        uint64_t connectionId = 0;
+        std::chrono::steady_clock::time_point connectionIdExpiry{};
+        std::unique_ptr<asio::steady_timer> connecting; // set while a connect is in flight
+    };
+
+    // a request waiting for its answer
+    struct Pending {
+        asio::ip::udp::endpoint tracker;
+        asio::steady_timer* timer;
+        std::vector<std::byte>* response;
+        bool answered = false;
+    };
+
+    asio::awaitable<Tracker*> _Tracker(std::string_view announceUrl);
+    asio::awaitable<uint64_t> _ConnectionId(Tracker& tracker);
+    asio::awaitable<std::vector<std::byte>> _Exchange(Tracker& tracker,
+                                                      std::vector<std::byte> request,
+                                                      uint32_t transactionId);
+    asio::awaitable<void> _Receive();
+    uint32_t _NewTransactionId();
+
+    asio::any_io_executor _executor;
+    UdpTrackerOptions _options;
+    asio::ip::udp::socket _socket;
+    std::vector<std::byte> _receiveBuffer;
+    asio::ip::udp::endpoint _sender;
+    std::map<std::string, Tracker, std::less<>> _trackers; // by host:port
+    std::unordered_map<uint32_t, Pending> _pending;       // by transaction id
+    std::mt19937 _random;
+};
+
+} // namespace bt
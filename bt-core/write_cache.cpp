@@ -0,0 +1,126 @@
+#include "write_cache.hpp"
+
+#include "external/sha1.h"
+
+#include <iterator>
+#include <stdexcept>
+
+namespace bt {
+
+struct WriteCache::Entry {
+    CachedPiece piece;
+    long long pieceSize;
+    long long bytes = 0;
+    SHA1 sha1;
+    long long hashed = 0; // every byte before is hashed
+    std::list<Key>::iterator recent;
+};
+
+WriteCache::WriteCache(size_t maxBytes) : _maxBytes(maxBytes) {
+}
+
+WriteCache::~WriteCache() = default;
+
+WriteCache::Insertion WriteCache::Insert(size_t storage, uint32_t pieceIndex, long long pieceSize,
+                                         uint32_t begin, std::vector<std::byte> data) {
+    if (data.empty() || begin + static_cast<long long>(data.size()) > pieceSize) {
+        throw std::out_of_range("Block is outside of the piece");
+    }
+    Insertion insertion;
+    Key key{storage, pieceIndex};
+    auto it = _entries.find(key);
+    if (it != _entries.end()) {
+        const auto& blocks = it->second->piece.blocks;
+        auto next = blocks.lower_bound(begin);
+        bool overlaps = (next != blocks.end() && next->first < begin + data.size()) ||
+                        (next != blocks.begin() &&
+                         std::prev(next)->first + std::prev(next)->second.size() > begin);
+        if (overlaps) {
+            insertion.evicted.push_back(_Remove(it));
+            it = _entries.end();
+        }
+    }
+    if (it == _entries.end()) {
+        auto entry = std::make_unique<Entry>();
+        entry->piece.storage = storage;
+        entry->piece.pieceIndex = pieceIndex;
+        entry->pieceSize = pieceSize;
+        entry->recent = _recent.insert(_recent.end(), key);
+        it = _entries.emplace(key, std::move(entry)).first;
+    } else {
+        _recent.splice(_recent.end(), _recent, it->second->recent);
+    }
+
+    Entry& entry = *it->second;
+    entry.bytes += static_cast<long long>(data.size());
+    _size += data.size();
+    entry.piece.blocks.emplace(begin, std::move(data));
+    for (auto block = entry.piece.blocks.find(static_cast<uint32_t>(entry.hashed));
+         block != entry.piece.blocks.end() && block->first == entry.hashed; block++) {
+        entry.sha1.add(block->second.data(), block->second.size());
+        entry.hashed += static_cast<long long>(block->second.size());
+    }
+    if (entry.bytes == entry.pieceSize) {
+        Sha1Digest digest;
+        entry.sha1.getHash(reinterpret_cast<unsigned char*>(digest.bytes.data()));
+        insertion.completed = _Remove(it);
+        insertion.completed->digest = digest;
+    }
+
+    for (CachedPiece& piece : _Evict()) {
+        insertion.evicted.push_back(std::move(piece));
+    }
+    return insertion;
+}
+
+std::optional<CachedPiece> WriteCache::Take(size_t storage, uint32_t pieceIndex) {
+    auto it = _entries.find({storage, pieceIndex});
+    if (it == _entries.end()) {
+        return std::nullopt;
+    }
+    return _Remove(it);
+}
+
+std::vector<CachedPiece> WriteCache::TakeStorage(size_t storage) {
+    std::vector<CachedPiece> pieces;
+    auto it = _entries.lower_bound({storage, 0});
+    while (it != _entries.end() && it->first.first == storage) {
+        pieces.push_back(_Remove(it++));
+    }
+    return pieces;
+}
+
+std::vector<CachedPiece> WriteCache::TakeAll() {
+    std::vector<CachedPiece> pieces;
+    while (!_entries.empty()) {
+        pieces.push_back(_Remove(_entries.begin()));
+    }
+    return pieces;
+}
+
+size_t WriteCache::size() const {
+    return _size;
+}
+
+size_t WriteCache::piecesCount() const {
+    return _entries.size();
+}
+
+std::vector<CachedPiece> WriteCache::_Evict() {
+    std::vector<CachedPiece> evicted;
+    while (_size > _maxBytes) {
+        evicted.push_back(_Remove(_entries.find(_recent.front())));
+    }
+    return evicted;
+}
+
+CachedPiece WriteCache::_Remove(std::map<Key, std::unique_ptr<Entry>>::iterator it) {
+    Entry& entry = *it->second;
+    _size -= static_cast<size_t>(entry.bytes);
+    _recent.erase(entry.recent);
+    CachedPiece piece = std::move(entry.piece);
+    _entries.erase(it);
+    return piece;
+}
+
+} // namespace bt
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "sha1_digest.hpp"
+
+namespace bt {
+
+/**
+ * @brief downloaded blocks of one piece, held in memory until they are written
+ */
+struct CachedPiece {
+    size_t storage;
+    uint32_t pieceIndex;
+    std::map<uint32_t, std::vector<std::byte>> blocks; // by offset in the piece, never overlap
+    std::optional<Sha1Digest> digest;                   // set once every byte is cached
+};
+
+/**
+ * @brief gathers downloaded blocks per piece, so that a piece is written with one vectored
+ *        write once it is complete, and is never written at all if its hash is wrong
+ * @brief a piece is hashed while its blocks arrive: each block that continues the hashed
+ *        prefix is hashed right away, together with the blocks after it that arrived
+ *        earlier; the last block only hashes what is left
+ * @brief beyond maxBytes the partial pieces least recently added to are evicted, to be
+ *        written as they are; blocks of a piece that arrive after it was evicted gather
+ *        again, but only complete it in memory if all of them arrive again
+ * @brief does no io; not thread safe
+ */
+class WriteCache {
+  public:
+    struct Insertion {
+        // the piece the block completed, with its digest
+        std::optional<CachedPiece> completed;
+        // partial pieces to write as they are, in the order they were evicted
+        std::vector<CachedPiece> evicted;
+    };
+
+    explicit WriteCache(size_t maxBytes);
+    ~WriteCache();
+
+    WriteCache(const WriteCache&) = delete;
+    WriteCache& operator=(const WriteCache&) = delete;
+
+    /**
+     * @brief adds a block of a piece of pieceSize bytes; a block overlapping blocks already
+     *        cached evicts them first, so it is written after them
+     * @throws std::out_of_range if the block is empty or not inside the piece
+     */
+    Insertion Insert(size_t storage, uint32_t pieceIndex, long long pieceSize, uint32_t begin,
+                     std::vector<std::byte> data);
+
+    /**
+     * @return blocks of the piece taken out of the cache, if there are any
+     */
+    std::optional<CachedPiece> Take(size_t storage, uint32_t pieceIndex);
+
+    /**
+     * @return pieces of the storage taken out of the cache, in piece order
+     */
+    std::vector<CachedPiece> TakeStorage(size_t storage);
+
+    /**
+     * @return every piece taken out of the cache
+     */
+    std::vector<CachedPiece> TakeAll();
+
+    /**
+     * @return bytes of the cached blocks
+     */
+    size_t size() const;
+
+    size_t piecesCount() const;
+
+  private:
+    using Key = std::pair<size_t, uint32_t>; // storage, piece index
+
+    struct Entry;
+
+    std::vector<CachedPiece> _Evict();
+    CachedPiece _Remove(std::map<Key, std::unique_ptr<Entry>>::iterator it);
+
+    size_t _maxBytes;
+    size_t _size = 0;
+    std::map<Key, std::unique_ptr<Entry>> _entries;
+    std::list<Key> _recent; // least recently added to first
+};
+
+} // namespace bt
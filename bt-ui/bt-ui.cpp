@@ -1,3 +1,4 @@
+#include <array>
 #include <thread>
 #include <vector>
 
@@ -28,17 +29,19 @@ static void _DisplayComments() {
     ImGui::Text("comment");
     ImGui::SameLine(allignedPos);
 
+    std::string_view comment = torr.comment().value_or("");
+
     // calculate possible lines
-    size_t lines = torr.comment().value_or("").size() / 80;
+    size_t lines = comment.size() / 80;
 
     // if line greater than 3 enable scrolling
     if (lines > 3) {
         ImGui::BeginChild("commentChild", ImVec2(ImGui::GetContentRegionAvail().x, 80),
                           ImGuiChildFlags_None, 0);
-        ImGui::TextWrapped("%s", torr.comment().value_or("").c_str());
+        ImGui::TextWrapped("%.*s", static_cast<int>(comment.size()), comment.data());
         ImGui::EndChild();
     } else {
-        ImGui::TextWrapped("%s", torr.comment().value_or("").c_str());
+        ImGui::TextWrapped("%.*s", static_cast<int>(comment.size()), comment.data());
     }
 }
 
@@ -59,19 +62,24 @@ static void _DisplayFiles() {
         ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthFixed);
         ImGui::TableHeadersRow();
 
+        const bt::FileTable& files = torr.files();
+        std::string pathBuffer;
+
         // use clipper to only draw what is visible
         ImGuiListClipper clipper;
 
-        clipper.Begin(static_cast<int>(torr.files().size()));
+        clipper.Begin(static_cast<int>(files.size()));
         while (clipper.Step()) {
             for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
                 ImGui::TableNextRow();
 
                 ImGui::TableSetColumnIndex(0);
-                ImGui::TextWrapped("%s", torr.files()[row].GetRelativePathAsString().c_str());
+                pathBuffer.clear();
+                files.path(row).AppendTo(pathBuffer);
+                ImGui::TextWrapped("%s", pathBuffer.c_str());
 
                 ImGui::TableSetColumnIndex(1);
-                ImGui::TextUnformatted(utils::BytesToString(torr.files()[row].size).c_str());
+                ImGui::TextUnformatted(utils::BytesToString(files.fileSize(row)).c_str());
             }
         }
         ImGui::EndTable();
@@ -83,12 +91,15 @@ static void _DisplayFiles() {
 static void _DrawTorrentPreview() {
     bt::TorrentMetadata& torr = state.selectedTorrent.value();
 
-    ImGui::OpenPopup(torr.name().c_str());
+    // popup id has to be null terminated
+    std::string popupName(torr.name());
+
+    ImGui::OpenPopup(popupName.c_str());
     ImVec2 center = ImGui::GetMainViewport()->GetCenter();
     ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
     ImGui::SetNextWindowSize(popupSize);
 
-    if (ImGui::BeginPopupModal(torr.name().c_str(), NULL, ImGuiWindowFlags_NoResize)) {
+    if (ImGui::BeginPopupModal(popupName.c_str(), NULL, ImGuiWindowFlags_NoResize)) {
         {
             ImGui::Text("size");
             ImGui::SameLine(allignedPos);
@@ -97,7 +108,8 @@ static void _DrawTorrentPreview() {
 
             ImGui::Text("infoHash");
             ImGui::SameLine(allignedPos);
-            ImGui::TextUnformatted(torr.infoHash().c_str());
+            std::array<char, 40> infoHashHex = torr.infoHash().ToHex();
+            ImGui::TextUnformatted(infoHashHex.data(), infoHashHex.data() + infoHashHex.size());
             ImGui::Separator();
             
             ImGui::Text("date");
@@ -107,7 +119,8 @@ static void _DrawTorrentPreview() {
 
             ImGui::Text("created by");
             ImGui::SameLine(allignedPos);
-            ImGui::TextUnformatted(torr.createdBy().value_or("").c_str());
+            std::string_view createdBy = torr.createdBy().value_or("");
+            ImGui::TextUnformatted(createdBy.data(), createdBy.data() + createdBy.size());
             ImGui::Separator();
 
             _DisplayComments();
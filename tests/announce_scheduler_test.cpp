@@ -0,0 +1,203 @@
+#include "announce_scheduler.hpp"
+#include "doctest.h"
+
+#include <string>
+
+using bt::AnnounceBatch;
+using bt::AnnounceResponse;
+using bt::AnnounceScheduler;
+using bt::AnnounceSchedulerOptions;
+using namespace std::chrono_literals;
+
+using Tiers = std::vector<std::vector<std::string_view>>;
+
+static bt::InfoHash _Hash(int i) {
+    return bt::torrent_parser::GetSha1Hash(std::to_string(i));
+}
+
+static AnnounceResponse _Response(std::chrono::seconds interval,
+                                  std::chrono::seconds minInterval = 0s) {
+    AnnounceResponse response;
+    response.interval = interval;
+    response.minInterval = minInterval;
+    return response;
+}
+
+static size_t _Count(const std::vector<AnnounceBatch>& batches) {
+    size_t count = 0;
+    for (const AnnounceBatch& batch : batches) {
+        count += batch.announces.size();
+    }
+    return count;
+}
+
+// url of the single announce in batches
+static std::string _Url(const std::vector<AnnounceBatch>& batches) {
+    REQUIRE(_Count(batches) == 1);
+    return std::string(batches[0].announces[0].url);
+}
+
+TEST_CASE("announce scheduler spreads the first announces of many torrents") {
+    auto start = AnnounceScheduler::Clock::now();
+    AnnounceSchedulerOptions options;
+    options.maxAnnouncesPerTick = 10;
+    AnnounceScheduler scheduler(start, options);
+
+    std::vector<std::string> urls;
+    for (int i = 0; i < 35; i++) {
+        urls.push_back("http://tracker" + std::to_string(i % 7) + ".example/announce");
+    }
+    for (int i = 0; i < 35; i++) {
+        CHECK(scheduler.Add(_Hash(i), Tiers{{urls[i]}}, start));
+    }
+    CHECK(!scheduler.Add(_Hash(0), Tiers{{urls[0]}}, start));
+    CHECK(!scheduler.Add(_Hash(100), Tiers{{}}, start));
+    CHECK(scheduler.size() == 35);
+
+    size_t total = 0;
+    for (int second = 0; second < 4; second++) {
+        std::vector<AnnounceBatch> batches = scheduler.Poll(start + std::chrono::seconds(second));
+        CHECK(_Count(batches) == (second < 3 ? 10 : 5));
+        for (const AnnounceBatch& batch : batches) {
+            for (const bt::ScheduledAnnounce& announce : batch.announces) {
+                CHECK(announce.url.starts_with(batch.host));
+                CHECK(announce.event == bt::AnnounceEvent::Started);
+            }
+        }
+        total += _Count(batches);
+    }
+    CHECK(total == 35);
+
+    // a torrent added alone does not wait
+    scheduler.Add(_Hash(35), Tiers{{urls[0]}}, start + 10s);
+    CHECK(_Count(scheduler.Poll(start + 10s)) == 1);
+}
+
+TEST_CASE("announce scheduler follows the tracker's intervals") {
+    auto start = AnnounceScheduler::Clock::now();
+    AnnounceSchedulerOptions options;
+    options.intervalJitter = 0.1;
+    AnnounceScheduler scheduler(start, options);
+    bt::InfoHash infoHash = _Hash(1);
+    scheduler.Add(infoHash, Tiers{{"udp://tracker.example:1337"}}, start);
+    REQUIRE(_Count(scheduler.Poll(start)) == 1);
+    scheduler.OnSuccess(infoHash, _Response(100s, 60s), start);
+
+    SUBCASE("regular announce within the jitter") {
+        CHECK(_Count(scheduler.Poll(start + 89s)) == 0);
+        std::vector<AnnounceBatch> batches = scheduler.Poll(start + 111s);
+        REQUIRE(_Count(batches) == 1);
+        CHECK(batches[0].host == "udp://tracker.example:1337");
+        CHECK(batches[0].announces[0].event == bt::AnnounceEvent::None);
+    }
+
+    SUBCASE("requested announce waits for the min interval") {
+        scheduler.RequestAnnounce(infoHash, start + 1s);
+        CHECK(_Count(scheduler.Poll(start + 30s)) == 0);
+        CHECK(_Count(scheduler.Poll(start + 60s)) == 1);
+        // in flight now
+        scheduler.RequestAnnounce(infoHash, start + 61s);
+        CHECK(_Count(scheduler.Poll(start + 61s)) == 0);
+    }
+
+    SUBCASE("intervals longer than the wheel take laps") {
+        AnnounceSchedulerOptions smallWheel;
+        smallWheel.wheelSize = 8;
+        smallWheel.intervalJitter = 0;
+        AnnounceScheduler lapping(start, smallWheel);
+        lapping.Add(infoHash, Tiers{{"udp://tracker.example:1337"}}, start);
+        REQUIRE(_Count(lapping.Poll(start)) == 1);
+        lapping.OnSuccess(infoHash, _Response(20s), start);
+        for (int second = 1; second < 20; second++) {
+            CHECK(_Count(lapping.Poll(start + std::chrono::seconds(second))) == 0);
+        }
+        CHECK(_Count(lapping.Poll(start + 20s)) == 1);
+    }
+
+    SUBCASE("removed torrents are not announced") {
+        scheduler.Remove(infoHash);
+        CHECK(scheduler.size() == 0);
+        CHECK(_Count(scheduler.Poll(start + 200s)) == 0);
+    }
+}
+
+TEST_CASE("announce scheduler fails over along the tiers") {
+    auto start = AnnounceScheduler::Clock::now();
+    AnnounceScheduler scheduler(start);
+    bt::InfoHash infoHash = _Hash(1);
+    scheduler.Add(infoHash, Tiers{{"http://a1/announce", "http://a2/announce"}, {"udp://b:80"}},
+                  start);
+
+    CHECK(_Url(scheduler.Poll(start)) == "http://a1/announce");
+    scheduler.OnFailure(infoHash, start);
+    CHECK(scheduler.health("http://a1/other").consecutiveFailures == 1);
+    CHECK(scheduler.health("http://a1/other").retryAt == start + 30s);
+
+    CHECK(_Url(scheduler.Poll(start + 1s)) == "http://a2/announce");
+    scheduler.OnFailure(infoHash, start + 1s);
+    CHECK(_Url(scheduler.Poll(start + 2s)) == "udp://b:80");
+    scheduler.OnSuccess(infoHash, _Response(100s), start + 2s);
+    CHECK(scheduler.health("udp://b:80").consecutiveFailures == 0);
+
+    SUBCASE("a tracker that answered moves to the front of its tier") {
+        CHECK(_Url(scheduler.Poll(start + 200s)) == "http://a1/announce");
+        scheduler.OnFailure(infoHash, start + 200s);
+        CHECK(_Url(scheduler.Poll(start + 201s)) == "http://a2/announce");
+        scheduler.OnSuccess(infoHash, _Response(100s), start + 201s);
+        CHECK(scheduler.health("http://a1").consecutiveFailures == 2);
+        CHECK(_Url(scheduler.Poll(start + 400s)) == "http://a2/announce");
+    }
+
+    SUBCASE("other torrents skip a failing host") {
+        scheduler.Add(_Hash(2), Tiers{{"http://a1/announce"}, {"http://c/announce"}}, start + 3s);
+        CHECK(_Url(scheduler.Poll(start + 3s)) == "http://c/announce");
+    }
+
+    SUBCASE("a torrent backs off when all its trackers failed") {
+        scheduler.Add(_Hash(2), Tiers{{"http://d/announce"}}, start + 3s);
+        CHECK(_Url(scheduler.Poll(start + 3s)) == "http://d/announce");
+        scheduler.OnFailure(_Hash(2), start + 3s);
+        CHECK(_Count(scheduler.Poll(start + 32s)) == 0);
+        CHECK(_Url(scheduler.Poll(start + 33s)) == "http://d/announce");
+        scheduler.OnFailure(_Hash(2), start + 33s);
+        CHECK(scheduler.health("http://d").retryAt == start + 93s);
+        CHECK(_Count(scheduler.Poll(start + 92s)) == 0);
+        CHECK(_Count(scheduler.Poll(start + 93s)) == 1);
+    }
+}
+
+TEST_CASE("announce scheduler coalesces announces to a host") {
+    auto start = AnnounceScheduler::Clock::now();
+    AnnounceSchedulerOptions options;
+    options.intervalJitter = 0;
+    AnnounceScheduler scheduler(start, options);
+    scheduler.Add(_Hash(1), Tiers{{"http://a/announce"}}, start);
+    scheduler.Add(_Hash(2), Tiers{{"http://a/announce?key=2"}}, start);
+    scheduler.Add(_Hash(3), Tiers{{"http://b/announce"}}, start);
+    REQUIRE(_Count(scheduler.Poll(start)) == 3);
+    scheduler.OnSuccess(_Hash(1), _Response(100s), start);
+    scheduler.OnSuccess(_Hash(2), _Response(120s), start);
+    scheduler.OnSuccess(_Hash(3), _Response(110s), start);
+
+    std::vector<AnnounceBatch> batches = scheduler.Poll(start + 100s);
+    REQUIRE(batches.size() == 1);
+    CHECK(batches[0].host == "http://a");
+    CHECK(batches[0].announces.size() == 2);
+    CHECK(_Url(scheduler.Poll(start + 110s)) == "http://b/announce");
+    CHECK(_Count(scheduler.Poll(start + 120s)) == 0);
+}
+
+TEST_CASE("announce scheduler takes the trackers of a torrent file") {
+    auto start = AnnounceScheduler::Clock::now();
+    AnnounceScheduler scheduler(start);
+    std::string info =
+        "d6:lengthi5e4:name3:abc12:piece lengthi16384e6:pieces20:aaaaaaaaaaaaaaaaaaaae";
+
+    bt::TorrentMetadata single =
+        bt::torrent_parser::Parse("d8:announce10:http://a/x4:info" + info + "e");
+    CHECK(scheduler.Add(single, start));
+    CHECK(_Url(scheduler.Poll(start)) == "http://a/x");
+
+    bt::TorrentMetadata none = bt::torrent_parser::Parse("d4:info" + info + "e");
+    CHECK(!scheduler.Add(none, start));
+}
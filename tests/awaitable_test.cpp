@@ -0,0 +1,82 @@
+#include "awaitable.hpp"
+#include "doctest.h"
+
+#include <optional>
+
+using namespace std::chrono_literals;
+
+static asio::awaitable<int> _Delayed(int value, std::chrono::milliseconds delay) {
+    asio::steady_timer timer(co_await asio::this_coro::executor, delay);
+    co_await timer.async_wait(asio::use_awaitable);
+    co_return value;
+}
+
+static asio::awaitable<void> _Sleep(std::chrono::milliseconds delay) {
+    asio::steady_timer timer(co_await asio::this_coro::executor, delay);
+    co_await timer.async_wait(asio::use_awaitable);
+}
+
+/**
+ * @brief runs coroutine to completion and returns the error it failed with
+ */
+static std::error_code _Run(asio::io_context& ioContext, asio::awaitable<void> coroutine) {
+    std::error_code result;
+    asio::co_spawn(ioContext, std::move(coroutine), [&](std::exception_ptr exception) {
+        try {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        } catch (std::system_error& e) {
+            result = e.code();
+        }
+    });
+    ioContext.run();
+    return result;
+}
+
+TEST_CASE("WithTimeout returns the result of an operation finishing in time") {
+    asio::io_context ioContext;
+    std::optional<int> value;
+    std::error_code error = _Run(ioContext, [&]() -> asio::awaitable<void> {
+        value = co_await bt::WithTimeout(_Delayed(42, 1ms), 10s);
+        co_await bt::WithTimeout(_Sleep(1ms), 10s);
+    }());
+    CHECK(!error);
+    CHECK(value == 42);
+}
+
+TEST_CASE("WithTimeout cancels a late operation") {
+    asio::io_context ioContext;
+    std::optional<int> value;
+    auto start = std::chrono::steady_clock::now();
+    std::error_code error = _Run(ioContext, [&]() -> asio::awaitable<void> {
+        value = co_await bt::WithTimeout(_Delayed(42, 10s), 10ms);
+    }());
+    CHECK((error == asio::error::timed_out));
+    CHECK(!value);
+    // the late operation did not keep the io_context running
+    CHECK(std::chrono::steady_clock::now() - start < 5s);
+
+    ioContext.restart();
+    error = _Run(ioContext, bt::WithTimeout(_Sleep(10s), 10ms));
+    CHECK((error == asio::error::timed_out));
+}
+
+TEST_CASE("cancelling a coroutine cancels the operation it waits for") {
+    asio::io_context ioContext;
+    asio::cancellation_signal cancel;
+    std::error_code error;
+    asio::co_spawn(ioContext, bt::WithTimeout(_Sleep(10s), 10s),
+                   asio::bind_cancellation_slot(cancel.slot(), [&](std::exception_ptr exception) {
+                       try {
+                           std::rethrow_exception(exception);
+                       } catch (std::system_error& e) {
+                           error = e.code();
+                       }
+                   }));
+    asio::post(ioContext, [&] { cancel.emit(asio::cancellation_type::terminal); });
+    auto start = std::chrono::steady_clock::now();
+    ioContext.run();
+    CHECK((error == asio::error::operation_aborted));
+    CHECK(std::chrono::steady_clock::now() - start < 5s);
+}
@@ -0,0 +1,49 @@
+#include "bitfield.hpp"
+#include "doctest.h"
+
+#include <stdexcept>
+#include <vector>
+
+TEST_CASE("Bitfield") {
+    SUBCASE("wire layout") {
+        bt::Bitfield bitfield(10);
+        CHECK(bitfield.none());
+        bitfield.Set(0);
+        bitfield.Set(7);
+        bitfield.Set(9);
+        CHECK(bitfield.Test(0));
+        CHECK(!bitfield.Test(1));
+        CHECK(bitfield.Test(9));
+        CHECK(bitfield.count() == 3);
+
+        // piece 0 is the high bit of the first byte
+        REQUIRE(bitfield.bytes().size() == 2);
+        CHECK(bitfield.bytes()[0] == std::byte(0x81));
+        CHECK(bitfield.bytes()[1] == std::byte(0x40));
+
+        bitfield.Set(0, false);
+        CHECK(!bitfield.Test(0));
+        CHECK(bitfield.count() == 2);
+    }
+
+    SUBCASE("all") {
+        bt::Bitfield bitfield(3);
+        for (size_t i = 0; i < 3; i++) {
+            bitfield.Set(i);
+        }
+        CHECK(bitfield.all());
+        CHECK(bt::Bitfield(0).all());
+    }
+
+    SUBCASE("from bytes") {
+        std::vector<std::byte> bytes = {std::byte(0xff), std::byte(0xc0)};
+        bt::Bitfield bitfield = bt::Bitfield::FromBytes(bytes, 10);
+        CHECK(bitfield.all());
+        CHECK(bitfield == bt::Bitfield::FromBytes(bitfield.bytes(), 10));
+
+        CHECK_THROWS_AS(bt::Bitfield::FromBytes(bytes, 8), std::invalid_argument);
+        // bit of piece 10 does not exist
+        bytes[1] = std::byte(0xe0);
+        CHECK_THROWS_AS(bt::Bitfield::FromBytes(bytes, 10), std::invalid_argument);
+    }
+}
@@ -0,0 +1,588 @@
+#include "disk_io.hpp"
+#include "doctest.h"
+#include "test_torrent.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using bt::DiskIoService;
+using bt::ReadCache;
+using bt::peer_wire::BlockSize;
+
+static constexpr long long pieceLength = 2 * BlockSize;
+
+TEST_CASE("DiskIoService") {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bt_disk_io_test";
+    std::filesystem::remove_all(directory);
+    // blocks span file boundaries, the second file is empty
+    std::vector<long long> fileSizes = {40'000, 0, 100'000, 5'000};
+    std::string data = test::RandomData(145'000, 5);
+    std::mt19937 random(5);
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, fileSizes, pieceLength));
+    bt::StorageLayout layout(torr, directory);
+
+    bt::DiskIoOptions options;
+    SUBCASE("thread pool") {
+    }
+    SUBCASE("io_uring") {
+        options.backend = bt::DiskIoBackend::IoUring;
+    }
+    SUBCASE("write cache") {
+        options.writeCacheSize = 1 << 20;
+    }
+    SUBCASE("read cache") {
+        options.readCacheSize = 1 << 20;
+    }
+    asio::io_context ioContext;
+    DiskIoService disk(options);
+    if (disk.backend() != options.backend) {
+        MESSAGE("io_uring is not available, testing the thread pool backend");
+    }
+    DiskIoService::StorageId storage = disk.AddStorage(layout);
+    std::thread::id ioThread = std::this_thread::get_id();
+
+    auto block = [&](uint32_t piece, uint32_t begin) {
+        long long offset = piece * pieceLength + begin;
+        size_t length = std::min<size_t>(BlockSize, torr.pieceSize(piece) - begin);
+        auto bytes = reinterpret_cast<const std::byte*>(data.data()) + offset;
+        return std::vector<std::byte>(bytes, bytes + length);
+    };
+
+    SUBCASE("write in random order, hash and read back") {
+        std::vector<std::pair<uint32_t, uint32_t>> blocks;
+        for (uint32_t piece = 0; piece < torr.piecesCount(); piece++) {
+            for (uint32_t begin = 0; begin < torr.pieceSize(piece); begin += BlockSize) {
+                blocks.emplace_back(piece, begin);
+            }
+        }
+        std::shuffle(blocks.begin(), blocks.end(), random);
+
+        size_t written = 0;
+        for (auto [piece, begin] : blocks) {
+            disk.AsyncWrite(storage, piece, begin, block(piece, begin), ioContext.get_executor(),
+                            [&](const std::error_code& error) {
+                                CHECK(!error);
+                                CHECK(std::this_thread::get_id() == ioThread);
+                                written++;
+                            });
+        }
+        ioContext.run();
+        ioContext.restart();
+        REQUIRE(written == blocks.size());
+        CHECK(std::filesystem::file_size(layout.filePath(2)) == 100'000);
+        CHECK(std::filesystem::exists(layout.filePath(1)) == false);
+
+        size_t validCount = 0;
+        for (uint32_t piece = 0; piece < torr.piecesCount(); piece++) {
+            disk.AsyncHash(storage, piece, ioContext.get_executor(),
+                           [&](const std::error_code& error, bool valid) {
+                               CHECK(!error);
+                               validCount += valid;
+                           });
+        }
+        std::vector<std::byte> read;
+        disk.AsyncRead(storage, {1, BlockSize, BlockSize}, ioContext.get_executor(),
+                       [&](const std::error_code& error, std::vector<std::byte> bytes) {
+                           CHECK(!error);
+                           read = std::move(bytes);
+                       });
+        bool flushed = false;
+        disk.AsyncFlush(storage, ioContext.get_executor(), [&](const std::error_code& error) {
+            CHECK(!error);
+            flushed = true;
+        });
+        ioContext.run();
+        CHECK(validCount == torr.piecesCount());
+        CHECK((read == block(1, BlockSize)));
+        CHECK(flushed);
+    }
+
+    SUBCASE("corrupt and missing data") {
+        std::vector<std::byte> wrong = block(0, 0);
+        wrong[5] ^= std::byte(1);
+        disk.AsyncWrite(storage, 0, 0, wrong, ioContext.get_executor(),
+                        [](const std::error_code& error) { CHECK(!error); });
+        disk.AsyncWrite(storage, 0, BlockSize, block(0, BlockSize), ioContext.get_executor(),
+                        [](const std::error_code& error) { CHECK(!error); });
+        ioContext.run();
+        ioContext.restart();
+
+        bool firstValid = true;
+        std::error_code secondError;
+        std::error_code readError;
+        disk.AsyncHash(storage, 0, ioContext.get_executor(),
+                       [&](const std::error_code& error, bool valid) {
+                           CHECK(!error);
+                           firstValid = valid;
+                       });
+        disk.AsyncHash(storage, 1, ioContext.get_executor(),
+                       [&](const std::error_code& error, bool) { secondError = error; });
+        disk.AsyncRead(storage, {4, 9'000, 1'000}, ioContext.get_executor(),
+                       [&](const std::error_code& error, std::vector<std::byte> bytes) {
+                           readError = error;
+                           CHECK(bytes.empty());
+                       });
+        ioContext.run();
+        CHECK(!firstValid);
+        CHECK((secondError == asio::error::eof));
+        CHECK((readError == asio::error::eof));
+    }
+
+    SUBCASE("allocate") {
+        bt::AllocationOptions allocation;
+        SUBCASE("sparse") {
+        }
+        SUBCASE("full") {
+            allocation.mode = bt::AllocationMode::Full;
+        }
+        std::error_code allocateError = asio::error::would_block;
+        disk.AsyncAllocate(storage, allocation, ioContext.get_executor(),
+                           [&](const std::error_code& error) { allocateError = error; });
+        ioContext.run();
+        CHECK(!allocateError);
+        for (size_t i = 0; i < fileSizes.size(); i++) {
+            CHECK(std::filesystem::file_size(layout.filePath(i)) == fileSizes[i]);
+        }
+#ifndef _WIN32
+        struct stat status {};
+        REQUIRE(stat(layout.filePath(2).c_str(), &status) == 0);
+        if (allocation.mode == bt::AllocationMode::Full) {
+            CHECK(status.st_blocks * 512 >= 100'000);
+        } else {
+            CHECK(status.st_blocks * 512 < 100'000);
+        }
+#endif
+    }
+
+    SUBCASE("invalid jobs") {
+        CHECK_THROWS_AS(disk.AsyncRead(storage, {4, 0, BlockSize}, ioContext.get_executor(),
+                                       [](const std::error_code&, std::vector<std::byte>) {}),
+                        std::out_of_range);
+        CHECK_THROWS_AS(disk.AsyncHash(storage, 5, ioContext.get_executor(),
+                                       [](const std::error_code&, bool) {}),
+                        std::out_of_range);
+
+        disk.RemoveStorage(storage);
+        std::error_code error;
+        disk.AsyncWrite(storage, 0, 0, block(0, 0), ioContext.get_executor(),
+                        [&](const std::error_code& e) { error = e; });
+        ioContext.run();
+        CHECK((error == asio::error::operation_aborted));
+    }
+}
+
+TEST_CASE("DiskIoService write cache") {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bt_disk_io_cache_test";
+    std::filesystem::remove_all(directory);
+    std::string data = test::RandomData(8 * pieceLength, 9);
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, {8 * pieceLength}, pieceLength));
+    bt::StorageLayout layout(torr, directory);
+    auto block = [&](uint32_t piece, uint32_t begin) {
+        auto bytes = reinterpret_cast<const std::byte*>(data.data()) + piece * pieceLength + begin;
+        return std::vector<std::byte>(bytes, bytes + BlockSize);
+    };
+
+    asio::io_context ioContext;
+    DiskIoService disk({.writeCacheSize = 3 * BlockSize});
+    DiskIoService::StorageId storage = disk.AddStorage(layout);
+    auto write = [&](uint32_t piece, uint32_t begin) {
+        disk.AsyncWrite(storage, piece, begin, block(piece, begin), ioContext.get_executor(),
+                        [](const std::error_code& error) { CHECK(!error); });
+        ioContext.run();
+        ioContext.restart();
+    };
+
+    SUBCASE("a piece is written once it is complete and valid") {
+        write(2, BlockSize);
+        CHECK(disk.cachedBytes() == BlockSize);
+        CHECK(std::filesystem::exists(layout.filePath(0)) == false);
+        write(2, 0);
+        CHECK(disk.cachedBytes() == 0);
+        REQUIRE(std::filesystem::exists(layout.filePath(0)));
+
+        std::vector<std::byte> wrong = block(5, 0);
+        wrong[9] ^= std::byte(1);
+        disk.AsyncWrite(storage, 5, 0, wrong, ioContext.get_executor(),
+                        [](const std::error_code& error) { CHECK(!error); });
+        write(5, BlockSize);
+        std::vector<bool> valid(8);
+        for (uint32_t piece : {2, 5}) {
+            disk.AsyncHash(storage, piece, ioContext.get_executor(),
+                           [&, piece](const std::error_code& error, bool v) {
+                               CHECK(!error);
+                               valid[piece] = v;
+                           });
+        }
+        ioContext.run();
+        CHECK(valid[2]);
+        CHECK(!valid[5]);
+        // the corrupt piece was never written
+        CHECK(std::filesystem::file_size(layout.filePath(0)) == 3 * pieceLength);
+    }
+
+    SUBCASE("partial pieces are written when evicted, read or flushed") {
+        for (uint32_t piece = 0; piece < 4; piece++) {
+            write(piece, 0);
+        }
+        // the first piece was evicted
+        CHECK(disk.cachedBytes() == 3 * BlockSize);
+        CHECK(std::filesystem::file_size(layout.filePath(0)) == BlockSize);
+
+        std::vector<std::byte> read;
+        disk.AsyncRead(storage, {3, 0, BlockSize}, ioContext.get_executor(),
+                       [&](const std::error_code& error, std::vector<std::byte> bytes) {
+                           CHECK(!error);
+                           read = std::move(bytes);
+                       });
+        ioContext.run();
+        ioContext.restart();
+        CHECK((read == block(3, 0)));
+        CHECK(disk.cachedBytes() == 2 * BlockSize);
+
+        disk.AsyncFlush(storage, ioContext.get_executor(),
+                        [](const std::error_code& error) { CHECK(!error); });
+        ioContext.run();
+        CHECK(disk.cachedBytes() == 0);
+        std::string written(3 * pieceLength, '\0');
+        std::ifstream(layout.filePath(0), std::ios::binary).read(written.data(), written.size());
+        for (uint32_t piece = 0; piece < 3; piece++) {
+            CHECK(written.substr(piece * pieceLength, BlockSize) ==
+                  data.substr(piece * pieceLength, BlockSize));
+        }
+    }
+
+    SUBCASE("cached blocks are written when the service is destroyed") {
+        write(6, 0);
+        {
+            DiskIoService closing({.writeCacheSize = 3 * BlockSize});
+            closing.AsyncWrite(closing.AddStorage(layout), 7, BlockSize, block(7, BlockSize),
+                               ioContext.get_executor(), [](const std::error_code&) {});
+        }
+        CHECK(std::filesystem::file_size(layout.filePath(0)) == 8 * pieceLength);
+    }
+}
+
+TEST_CASE("DiskIoService read cache") {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bt_disk_io_read_cache_test";
+    std::filesystem::remove_all(directory);
+    std::string data(8 * pieceLength, 'a');
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, {8 * pieceLength}, pieceLength));
+    bt::StorageLayout layout(torr, directory);
+
+    asio::io_context ioContext;
+    DiskIoService disk({.readCacheSize = 1 << 20, .readAheadBlocks = 1});
+    DiskIoService::StorageId storage = disk.AddStorage(layout);
+    auto write = [&](uint32_t piece, char c) {
+        disk.AsyncWrite(storage, piece, 0, std::vector<std::byte>(pieceLength, std::byte(c)),
+                        ioContext.get_executor(),
+                        [](const std::error_code& error) { CHECK(!error); });
+        ioContext.run();
+        ioContext.restart();
+    };
+    auto read = [&](uint32_t piece, uint32_t begin, size_t length) {
+        std::vector<std::byte> read;
+        disk.AsyncRead(storage, {piece, begin, static_cast<uint32_t>(length)},
+                       ioContext.get_executor(),
+                       [&](const std::error_code& error, std::vector<std::byte> bytes) {
+                           CHECK(!error);
+                           read = std::move(bytes);
+                       });
+        ioContext.run();
+        ioContext.restart();
+        return read;
+    };
+    for (uint32_t piece = 0; piece < 8; piece++) {
+        write(piece, 'a');
+    }
+
+    // the miss reads the next block of the piece ahead
+    CHECK((read(3, 100, 1000) == std::vector<std::byte>(1000, std::byte('a'))));
+    CHECK((read(3, BlockSize, BlockSize) == std::vector<std::byte>(BlockSize, std::byte('a'))));
+    CHECK(read(3, 0, BlockSize).size() == BlockSize);
+    ReadCache::Stats stats = disk.readCacheStats();
+    CHECK(stats.misses == 1);
+    CHECK(stats.hits == 2);
+    CHECK(stats.readAheadHits == 1);
+
+    // a write drops the piece's cached blocks
+    write(3, 'b');
+    CHECK((read(3, BlockSize, BlockSize) == std::vector<std::byte>(BlockSize, std::byte('b'))));
+    CHECK(disk.readCacheStats().misses == 2);
+}
+
+TEST_CASE("DiskIoService pad files") {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bt_disk_io_pad_test";
+    std::filesystem::remove_all(directory);
+    // the pad file aligns the second file to a piece
+    std::vector<long long> fileSizes = {10'000, pieceLength - 10'000, 20'000};
+    std::string data = test::RandomData(pieceLength + 20'000, 11);
+    std::fill(data.begin() + 10'000, data.begin() + pieceLength, '\0');
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, fileSizes, pieceLength, {1}));
+    bt::StorageLayout layout(torr, directory);
+
+    bt::DiskIoOptions options;
+    SUBCASE("thread pool") {
+    }
+    SUBCASE("io_uring") {
+        options.backend = bt::DiskIoBackend::IoUring;
+    }
+    SUBCASE("write cache") {
+        options.writeCacheSize = 1 << 20;
+    }
+    asio::io_context ioContext;
+    DiskIoService disk(options);
+    DiskIoService::StorageId storage = disk.AddStorage(layout);
+
+    disk.AsyncAllocate(storage, {}, ioContext.get_executor(),
+                       [](const std::error_code& error) { CHECK(!error); });
+    for (long long offset = 0; offset < static_cast<long long>(data.size()); offset += BlockSize) {
+        auto bytes = reinterpret_cast<const std::byte*>(data.data()) + offset;
+        size_t length = std::min<size_t>(BlockSize, data.size() - offset);
+        disk.AsyncWrite(storage, static_cast<uint32_t>(offset / pieceLength),
+                        static_cast<uint32_t>(offset % pieceLength),
+                        std::vector<std::byte>(bytes, bytes + length), ioContext.get_executor(),
+                        [](const std::error_code& error) { CHECK(!error); });
+    }
+    ioContext.run();
+    ioContext.restart();
+    CHECK(!std::filesystem::exists(layout.filePath(1)));
+    CHECK(std::filesystem::file_size(layout.filePath(2)) == 20'000);
+
+    size_t validCount = 0;
+    for (uint32_t piece = 0; piece < torr.piecesCount(); piece++) {
+        disk.AsyncHash(storage, piece, ioContext.get_executor(),
+                       [&](const std::error_code& error, bool valid) {
+                           CHECK(!error);
+                           validCount += valid;
+                       });
+    }
+    std::vector<std::byte> read;
+    disk.AsyncRead(storage, {0, 8'000, 4'000}, ioContext.get_executor(),
+                   [&](const std::error_code& error, std::vector<std::byte> bytes) {
+                       CHECK(!error);
+                       read = std::move(bytes);
+                   });
+    ioContext.run();
+    CHECK(validCount == torr.piecesCount());
+    REQUIRE(read.size() == 4'000);
+    CHECK(std::equal(read.begin(), read.end(),
+                     reinterpret_cast<const std::byte*>(data.data()) + 8'000));
+    CHECK(!std::filesystem::exists(layout.filePath(1)));
+}
+
+TEST_CASE("DiskIoService keeps files not wanted out of the tree") {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bt_disk_io_wanted_test";
+    std::filesystem::remove_all(directory);
+    // files 1 and 3 share pieces with the wanted files 0 and 2
+    std::vector<long long> fileSizes = {40'000, 30'000, 70'000, 5'000};
+    std::string data = test::RandomData(145'000, 13);
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, fileSizes, pieceLength));
+    bt::StorageLayout layout(torr, directory, {true, false, true, false});
+
+    bt::DiskIoOptions options;
+    SUBCASE("thread pool") {
+    }
+    SUBCASE("io_uring") {
+        options.backend = bt::DiskIoBackend::IoUring;
+    }
+    SUBCASE("write cache") {
+        options.writeCacheSize = 1 << 20;
+    }
+    asio::io_context ioContext;
+    DiskIoService disk(options);
+    DiskIoService::StorageId storage = disk.AddStorage(layout);
+
+    disk.AsyncAllocate(storage, {}, ioContext.get_executor(),
+                       [](const std::error_code& error) { CHECK(!error); });
+    ioContext.run();
+    ioContext.restart();
+    CHECK(std::filesystem::file_size(layout.filePath(2)) == 70'000);
+    CHECK(!std::filesystem::exists(layout.filePath(1)));
+
+    for (long long offset = 0; offset < static_cast<long long>(data.size()); offset += BlockSize) {
+        auto bytes = reinterpret_cast<const std::byte*>(data.data()) + offset;
+        size_t length = std::min<size_t>(BlockSize, data.size() - offset);
+        disk.AsyncWrite(storage, static_cast<uint32_t>(offset / pieceLength),
+                        static_cast<uint32_t>(offset % pieceLength),
+                        std::vector<std::byte>(bytes, bytes + length), ioContext.get_executor(),
+                        [](const std::error_code& error) { CHECK(!error); });
+    }
+    disk.AsyncFlush(storage, ioContext.get_executor(),
+                    [](const std::error_code& error) { CHECK(!error); });
+    ioContext.run();
+    ioContext.restart();
+    CHECK(!std::filesystem::exists(layout.filePath(1)));
+    CHECK(!std::filesystem::exists(layout.filePath(3)));
+    CHECK(std::filesystem::exists(layout.partFilePath()));
+    CHECK(layout.partFilePath().parent_path() == directory);
+
+    size_t validCount = 0;
+    for (uint32_t piece = 0; piece < torr.piecesCount(); piece++) {
+        disk.AsyncHash(storage, piece, ioContext.get_executor(),
+                       [&](const std::error_code& error, bool valid) {
+                           CHECK(!error);
+                           validCount += valid;
+                       });
+    }
+    // from file 0 into file 1
+    std::vector<std::byte> read;
+    disk.AsyncRead(storage, {1, 0, BlockSize}, ioContext.get_executor(),
+                   [&](const std::error_code& error, std::vector<std::byte> bytes) {
+                       CHECK(!error);
+                       read = std::move(bytes);
+                   });
+    ioContext.run();
+    CHECK(validCount == torr.piecesCount());
+    REQUIRE(read.size() == BlockSize);
+    CHECK(std::equal(read.begin(), read.end(),
+                     reinterpret_cast<const std::byte*>(data.data()) + pieceLength));
+}
+
+#ifndef _WIN32
+/**
+ * @brief queues a read that blocks the thread running it, opening a FIFO waits for a writer
+ * @return FIFO to open for writing to let the thread go on
+ */
+static std::filesystem::path _BlockDiskThread(DiskIoService& disk, const bt::StorageLayout& layout,
+                                              asio::io_context& ioContext) {
+    std::filesystem::create_directories(layout.filePath(0).parent_path());
+    REQUIRE(mkfifo(layout.filePath(0).c_str(), 0600) == 0);
+    disk.AsyncRead(disk.AddStorage(layout), {0, 0, BlockSize}, ioContext.get_executor(),
+                   [](const std::error_code&, std::vector<std::byte>) {});
+    return layout.filePath(0);
+}
+
+TEST_CASE("DiskIoService io_uring backend batches submissions") {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bt_disk_io_uring_test";
+    std::filesystem::remove_all(directory);
+    std::string data(64 * pieceLength, 'x');
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, {64 * pieceLength}, pieceLength));
+    bt::StorageLayout layout(torr, directory);
+
+    DiskIoService disk({.backend = bt::DiskIoBackend::IoUring,
+                        .ioUring = {.entries = 32, .registeredBuffers = 8}});
+    DiskIoService::StorageId storage = disk.AddStorage(layout);
+    if (disk.backend() != bt::DiskIoBackend::IoUring) {
+        MESSAGE("io_uring is not available");
+        return;
+    }
+    CHECK(disk.ring()->registeredBuffers());
+    CHECK(disk.ring()->fixedFiles());
+
+    // all blocks are queued while the ring's thread waits, more than there are entries and
+    // buffers; the thread submits what fits and the rest after completions
+    asio::io_context ioContext;
+    bt::StorageLayout blocking(torr, directory / "blocking");
+    std::filesystem::path fifo = _BlockDiskThread(disk, blocking, ioContext);
+    size_t written = 0;
+    for (uint32_t piece = 0; piece < torr.piecesCount(); piece++) {
+        for (uint32_t begin = 0; begin < pieceLength; begin += BlockSize) {
+            disk.AsyncWrite(storage, piece, begin,
+                            std::vector<std::byte>(BlockSize, std::byte('x')),
+                            ioContext.get_executor(), [&](const std::error_code& error) {
+                                CHECK(!error);
+                                written++;
+                            });
+        }
+    }
+    close(open(fifo.c_str(), O_WRONLY));
+    ioContext.run();
+    CHECK(written == 128);
+    // each io_uring_enter submitted and reaped many operations
+    CHECK(disk.ring()->submitCount() < written / 4);
+}
+
+TEST_CASE("DiskIoService completes queued ring reads when destroyed") {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bt_disk_io_shutdown_test";
+    std::filesystem::remove_all(directory);
+    std::string data(8 * pieceLength, 'x');
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, {8 * pieceLength}, pieceLength));
+    bt::StorageLayout blocking(torr, directory / "blocking");
+    bt::StorageLayout layout(torr, directory / "read");
+
+    asio::io_context ioContext;
+    size_t completed = 0;
+    std::thread unblock;
+    {
+        DiskIoService disk({.backend = bt::DiskIoBackend::IoUring,
+                            .writeCacheSize = 1 << 20,
+                            .readCacheSize = 1 << 20});
+        if (disk.backend() != bt::DiskIoBackend::IoUring) {
+            MESSAGE("io_uring is not available");
+            return;
+        }
+        DiskIoService::StorageId storage = disk.AddStorage(layout);
+        disk.AsyncWrite(storage, 0, 0, std::vector<std::byte>(BlockSize, std::byte('x')),
+                        ioContext.get_executor(), [](const std::error_code&) {});
+        ioContext.run();
+        ioContext.restart();
+
+        // the reads wait on the ring behind the blocked one while the service is destroyed,
+        // which lets the ring go on and complete them
+        std::filesystem::path fifo = _BlockDiskThread(disk, blocking, ioContext);
+        for (uint32_t piece = 0; piece < torr.piecesCount(); piece++) {
+            disk.AsyncRead(storage, {piece, 0, BlockSize}, ioContext.get_executor(),
+                           [&](const std::error_code&, std::vector<std::byte>) { completed++; });
+        }
+        unblock = std::thread([fifo] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            close(open(fifo.c_str(), O_WRONLY));
+        });
+    }
+    unblock.join();
+    ioContext.run();
+    CHECK(completed == torr.piecesCount());
+}
+
+TEST_CASE("DiskIoService runs queued jobs in offset order") {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bt_disk_io_order_test";
+    std::filesystem::remove_all(directory);
+    std::string data(8 * pieceLength, 'x');
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, {8 * pieceLength}, pieceLength));
+    bt::StorageLayout blocking(torr, directory / "blocking");
+    bt::StorageLayout layout(torr, directory / "written");
+
+    asio::io_context ioContext;
+    std::vector<uint32_t> order;
+    DiskIoService disk({.threadsCount = 1});
+    std::filesystem::path fifo = _BlockDiskThread(disk, blocking, ioContext);
+    while (disk.pendingCount() > 0) {
+        std::this_thread::yield();
+    }
+    DiskIoService::StorageId storage = disk.AddStorage(layout);
+    std::vector<std::byte> piece(pieceLength);
+    for (uint32_t index : {0, 6, 2, 7, 1, 5, 3, 4}) {
+        disk.AsyncWrite(storage, index, 0, piece, ioContext.get_executor(),
+                        [&order, index](const std::error_code&) { order.push_back(index); });
+    }
+    CHECK(disk.pendingCount() == 8);
+    close(open(fifo.c_str(), O_WRONLY));
+
+    ioContext.run();
+    CHECK(order == std::vector<uint32_t>{0, 1, 2, 3, 4, 5, 6, 7});
+}
+#endif
@@ -0,0 +1,246 @@
+#include "file_handle.hpp"
+#include "peer_connection.hpp"
+#include "doctest.h"
+#include "test_torrent.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <map>
+
+using bt::PeerConnection;
+using bt::peer_wire::BlockInfo;
+using bt::peer_wire::BlockSize;
+
+static constexpr long long pieceLength = 2 * BlockSize;
+
+static std::byte _DataByte(long long offset) {
+    return std::byte(static_cast<unsigned char>(offset * 7 / 5));
+}
+
+/**
+ * @brief writes files whose bytes count up through the concatenated data, see _DataByte, below
+ *        directory
+ * @return metainfo of the torrent, see test::MakeTorrent
+ */
+static std::string _MakePayload(const std::filesystem::path& directory,
+                                const std::vector<long long>& fileSizes) {
+    std::string data;
+    for (long long size : fileSizes) {
+        for (long long i = 0; i < size; i++) {
+            data.push_back(static_cast<char>(_DataByte(static_cast<long long>(data.size()))));
+        }
+    }
+    std::string metaInfo = test::MakeTorrent(data, fileSizes, pieceLength);
+    bt::TorrentMetadata torr = bt::torrent_parser::Parse(metaInfo);
+    test::WriteFiles(bt::StorageLayout(torr, directory), data);
+    return metaInfo;
+}
+
+TEST_CASE("FileHandle writes and reads buffers at an offset") {
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "bt_file_handle_test";
+    std::filesystem::remove(path);
+    bt::FileHandle file(path, bt::FileMode::ReadWrite);
+
+    // more buffers than one pwritev takes, some empty
+    std::vector<std::byte> bytes(3000);
+    std::vector<std::span<const std::byte>> buffers;
+    for (size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = _DataByte(static_cast<long long>(i));
+        buffers.emplace_back(&bytes[i], 1);
+        if (i % 100 == 0) {
+            buffers.emplace_back();
+        }
+    }
+    file.WriteAt(100, buffers);
+
+    std::vector<std::byte> read(5000);
+    REQUIRE(file.ReadAt(0, read) == 3100);
+    CHECK(file.size() == 3100);
+    CHECK(std::all_of(read.begin(), read.begin() + 100,
+                      [](std::byte b) { return b == std::byte(0); }));
+    CHECK(std::equal(bytes.begin(), bytes.end(), read.begin() + 100));
+
+    // read back into buffers of 7 bytes, the last one past the end of the file
+    std::vector<std::byte> gathered(3003);
+    std::vector<std::span<std::byte>> parts;
+    for (size_t i = 0; i < gathered.size(); i += 7) {
+        parts.emplace_back(gathered.data() + i, 7);
+    }
+    REQUIRE(file.ReadAt(100, parts) == 3000);
+    CHECK(std::equal(bytes.begin(), bytes.end(), gathered.begin()));
+}
+
+TEST_CASE("UploadSource") {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bt_upload_test";
+    std::filesystem::remove_all(directory);
+    // blocks span file boundaries, the second file is empty
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(_MakePayload(directory, {40'000, 0, 100'000, 5'000}));
+    bt::StorageLayout layout(torr, directory);
+    bt::UploadSource source(layout);
+
+    SUBCASE("block inside one file") {
+        std::vector<bt::FileRange> ranges = source.Block({0, BlockSize, BlockSize});
+        REQUIRE(ranges.size() == 1);
+        CHECK(ranges[0].offset == BlockSize);
+        CHECK(ranges[0].length == BlockSize);
+
+        std::vector<std::byte> data(BlockSize);
+        CHECK(ranges[0].file->ReadAt(ranges[0].offset, data) == BlockSize);
+        CHECK(data.front() == _DataByte(BlockSize));
+        CHECK(data.back() == _DataByte(2 * BlockSize - 1));
+    }
+
+    SUBCASE("block across files skips the empty one") {
+        std::vector<bt::FileRange> ranges = source.Block({1, 0, BlockSize});
+        REQUIRE(ranges.size() == 2);
+        CHECK(ranges[0].offset == 2 * BlockSize);
+        CHECK(ranges[0].length == 40'000 - 2 * BlockSize);
+        CHECK(ranges[1].offset == 0);
+        CHECK(ranges[1].length == 3 * BlockSize - 40'000);
+        CHECK(ranges[0].file != ranges[1].file);
+
+        // files stay open for later blocks
+        CHECK(source.Block({1, BlockSize, BlockSize})[0].file == ranges[1].file);
+    }
+
+    SUBCASE("short last block and reads past the end") {
+        long long lastPiece = torr.piecesCount() - 1;
+        long long lastLength = torr.pieceSize(lastPiece);
+        std::vector<bt::FileRange> ranges =
+            source.Block({static_cast<uint32_t>(lastPiece), 0, static_cast<uint32_t>(lastLength)});
+        REQUIRE(!ranges.empty());
+        std::vector<std::byte> data(ranges.back().length + 100);
+        CHECK(ranges.back().file->ReadAt(ranges.back().offset, data) == ranges.back().length);
+
+        CHECK_THROWS_AS(source.Block({static_cast<uint32_t>(lastPiece), 0,
+                                      static_cast<uint32_t>(lastLength + 1)}),
+                        std::out_of_range);
+        CHECK_THROWS_AS(source.Block({static_cast<uint32_t>(torr.piecesCount()), 0, 1}),
+                        std::out_of_range);
+    }
+
+    SUBCASE("missing file") {
+        std::filesystem::remove(layout.filePath(3));
+        CHECK_THROWS_AS(source.Block({4, 9'000, 1'000}), std::system_error);
+    }
+}
+
+TEST_CASE("UploadSource leaves pad files unopened") {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bt_upload_pad_test";
+    std::filesystem::remove_all(directory);
+    std::vector<long long> fileSizes = {10'000, pieceLength - 10'000, 5'000};
+    std::string data = test::RandomData(pieceLength + 5'000, 3);
+    std::fill(data.begin() + 10'000, data.begin() + pieceLength, '\0');
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, fileSizes, pieceLength, {1}));
+    bt::StorageLayout layout(torr, directory);
+    test::WriteFiles(layout, data);
+
+    bt::UploadSource source(layout);
+    std::vector<bt::FileRange> ranges = source.Block({0, 8'000, 4'000});
+    REQUIRE(ranges.size() == 2);
+    CHECK(ranges[0].file != nullptr);
+    CHECK(ranges[0].length == 2'000);
+    CHECK(ranges[1].file == nullptr);
+    CHECK(ranges[1].length == 2'000);
+}
+
+/**
+ * @brief a seeder answering requests from the files and a leecher downloading everything
+ *        over loopback
+ * @return false if a block arrived with wrong data
+ */
+static bool _DownloadFromFiles(const bt::StorageLayout& layout, bool zeroCopy) {
+    const bt::TorrentMetadata& torr = layout.torrent();
+    asio::io_context ioContext;
+    asio::ip::tcp::acceptor acceptor(ioContext, {asio::ip::address_v4::loopback(), 0});
+
+    PeerConnection::Options options;
+    options.infoHash = torr.infoHash();
+    options.piecesCount = torr.piecesCount();
+    options.zeroCopyUploads = zeroCopy;
+
+    bt::UploadSource source(layout);
+    PeerConnection::Callbacks seederCallbacks;
+    seederCallbacks.onConnected = [&](PeerConnection& peer) {
+        bt::Bitfield all(torr.piecesCount());
+        for (size_t i = 0; i < all.size(); i++) {
+            all.Set(i);
+        }
+        peer.SendBitfield(all);
+    };
+    seederCallbacks.onStateChanged = [](PeerConnection& peer) {
+        if (peer.peerInterested()) {
+            peer.Unchoke();
+        }
+    };
+    seederCallbacks.onRequest = [&](PeerConnection& peer, const BlockInfo& block) {
+        peer.SendPiece(block.pieceIndex, block.begin, source.Block(block));
+        // a message queued behind the file data must keep its place
+        peer.SendKeepAlive();
+    };
+    std::shared_ptr<PeerConnection> seeder;
+    acceptor.async_accept([&](const std::error_code& error, asio::ip::tcp::socket socket) {
+        REQUIRE(!error);
+        seeder = PeerConnection::Accept(std::move(socket), options, seederCallbacks);
+    });
+
+    bool intact = true;
+    size_t remaining = 0;
+    PeerConnection::Callbacks leecherCallbacks;
+    leecherCallbacks.onStateChanged = [&](PeerConnection& peer) {
+        if (peer.peerChoking() || remaining > 0) {
+            return;
+        }
+        // everything at once, so that several blocks are queued behind each other
+        for (uint32_t piece = 0; piece < torr.piecesCount(); piece++) {
+            uint32_t size = static_cast<uint32_t>(torr.pieceSize(piece));
+            for (uint32_t begin = 0; begin < size; begin += BlockSize) {
+                peer.Request({piece, begin, std::min(BlockSize, size - begin)});
+                remaining++;
+            }
+        }
+    };
+    leecherCallbacks.onConnected = [](PeerConnection& peer) { peer.SetInterested(true); };
+    leecherCallbacks.onPiece = [&](PeerConnection&, const BlockInfo& block,
+                                   std::span<const std::byte> data) {
+        long long offset = static_cast<long long>(block.pieceIndex) * pieceLength + block.begin;
+        for (size_t i = 0; i < data.size(); i++) {
+            intact &= data[i] == _DataByte(offset + static_cast<long long>(i));
+        }
+        if (--remaining == 0) {
+            ioContext.stop();
+        }
+    };
+    auto leecher =
+        PeerConnection::Connect(ioContext, acceptor.local_endpoint(), options, leecherCallbacks);
+
+    asio::steady_timer timeout(ioContext, std::chrono::seconds(10));
+    timeout.async_wait([&](const std::error_code& error) {
+        if (!error) {
+            FAIL("timed out");
+            ioContext.stop();
+        }
+    });
+    ioContext.run();
+    CHECK(remaining == 0);
+    return intact;
+}
+
+TEST_CASE("PeerConnection sends blocks from files") {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bt_upload_loopback_test";
+    std::filesystem::remove_all(directory);
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(_MakePayload(directory, {40'000, 0, 100'000, 5'000}));
+    bt::StorageLayout layout(torr, directory);
+
+    SUBCASE("zero copy") {
+        CHECK(_DownloadFromFiles(layout, true));
+    }
+    SUBCASE("read and gather") {
+        CHECK(_DownloadFromFiles(layout, false));
+    }
+}
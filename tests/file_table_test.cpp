@@ -0,0 +1,74 @@
+#include "file_table.hpp"
+#include "doctest.h"
+
+#include <vector>
+
+TEST_CASE("FileTable stores paths, sizes and offsets") {
+    bt::FileTable::Builder builder;
+    std::vector<std::string_view> first = {"docs", "readme.txt"};
+    std::vector<std::string_view> second = {"docs", "images", "logo.png"};
+    std::vector<std::string_view> third = {"empty"};
+    builder.AddFile(first, 100);
+    builder.AddFile(second, 2500);
+    builder.AddFile(third, 0);
+    bt::FileTable table = builder.Build();
+
+    REQUIRE(table.size() == 3);
+    CHECK(table.totalSize() == 2600);
+    CHECK(table.fileSize(1) == 2500);
+    CHECK(table.fileOffset(0) == 0);
+    CHECK(table.fileOffset(1) == 100);
+    CHECK(table.fileOffset(2) == 2600);
+    CHECK(table.fileOffsets().size() == 4);
+
+    CHECK(table.path(0).ToString() == "docs/readme.txt");
+    CHECK(table.path(1).ToString('\\') == "docs\\images\\logo.png");
+    CHECK(table.path(1).JoinedLength() == table.path(1).ToString().size());
+    CHECK(table.path(1).size() == 3);
+    CHECK(table.path(1)[1] == "images");
+    CHECK(table.path(2).back() == "empty");
+
+    SUBCASE("repeated path nodes are interned once") {
+        CHECK(table.internedCount() == 5);
+    }
+
+    SUBCASE("AppendTo keeps existing content") {
+        std::string out = "/srv/";
+        table.path(0).AppendTo(out);
+        CHECK(out == "/srv/docs/readme.txt");
+    }
+}
+
+TEST_CASE("empty FileTable") {
+    bt::FileTable table;
+    CHECK(table.empty());
+    CHECK(table.totalSize() == 0);
+}
+
+TEST_CASE("FileTable maps byte ranges to file slices") {
+    // sizes: 10, 0, 5, 0, 20
+    bt::FileTable::Builder builder;
+    const char* names[] = {"a", "b", "c", "d", "e"};
+    long long sizes[] = {10, 0, 5, 0, 20};
+    for (int i = 0; i < 5; i++) {
+        std::string_view name = names[i];
+        builder.AddFile({&name, 1}, sizes[i]);
+    }
+    bt::FileTable table = builder.Build();
+
+    auto slices = [&](long long offset, long long length) {
+        bt::FileSliceRange range = table.MapRange(offset, length);
+        return std::vector<bt::FileSlice>(range.begin(), range.end());
+    };
+
+    CHECK(slices(0, 4) == std::vector<bt::FileSlice>{{0, 0, 4}});
+    CHECK(slices(8, 4) == std::vector<bt::FileSlice>{{0, 8, 2}, {2, 0, 2}});
+    CHECK(slices(10, 5) == std::vector<bt::FileSlice>{{2, 0, 5}});
+    CHECK(slices(0, 35) == std::vector<bt::FileSlice>{{0, 0, 10}, {2, 0, 5}, {4, 0, 20}});
+
+    SUBCASE("ranges are clamped to the torrent") {
+        CHECK(slices(30, 100) == std::vector<bt::FileSlice>{{4, 15, 5}});
+        CHECK(table.MapRange(35, 10).empty());
+        CHECK(slices(35, 10).empty());
+    }
+}
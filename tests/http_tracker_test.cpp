@@ -0,0 +1,273 @@
+#include "http_tracker.hpp"
+#include "doctest.h"
+
+#include "external/bencode.hpp"
+
+using bt::AnnounceRequest;
+using bt::AnnounceResponse;
+using bt::HttpTrackerClient;
+using namespace std::chrono_literals;
+
+using CompactPeer = std::pair<std::array<uint8_t, 4>, uint16_t>;
+
+static std::string _Compact(std::initializer_list<CompactPeer> peers) {
+    std::string compact;
+    for (const auto& [ip, port] : peers) {
+        compact.append(reinterpret_cast<const char*>(ip.data()), ip.size());
+        compact += char(port >> 8);
+        compact += char(port & 0xff);
+    }
+    return compact;
+}
+
+/**
+ * @brief stand-in for an HTTP tracker on loopback, answers every request with body
+ */
+struct LocalHttpTracker {
+    enum class Mode {
+        KeepAlive,
+        Close,          // sends Connection: close and closes
+        CloseSilently,  // closes after answering without saying so, like an idle timeout
+        Chunked,
+    };
+
+    explicit LocalHttpTracker(asio::io_context& ioContext)
+        : acceptor(ioContext, {asio::ip::address_v4::loopback(), 0}) {
+        asio::co_spawn(ioContext, _Serve(), asio::detached);
+    }
+
+    std::string url() const {
+        return "http://127.0.0.1:" + std::to_string(acceptor.local_endpoint().port()) +
+               "/announce";
+    }
+
+    asio::ip::tcp::acceptor acceptor;
+    Mode mode = Mode::KeepAlive;
+    std::string body;
+    size_t connectionsCount = 0;
+    std::vector<std::string> targets;
+
+  private:
+    asio::awaitable<void> _Serve() {
+        for (;;) {
+            asio::ip::tcp::socket socket = co_await acceptor.async_accept(asio::use_awaitable);
+            connectionsCount++;
+            asio::co_spawn(acceptor.get_executor(), _Session(std::move(socket)), asio::detached);
+        }
+    }
+
+    asio::awaitable<void> _Session(asio::ip::tcp::socket socket) {
+        std::string buffer;
+        for (;;) {
+            size_t headerSize = co_await asio::async_read_until(
+                socket, asio::dynamic_buffer(buffer), "\r\n\r\n", asio::use_awaitable);
+            std::string header = buffer.substr(0, headerSize);
+            buffer.erase(0, headerSize);
+            targets.push_back(header.substr(4, header.find(' ', 4) - 4));
+
+            std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n";
+            if (mode == Mode::Chunked) {
+                size_t half = body.size() / 2;
+                response += "Transfer-Encoding: chunked\r\n\r\n";
+                for (std::string_view chunk : {body.substr(0, half), body.substr(half)}) {
+                    char size[16];
+                    std::snprintf(size, sizeof(size), "%zx", chunk.size());
+                    response += std::string(size) + ";ext=1\r\n" + std::string(chunk) + "\r\n";
+                }
+                response += "0\r\n\r\n";
+            } else {
+                response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+                if (mode == Mode::Close) {
+                    response += "Connection: close\r\n";
+                }
+                response += "\r\n" + body;
+            }
+            co_await asio::async_write(socket, asio::buffer(response), asio::use_awaitable);
+            if (mode == Mode::Close || mode == Mode::CloseSilently) {
+                co_return;
+            }
+        }
+    }
+};
+
+static AnnounceRequest _Request() {
+    AnnounceRequest request;
+    request.infoHash = bt::Sha1Digest::FromHex("a9993e364706816aba3e25717850c26c9cd0d89d").value();
+    request.peerId.fill(std::byte('-'));
+    request.port = 6881;
+    request.left = 1000;
+    request.event = bt::AnnounceEvent::Started;
+    return request;
+}
+
+/**
+ * @brief runs announce on ioContext until it completes
+ */
+static void _Run(asio::io_context& ioContext, std::function<asio::awaitable<void>()> announce) {
+    std::exception_ptr failure;
+    asio::co_spawn(ioContext, announce(), [&](std::exception_ptr exception) {
+        failure = exception;
+        ioContext.stop();
+    });
+    ioContext.run();
+    ioContext.restart();
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+TEST_CASE("announce url carries the BEP 3 parameters") {
+    AnnounceRequest request = _Request();
+    std::string url =
+        bt::http_tracker::BuildAnnounceUrl("http://tracker.example:6969/announce", request);
+    CHECK(url.starts_with("http://tracker.example:6969/announce?info_hash="
+                          "%A9%99%3E%36%47%06%81%6A%BA%3E%25%71%78%50%C2%6C%9C%D0%D8%9D&"));
+    CHECK(url.find("&peer_id=%2D%2D%2D") != std::string::npos);
+    CHECK(url.find("&port=6881&uploaded=0&downloaded=0&left=1000&compact=1") !=
+          std::string::npos);
+    CHECK(url.ends_with("&event=started"));
+
+    // parameters already in the url are kept
+    url = bt::http_tracker::BuildAnnounceUrl("http://tracker.example/a?passkey=x", request);
+    CHECK(url.starts_with("http://tracker.example/a?passkey=x&info_hash="));
+
+    CHECK_THROWS_AS(bt::http_tracker::BuildAnnounceUrl("udp://tracker.example:6969", request),
+                    std::invalid_argument);
+}
+
+TEST_CASE("announce responses are parsed into endpoints") {
+    SUBCASE("compact IPv4 and IPv6 peers") {
+        std::string peers6(18, '\0');
+        peers6[15] = 1; // ::1
+        peers6[16] = char(0x1a);
+        peers6[17] = char(0xe1);
+        std::string body = bencode::encode(bencode::dict{
+            {"interval", 1800},
+            {"min interval", 900},
+            {"complete", 5},
+            {"incomplete", 7},
+            {"peers", _Compact({{{10, 0, 0, 1}, 6881}, {{192, 168, 1, 20}, 51413}})},
+            {"peers6", peers6},
+        });
+        AnnounceResponse response = bt::http_tracker::ParseAnnounceResponse(body);
+        CHECK(response.interval == 1800s);
+        CHECK(response.minInterval == 900s);
+        CHECK(response.seeders == 5);
+        CHECK(response.leechers == 7);
+        REQUIRE(response.peers.size() == 3);
+        CHECK(response.peers[0] ==
+              asio::ip::tcp::endpoint(asio::ip::make_address("10.0.0.1"), 6881));
+        CHECK(response.peers[1] ==
+              asio::ip::tcp::endpoint(asio::ip::make_address("192.168.1.20"), 51413));
+        CHECK(response.peers[2] == asio::ip::tcp::endpoint(asio::ip::make_address("::1"), 6881));
+    }
+
+    SUBCASE("dictionary peers") {
+        std::string body = bencode::encode(bencode::dict{
+            {"interval", 60},
+            {"peers", bencode::list{bencode::dict{{"ip", "10.0.0.2"}, {"port", 1234}},
+                                    bencode::dict{{"ip", "not.an.address"}, {"port", 1}},
+                                    bencode::dict{{"ip", "10.0.0.3"}, {"port", 70000}}}},
+        });
+        AnnounceResponse response = bt::http_tracker::ParseAnnounceResponse(body);
+        CHECK(response.seeders == -1);
+        REQUIRE(response.peers.size() == 1);
+        CHECK(response.peers[0] ==
+              asio::ip::tcp::endpoint(asio::ip::make_address("10.0.0.2"), 1234));
+    }
+
+    SUBCASE("errors") {
+        CHECK_THROWS_WITH_AS(bt::http_tracker::ParseAnnounceResponse(
+                                 "d14:failure reason12:unregisterede"),
+                             "tracker refused the announce: unregistered", bt::TrackerError);
+        CHECK_THROWS_AS(bt::http_tracker::ParseAnnounceResponse("<html>"), bt::TrackerError);
+        CHECK_THROWS_AS(bt::http_tracker::ParseAnnounceResponse("de"), bt::TrackerError);
+        CHECK_THROWS_AS(bt::http_tracker::ParseAnnounceResponse("d8:intervali60e5:peers5:abcdee"),
+                        bt::TrackerError);
+    }
+}
+
+TEST_CASE("HttpTrackerClient against a local tracker") {
+    asio::io_context ioContext;
+    LocalHttpTracker tracker(ioContext);
+    tracker.body = bencode::encode(bencode::dict{
+        {"interval", 1800},
+        {"peers", _Compact({{{127, 0, 0, 1}, 6882}})},
+    });
+    HttpTrackerClient client(ioContext.get_executor());
+    AnnounceResponse response;
+
+    SUBCASE("connections are kept alive") {
+        _Run(ioContext, [&]() -> asio::awaitable<void> {
+            response = co_await client.Announce(tracker.url(), _Request());
+            co_await client.Announce(tracker.url(), _Request());
+            co_await client.Announce(tracker.url(), _Request());
+        });
+        CHECK(response.interval == 1800s);
+        REQUIRE(response.peers.size() == 1);
+        CHECK(response.peers[0].port() == 6882);
+        CHECK(tracker.targets.size() == 3);
+        CHECK(tracker.targets[0].starts_with("/announce?info_hash=%A9%99"));
+        CHECK(tracker.connectionsCount == 1);
+        CHECK(client.idleConnectionsCount() == 1);
+    }
+
+    SUBCASE("Connection: close is honored") {
+        tracker.mode = LocalHttpTracker::Mode::Close;
+        _Run(ioContext, [&]() -> asio::awaitable<void> {
+            co_await client.Announce(tracker.url(), _Request());
+            co_await client.Announce(tracker.url(), _Request());
+        });
+        CHECK(tracker.connectionsCount == 2);
+        CHECK(client.idleConnectionsCount() == 0);
+    }
+
+    SUBCASE("a connection the tracker closed while idle is replaced") {
+        tracker.mode = LocalHttpTracker::Mode::CloseSilently;
+        _Run(ioContext, [&]() -> asio::awaitable<void> {
+            co_await client.Announce(tracker.url(), _Request());
+            response = co_await client.Announce(tracker.url(), _Request());
+        });
+        CHECK(response.peers.size() == 1);
+        CHECK(tracker.connectionsCount == 2);
+        CHECK(tracker.targets.size() == 2);
+    }
+
+    SUBCASE("chunked responses") {
+        tracker.mode = LocalHttpTracker::Mode::Chunked;
+        _Run(ioContext, [&]() -> asio::awaitable<void> {
+            response = co_await client.Announce(tracker.url(), _Request());
+            co_await client.Announce(tracker.url(), _Request());
+        });
+        CHECK(response.peers.size() == 1);
+        CHECK(tracker.connectionsCount == 1);
+    }
+
+    SUBCASE("tracker failure") {
+        tracker.body = "d14:failure reason17:torrent not founde";
+        CHECK_THROWS_AS(_Run(ioContext,
+                             [&]() -> asio::awaitable<void> {
+                                 co_await client.Announce(tracker.url(), _Request());
+                             }),
+                        bt::TrackerError);
+    }
+
+    SUBCASE("a silent tracker times out") {
+        asio::ip::tcp::acceptor silent(ioContext, {asio::ip::address_v4::loopback(), 0});
+        asio::ip::tcp::socket accepted(ioContext);
+        silent.async_accept(accepted, [](const std::error_code&) {});
+        bt::HttpTrackerOptions options;
+        options.timeout = 20ms;
+        HttpTrackerClient impatient(ioContext.get_executor(), options);
+        std::string url = "http://127.0.0.1:" + std::to_string(silent.local_endpoint().port());
+        std::error_code error;
+        try {
+            _Run(ioContext, [&]() -> asio::awaitable<void> {
+                co_await impatient.Announce(url, _Request());
+            });
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+        CHECK((error == asio::error::timed_out));
+    }
+}
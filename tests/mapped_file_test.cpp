@@ -0,0 +1,63 @@
+#include "mapped_file.hpp"
+#include "torrent_metadata.hpp"
+#include "doctest.h"
+
+#include <filesystem>
+#include <fstream>
+
+static std::string _WriteTempFile(const std::string& name, const std::string& content) {
+    std::filesystem::path path = std::filesystem::temp_directory_path() / name;
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    file.write(content.data(), content.size());
+    return path.string();
+}
+
+TEST_CASE("MappedFile loads whole files") {
+    SUBCASE("small files are read into a buffer") {
+        std::string path = _WriteTempFile("bt_mapped_small.txt", "hello torrent");
+        bt::MappedFile file(path);
+        CHECK(!file.isMapped());
+        CHECK(file.data() == "hello torrent");
+        std::filesystem::remove(path);
+    }
+
+    SUBCASE("large files are mapped") {
+        std::string content(bt::MappedFile::MapThreshold + 123, 'x');
+        content.back() = 'y';
+        std::string path = _WriteTempFile("bt_mapped_large.bin", content);
+        {
+            bt::MappedFile file(path);
+            CHECK(file.isMapped());
+            CHECK(file.data() == content);
+        }
+        std::filesystem::remove(path);
+    }
+
+    SUBCASE("empty files") {
+        std::string path = _WriteTempFile("bt_mapped_empty.bin", "");
+        bt::MappedFile file(path);
+        CHECK(file.data().empty());
+        std::filesystem::remove(path);
+    }
+
+    CHECK_THROWS_AS(bt::MappedFile(TORRENT_FILES_PATH "non_existant_file.torrent"),
+                    std::runtime_error);
+}
+
+TEST_CASE("large torrent is parsed from its mapping") {
+    long long piecesCount = bt::MappedFile::MapThreshold / 20 + 1;
+    long long pieceLength = 16384;
+    std::string pieces(piecesCount * 20, 'p');
+    std::string metaInfo = "d4:infod6:lengthi" + std::to_string(piecesCount * pieceLength) +
+                           "e4:name3:big12:piece lengthi" + std::to_string(pieceLength) +
+                           "e6:pieces" + std::to_string(pieces.size()) + ":" + pieces + "ee";
+    std::string path = _WriteTempFile("bt_mapped_large.torrent", metaInfo);
+
+    {
+        bt::TorrentMetadata torr = bt::torrent_parser::ParseFromFile(path);
+        CHECK(torr.name() == "big");
+        CHECK(torr.piecesCount() == piecesCount);
+        CHECK(torr.infoHash() == bt::torrent_parser::Parse(metaInfo).infoHash());
+    }
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,67 @@
+#include "mpsc_queue.hpp"
+#include "doctest.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+TEST_CASE("MpscQueue pops values in push order") {
+    bt::MpscQueue<int> queue;
+    CHECK(!queue.TryPop());
+    for (int i = 0; i < 3; i++) {
+        queue.Push(i);
+    }
+    for (int i = 0; i < 3; i++) {
+        CHECK(queue.TryPop() == i);
+    }
+    CHECK(!queue.TryPop());
+
+    // the stub node is reused once the queue has run empty
+    queue.Push(7);
+    CHECK(queue.TryPop() == 7);
+    CHECK(!queue.TryPop());
+}
+
+TEST_CASE("MpscQueue frees values left in it") {
+    auto value = std::make_shared<int>(1);
+    {
+        bt::MpscQueue<std::shared_ptr<int>> queue;
+        queue.Push(value);
+        queue.Push(value);
+        CHECK(value.use_count() == 3);
+    }
+    CHECK(value.use_count() == 1);
+}
+
+TEST_CASE("MpscQueue keeps the order of each producer") {
+    constexpr int producersCount = 4;
+    constexpr int valuesCount = 20000;
+    bt::MpscQueue<std::pair<int, int>> queue;
+
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < producersCount; producer++) {
+        producers.emplace_back([&queue, producer] {
+            for (int i = 0; i < valuesCount; i++) {
+                queue.Push({producer, i});
+            }
+        });
+    }
+
+    std::vector<int> next(producersCount, 0);
+    bool ordered = true;
+    for (int popped = 0; popped < producersCount * valuesCount;) {
+        std::optional<std::pair<int, int>> value = queue.TryPop();
+        if (!value) {
+            std::this_thread::yield();
+            continue;
+        }
+        ordered = ordered && value->second == next[value->first];
+        next[value->first] = value->second + 1;
+        popped++;
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    CHECK(ordered);
+    CHECK(!queue.TryPop());
+}
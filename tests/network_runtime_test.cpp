@@ -0,0 +1,105 @@
+#include "network_runtime.hpp"
+#include "doctest.h"
+
+#include <atomic>
+#include <future>
+#include <thread>
+
+TEST_CASE("NetworkRuntime runs posted tasks on the shard's thread") {
+    bt::NetworkRuntime runtime(3, false);
+    CHECK(runtime.size() == 3);
+    CHECK(!bt::NetworkRuntime::CurrentShard());
+
+    for (size_t shard = 0; shard < runtime.size(); shard++) {
+        std::promise<std::optional<size_t>> ranOn;
+        runtime.Post(shard, [&ranOn] { ranOn.set_value(bt::NetworkRuntime::CurrentShard()); });
+        CHECK(ranOn.get_future().get() == shard);
+    }
+
+    // handlers of the shard's io_context run on the same thread
+    std::promise<std::optional<size_t>> ranOn;
+    asio::post(runtime.context(1),
+               [&ranOn] { ranOn.set_value(bt::NetworkRuntime::CurrentShard()); });
+    CHECK(ranOn.get_future().get() == 1);
+
+    CHECK(runtime.NextShard() == 0);
+    CHECK(runtime.NextShard() == 1);
+    CHECK(runtime.NextShard() == 2);
+    CHECK(runtime.NextShard() == 0);
+}
+
+TEST_CASE("NetworkRuntime keeps the order of tasks posted from several threads") {
+    constexpr int postersCount = 4;
+    constexpr int tasksCount = 5000;
+    // only touched by shard 0, no locking
+    std::vector<int> next(postersCount, 0);
+    bool ordered = true;
+    int ran = 0;
+    {
+        bt::NetworkRuntime runtime(2);
+        std::vector<std::thread> posters;
+        for (int poster = 0; poster < postersCount; poster++) {
+            posters.emplace_back([&, poster] {
+                for (int i = 0; i < tasksCount; i++) {
+                    runtime.Post(0, [&, poster, i] {
+                        ordered = ordered && next[poster] == i;
+                        next[poster] = i + 1;
+                        ran++;
+                    });
+                }
+            });
+        }
+        for (std::thread& poster : posters) {
+            poster.join();
+        }
+        // Stop runs what was already posted
+    }
+    CHECK(ordered);
+    CHECK(ran == postersCount * tasksCount);
+}
+
+TEST_CASE("NetworkRuntime runs sparse posts without waiting for a later one") {
+    // every poster waits for its task before posting the next, so posts keep racing with a
+    // drain that just found the queue empty; a lost wakeup leaves a task waiting
+    constexpr int postersCount = 8;
+    constexpr int tasksCount = 2000;
+    bt::NetworkRuntime runtime(1, false);
+    std::atomic<int> late = 0;
+    std::vector<std::thread> posters;
+    for (int poster = 0; poster < postersCount; poster++) {
+        posters.emplace_back([&] {
+            for (int i = 0; i < tasksCount; i++) {
+                std::promise<void> ran;
+                runtime.Post(0, [&ran] { ran.set_value(); });
+                std::future<void> done = ran.get_future();
+                if (done.wait_for(std::chrono::seconds(1)) != std::future_status::ready) {
+                    late++;
+                    // the next drain picks the task up
+                    runtime.Post(0, [] {});
+                    done.wait();
+                }
+            }
+        });
+    }
+    for (std::thread& poster : posters) {
+        poster.join();
+    }
+    CHECK(late == 0);
+}
+
+TEST_CASE("NetworkRuntime broadcasts to every shard") {
+    bt::NetworkRuntime runtime(4, false);
+    std::vector<std::promise<std::optional<size_t>>> ranOn(runtime.size());
+    runtime.Broadcast([&ranOn](size_t shard) {
+        ranOn[shard].set_value(bt::NetworkRuntime::CurrentShard());
+    });
+    for (size_t shard = 0; shard < runtime.size(); shard++) {
+        CHECK(ranOn[shard].get_future().get() == shard);
+    }
+
+    // a failing task does not take the shard down
+    runtime.Post(0, [] { throw std::runtime_error("task failure"); });
+    std::promise<void> after;
+    runtime.Post(0, [&after] { after.set_value(); });
+    after.get_future().get();
+}
@@ -0,0 +1,183 @@
+#include "peer_channel.hpp"
+#include "awaitable.hpp"
+#include "doctest.h"
+
+#include <chrono>
+#include <exception>
+#include <memory>
+
+using bt::PeerChannel;
+using bt::PeerConnection;
+using bt::peer_wire::BlockInfo;
+using namespace std::chrono_literals;
+
+static constexpr size_t piecesCount = 2;
+static constexpr uint32_t pieceLength = 2 * bt::peer_wire::BlockSize;
+
+static std::byte _PieceByte(uint32_t pieceIndex, uint32_t offset) {
+    return std::byte((pieceIndex * 31 + offset) & 0xff);
+}
+
+/**
+ * @return error code of the std::system_error that exception holds, an empty one if none
+ */
+static std::error_code _ErrorOf(std::exception_ptr exception) {
+    try {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    } catch (const std::system_error& e) {
+        return e.code();
+    }
+    return {};
+}
+
+/**
+ * @brief a seeder PeerConnection accepting on loopback and a leecher written as a coroutine
+ *        over PeerChannel, both on one io_context
+ */
+TEST_CASE("PeerChannel reads the events of a connection as a coroutine") {
+    asio::io_context ioContext;
+    asio::ip::tcp::acceptor acceptor(ioContext, {asio::ip::address_v4::loopback(), 0});
+
+    PeerConnection::Options seederOptions;
+    seederOptions.infoHash =
+        bt::Sha1Digest::FromHex("a9993e364706816aba3e25717850c26c9cd0d89d").value();
+    seederOptions.localPeerId.fill(std::byte('S'));
+    seederOptions.piecesCount = piecesCount;
+    PeerConnection::Options leecherOptions = seederOptions;
+    leecherOptions.localPeerId.fill(std::byte('L'));
+
+    std::shared_ptr<PeerConnection> seeder;
+    bool sendBitfield = true;
+    PeerConnection::Callbacks seederCallbacks;
+    seederCallbacks.onConnected = [&](PeerConnection& peer) {
+        if (!sendBitfield) {
+            return;
+        }
+        bt::Bitfield all(piecesCount);
+        for (size_t i = 0; i < piecesCount; i++) {
+            all.Set(i);
+        }
+        peer.SendBitfield(all);
+    };
+    seederCallbacks.onStateChanged = [](PeerConnection& peer) {
+        if (peer.peerInterested()) {
+            peer.Unchoke();
+        }
+    };
+    seederCallbacks.onRequest = [](PeerConnection& peer, const BlockInfo& block) {
+        std::vector<std::byte> data(block.length);
+        for (uint32_t i = 0; i < block.length; i++) {
+            data[i] = _PieceByte(block.pieceIndex, block.begin + i);
+        }
+        peer.SendPiece(block.pieceIndex, block.begin, data);
+    };
+    acceptor.async_accept(asio::make_strand(ioContext),
+                          [&](const std::error_code& error, asio::ip::tcp::socket socket) {
+                              REQUIRE(!error);
+                              seeder = PeerConnection::Accept(std::move(socket), seederOptions,
+                                                              seederCallbacks);
+                          });
+
+    // guards the test from hanging
+    asio::steady_timer timeout(ioContext, std::chrono::seconds(10));
+    timeout.async_wait([&](const std::error_code& error) {
+        if (!error) {
+            FAIL("timed out");
+            ioContext.stop();
+        }
+    });
+
+    PeerChannel leecher(ioContext, acceptor.local_endpoint(), leecherOptions);
+    bool finished = false;
+    std::exception_ptr failure;
+    auto run = [&](asio::awaitable<void> session) {
+        asio::co_spawn(leecher.executor(), std::move(session), [&](std::exception_ptr exception) {
+            failure = exception;
+            finished = true;
+            timeout.cancel();
+            if (seeder) {
+                seeder->Close();
+            }
+        });
+        ioContext.run();
+        CHECK(finished);
+        CHECK(!_ErrorOf(failure));
+    };
+
+    SUBCASE("download all blocks") {
+        run([&]() -> asio::awaitable<void> {
+            using Type = PeerChannel::Event::Type;
+            PeerChannel::Event event = co_await leecher.ReadEvent();
+            CHECK(event.type == Type::Connected);
+            event = co_await leecher.ReadEvent();
+            CHECK(event.type == Type::Bitfield);
+            CHECK(leecher.connection().peerPieces().all());
+
+            leecher.connection().SetInterested(true);
+            co_await leecher.Flush();
+            CHECK(!leecher.connection().writePending());
+            event = co_await leecher.ReadEvent();
+            CHECK(event.type == Type::StateChanged);
+            CHECK(!leecher.connection().peerChoking());
+
+            for (uint32_t piece = 0; piece < piecesCount; piece++) {
+                for (uint32_t begin = 0; begin < pieceLength; begin += bt::peer_wire::BlockSize) {
+                    CHECK(leecher.connection().Request({piece, begin, bt::peer_wire::BlockSize}));
+                }
+            }
+            for (size_t received = 0; received < piecesCount * 2; received++) {
+                event = co_await leecher.ReadEvent();
+                REQUIRE(event.type == Type::Piece);
+                bool intact = event.data.size() == event.block.length;
+                for (uint32_t i = 0; intact && i < event.data.size(); i++) {
+                    intact = event.data[i] == _PieceByte(event.block.pieceIndex,
+                                                         event.block.begin + i);
+                }
+                CHECK(intact);
+            }
+
+            leecher.Close();
+            std::error_code closed;
+            try {
+                co_await leecher.ReadEvent();
+            } catch (const std::system_error& e) {
+                closed = e.code();
+            }
+            CHECK((closed == asio::error::operation_aborted));
+        }());
+    }
+
+    SUBCASE("a cancelled wait leaves the channel usable") {
+        sendBitfield = false;
+        run([&]() -> asio::awaitable<void> {
+            PeerChannel::Event event = co_await leecher.ReadEvent();
+            CHECK(event.type == PeerChannel::Event::Type::Connected);
+
+            // the seeder sends nothing, WithTimeout cancels the wait through its slot
+            std::error_code error;
+            try {
+                co_await bt::WithTimeout(leecher.ReadEvent(), 20ms);
+            } catch (const std::system_error& e) {
+                error = e.code();
+            }
+            CHECK((error == asio::error::timed_out));
+
+            seeder->SendHave(1);
+            event = co_await bt::WithTimeout(leecher.ReadEvent(), 10s);
+            CHECK(event.type == PeerChannel::Event::Type::Have);
+            CHECK(event.pieceIndex == 1);
+
+            // the seeder going away ends the events
+            seeder->Close();
+            error = {};
+            try {
+                co_await leecher.ReadEvent();
+            } catch (const std::system_error& e) {
+                error = e.code();
+            }
+            CHECK((error == asio::error::eof));
+        }());
+    }
+}
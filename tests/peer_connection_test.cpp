@@ -0,0 +1,202 @@
+#include "peer_connection.hpp"
+#include "doctest.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+
+using bt::PeerConnection;
+using bt::peer_wire::BlockInfo;
+
+static constexpr size_t piecesCount = 4;
+static constexpr uint32_t pieceLength = 2 * bt::peer_wire::BlockSize;
+
+static std::byte _PieceByte(uint32_t pieceIndex, uint32_t offset) {
+    return std::byte((pieceIndex * 31 + offset) & 0xff);
+}
+
+/**
+ * @brief a seeder accepting on loopback and a leecher downloading every block from it,
+ *        both on one io_context
+ */
+TEST_CASE("PeerConnection between two peers over loopback") {
+    asio::io_context ioContext;
+    asio::ip::tcp::acceptor acceptor(ioContext, {asio::ip::address_v4::loopback(), 0});
+
+    PeerConnection::Options seederOptions;
+    seederOptions.infoHash =
+        bt::Sha1Digest::FromHex("a9993e364706816aba3e25717850c26c9cd0d89d").value();
+    seederOptions.localPeerId.fill(std::byte('S'));
+    seederOptions.piecesCount = piecesCount;
+    PeerConnection::Options leecherOptions = seederOptions;
+    leecherOptions.localPeerId.fill(std::byte('L'));
+
+    std::shared_ptr<PeerConnection> seeder;
+    std::shared_ptr<PeerConnection> leecher;
+    std::error_code seederClosed;
+    std::error_code leecherClosed;
+    bool seederSawClose = false;
+
+    // guards the test from hanging
+    asio::steady_timer timeout(ioContext, std::chrono::seconds(10));
+    timeout.async_wait([&](const std::error_code& error) {
+        if (!error) {
+            FAIL("timed out");
+            ioContext.stop();
+        }
+    });
+
+    SUBCASE("download all blocks") {
+        PeerConnection::Callbacks seederCallbacks;
+        seederCallbacks.onConnected = [](PeerConnection& peer) {
+            bt::Bitfield all(piecesCount);
+            for (size_t i = 0; i < piecesCount; i++) {
+                all.Set(i);
+            }
+            peer.SendBitfield(all);
+        };
+        seederCallbacks.onStateChanged = [](PeerConnection& peer) {
+            if (peer.peerInterested()) {
+                peer.Unchoke();
+            }
+        };
+        seederCallbacks.onRequest = [](PeerConnection& peer, const BlockInfo& block) {
+            std::vector<std::byte> data(block.length);
+            for (uint32_t i = 0; i < block.length; i++) {
+                data[i] = _PieceByte(block.pieceIndex, block.begin + i);
+            }
+            peer.SendPiece(block.pieceIndex, block.begin, data);
+        };
+        seederCallbacks.onClosed = [&](PeerConnection&, const std::error_code& error) {
+            seederClosed = error;
+            seederSawClose = true;
+            timeout.cancel();
+        };
+
+        std::map<std::pair<uint32_t, uint32_t>, bool> received;
+        bool leecherConnected = false;
+        PeerConnection::Callbacks leecherCallbacks;
+        leecherCallbacks.onConnected = [&](PeerConnection& peer) {
+            leecherConnected = true;
+            CHECK(peer.peerId()[0] == std::byte('S'));
+        };
+        leecherCallbacks.onBitfield = [](PeerConnection& peer) {
+            CHECK(peer.peerPieces().all());
+            CHECK(!peer.Request({0, 0, bt::peer_wire::BlockSize})); // still choked
+            peer.SetInterested(true);
+        };
+        leecherCallbacks.onStateChanged = [](PeerConnection& peer) {
+            if (peer.peerChoking()) {
+                return;
+            }
+            for (uint32_t piece = 0; piece < piecesCount; piece++) {
+                for (uint32_t begin = 0; begin < pieceLength; begin += bt::peer_wire::BlockSize) {
+                    CHECK(peer.Request({piece, begin, bt::peer_wire::BlockSize}));
+                }
+            }
+        };
+        leecherCallbacks.onPiece = [&](PeerConnection& peer, const BlockInfo& block,
+                                       std::span<const std::byte> data) {
+            bool intact = data.size() == block.length;
+            for (uint32_t i = 0; intact && i < data.size(); i++) {
+                intact = data[i] == _PieceByte(block.pieceIndex, block.begin + i);
+            }
+            CHECK(intact);
+            received[{block.pieceIndex, block.begin}] = true;
+            if (peer.outstandingRequests().empty()) {
+                peer.Close();
+            }
+        };
+        leecherCallbacks.onClosed = [&](PeerConnection&, const std::error_code& error) {
+            leecherClosed = error;
+        };
+
+        acceptor.async_accept(asio::make_strand(ioContext),
+                              [&](const std::error_code& error, asio::ip::tcp::socket socket) {
+                                  REQUIRE(!error);
+                                  seeder = PeerConnection::Accept(std::move(socket), seederOptions,
+                                                                  seederCallbacks);
+                              });
+        leecher = PeerConnection::Connect(ioContext, acceptor.local_endpoint(), leecherOptions,
+                                          leecherCallbacks);
+        ioContext.run();
+
+        CHECK(leecherConnected);
+        CHECK(received.size() == piecesCount * 2);
+        CHECK((leecherClosed == asio::error::operation_aborted));
+        // the seeder notices the leecher going away
+        CHECK(seederSawClose);
+        CHECK((seederClosed == asio::error::eof));
+        CHECK(leecher->state() == PeerConnection::State::Closed);
+        CHECK(seeder->state() == PeerConnection::State::Closed);
+    }
+
+    SUBCASE("handshake for another torrent is rejected") {
+        PeerConnection::Callbacks seederCallbacks;
+        seederCallbacks.onClosed = [&](PeerConnection&, const std::error_code& error) {
+            seederClosed = error;
+            seederSawClose = true;
+        };
+        PeerConnection::Callbacks leecherCallbacks;
+        leecherCallbacks.onConnected = [](PeerConnection&) { FAIL("connected"); };
+        leecherCallbacks.onClosed = [&](PeerConnection&, const std::error_code& error) {
+            leecherClosed = error;
+            timeout.cancel();
+        };
+
+        acceptor.async_accept(asio::make_strand(ioContext),
+                              [&](const std::error_code& error, asio::ip::tcp::socket socket) {
+                                  REQUIRE(!error);
+                                  seeder = PeerConnection::Accept(std::move(socket), seederOptions,
+                                                                  seederCallbacks);
+                              });
+        leecherOptions.infoHash.bytes[0] ^= std::byte(1);
+        leecher = PeerConnection::Connect(ioContext, acceptor.local_endpoint(), leecherOptions,
+                                          leecherCallbacks);
+        ioContext.run();
+
+        CHECK(seederSawClose);
+        CHECK((seederClosed == bt::peer_wire::Error::InfoHashMismatch));
+        CHECK(leecherClosed);
+    }
+
+    SUBCASE("handler closing the connection keeps its captures") {
+        PeerConnection::Callbacks seederCallbacks;
+        seederCallbacks.onClosed = [&](PeerConnection&, const std::error_code& error) {
+            seederClosed = error;
+            seederSawClose = true;
+            timeout.cancel();
+        };
+        auto owned = std::make_shared<int>(0);
+        std::string afterClose;
+        PeerConnection::Callbacks leecherCallbacks;
+        leecherCallbacks.onConnected = [&, owned, name = std::string(64, 'x')](
+                                           PeerConnection& peer) {
+            peer.Close();
+            // the handler still runs after Close(), its captures must be alive
+            afterClose = name;
+            *owned = 1;
+        };
+        leecherCallbacks.onClosed = [&](PeerConnection&, const std::error_code& error) {
+            leecherClosed = error;
+        };
+
+        acceptor.async_accept(asio::make_strand(ioContext),
+                              [&](const std::error_code& error, asio::ip::tcp::socket socket) {
+                                  REQUIRE(!error);
+                                  seeder = PeerConnection::Accept(std::move(socket), seederOptions,
+                                                                  seederCallbacks);
+                              });
+        leecher = PeerConnection::Connect(ioContext, acceptor.local_endpoint(), leecherOptions,
+                                          std::move(leecherCallbacks));
+        ioContext.run();
+
+        CHECK(afterClose == std::string(64, 'x'));
+        CHECK(*owned == 1);
+        CHECK((leecherClosed == asio::error::operation_aborted));
+        CHECK(seederSawClose);
+        // the callbacks are released once the handler returned
+        CHECK(owned.use_count() == 1);
+    }
+}
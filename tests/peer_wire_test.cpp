@@ -0,0 +1,94 @@
+#include "peer_wire.hpp"
+#include "doctest.h"
+
+#include <vector>
+
+using namespace bt::peer_wire;
+
+TEST_CASE("peer wire codec") {
+    SUBCASE("handshake round trip") {
+        Handshake handshake;
+        handshake.infoHash =
+            bt::Sha1Digest::FromHex("a9993e364706816aba3e25717850c26c9cd0d89d").value();
+        handshake.peerId.fill(std::byte('p'));
+        handshake.reserved[5] = std::byte(0x10);
+
+        std::array<std::byte, HandshakeSize> encoded;
+        EncodeHandshake(handshake, encoded);
+        CHECK(encoded[0] == std::byte(19));
+
+        auto decoded = DecodeHandshake(encoded);
+        REQUIRE(decoded.has_value());
+        CHECK(decoded->infoHash == handshake.infoHash);
+        CHECK(decoded->peerId == handshake.peerId);
+        CHECK(decoded->reserved == handshake.reserved);
+
+        encoded[3] = std::byte('X');
+        CHECK(!DecodeHandshake(encoded).has_value());
+    }
+
+    SUBCASE("messages round trip") {
+        std::vector<std::byte> stream;
+        AppendKeepAlive(stream);
+        AppendMessage(stream, MessageType::Interested);
+        AppendHave(stream, 1234567);
+        std::vector<std::byte> bits = {std::byte(0xf0), std::byte(0x0f)};
+        AppendBitfield(stream, bits);
+        AppendRequest(stream, {7, 16384, 16384});
+        std::vector<std::byte> block(100, std::byte(0xab));
+        AppendPiece(stream, 7, 16384, block);
+        AppendCancel(stream, {7, 0, 16384});
+
+        std::vector<Message> messages;
+        std::span<const std::byte> remaining(stream);
+        // feed one byte more at a time, as a slow socket would
+        for (size_t available = 0; available <= remaining.size();) {
+            Message message;
+            std::error_code error;
+            size_t used = DecodeMessage(remaining.first(available), message, error);
+            REQUIRE(!error);
+            if (used == 0) {
+                available++;
+                continue;
+            }
+            messages.push_back(message);
+            remaining = remaining.subspan(used);
+            available = 0;
+        }
+        CHECK(remaining.empty());
+
+        REQUIRE(messages.size() == 7);
+        CHECK(messages[0].type == MessageType::KeepAlive);
+        CHECK(messages[1].type == MessageType::Interested);
+        CHECK(messages[2].type == MessageType::Have);
+        CHECK(messages[2].pieceIndex == 1234567);
+        CHECK(messages[3].type == MessageType::Bitfield);
+        CHECK(std::equal(messages[3].payload.begin(), messages[3].payload.end(), bits.begin(),
+                         bits.end()));
+        CHECK(messages[4].type == MessageType::Request);
+        CHECK(messages[4].block() == BlockInfo{7, 16384, 16384});
+        CHECK(messages[5].type == MessageType::Piece);
+        CHECK(messages[5].block() == BlockInfo{7, 16384, 100});
+        CHECK(messages[5].payload.size() == 100);
+        CHECK(messages[5].payload[99] == std::byte(0xab));
+        CHECK(messages[6].type == MessageType::Cancel);
+        CHECK(messages[6].block() == BlockInfo{7, 0, 16384});
+    }
+
+    SUBCASE("broken streams") {
+        Message message;
+        std::error_code error;
+
+        std::vector<std::byte> tooLarge = {std::byte(0x7f), std::byte(0), std::byte(0),
+                                           std::byte(0), std::byte(7)};
+        CHECK(DecodeMessage(tooLarge, message, error) == 0);
+        CHECK((error == Error::MessageTooLarge));
+
+        // a have message without its index
+        error.clear();
+        std::vector<std::byte> shortHave = {std::byte(0), std::byte(0), std::byte(0),
+                                            std::byte(1), std::byte(4)};
+        CHECK(DecodeMessage(shortHave, message, error) == 0);
+        CHECK((error == Error::MalformedMessage));
+    }
+}
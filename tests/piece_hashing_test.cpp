@@ -0,0 +1,67 @@
+#include "piece_hashing.hpp"
+#include "sha1_backend.hpp"
+#include "torrent_metadata.hpp"
+#include "doctest.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using bt::sha1_backend::Backend;
+using bt::sha1_backend::MultiBackend;
+
+TEST_CASE("HashPieces") {
+    Backend previousBackend = bt::sha1_backend::Active();
+    MultiBackend previousMulti = bt::sha1_backend::ActiveMulti();
+
+    std::mt19937 random(42);
+    std::vector<std::string> buffers;
+    // equal pieces with a short last one, as in a torrent
+    for (size_t i = 0; i < 21; i++) {
+        buffers.emplace_back(i == 20 ? 1000 : 16 * 1024, '\0');
+    }
+    // lengths around the padding boundaries
+    for (size_t size : {0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 4095}) {
+        buffers.emplace_back(size, '\0');
+    }
+    for (std::string& buffer : buffers) {
+        for (char& c : buffer) {
+            c = static_cast<char>(random());
+        }
+    }
+
+    std::vector<std::span<const std::byte>> pieces;
+    std::vector<bt::Sha1Digest> expected;
+    for (const std::string& buffer : buffers) {
+        pieces.push_back(std::as_bytes(std::span(buffer)));
+        expected.push_back(bt::torrent_parser::GetSha1Hash(buffer));
+    }
+
+    // with SHA extensions narrow multi-buffer backends are skipped
+    for (Backend backend : {Backend::Scalar, previousBackend}) {
+        bt::sha1_backend::Select(backend);
+        for (MultiBackend multi : {MultiBackend::None, MultiBackend::Sse2, MultiBackend::Avx2,
+                                   MultiBackend::Avx512}) {
+            if (!bt::sha1_backend::Select(multi)) {
+                continue;
+            }
+            CAPTURE(bt::sha1_backend::Name(backend));
+            CAPTURE(bt::sha1_backend::Name(multi));
+
+            std::vector<bt::Sha1Digest> digests(pieces.size());
+            bt::HashPieces(pieces, digests);
+            CHECK(digests == expected);
+
+            // fewer pieces than lanes
+            std::vector<bt::Sha1Digest> few(3);
+            bt::HashPieces(std::span(pieces).first(3), few);
+            CHECK(few == std::vector<bt::Sha1Digest>(expected.begin(), expected.begin() + 3));
+        }
+    }
+
+    std::vector<bt::Sha1Digest> tooSmall(1);
+    CHECK_THROWS_AS(bt::HashPieces(pieces, tooSmall), std::invalid_argument);
+
+    bt::sha1_backend::Select(previousBackend);
+    bt::sha1_backend::Select(previousMulti);
+}
@@ -0,0 +1,218 @@
+#include "piece_picker.hpp"
+#include "doctest.h"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using bt::Bitfield;
+using bt::PiecePicker;
+using bt::peer_wire::BlockInfo;
+
+constexpr uint32_t BlockSize = 16 * 1024;
+
+static Bitfield _Pieces(size_t size, std::initializer_list<size_t> indexes) {
+    Bitfield pieces(size);
+    for (size_t index : indexes) {
+        pieces.Set(index);
+    }
+    return pieces;
+}
+
+static Bitfield _All(size_t size) {
+    Bitfield pieces(size);
+    for (size_t i = 0; i < size; i++) {
+        pieces.Set(i);
+    }
+    return pieces;
+}
+
+static std::vector<uint32_t> _PieceIndexes(const std::vector<BlockInfo>& blocks) {
+    std::vector<uint32_t> indexes;
+    for (const BlockInfo& block : blocks) {
+        indexes.push_back(block.pieceIndex);
+    }
+    std::sort(indexes.begin(), indexes.end());
+    return indexes;
+}
+
+TEST_CASE("piece picker picks the rarest pieces first") {
+    // one block per piece
+    PiecePicker picker(8, BlockSize, 8 * BlockSize);
+    picker.IncrementAvailability(_All(8));
+    picker.IncrementAvailability(_Pieces(8, {0, 1, 2, 3}));
+    picker.IncrementAvailability(_Pieces(8, {0, 1}));
+    CHECK(picker.availability(0) == 3);
+    CHECK(picker.availability(3) == 2);
+    CHECK(picker.availability(7) == 1);
+
+    CHECK(_PieceIndexes(picker.Pick(_All(8), 4)) == std::vector<uint32_t>{4, 5, 6, 7});
+    CHECK(_PieceIndexes(picker.Pick(_All(8), 2)) == std::vector<uint32_t>{2, 3});
+
+    SUBCASE("HAVE and departing peers reorder the pieces") {
+        picker.DecrementAvailability(_Pieces(8, {0, 1, 2, 3}));
+        picker.IncrementAvailability(1);
+        CHECK(picker.availability(0) == 2);
+        CHECK(picker.availability(1) == 3);
+        CHECK(_PieceIndexes(picker.Pick(_All(8), 1)) == std::vector<uint32_t>{0});
+    }
+
+    SUBCASE("only pieces the peer has") {
+        CHECK(picker.Pick(_Pieces(8, {2, 3, 4}), 4).empty());
+        CHECK(_PieceIndexes(picker.Pick(_Pieces(8, {1}), 4)) == std::vector<uint32_t>{1});
+    }
+
+    SUBCASE("seeds make every piece available") {
+        PiecePicker seeded(4, BlockSize, 4 * BlockSize);
+        CHECK(seeded.Pick(_All(4), 4).empty());
+        seeded.AddSeed();
+        CHECK(seeded.availability(2) == 1);
+        CHECK(seeded.Pick(_All(4), 4).size() == 4);
+    }
+
+    CHECK_THROWS_AS(picker.IncrementAvailability(Bitfield(9)), std::invalid_argument);
+}
+
+TEST_CASE("piece picker buckets stay sorted under churn") {
+    constexpr size_t PiecesCount = 300;
+    PiecePicker picker(PiecesCount, BlockSize, PiecesCount * BlockSize);
+    std::vector<size_t> availability(PiecesCount);
+    std::mt19937 random(7);
+    for (int step = 0; step < 20000; step++) {
+        uint32_t index = random() % PiecesCount;
+        if (random() % 3 != 0 || availability[index] == 0) {
+            picker.IncrementAvailability(index);
+            availability[index]++;
+        } else {
+            picker.DecrementAvailability(index);
+            availability[index]--;
+        }
+        if (step % 1000 == 999) {
+            picker.SetPriority(random() % PiecesCount, static_cast<uint8_t>(random() % 3 + 3));
+        }
+    }
+
+    // the pick is always one of the rarest available pieces of the highest priority
+    Bitfield all = _All(PiecesCount);
+    for (size_t picked = 0; picked < PiecesCount; picked++) {
+        std::vector<BlockInfo> blocks = picker.Pick(all, 1);
+        if (blocks.empty()) {
+            break;
+        }
+        uint32_t index = blocks[0].pieceIndex;
+        CHECK(picker.availability(index) == availability[index]);
+        for (uint32_t other = 0; other < PiecesCount; other++) {
+            if (picker.Have(other) || other == index || availability[other] == 0) {
+                continue;
+            }
+            bool before = picker.priority(other) > picker.priority(index) ||
+                          (picker.priority(other) == picker.priority(index) &&
+                           availability[other] < availability[index]);
+            CHECK(!before);
+        }
+        CHECK(picker.OnBlockReceived(blocks[0]));
+        picker.OnPieceVerified(index);
+    }
+    for (uint32_t index = 0; index < PiecesCount; index++) {
+        CHECK(picker.Have(index) == (availability[index] > 0));
+    }
+    CHECK(picker.haveCount() == PiecesCount - std::count(availability.begin(),
+                                                          availability.end(), size_t(0)));
+}
+
+TEST_CASE("piece picker priorities and sequential mode") {
+    PiecePicker picker(6, BlockSize, 6 * BlockSize);
+    picker.AddSeed();
+    picker.IncrementAvailability(_Pieces(6, {0, 1, 2, 3}));
+    picker.SetPriority(3, PiecePicker::MaxPriority);
+    picker.SetPriority(4, PiecePicker::SkipPriority);
+    CHECK(picker.priority(3) == PiecePicker::MaxPriority);
+
+    CHECK(_PieceIndexes(picker.Pick(_All(6), 1)) == std::vector<uint32_t>{3});
+    CHECK(_PieceIndexes(picker.Pick(_All(6), 1)) == std::vector<uint32_t>{5});
+    CHECK(_PieceIndexes(picker.Pick(_All(6), 3)) == std::vector<uint32_t>{0, 1, 2});
+    CHECK(picker.endgame());
+
+    PiecePicker sequential(6, BlockSize, 6 * BlockSize, {.sequential = true});
+    sequential.AddSeed();
+    sequential.IncrementAvailability(_Pieces(6, {0, 1}));
+    sequential.SetPriority(1, PiecePicker::SkipPriority);
+    std::vector<BlockInfo> blocks = sequential.Pick(_All(6), 3);
+    REQUIRE(blocks.size() == 3);
+    CHECK(blocks[0].pieceIndex == 0);
+    CHECK(blocks[1].pieceIndex == 2);
+    CHECK(blocks[2].pieceIndex == 3);
+
+    // a failed piece is picked again, before the later ones
+    sequential.OnBlockReceived(blocks[0]);
+    sequential.OnPieceFailed(0);
+    CHECK(sequential.Pick(_All(6), 1)[0].pieceIndex == 0);
+}
+
+TEST_CASE("piece picker hands out blocks") {
+    // 3 pieces of 4 blocks, the last piece has 1.5 blocks
+    long long pieceLength = 4 * BlockSize;
+    PiecePicker picker(3, pieceLength, 2 * pieceLength + BlockSize + BlockSize / 2);
+    picker.AddSeed();
+    picker.IncrementAvailability(_Pieces(3, {1, 2}));
+    Bitfield all = _All(3);
+
+    std::vector<BlockInfo> first = picker.Pick(all, 2);
+    CHECK(first == std::vector<BlockInfo>{{0, 0, BlockSize}, {0, BlockSize, BlockSize}});
+
+    SUBCASE("partial pieces are finished first") {
+        std::vector<BlockInfo> second = picker.Pick(all, 2);
+        CHECK(second == std::vector<BlockInfo>{{0, 2 * BlockSize, BlockSize},
+                                               {0, 3 * BlockSize, BlockSize}});
+    }
+
+    SUBCASE("failed requests are handed out again") {
+        picker.OnRequestFailed(first[1]);
+        std::vector<BlockInfo> again = picker.Pick(all, 1);
+        CHECK(again == std::vector<BlockInfo>{first[1]});
+    }
+
+    SUBCASE("the last block of the last piece is short") {
+        std::vector<BlockInfo> blocks = picker.Pick(all, 2 + 4 + 2);
+        CHECK(blocks.size() == 2 + 4 + 2);
+        CHECK(std::count(blocks.begin(), blocks.end(), BlockInfo{2, BlockSize, BlockSize / 2}) ==
+              1);
+    }
+
+    SUBCASE("a piece is complete when all blocks arrived") {
+        std::vector<BlockInfo> rest = picker.Pick(_Pieces(3, {0}), 10);
+        CHECK(rest.size() == 2);
+        for (const BlockInfo& block : first) {
+            picker.OnBlockReceived(block);
+        }
+        for (size_t i = 0; i < rest.size(); i++) {
+            CHECK(picker.OnBlockReceived(rest[i]) == (i + 1 == rest.size()));
+        }
+        CHECK(!picker.OnBlockReceived(first[0]));
+    }
+}
+
+TEST_CASE("piece picker endgame") {
+    PiecePicker picker(1, 2 * BlockSize, 2 * BlockSize);
+    picker.AddSeed();
+    Bitfield all = _All(1);
+    std::vector<BlockInfo> first = picker.Pick(all, 10);
+    REQUIRE(first.size() == 2);
+    CHECK(picker.endgame());
+
+    // other peers get the same blocks, a peer never gets a block twice
+    CHECK(picker.Pick(all, 10, first).empty());
+    std::vector<BlockInfo> second = picker.Pick(all, 1);
+    CHECK(second.size() == 1);
+    picker.OnBlockReceived(second[0]);
+    std::vector<BlockInfo> third = picker.Pick(all, 10);
+    REQUIRE(third.size() == 1);
+    CHECK(third[0] != second[0]);
+
+    CHECK(picker.OnBlockReceived(third[0]));
+    picker.OnPieceVerified(0);
+    CHECK(!picker.endgame());
+    CHECK(picker.Pick(all, 10).empty());
+    CHECK(picker.haveCount() == 1);
+}
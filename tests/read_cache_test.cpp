@@ -0,0 +1,116 @@
+#include "read_cache.hpp"
+#include "peer_wire.hpp"
+#include "doctest.h"
+
+using bt::ReadCache;
+using bt::peer_wire::BlockSize;
+
+static std::vector<std::byte> _Block(uint32_t piece, uint32_t begin) {
+    std::vector<std::byte> block(BlockSize);
+    for (size_t i = 0; i < block.size(); i++) {
+        block[i] = std::byte(static_cast<unsigned char>(piece * 31 + begin + i));
+    }
+    return block;
+}
+
+/**
+ * @brief reads a block the way DiskIoService does, inserting it on a miss
+ * @return whether it was a hit
+ */
+static bool _Read(ReadCache& cache, uint32_t piece, uint32_t begin = 0) {
+    if (cache.Find(0, piece, begin, BlockSize)) {
+        return true;
+    }
+    cache.Insert(0, piece, begin, _Block(piece, begin), false);
+    return false;
+}
+
+TEST_CASE("ReadCache") {
+    SUBCASE("hits and misses, parts of blocks") {
+        ReadCache cache(1 << 20);
+        cache.Insert(0, 3, BlockSize, _Block(3, BlockSize), false);
+        std::optional<std::vector<std::byte>> found = cache.Find(0, 3, BlockSize, BlockSize);
+        REQUIRE(found);
+        CHECK((*found == _Block(3, BlockSize)));
+        found = cache.Find(0, 3, BlockSize + 100, 1000);
+        REQUIRE(found);
+        CHECK(found->size() == 1000);
+        CHECK(found->front() == _Block(3, BlockSize)[100]);
+        CHECK(!cache.Find(0, 3, 0, BlockSize));
+        CHECK(!cache.Find(0, 3, 2 * BlockSize - 10, 20));
+        CHECK(!cache.Find(1, 3, BlockSize, BlockSize));
+
+        ReadCache::Stats stats = cache.stats();
+        CHECK(stats.hits == 2);
+        CHECK(stats.misses == 3);
+        CHECK(stats.readAheadHits == 0);
+        CHECK(cache.size() == BlockSize);
+    }
+
+    SUBCASE("blocks read ahead") {
+        ReadCache cache(1 << 20);
+        cache.Insert(0, 0, 0, _Block(0, 0), false);
+        cache.Insert(0, 0, BlockSize, _Block(0, BlockSize), true);
+        CHECK(_Read(cache, 0, BlockSize));
+        CHECK(_Read(cache, 0, BlockSize));
+        CHECK(cache.stats().readAheadHits == 1);
+        CHECK(cache.stats().hits == 2);
+    }
+
+    SUBCASE("holds maxBytes") {
+        ReadCache cache(4 * BlockSize);
+        for (uint32_t piece = 0; piece < 10; piece++) {
+            CHECK(!_Read(cache, piece));
+        }
+        CHECK(cache.blocksCount() == 4);
+        CHECK(cache.size() == 4 * BlockSize);
+        CHECK(_Read(cache, 9));
+        CHECK(!_Read(cache, 0));
+    }
+
+    SUBCASE("a scan does not evict the blocks read again") {
+        ReadCache cache(8 * BlockSize);
+        for (int round = 0; round < 2; round++) {
+            for (uint32_t piece = 0; piece < 4; piece++) {
+                _Read(cache, piece);
+            }
+        }
+        // every block once, like a peer downloading the whole torrent; LRU would keep none
+        // of the hot blocks
+        for (uint32_t piece = 100; piece < 1000; piece++) {
+            CHECK(!_Read(cache, piece));
+        }
+        for (uint32_t piece = 0; piece < 4; piece++) {
+            CHECK(_Read(cache, piece));
+        }
+        CHECK(cache.blocksCount() <= 8);
+    }
+
+    SUBCASE("a block read again soon after its eviction is cached again") {
+        ReadCache cache(2 * BlockSize);
+        _Read(cache, 0);
+        _Read(cache, 0);
+        _Read(cache, 1);
+        _Read(cache, 2); // evicts 1, keeping its key
+        CHECK(!_Read(cache, 1));
+        CHECK(_Read(cache, 1));
+        CHECK(cache.blocksCount() == 2);
+    }
+
+    SUBCASE("erase") {
+        ReadCache cache(1 << 20);
+        for (uint32_t piece = 0; piece < 3; piece++) {
+            cache.Insert(0, piece, 0, _Block(piece, 0), false);
+            cache.Insert(0, piece, BlockSize, _Block(piece, BlockSize), false);
+            cache.Insert(1, piece, 0, _Block(piece, 0), false);
+        }
+        cache.Erase(0, 1);
+        CHECK(!cache.Find(0, 1, 0, BlockSize));
+        CHECK(!cache.Find(0, 1, BlockSize, BlockSize));
+        CHECK(cache.Find(0, 2, BlockSize, BlockSize));
+        cache.EraseStorage(1);
+        CHECK(!cache.Find(1, 0, 0, BlockSize));
+        CHECK(cache.blocksCount() == 4);
+        CHECK(cache.size() == 4 * BlockSize);
+    }
+}
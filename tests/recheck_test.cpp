@@ -0,0 +1,114 @@
+#include "recheck.hpp"
+#include "doctest.h"
+#include "test_torrent.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+static constexpr long long pieceLength = 16 * 1024;
+
+TEST_CASE("Recheck") {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bt_recheck_test";
+    std::filesystem::remove_all(directory);
+    // pieces span file boundaries, the second file is empty
+    std::vector<long long> fileSizes = {40'000, 0, 100'000, 5'000};
+    std::string data = test::RandomData(145'000, 7);
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, fileSizes, pieceLength));
+    bt::StorageLayout layout(torr, directory);
+    test::WriteFiles(layout, data);
+    const size_t piecesCount = torr.piecesCount();
+    REQUIRE(piecesCount == 9);
+
+    // small reads, so that several are in flight
+    bt::RecheckOptions options;
+    options.threadsCount = 3;
+    options.readSize = 2 * pieceLength;
+
+    SUBCASE("intact data") {
+        size_t progressCalls = 0;
+        bt::RecheckProgress last{};
+        options.onProgress = [&](const bt::RecheckProgress& progress) {
+            CHECK(progress.piecesChecked > last.piecesChecked);
+            last = progress;
+            progressCalls++;
+        };
+        bt::Bitfield bitfield = bt::Recheck(layout, options);
+        CHECK(bitfield.all());
+        CHECK(progressCalls >= 1);
+        CHECK(last.piecesChecked == piecesCount);
+        CHECK(last.piecesValid == piecesCount);
+        CHECK(last.bytesChecked == torr.totalSize());
+    }
+
+    SUBCASE("corrupt byte fails only its piece") {
+        {
+            std::fstream file(layout.filePath(2), std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(50'000 - 40'000);
+            file.put('\x55' ^ file.peek());
+        }
+        bt::Bitfield bitfield = bt::Recheck(layout, options);
+        CHECK(bitfield.count() == piecesCount - 1);
+        CHECK(!bitfield.Test(50'000 / pieceLength));
+    }
+
+    SUBCASE("missing and truncated files") {
+        std::filesystem::remove(layout.filePath(0));
+        std::filesystem::resize_file(layout.filePath(3), 4'000);
+        bt::Bitfield bitfield = bt::Recheck(layout, options);
+        // file 0 covers pieces 0 - 2, file 3 starts in piece 8
+        for (size_t i = 0; i < piecesCount; i++) {
+            CAPTURE(i);
+            CHECK(bitfield.Test(i) == (i >= 3 && i < 8));
+        }
+    }
+
+    SUBCASE("throwing progress callback") {
+        // the hashing tasks still queued finish before the shared state goes away
+        options.onProgress = [](const bt::RecheckProgress&) {
+            throw std::runtime_error("stop");
+        };
+        CHECK_THROWS_AS(bt::Recheck(layout, options), std::runtime_error);
+    }
+
+    SUBCASE("stopping early") {
+        std::stop_source stop;
+        stop.request_stop();
+        options.stopToken = stop.get_token();
+        CHECK(bt::Recheck(layout, options).none());
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Recheck reads pad files as zeros") {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bt_recheck_pad_test";
+    std::filesystem::remove_all(directory);
+    // the pad file aligns the last file to a piece
+    std::vector<long long> fileSizes = {10'000, pieceLength - 10'000, 20'000};
+    std::string data = test::RandomData(pieceLength + 20'000, 7);
+    std::fill(data.begin() + 10'000, data.begin() + pieceLength, '\0');
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, fileSizes, pieceLength, {1}));
+    bt::StorageLayout layout(torr, directory);
+    test::WriteFiles(layout, data);
+    REQUIRE(!std::filesystem::exists(layout.filePath(1)));
+    CHECK(bt::Recheck(layout, {}).all());
+}
+
+TEST_CASE("Recheck reads files not wanted from the part file") {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "bt_recheck_wanted_test";
+    std::filesystem::remove_all(directory);
+    std::vector<long long> fileSizes = {40'000, 30'000, 70'000, 5'000};
+    std::string data = test::RandomData(145'000, 7);
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(test::MakeTorrent(data, fileSizes, pieceLength));
+    bt::StorageLayout layout(torr, directory, {true, false, true, false});
+    test::WriteFiles(layout, data);
+    REQUIRE(!std::filesystem::exists(layout.filePath(1)));
+    CHECK(bt::Recheck(layout, {}).all());
+}
@@ -0,0 +1,205 @@
+#include "block_downloader.hpp"
+#include "request_queue.hpp"
+#include "doctest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+
+using bt::PeerConnection;
+using bt::RequestQueue;
+using bt::RequestQueueOptions;
+using bt::peer_wire::BlockInfo;
+using bt::peer_wire::BlockSize;
+using namespace std::chrono_literals;
+
+/**
+ * @brief drives a queue against a simulated peer: requests reach it after half the round trip,
+ *        it sends one block per blockTime in order, and the block arrives half a round trip later
+ * @return depth after simulating duration
+ */
+static size_t _Simulate(RequestQueue& queue, RequestQueue::Clock::duration rtt,
+                        RequestQueue::Clock::duration blockTime,
+                        RequestQueue::Clock::duration duration) {
+    auto start = RequestQueue::Clock::time_point();
+    auto now = start;
+    auto peerFreeAt = start;
+    uint32_t nextBlock = 0;
+    std::deque<std::pair<BlockInfo, RequestQueue::Clock::time_point>> inFlight;
+    while (now - start < duration) {
+        while (queue.deficit() > 0) {
+            BlockInfo block{nextBlock++, 0, BlockSize};
+            queue.OnRequested(block, now);
+            peerFreeAt = std::max(peerFreeAt, now + rtt / 2) + blockTime;
+            inFlight.emplace_back(block, peerFreeAt + rtt / 2);
+        }
+        auto [block, arrival] = inFlight.front();
+        inFlight.pop_front();
+        now = arrival;
+        CHECK(queue.OnReceived(block, now));
+    }
+    return queue.depth();
+}
+
+TEST_CASE("request queue depth follows the bandwidth-delay product") {
+    SUBCASE("depth limited, doubles every round trip") {
+        RequestQueue queue;
+        CHECK(queue.depth() == 4);
+        _Simulate(queue, 50ms, 10us, 160ms);
+        CHECK(queue.depth() >= 32);
+        CHECK(queue.minRtt() >= 50ms);
+    }
+
+    SUBCASE("bandwidth limited, settles at twice the product") {
+        // 1000 blocks per second for 50 ms is 50 blocks in flight
+        RequestQueue queue;
+        size_t depth = _Simulate(queue, 50ms, 1ms, 3s);
+        CHECK(depth >= 80);
+        CHECK(depth <= 130);
+        CHECK(queue.rate() == doctest::Approx(1000.0 * BlockSize).epsilon(0.1));
+        CHECK(queue.minRtt() < 60ms);
+    }
+
+    SUBCASE("fixed depth") {
+        RequestQueue queue({.initialDepth = 6, .adaptive = false});
+        CHECK(_Simulate(queue, 50ms, 10us, 1s) == 6);
+    }
+
+    SUBCASE("bounds") {
+        RequestQueue queue({.maxDepth = 20});
+        CHECK(_Simulate(queue, 50ms, 10us, 1s) == 20);
+    }
+}
+
+TEST_CASE("request queue tracks outstanding requests") {
+    RequestQueue queue;
+    auto start = RequestQueue::Clock::time_point();
+    BlockInfo first{0, 0, BlockSize};
+    BlockInfo second{0, BlockSize, BlockSize};
+    queue.OnRequested(first, start);
+    queue.OnRequested(second, start + 1s);
+    CHECK(queue.size() == 2);
+    CHECK(queue.deficit() == 2);
+    CHECK(queue.Contains(second));
+    CHECK(!queue.OnReceived({1, 0, BlockSize}, start + 1s));
+
+    SUBCASE("timeouts") {
+        CHECK(queue.timeout() == 10s);
+        CHECK(queue.TakeTimedOut(start + 10s).empty());
+        CHECK(queue.TakeTimedOut(start + 10500ms) == std::vector<BlockInfo>{first});
+        CHECK(queue.size() == 1);
+    }
+
+    SUBCASE("cancel and choke") {
+        CHECK(queue.Remove(first));
+        CHECK(!queue.Remove(first));
+        CHECK(queue.Clear() == std::vector<BlockInfo>{second});
+        CHECK(queue.size() == 0);
+    }
+}
+
+/**
+ * @brief downloads from a seeder on loopback that answers requests after latency and sends
+ *        at most rate bytes per second, like a peer on a long fat link
+ * @return seconds to download every piece
+ */
+static double _DownloadOverSlowLink(RequestQueueOptions options, size_t piecesCount,
+                                    std::chrono::microseconds latency, double rate) {
+    constexpr uint32_t PieceLength = 4 * BlockSize;
+    asio::io_context ioContext;
+    asio::ip::tcp::acceptor acceptor(ioContext, {asio::ip::address_v4::loopback(), 0});
+
+    PeerConnection::Options peerOptions;
+    peerOptions.infoHash =
+        bt::Sha1Digest::FromHex("a9993e364706816aba3e25717850c26c9cd0d89d").value();
+    peerOptions.piecesCount = piecesCount;
+
+    auto blockTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(BlockSize / rate));
+    auto sendFreeAt = std::chrono::steady_clock::now();
+    std::vector<std::byte> data(BlockSize, std::byte(7));
+    PeerConnection::Callbacks seederCallbacks;
+    seederCallbacks.onConnected = [&](PeerConnection& peer) {
+        bt::Bitfield all(piecesCount);
+        for (size_t i = 0; i < piecesCount; i++) {
+            all.Set(i);
+        }
+        peer.SendBitfield(all);
+    };
+    seederCallbacks.onStateChanged = [](PeerConnection& peer) {
+        if (peer.peerInterested()) {
+            peer.Unchoke();
+        }
+    };
+    seederCallbacks.onRequest = [&](PeerConnection& peer, const BlockInfo& block) {
+        sendFreeAt = std::max(sendFreeAt, std::chrono::steady_clock::now() + latency) + blockTime;
+        auto timer = std::make_shared<asio::steady_timer>(ioContext, sendFreeAt);
+        timer->async_wait([&, timer, block, connection = peer.shared_from_this()](
+                              const std::error_code&) {
+            connection->SendPiece(block.pieceIndex, block.begin,
+                                  std::span(data).first(block.length));
+        });
+    };
+
+    std::shared_ptr<PeerConnection> seeder;
+    acceptor.async_accept([&](const std::error_code& error, asio::ip::tcp::socket socket) {
+        REQUIRE(!error);
+        seeder = PeerConnection::Accept(std::move(socket), peerOptions, seederCallbacks);
+    });
+
+    bt::PiecePicker picker(piecesCount, PieceLength, piecesCount * PieceLength);
+    bt::BlockDownloader downloader(picker, options);
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0;
+    PeerConnection::Callbacks leecherCallbacks;
+    leecherCallbacks.onConnected = [&](PeerConnection& peer) {
+        downloader.AddPeer(peer);
+        peer.SetInterested(true);
+    };
+    leecherCallbacks.onBitfield = [&](PeerConnection& peer) {
+        picker.IncrementAvailability(peer.peerPieces());
+        downloader.Fill(peer);
+    };
+    leecherCallbacks.onStateChanged = [&](PeerConnection& peer) {
+        downloader.OnStateChanged(peer);
+    };
+    leecherCallbacks.onPiece = [&](PeerConnection& peer, const BlockInfo& block,
+                                   std::span<const std::byte>) {
+        if (downloader.OnPiece(peer, block)) {
+            picker.OnPieceVerified(block.pieceIndex);
+            if (picker.haveCount() == piecesCount) {
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                              .count();
+                ioContext.stop();
+            }
+        }
+    };
+    auto leecher = PeerConnection::Connect(ioContext, acceptor.local_endpoint(), peerOptions,
+                                           leecherCallbacks);
+
+    asio::steady_timer timeout(ioContext, 20s);
+    timeout.async_wait([&](const std::error_code& error) {
+        if (!error) {
+            FAIL("timed out");
+            ioContext.stop();
+        }
+    });
+    ioContext.run();
+    return seconds;
+}
+
+TEST_CASE("adaptive request depth fills a long fat link") {
+    // 2 MiB over a 20 ms link of 40 MB/s, the product is 50 blocks
+    constexpr size_t PiecesCount = 32;
+    constexpr double Rate = 40e6;
+    constexpr double Megabytes = PiecesCount * 4 * BlockSize / 1e6;
+
+    double fixed =
+        _DownloadOverSlowLink({.initialDepth = 4, .adaptive = false}, PiecesCount, 20ms, Rate);
+    double adaptive = _DownloadOverSlowLink({}, PiecesCount, 20ms, Rate);
+    MESSAGE("fixed depth 4: " << Megabytes / fixed << " MB/s, adaptive: "
+                              << Megabytes / adaptive << " MB/s");
+    REQUIRE(fixed > 0);
+    REQUIRE(adaptive > 0);
+    CHECK(adaptive < fixed / 2);
+}
@@ -0,0 +1,92 @@
+#include "sha1_backend.hpp"
+#include "torrent_metadata.hpp"
+#include "doctest.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using bt::sha1_backend::Backend;
+
+static constexpr Backend allBackends[] = {Backend::Scalar, Backend::Avx2, Backend::ShaNi};
+
+/**
+ * @brief restores the detected backend when a test is done overriding it
+ */
+struct BackendGuard {
+    Backend previous = bt::sha1_backend::Active();
+    ~BackendGuard() {
+        bt::sha1_backend::Select(previous);
+    }
+};
+
+TEST_CASE("SHA1 backends") {
+    BackendGuard guard;
+
+    SUBCASE("scalar is always available") {
+        CHECK(bt::sha1_backend::IsSupported(Backend::Scalar));
+        CHECK(bt::sha1_backend::IsSupported(bt::sha1_backend::Active()));
+        CHECK(bt::sha1_backend::Select(Backend::Scalar));
+        CHECK(bt::sha1_backend::Active() == Backend::Scalar);
+    }
+
+    SUBCASE("known digests") {
+        // one, two and three blocks after padding
+        std::string million(1'000'000, 'a');
+        for (Backend backend : allBackends) {
+            if (!bt::sha1_backend::Select(backend)) {
+                continue;
+            }
+            CAPTURE(bt::sha1_backend::Name(backend));
+            CHECK(bt::torrent_parser::GetSha1Hash("").ToHexString() ==
+                  "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+            CHECK(bt::torrent_parser::GetSha1Hash(
+                      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")
+                      .ToHexString() == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+            CHECK(bt::torrent_parser::GetSha1Hash(million).ToHexString() ==
+                  "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+        }
+    }
+
+    SUBCASE("every backend matches scalar") {
+        std::mt19937 random(1234);
+        std::vector<uint8_t> blocks(64 * 37);
+        for (uint8_t& byte : blocks) {
+            byte = static_cast<uint8_t>(random());
+        }
+
+        for (size_t blocksCount : {0, 1, 2, 3, 8, 37}) {
+            uint32_t expected[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+            bt::sha1_backend::Select(Backend::Scalar);
+            bt::sha1_backend::Compress(expected, blocks.data(), blocksCount);
+
+            for (Backend backend : allBackends) {
+                if (!bt::sha1_backend::Select(backend)) {
+                    continue;
+                }
+                CAPTURE(bt::sha1_backend::Name(backend));
+                CAPTURE(blocksCount);
+                uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+                bt::sha1_backend::Compress(state, blocks.data(), blocksCount);
+                CHECK(std::equal(state, state + 5, expected));
+            }
+        }
+
+        // lengths around block boundaries, fed through the buffered path of SHA1
+        std::string data(blocks.begin(), blocks.end());
+        for (size_t length = 0; length < data.size(); length += 1 + random() % 97) {
+            std::string_view message = std::string_view(data).substr(0, length);
+            bt::sha1_backend::Select(Backend::Scalar);
+            bt::Sha1Digest expected = bt::torrent_parser::GetSha1Hash(message);
+            for (Backend backend : allBackends) {
+                if (!bt::sha1_backend::Select(backend)) {
+                    continue;
+                }
+                CAPTURE(bt::sha1_backend::Name(backend));
+                CAPTURE(length);
+                CHECK(bt::torrent_parser::GetSha1Hash(message) == expected);
+            }
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#include "sha1_digest.hpp"
+#include "torrent_metadata.hpp"
+#include "doctest.h"
+
+#include <unordered_set>
+
+// SHA1("abc")
+static constexpr std::string_view abcHex = "a9993e364706816aba3e25717850c26c9cd0d89d";
+
+TEST_CASE("Sha1Digest hex conversion") {
+    constexpr std::optional<bt::Sha1Digest> digest = bt::Sha1Digest::FromHex(abcHex);
+    static_assert(digest.has_value());
+    static_assert(std::string_view(digest->ToHex().data(), 40) == abcHex);
+    static_assert(std::to_integer<int>(digest->bytes[0]) == 0xa9);
+
+    CHECK(bt::torrent_parser::GetSha1Hash("abc") == digest.value());
+    CHECK(bt::torrent_parser::GetSha1Hash("abc").ToHexString() == abcHex);
+
+    CHECK(bt::Sha1Digest::FromHex("A9993E364706816ABA3E25717850C26C9CD0D89D") == digest);
+    CHECK(!bt::Sha1Digest::FromHex("a9993e").has_value());
+    CHECK(!bt::Sha1Digest::FromHex("x9993e364706816aba3e25717850c26c9cd0d89d").has_value());
+}
+
+TEST_CASE("Sha1Digest percent encoding") {
+    bt::Sha1Digest digest = bt::Sha1Digest::FromHex(abcHex).value();
+    CHECK(digest.ToPercentEncodedString() ==
+          "%A9%99%3E%36%47%06%81%6A%BA%3E%25%71%78%50%C2%6C%9C%D0%D8%9D");
+}
+
+TEST_CASE("Sha1Digest comparison and hashing") {
+    bt::Sha1Digest a = bt::torrent_parser::GetSha1Hash("a");
+    bt::Sha1Digest b = bt::torrent_parser::GetSha1Hash("b");
+    bt::Sha1Digest aCopy = bt::Sha1Digest::FromBytes(a.bytes.data());
+
+    CHECK(a == aCopy);
+    CHECK(a != b);
+    CHECK((a < b) != (b < a));
+    CHECK(std::hash<bt::Sha1Digest>{}(a) == std::hash<bt::Sha1Digest>{}(aCopy));
+
+    std::unordered_set<bt::InfoHash> set = {a, b, aCopy};
+    CHECK(set.size() == 2);
+}
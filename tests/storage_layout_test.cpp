@@ -0,0 +1,75 @@
+#include "storage_layout.hpp"
+#include "doctest.h"
+
+#include "external/bencode.hpp"
+
+TEST_CASE("StorageLayout") {
+    SUBCASE("single file torrents are saved directly into the save path") {
+        bt::TorrentMetadata torr = bt::torrent_parser::ParseFromFile(
+            TORRENT_FILES_PATH "linuxmint-22-xfce-64bit.iso.torrent");
+        CHECK(!torr.isMultiFile());
+
+        bt::StorageLayout layout(torr, "downloads");
+        CHECK(layout.root() == std::filesystem::path("downloads"));
+        CHECK(layout.filePath(0) ==
+              std::filesystem::path("downloads") / "linuxmint-22-xfce-64bit.iso");
+    }
+
+    SUBCASE("multi file torrents get a directory and can not escape it") {
+        bencode::list files = {
+            bencode::dict{{"length", 1}, {"path", bencode::list{"dir", "a.txt"}}},
+            bencode::dict{{"length", 1}, {"path", bencode::list{"..", "..", "evil"}}},
+            bencode::dict{{"length", 1}, {"path", bencode::list{"x/../../y"}}},
+        };
+        bencode::dict info = {{"files", files},
+                              {"name", ".."},
+                              {"piece length", 16384},
+                              {"pieces", std::string(20, 'x')}};
+        bt::TorrentMetadata torr =
+            bt::torrent_parser::Parse(bencode::encode(bencode::dict{{"info", info}}));
+        CHECK(torr.isMultiFile());
+
+        bt::StorageLayout layout(torr, "downloads");
+        std::filesystem::path root = std::filesystem::path("downloads") / "_";
+        CHECK(layout.root() == root);
+        CHECK(layout.filePath(0) == root / "dir" / "a.txt");
+        CHECK(layout.filePath(1) == root / "_" / "_" / "evil");
+        CHECK(layout.filePath(2) == root / "x_.._.._y");
+    }
+}
+
+TEST_CASE("StorageLayout stores files not wanted in the part file") {
+    bencode::list files = {
+        bencode::dict{{"length", 100}, {"path", bencode::list{"a"}}},
+        bencode::dict{{"length", 200}, {"path", bencode::list{"b"}}},
+        bencode::dict{{"attr", "p"}, {"length", 50}, {"path", bencode::list{".pad", "50"}}},
+        bencode::dict{{"length", 300}, {"path", bencode::list{"c"}}},
+        bencode::dict{{"length", 400}, {"path", bencode::list{"d"}}},
+    };
+    bencode::dict info = {{"files", files},
+                          {"name", "payload"},
+                          {"piece length", 16384},
+                          {"pieces", std::string(20, 'x')}};
+    bt::TorrentMetadata torr =
+        bt::torrent_parser::Parse(bencode::encode(bencode::dict{{"info", info}}));
+
+    bt::StorageLayout everything(torr, "downloads");
+    CHECK(everything.isWanted(1));
+    CHECK(everything.storedPath(1) == everything.filePath(1));
+    CHECK(everything.storedOffset(1) == 0);
+
+    // the part file is next to the torrent's directory, not in it
+    bt::StorageLayout layout(torr, "downloads", {true, false, false, false, false});
+    CHECK(layout.partFilePath() ==
+          std::filesystem::path("downloads") / ("." + torr.infoHash().ToHexString() + ".parts"));
+    CHECK(layout.isWanted(0));
+    CHECK(layout.storedPath(0) == layout.filePath(0));
+    CHECK(!layout.isWanted(1));
+    // the files not wanted are back to back, the pad file takes no space
+    CHECK(layout.storedPath(1) == layout.partFilePath());
+    CHECK(layout.storedOffset(1) == 0);
+    CHECK(layout.storedOffset(3) == 200);
+    CHECK(layout.storedOffset(4) == 500);
+
+    CHECK_THROWS_AS(bt::StorageLayout(torr, "downloads", {true, false}), std::invalid_argument);
+}
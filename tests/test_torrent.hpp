@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "external/bencode.hpp"
+#include "storage_layout.hpp"
+#include "torrent_metadata.hpp"
+
+namespace test {
+
+/**
+ * @return size random bytes, the same for the same seed
+ */
+inline std::string RandomData(size_t size, unsigned seed) {
+    std::mt19937 random(seed);
+    std::string data(size, '\0');
+    for (char& c : data) {
+        c = static_cast<char>(random());
+    }
+    return data;
+}
+
+/**
+ * @return metainfo of a multi-file torrent named "payload" for data split into files
+ *         "dir/file-<index>" of fileSizes, the piece hashes are those of data
+ * @param padFiles indices of the files that are BEP 47 pad files, data holds zeros for them
+ */
+inline std::string MakeTorrent(std::string_view data, const std::vector<long long>& fileSizes,
+                               long long pieceLength, const std::vector<size_t>& padFiles = {}) {
+    bencode::list files;
+    for (size_t i = 0; i < fileSizes.size(); i++) {
+        bencode::dict file = {{"length", fileSizes[i]},
+                              {"path", bencode::list{"dir", "file-" + std::to_string(i)}}};
+        if (std::find(padFiles.begin(), padFiles.end(), i) != padFiles.end()) {
+            file["attr"] = "p";
+        }
+        files.push_back(std::move(file));
+    }
+    std::string pieces;
+    for (size_t offset = 0; offset < data.size(); offset += pieceLength) {
+        bt::Sha1Digest digest = bt::torrent_parser::GetSha1Hash(data.substr(offset, pieceLength));
+        pieces.append(reinterpret_cast<const char*>(digest.bytes.data()), digest.bytes.size());
+    }
+    bencode::dict info = {{"files", std::move(files)},
+                          {"name", "payload"},
+                          {"piece length", pieceLength},
+                          {"pieces", std::move(pieces)}};
+    return bencode::encode(bencode::dict{{"info", std::move(info)}});
+}
+
+/**
+ * @brief writes data, the concatenated bytes of the torrent, to the files of layout; pad files
+ *        are not stored and left out, files not wanted go to the part file
+ */
+inline void WriteFiles(const bt::StorageLayout& layout, std::string_view data) {
+    const bt::FileTable& files = layout.torrent().files();
+    for (size_t i = 0; i < files.size(); i++) {
+        if (files.isPadFile(i)) {
+            continue;
+        }
+        std::filesystem::path path = layout.storedPath(i);
+        std::filesystem::create_directories(path.parent_path());
+        if (!std::filesystem::exists(path)) {
+            std::ofstream(path, std::ios::binary);
+        }
+        std::string_view content = data.substr(files.fileOffset(i), files.fileSize(i));
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(layout.storedOffset(i));
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+    }
+}
+
+} // namespace test
@@ -0,0 +1,26 @@
+#include "thread_pool.hpp"
+#include "doctest.h"
+
+#include <atomic>
+
+TEST_CASE("ThreadPool runs every posted task before it is destroyed") {
+    std::atomic<int> sum = 0;
+    {
+        bt::ThreadPool pool(4);
+        CHECK(pool.size() == 4);
+        for (int i = 1; i <= 1000; i++) {
+            pool.Post([&sum, i] { sum += i; });
+        }
+    }
+    CHECK(sum == 500500);
+}
+
+TEST_CASE("ThreadPool keeps running after a task throws") {
+    std::atomic<int> ran = 0;
+    {
+        bt::ThreadPool pool(1);
+        pool.Post([] { throw std::runtime_error("task failure"); });
+        pool.Post([&ran] { ran++; });
+    }
+    CHECK(ran == 1);
+}
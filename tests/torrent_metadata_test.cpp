@@ -1,21 +1,12 @@
+#include "http_tracker.hpp"
 #include "torrent_metadata.hpp"
 #include "utils.hpp"
 
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
-std::string EncodeWithPercent(std::string str) {
-    std::string percentEncodedString;
-    size_t i = 0;
-    for (auto c : str) {
-        if ((i % 2) == 0) {
-            percentEncodedString.push_back('%');
-        }
-        percentEncodedString.push_back(std::toupper(c));
-        i++;
-    }
-    return percentEncodedString;
-}
+#include <algorithm>
+#include <map>
 
 TEST_CASE("testing parser with single file torrent") {
     std::string filePath = TORRENT_FILES_PATH "linuxmint-22-xfce-64bit.iso.torrent";
@@ -41,17 +32,198 @@ TEST_CASE("testing parser with multiple file torrent") {
     CHECK(torr.announceList().size() > 0);
     CHECK(torr.mainAnnounce().has_value());
 
-    SUBCASE("download torrent") {
-        // build http request url that can be used to get peers
-        std::string httpString = torr.mainAnnounce().value() +
-                                 "?info_hash=" + EncodeWithPercent(torr.infoHash()) +
-                                 "&left=" + std::to_string(torr.pieceLength()) +
-                                 "&peer_id=-PC0001-706887310628&uploaded=0&downloaded=0&port="
-                                 "6889&compact=1";
+    SUBCASE("announce url") {
+        // announcing is tested against a local tracker in http_tracker_test.cpp
+        bt::AnnounceRequest request;
+        request.infoHash = torr.infoHash();
+        request.left = torr.totalSize();
+        request.port = 6889;
+        request.event = bt::AnnounceEvent::Started;
+        std::string httpString =
+            bt::http_tracker::BuildAnnounceUrl(torr.mainAnnounce().value(), request);
 
         LogTrace("your http url :\n\t {}", httpString);
+        CHECK(httpString.starts_with(std::string(torr.mainAnnounce().value()) +
+                                     "?info_hash=" + torr.infoHash().ToPercentEncodedString()));
+    }
+}
+
+TEST_CASE("pieces map onto files") {
+    std::string filePath = TORRENT_FILES_PATH "india-pocket-map_archive.torrent";
+    bt::TorrentMetadata torr = bt::torrent_parser::ParseFromFile(filePath);
+
+    long long piecesCount = torr.piecesCount();
+    REQUIRE(piecesCount > 1);
+    CHECK(piecesCount == (torr.totalSize() + torr.pieceLength() - 1) / torr.pieceLength());
+    CHECK(torr.pieceSize(0) == torr.pieceLength());
+    CHECK(torr.pieceSize(piecesCount - 1) ==
+          torr.totalSize() - (piecesCount - 1) * torr.pieceLength());
+
+    // every byte of every file is covered exactly once, in order
+    size_t fileIndex = 0;
+    long long fileOffset = 0;
+    for (long long piece = 0; piece < piecesCount; piece++) {
+        long long covered = 0;
+        for (bt::FileSlice slice : torr.MapPiece(piece)) {
+            while (torr.files().fileSize(fileIndex) == fileOffset) {
+                fileIndex++;
+                fileOffset = 0;
+            }
+            CHECK(slice.fileIndex == fileIndex);
+            CHECK(slice.offset == fileOffset);
+            fileOffset += slice.length;
+            covered += slice.length;
+        }
+        CHECK(covered == torr.pieceSize(piece));
+    }
+}
+
+TEST_CASE("parsed strings stay valid after the metadata is copied") {
+    std::string filePath = TORRENT_FILES_PATH "india-pocket-map_archive.torrent";
+
+    std::optional<bt::TorrentMetadata> copy;
+    {
+        bt::TorrentMetadata torr = bt::torrent_parser::ParseFromFile(filePath);
+        copy = torr;
+    }
+
+    REQUIRE(copy->files().size() > 1);
+    CHECK(!copy->name().empty());
+    CHECK(copy->piecesHashes().size() == copy->piecesCount() * 20);
+    CHECK(copy->announceList().front().starts_with("http"));
+    CHECK(!copy->files().path(0).ToString().empty());
+}
+
+TEST_CASE("infohash is computed from the raw info dict bytes") {
+    std::string filePath = TORRENT_FILES_PATH "linuxmint-22-xfce-64bit.iso.torrent";
+    bt::TorrentMetadata torr = bt::torrent_parser::ParseFromFile(filePath);
+    CHECK(torr.infoHash().ToHexString() == "affcd07474276825ad07b9f9c7b4d830152b6ec9");
+
+    SUBCASE("piece hashes are views into the pieces string") {
+        REQUIRE(torr.piecesCount() > 1);
+        std::span<const std::byte, 20> last = torr.pieceHash(torr.piecesCount() - 1);
+        CHECK(last.data() == torr.piecesHashes().data() + (torr.piecesCount() - 1) * 20);
+        CHECK(torr.pieceHash(0).data() == torr.piecesHashes().data());
+    }
+
+    SUBCASE("non canonical key order is hashed as is") {
+        // 'name' is placed before 'length', re-encoding would reorder them
+        std::string info =
+            "d4:name3:abc6:lengthi5e12:piece lengthi16384e6:pieces20:aaaaaaaaaaaaaaaaaaaae";
+        std::string canonicalInfo =
+            "d6:lengthi5e4:name3:abc12:piece lengthi16384e6:pieces20:aaaaaaaaaaaaaaaaaaaae";
+
+        bt::TorrentMetadata nonCanonical =
+            bt::torrent_parser::Parse("d8:announce9:http://a/4:info" + info + "e");
+
+        CHECK(nonCanonical.infoHash() ==
+              bt::Sha1Digest::FromHex("89e247aba9b108e9a4667cb926b66def9b0b2c32"));
+        CHECK(nonCanonical.infoHash() == bt::torrent_parser::GetSha1Hash(info));
+        CHECK(nonCanonical.infoHash() != bt::torrent_parser::GetSha1Hash(canonicalInfo));
+    }
 
-        // TODO : implement http handshake with tracker
+    SUBCASE("truncated or trailing data is rejected") {
+        std::string info =
+            "d6:lengthi5e4:name3:abc12:piece lengthi16384e6:pieces20:aaaaaaaaaaaaaaaaaaaae";
+        CHECK_NOTHROW(bt::torrent_parser::Parse("d4:info" + info + "e"));
+        CHECK_THROWS_AS(bt::torrent_parser::Parse("d4:info" + info), bt::InvalidTorrentFile);
+        CHECK_THROWS_AS(bt::torrent_parser::Parse("d4:info" + info + "ee"),
+                        bt::InvalidTorrentFile);
+    }
+}
+
+TEST_CASE("announce-list keeps its tiers") {
+    std::string info =
+        "d6:lengthi5e4:name3:abc12:piece lengthi16384e6:pieces20:aaaaaaaaaaaaaaaaaaaae";
+    // tiers: [a, b], [], [c], [7, d], the empty tier and the integer are dropped
+    bt::TorrentMetadata torr = bt::torrent_parser::Parse(
+        "d13:announce-listll8:http://a8:http://belel8:http://celi7e8:http://dee4:info" +
+        info + "e");
+
+    CHECK(torr.announceList() ==
+          std::vector<std::string_view>{"http://a", "http://b", "http://c", "http://d"});
+    REQUIRE(torr.announceTiersCount() == 3);
+    CHECK(std::ranges::equal(torr.announceTier(0),
+                             std::vector<std::string_view>{"http://a", "http://b"}));
+    CHECK(std::ranges::equal(torr.announceTier(1), std::vector<std::string_view>{"http://c"}));
+    CHECK(std::ranges::equal(torr.announceTier(2), std::vector<std::string_view>{"http://d"}));
+
+    bt::TorrentMetadata noList = bt::torrent_parser::Parse("d4:info" + info + "e");
+    CHECK(noList.announceTiersCount() == 0);
+}
+
+TEST_CASE("BEP 47 pad files are marked") {
+    // a, a pad file, b with an attribute other than "p"
+    bt::TorrentMetadata torr = bt::torrent_parser::Parse(
+        "d4:infod5:filesld6:lengthi10e4:pathl1:aeed4:attr1:p6:lengthi16374e4:pathl4:.pad"
+        "5:16374eed4:attr1:x6:lengthi5e4:pathl1:beee4:name3:abc12:piece lengthi16384e"
+        "6:pieces40:aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaee");
+
+    REQUIRE(torr.files().size() == 3);
+    CHECK(!torr.files().isPadFile(0));
+    CHECK(torr.files().isPadFile(1));
+    CHECK(!torr.files().isPadFile(2));
+    CHECK(torr.files().totalSize() == 16389);
+}
+
+TEST_CASE("sizes that break the piece layout are rejected") {
+    const std::string hash(20, 'a');
+    auto parse = [](const std::string &info) {
+        return bt::torrent_parser::Parse("d4:info" + info + "e");
+    };
+    CHECK_NOTHROW(parse("d6:lengthi5e4:name3:abc12:piece lengthi16384e6:pieces20:" + hash + "e"));
+
+    SUBCASE("negative file length") {
+        CHECK_THROWS_AS(
+            parse("d6:lengthi-5e4:name3:abc12:piece lengthi16384e6:pieces20:" + hash + "e"),
+            bt::InvalidTorrentFile);
+        CHECK_THROWS_AS(parse("d5:filesld6:lengthi10e4:pathl1:aeed6:lengthi-5e4:pathl1:beee"
+                              "4:name3:abc12:piece lengthi16384e6:pieces20:" +
+                              hash + "e"),
+                        bt::InvalidTorrentFile);
+    }
+
+    SUBCASE("piece length not positive") {
+        CHECK_THROWS_AS(parse("d6:lengthi5e4:name3:abc12:piece lengthi0e6:pieces20:" + hash + "e"),
+                        bt::InvalidTorrentFile);
+        CHECK_THROWS_AS(
+            parse("d6:lengthi5e4:name3:abc12:piece lengthi-16384e6:pieces20:" + hash + "e"),
+            bt::InvalidTorrentFile);
+    }
+
+    SUBCASE("pieces not a multiple of 20 bytes") {
+        CHECK_THROWS_AS(
+            parse("d6:lengthi5e4:name3:abc12:piece lengthi16384e6:pieces21:" + hash + "ae"),
+            bt::InvalidTorrentFile);
+    }
+
+    SUBCASE("pieces count not matching the total size") {
+        // 16385 bytes are two pieces
+        CHECK_THROWS_AS(
+            parse("d6:lengthi16385e4:name3:abc12:piece lengthi16384e6:pieces20:" + hash + "e"),
+            bt::InvalidTorrentFile);
+        CHECK_THROWS_AS(
+            parse("d6:lengthi5e4:name3:abc12:piece lengthi16384e6:pieces40:" + hash + hash + "e"),
+            bt::InvalidTorrentFile);
+        CHECK_THROWS_AS(parse("d6:lengthi5e4:name3:abc12:piece lengthi16384e6:pieces0:e"),
+                        bt::InvalidTorrentFile);
+    }
+
+    SUBCASE("total size overflowing") {
+        // four files of 2^62 bytes wrap the total around to the 5 bytes of the last one
+        std::string files;
+        for (int i = 0; i < 4; i++) {
+            files += "d6:lengthi4611686018427387904e4:pathl1:" + std::to_string(i) + "ee";
+        }
+        files += "d6:lengthi5e4:pathl1:5ee";
+        CHECK_THROWS_AS(parse("d5:filesl" + files +
+                              "e4:name3:abc12:piece lengthi16384e6:pieces20:" + hash + "e"),
+                        bt::InvalidTorrentFile);
+        // the largest size must not overflow when counting its pieces
+        CHECK_THROWS_AS(parse("d6:lengthi9223372036854775807e4:name3:abc12:piece lengthi16384e"
+                              "6:pieces20:" +
+                              hash + "e"),
+                        bt::InvalidTorrentFile);
     }
 }
 
@@ -70,6 +242,49 @@ TEST_CASE("Testing Parser with various Invalid files") {
     }
 }
 
+TEST_CASE("parsing many files reports every file") {
+    // repeat the files so workers race for them
+    std::vector<std::string> paths;
+    for (int i = 0; i < 4; i++) {
+        paths.push_back(TORRENT_FILES_PATH "linuxmint-22-xfce-64bit.iso.torrent");
+        paths.push_back(TORRENT_FILES_PATH "plain_text.txt");
+        paths.push_back(TORRENT_FILES_PATH "india-pocket-map_archive.torrent");
+        paths.push_back(TORRENT_FILES_PATH "non_existant_file.torrent");
+    }
+
+    std::map<std::string, int> reported;
+    size_t failed = 0;
+    size_t loaded = bt::torrent_parser::ParseMany(
+        paths,
+        [&](bt::torrent_parser::ParseResult &&result) {
+            reported[result.path]++;
+            if (!result.metadata.has_value()) {
+                CHECK(!result.error.empty());
+                failed++;
+            }
+        },
+        3);
+
+    CHECK(loaded == 8);
+    CHECK(failed == 8);
+    CHECK(reported.size() == 4);
+    for (auto &[path, count] : reported) {
+        CHECK(count == 4);
+    }
+
+    SUBCASE("directory") {
+        std::vector<bt::InfoHash> hashes;
+        size_t directoryLoaded = bt::torrent_parser::ParseDirectory(
+            TORRENT_FILES_PATH,
+            [&](bt::torrent_parser::ParseResult &&result) {
+                REQUIRE(result.metadata.has_value());
+                hashes.push_back(result.metadata->infoHash());
+            });
+        CHECK(directoryLoaded == 2);
+        CHECK(hashes.size() == 2);
+    }
+}
+
 int DaytimeClient(const char *);
 
 TEST_CASE("TEST NETWORKING") {
@@ -0,0 +1,236 @@
+#include "udp_tracker.hpp"
+#include "doctest.h"
+
+#include <cstring>
+
+using bt::AnnounceRequest;
+using bt::AnnounceResponse;
+using bt::UdpTrackerClient;
+using namespace std::chrono_literals;
+
+static uint32_t _Read32(const std::byte* data) {
+    uint32_t value;
+    std::memcpy(&value, data, 4);
+    return asio::detail::socket_ops::network_to_host_long(value);
+}
+
+static void _Append32(std::vector<std::byte>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(std::byte(value >> shift));
+    }
+}
+
+/**
+ * @brief stand-in for a BEP 15 tracker on loopback
+ */
+struct LocalUdpTracker {
+    explicit LocalUdpTracker(asio::io_context& ioContext)
+        : socket(ioContext, {asio::ip::address_v4::loopback(), 0}) {
+        asio::co_spawn(ioContext, _Serve(), asio::detached);
+    }
+
+    std::string url() const {
+        return "udp://127.0.0.1:" + std::to_string(socket.local_endpoint().port()) + "/announce";
+    }
+
+    asio::ip::udp::socket socket;
+    size_t dropCount = 0; // requests ignored before answering, to force retransmits
+    std::string error;    // answers announces and scrapes with this error if set
+    size_t connectsCount = 0;
+    size_t announcesCount = 0;
+    std::vector<size_t> scrapeSizes;
+    uint32_t lastEvent = 0;
+
+  private:
+    static constexpr uint64_t connectionId = 0x1122334455667788;
+
+    asio::awaitable<void> _Serve() {
+        std::vector<std::byte> packet(2048);
+        asio::ip::udp::endpoint sender;
+        for (;;) {
+            size_t size = co_await socket.async_receive_from(asio::buffer(packet), sender,
+                                                             asio::use_awaitable);
+            if (dropCount > 0) {
+                dropCount--;
+                continue;
+            }
+            REQUIRE(size >= 16);
+            uint32_t action = _Read32(packet.data() + 8);
+            uint32_t transactionId = _Read32(packet.data() + 12);
+            std::vector<std::byte> answer;
+
+            if (action == 0) {
+                CHECK(_Read32(packet.data()) == 0x417);
+                CHECK(_Read32(packet.data() + 4) == 0x27101980);
+                connectsCount++;
+                _Append32(answer, 0);
+                _Append32(answer, transactionId);
+                _Append32(answer, uint32_t(connectionId >> 32));
+                _Append32(answer, uint32_t(connectionId));
+            } else {
+                CHECK(_Read32(packet.data()) == uint32_t(connectionId >> 32));
+                CHECK(_Read32(packet.data() + 4) == uint32_t(connectionId));
+                if (!error.empty()) {
+                    _Append32(answer, 3);
+                    _Append32(answer, transactionId);
+                    answer.insert(answer.end(), reinterpret_cast<const std::byte*>(error.data()),
+                                  reinterpret_cast<const std::byte*>(error.data() + error.size()));
+                } else if (action == 1) {
+                    REQUIRE(size == 98);
+                    announcesCount++;
+                    lastEvent = _Read32(packet.data() + 80);
+                    _Append32(answer, 1);
+                    _Append32(answer, transactionId);
+                    _Append32(answer, 1800); // interval
+                    _Append32(answer, 3);    // leechers
+                    _Append32(answer, 4);    // seeders
+                    for (uint8_t byte : {10, 0, 0, 1, 0x1a, 0xe1, 10, 0, 0, 2, 0x1a, 0xe2}) {
+                        answer.push_back(std::byte(byte));
+                    }
+                } else if (action == 2) {
+                    size_t count = (size - 16) / 20;
+                    scrapeSizes.push_back(count);
+                    _Append32(answer, 2);
+                    _Append32(answer, transactionId);
+                    for (size_t i = 0; i < count; i++) {
+                        // the first infohash byte tells the torrents apart
+                        uint32_t first = std::to_integer<uint32_t>(packet[16 + 20 * i]);
+                        _Append32(answer, first);
+                        _Append32(answer, first + 1);
+                        _Append32(answer, first + 2);
+                    }
+                }
+            }
+            co_await socket.async_send_to(asio::buffer(answer), sender, asio::use_awaitable);
+        }
+    }
+};
+
+static AnnounceRequest _Request() {
+    AnnounceRequest request;
+    request.infoHash = bt::Sha1Digest::FromHex("a9993e364706816aba3e25717850c26c9cd0d89d").value();
+    request.peerId.fill(std::byte('-'));
+    request.port = 6881;
+    request.event = bt::AnnounceEvent::Completed;
+    return request;
+}
+
+static void _Run(asio::io_context& ioContext, std::function<asio::awaitable<void>()> requests) {
+    std::exception_ptr failure;
+    asio::co_spawn(ioContext, requests(), [&](std::exception_ptr exception) {
+        failure = exception;
+        ioContext.stop();
+    });
+    ioContext.run();
+    ioContext.restart();
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+TEST_CASE("UdpTrackerClient against a local tracker") {
+    asio::io_context ioContext;
+    LocalUdpTracker tracker(ioContext);
+    bt::UdpTrackerOptions options;
+    options.initialTimeout = 20ms;
+    options.maxRetransmits = 3;
+    UdpTrackerClient client(ioContext.get_executor(), options);
+
+    SUBCASE("announces reuse the connection id") {
+        AnnounceResponse response;
+        _Run(ioContext, [&]() -> asio::awaitable<void> {
+            response = co_await client.Announce(tracker.url(), _Request());
+            co_await client.Announce(tracker.url(), _Request());
+        });
+        CHECK(response.interval == 1800s);
+        CHECK(response.leechers == 3);
+        CHECK(response.seeders == 4);
+        REQUIRE(response.peers.size() == 2);
+        CHECK(response.peers[0] ==
+              asio::ip::tcp::endpoint(asio::ip::make_address("10.0.0.1"), 6881));
+        CHECK(response.peers[1] ==
+              asio::ip::tcp::endpoint(asio::ip::make_address("10.0.0.2"), 6882));
+        CHECK(tracker.connectsCount == 1);
+        CHECK(tracker.announcesCount == 2);
+        CHECK(tracker.lastEvent == 1);
+    }
+
+    SUBCASE("concurrent requests wait for one connect") {
+        size_t done = 0;
+        _Run(ioContext, [&]() -> asio::awaitable<void> {
+            for (int i = 0; i < 5; i++) {
+                asio::co_spawn(
+                    ioContext,
+                    [&]() -> asio::awaitable<void> {
+                        co_await client.Announce(tracker.url(), _Request());
+                        done++;
+                    },
+                    asio::detached);
+            }
+            co_await client.Announce(tracker.url(), _Request());
+            asio::steady_timer wait(ioContext, 10ms);
+            while (done < 5) {
+                co_await wait.async_wait(asio::use_awaitable);
+                wait.expires_after(10ms);
+            }
+        });
+        CHECK(tracker.connectsCount == 1);
+        CHECK(tracker.announcesCount == 6);
+    }
+
+    SUBCASE("lost packets are sent again") {
+        tracker.dropCount = 2;
+        AnnounceResponse response;
+        _Run(ioContext, [&]() -> asio::awaitable<void> {
+            response = co_await client.Announce(tracker.url(), _Request());
+        });
+        CHECK(response.peers.size() == 2);
+        CHECK(tracker.connectsCount == 1);
+    }
+
+    SUBCASE("a tracker that never answers times out") {
+        tracker.dropCount = 100;
+        std::error_code error;
+        try {
+            _Run(ioContext, [&]() -> asio::awaitable<void> {
+                co_await client.Announce(tracker.url(), _Request());
+            });
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+        CHECK((error == asio::error::timed_out));
+        // 1 send and 3 retransmits
+        CHECK(tracker.dropCount == 96);
+    }
+
+    SUBCASE("scrapes are batched") {
+        std::vector<bt::InfoHash> infoHashes(100);
+        for (size_t i = 0; i < infoHashes.size(); i++) {
+            infoHashes[i].bytes[0] = std::byte(i);
+        }
+        std::vector<bt::ScrapeInfo> scrape;
+        _Run(ioContext, [&]() -> asio::awaitable<void> {
+            scrape = co_await client.Scrape(tracker.url(), infoHashes);
+        });
+        CHECK(tracker.scrapeSizes == std::vector<size_t>{74, 26});
+        REQUIRE(scrape.size() == 100);
+        CHECK(scrape[0] == bt::ScrapeInfo{0, 1, 2});
+        CHECK(scrape[99] == bt::ScrapeInfo{99, 100, 101});
+        CHECK(tracker.connectsCount == 1);
+    }
+
+    SUBCASE("tracker errors") {
+        tracker.error = "unregistered torrent";
+        CHECK_THROWS_WITH_AS(_Run(ioContext,
+                                  [&]() -> asio::awaitable<void> {
+                                      co_await client.Announce(tracker.url(), _Request());
+                                  }),
+                             "tracker refused the request: unregistered torrent",
+                             bt::TrackerError);
+        CHECK_THROWS_AS(_Run(ioContext,
+                             [&]() -> asio::awaitable<void> {
+                                 co_await client.Announce("udp://127.0.0.1/announce", _Request());
+                             }),
+                        std::invalid_argument);
+    }
+}
@@ -0,0 +1,123 @@
+#include "write_cache.hpp"
+#include "torrent_metadata.hpp"
+#include "doctest.h"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+
+using bt::CachedPiece;
+using bt::WriteCache;
+
+static constexpr long long pieceSize = 4 * 1000;
+
+static std::vector<std::byte> _Block(uint32_t begin, size_t length = 1000) {
+    std::vector<std::byte> block(length);
+    for (size_t i = 0; i < length; i++) {
+        block[i] = std::byte(static_cast<unsigned char>((begin + i) * 13));
+    }
+    return block;
+}
+
+static bt::Sha1Digest _PieceDigest(long long size) {
+    std::vector<std::byte> piece = _Block(0, static_cast<size_t>(size));
+    return bt::torrent_parser::GetSha1Hash(
+        std::string_view(reinterpret_cast<const char*>(piece.data()), piece.size()));
+}
+
+TEST_CASE("WriteCache") {
+    WriteCache cache(8 * 1000);
+
+    SUBCASE("blocks in any order complete a piece with its digest") {
+        std::vector<uint32_t> begins = {0, 1000, 2000, 3000};
+        std::mt19937 random(7);
+        for (int round = 0; round < 10; round++) {
+            std::shuffle(begins.begin(), begins.end(), random);
+            for (size_t i = 0; i < begins.size(); i++) {
+                WriteCache::Insertion insertion =
+                    cache.Insert(0, 3, pieceSize, begins[i], _Block(begins[i]));
+                CHECK(insertion.evicted.empty());
+                REQUIRE(insertion.completed.has_value() == (i + 1 == begins.size()));
+            }
+            CHECK(cache.size() == 0);
+            CHECK(cache.piecesCount() == 0);
+        }
+        WriteCache::Insertion insertion;
+        for (uint32_t begin : {3000, 1000, 0, 2000}) {
+            insertion = cache.Insert(0, 3, pieceSize, begin, _Block(begin));
+        }
+        REQUIRE(insertion.completed);
+        CHECK(insertion.completed->storage == 0);
+        CHECK(insertion.completed->pieceIndex == 3);
+        CHECK(insertion.completed->blocks.size() == 4);
+        CHECK(insertion.completed->digest == _PieceDigest(pieceSize));
+    }
+
+    SUBCASE("short last piece") {
+        cache.Insert(1, 9, 1500, 1000, _Block(1000, 500));
+        WriteCache::Insertion insertion = cache.Insert(1, 9, 1500, 0, _Block(0));
+        REQUIRE(insertion.completed);
+        CHECK(insertion.completed->digest == _PieceDigest(1500));
+    }
+
+    SUBCASE("least recently added to partial pieces are evicted beyond the limit") {
+        for (uint32_t piece = 0; piece < 4; piece++) {
+            CHECK(cache.Insert(0, piece, pieceSize, 0, _Block(0)).evicted.empty());
+            CHECK(cache.Insert(0, piece, pieceSize, 1000, _Block(1000)).evicted.empty());
+        }
+        CHECK(cache.size() == 8 * 1000);
+        // piece 0 is added to again, piece 1 is the least recent
+        WriteCache::Insertion insertion = cache.Insert(0, 0, pieceSize, 2000, _Block(2000));
+        REQUIRE(insertion.evicted.size() == 1);
+        CHECK(insertion.evicted[0].pieceIndex == 1);
+        CHECK(insertion.evicted[0].blocks.size() == 2);
+        CHECK(!insertion.evicted[0].digest);
+        CHECK(cache.size() == 7 * 1000);
+        insertion = cache.Insert(0, 0, pieceSize, 3000, _Block(3000));
+        CHECK(insertion.completed);
+        CHECK(insertion.evicted.empty());
+
+        // a piece gathered again after its eviction only completes with all of its blocks
+        cache.Insert(0, 1, pieceSize, 2000, _Block(2000));
+        CHECK(!cache.Insert(0, 1, pieceSize, 3000, _Block(3000)).completed);
+    }
+
+    SUBCASE("a block overlapping cached ones evicts them") {
+        cache.Insert(0, 0, pieceSize, 0, _Block(0));
+        cache.Insert(0, 0, pieceSize, 1000, _Block(1000));
+        WriteCache::Insertion insertion = cache.Insert(0, 0, pieceSize, 500, _Block(500));
+        REQUIRE(insertion.evicted.size() == 1);
+        CHECK(insertion.evicted[0].blocks.size() == 2);
+        CHECK(cache.size() == 1000);
+
+        insertion = cache.Insert(0, 0, pieceSize, 500, _Block(500));
+        CHECK(insertion.evicted.size() == 1);
+        CHECK(cache.size() == 1000);
+    }
+
+    SUBCASE("take") {
+        cache.Insert(0, 1, pieceSize, 0, _Block(0));
+        cache.Insert(0, 2, pieceSize, 0, _Block(0));
+        cache.Insert(1, 0, pieceSize, 0, _Block(0));
+        CHECK(!cache.Take(0, 3));
+        std::optional<CachedPiece> piece = cache.Take(0, 2);
+        REQUIRE(piece);
+        CHECK(piece->blocks.size() == 1);
+        cache.Insert(0, 0, pieceSize, 0, _Block(0));
+
+        std::vector<CachedPiece> pieces = cache.TakeStorage(0);
+        REQUIRE(pieces.size() == 2);
+        CHECK(pieces[0].pieceIndex == 0);
+        CHECK(pieces[1].pieceIndex == 1);
+        CHECK(cache.piecesCount() == 1);
+        CHECK(cache.TakeAll().size() == 1);
+        CHECK(cache.size() == 0);
+    }
+
+    SUBCASE("blocks outside of the piece") {
+        CHECK_THROWS_AS(cache.Insert(0, 0, pieceSize, 3500, _Block(3500)), std::out_of_range);
+        CHECK_THROWS_AS(cache.Insert(0, 0, pieceSize, 0, {}), std::out_of_range);
+        CHECK(cache.piecesCount() == 0);
+    }
+}